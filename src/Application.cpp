@@ -42,6 +42,9 @@ using namespace Konsole;
 Application::Application() : KUniqueApplication()
 {
     init();
+
+    // clean up after a Konsole which crashed or was killed
+    SessionManager::instance()->removeUnusedHistoryFiles();
 }
 
 void Application::init()
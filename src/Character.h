@@ -23,6 +23,9 @@
 #ifndef CHARACTER_H
 #define CHARACTER_H
 
+// Standard
+#include <string.h>
+
 // Konsole
 #include "CharacterColor.h"
 
@@ -95,9 +98,9 @@ public:
                               bool _real = true)
         : character(_c)
         , rendition(_r)
+        , isRealCharacter(_real)
         , foregroundColor(_f)
-        , backgroundColor(_b)
-        , isRealCharacter(_real) { }
+        , backgroundColor(_b) { }
 
     /** The unicode character value for this character.
      *
@@ -110,12 +113,6 @@ public:
     /** A combination of RENDITION flags which specify options for drawing the character. */
     quint8  rendition;
 
-    /** The foreground color used to draw this character. */
-    CharacterColor  foregroundColor;
-
-    /** The color used to draw this character's background. */
-    CharacterColor  backgroundColor;
-
     /** Indicate whether this character really exists, or exists simply as place holder.
      *
      *  TODO: this boolean filed can be further improved to become a enum filed, which
@@ -127,6 +124,12 @@ public:
      */
     bool isRealCharacter;
 
+    /** The foreground color used to draw this character. */
+    CharacterColor  foregroundColor;
+
+    /** The color used to draw this character's background. */
+    CharacterColor  backgroundColor;
+
     /**
      * Returns true if this character should always be drawn in bold when
      * it is drawn with the specified @p palette, independent of whether
@@ -141,13 +144,13 @@ public:
 
     /**
      * Compares two characters and returns true if they have the same unicode character value,
-     * rendition and colors.
+     * rendition, colors and place holder flag.
      */
     friend bool operator == (const Character& a, const Character& b);
 
     /**
      * Compares two characters and returns true if they have different unicode character values,
-     * renditions or colors.
+     * renditions, colors or place holder flags.
      */
     friend bool operator != (const Character& a, const Character& b);
 
@@ -166,11 +169,27 @@ public:
             return QChar(character).isSpace();
         }
     }
+
+    /**
+     * Returns true if this is the cell which the double width character
+     * before it extends into.
+     */
+    inline bool isWidePlaceholder() const {
+        return character == 0 && !(rendition & RE_EXTENDED_CHAR);
+    }
 };
 
+// Characters are packed into 8 bytes without padding, so that they can be
+// compared as a whole.  This is the innermost loop of updating the display.
+typedef char CharacterSizeCheck[sizeof(Character) == sizeof(quint64) ? 1 : -1];
+
 inline bool operator == (const Character& a, const Character& b)
 {
-    return a.character == b.character && a.equalsFormat(b);
+    quint64 first;
+    quint64 second;
+    memcpy(&first, &a, sizeof(quint64));
+    memcpy(&second, &b, sizeof(quint64));
+    return first == second;
 }
 
 inline bool operator != (const Character& a, const Character& b)
@@ -185,12 +204,27 @@ inline bool Character::equalsFormat(const Character& other) const
            rendition == other.rendition;
 }
 
+/**
+ * Adds the positions in the table of RGB colors of the colors of @p count
+ * characters to @p indexes, see CharacterColor::trueColorIndex().
+ */
+inline void addTrueColorIndexes(const Character* characters, int count, QSet<int>& indexes)
+{
+    for (int i = 0; i < count; i++) {
+        const int foreground = characters[i].foregroundColor.trueColorIndex();
+        if (foreground != -1)
+            indexes << foreground;
+        const int background = characters[i].backgroundColor.trueColorIndex();
+        if (background != -1)
+            indexes << background;
+    }
+}
+
 inline ColorEntry::FontWeight Character::fontWeight(const ColorEntry* base) const
 {
-    if (foregroundColor._colorSpace == COLOR_SPACE_DEFAULT)
-        return base[foregroundColor._u + 0 + (foregroundColor._v ? BASE_COLORS : 0)].fontWeight;
-    else if (foregroundColor._colorSpace == COLOR_SPACE_SYSTEM)
-        return base[foregroundColor._u + 2 + (foregroundColor._v ? BASE_COLORS : 0)].fontWeight;
+    const int index = foregroundColor.paletteIndex();
+    if (index != -1)
+        return base[index].fontWeight;
     else
         return ColorEntry::UseCurrentFormat;
 }
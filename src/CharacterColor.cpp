@@ -0,0 +1,189 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "CharacterColor.h"
+
+// Qt
+#include <QtCore/QAtomicInt>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+
+// KDE
+#include <KDebug>
+#include <KGlobal>
+
+using namespace Konsole;
+
+// the RGB colors used by all terminals.  Positions which are no longer used
+// are reclaimed by Emulation::reclaimTrueColors().  The table is locked as
+// the output of terminals may be processed in different threads.
+struct TrueColorTable {
+    TrueColorTable()
+        : generation(1),
+          keptColors(0),
+          reclaimThreshold(CharacterColor::trueColorIndexLimit() * 3 / 4),
+          reclaimRequested(false),
+          approximated(false)
+    {}
+
+    QMutex mutex;
+    QVector<QRgb> colors;
+    // generation in which each position was last handed out, 0 for free ones
+    QVector<quint32> generations;
+    QVector<int> freeIndexes;
+    QHash<QRgb, quint16> codes;
+
+    quint32 generation;
+    // number of colors which were kept by the last reclamation
+    int keptColors;
+    // number of colors at which the next reclamation is requested
+    int reclaimThreshold;
+    bool reclaimRequested;
+    // whether a color has been approximated since the last reclamation
+    bool approximated;
+    QAtomicInt reclaimCount;
+};
+
+K_GLOBAL_STATIC(TrueColorTable, theTrueColorTable)
+
+CharacterColor CharacterColor::nearestIndexedColor(QRgb rgb)
+{
+    const int levels[3] = { qRed(rgb), qGreen(rgb), qBlue(rgb) };
+    int index = 0;
+
+    for (int i = 0; i < 3; i++) {
+        // the levels of the cube are 0, 95, 135, 175, 215 and 255
+        const int level = (levels[i] < 48) ? 0 : ((levels[i] < 115) ? 1 : (levels[i] - 35) / 40);
+        index = index * 6 + level;
+    }
+
+    return CharacterColor(COLOR_SPACE_256, 16 + index);
+}
+
+quint16 CharacterColor::trueColorCode(QRgb rgb)
+{
+    TrueColorTable* table = theTrueColorTable;
+    QMutexLocker locker(&table->mutex);
+
+    QHash<QRgb, quint16>::const_iterator iter = table->codes.constFind(rgb);
+    if (iter != table->codes.constEnd()) {
+        table->generations[iter.value() - RGB_CODE] = table->generation;
+        return iter.value();
+    }
+
+    int index;
+    if (!table->freeIndexes.isEmpty()) {
+        index = table->freeIndexes.takeLast();
+        table->colors[index] = rgb;
+    } else if (table->colors.size() < trueColorIndexLimit()) {
+        index = table->colors.size();
+        table->colors.append(rgb);
+        table->generations.append(0);
+    } else {
+        // this also requests a reclamation, see trueColorReclaimNeeded()
+        if (!table->approximated) {
+            kWarning() << "The table of RGB colors is full, approximating"
+                       << QColor(rgb).name() << "and further RGB colors until unused ones are reclaimed";
+        }
+        table->approximated = true;
+        return nearestIndexedColor(rgb)._code;
+    }
+
+    table->generations[index] = table->generation;
+    table->codes.insert(rgb, RGB_CODE + index);
+    return RGB_CODE + index;
+}
+
+QRgb CharacterColor::trueColor(int index)
+{
+    TrueColorTable* table = theTrueColorTable;
+    QMutexLocker locker(&table->mutex);
+
+    return table->colors.value(index);
+}
+
+CharacterColor CharacterColor::fromTrueColorIndex(int index)
+{
+    CharacterColor color;
+    if (index >= 0 && index < trueColorIndexLimit())
+        color._code = RGB_CODE + index;
+    return color;
+}
+
+bool CharacterColor::trueColorReclaimNeeded()
+{
+    TrueColorTable* table = theTrueColorTable;
+    QMutexLocker locker(&table->mutex);
+
+    if (table->reclaimRequested)
+        return false;
+
+    // a table which is still full of used colors is only looked at again
+    // once further colors have been added or approximated
+    const int colorCount = table->codes.size();
+    if (!table->approximated && (colorCount < table->reclaimThreshold || colorCount <= table->keptColors))
+        return false;
+
+    table->reclaimRequested = true;
+    return true;
+}
+
+quint32 CharacterColor::beginTrueColorReclaim()
+{
+    TrueColorTable* table = theTrueColorTable;
+    QMutexLocker locker(&table->mutex);
+
+    return ++table->generation;
+}
+
+int CharacterColor::endTrueColorReclaim(quint32 generation, const QSet<int>& usedIndexes)
+{
+    TrueColorTable* table = theTrueColorTable;
+    QMutexLocker locker(&table->mutex);
+
+    int reclaimed = 0;
+    for (int i = 0; i < table->colors.size(); i++) {
+        const quint32 lastUse = table->generations[i];
+        if (lastUse == 0 || lastUse >= generation || usedIndexes.contains(i))
+            continue;
+
+        table->codes.remove(table->colors[i]);
+        table->generations[i] = 0;
+        table->freeIndexes.append(i);
+        reclaimed++;
+    }
+
+    // the next reclamation is requested once half of the remaining
+    // positions have been handed out
+    const int limit = trueColorIndexLimit();
+    table->keptColors = table->codes.size();
+    table->reclaimThreshold = table->keptColors + (limit - table->keptColors) / 2;
+    table->reclaimRequested = false;
+    table->approximated = false;
+
+    if (reclaimed > 0)
+        table->reclaimCount.ref();
+
+    return reclaimed;
+}
+
+int CharacterColor::trueColorReclaimCount()
+{
+    return theTrueColorTable->reclaimCount;
+}
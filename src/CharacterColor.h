@@ -24,8 +24,12 @@
 #define CHARACTERCOLOR_H
 
 // Qt
+#include <QtCore/QSet>
 #include <QtGui/QColor>
 
+// Konsole
+#include "konsole_export.h"
+
 namespace Konsole
 {
 /**
@@ -144,18 +148,26 @@ inline bool operator != (const ColorEntry& a, const ColorEntry& b)
 
 /**
  * Describes the color of a single character in the terminal.
+ *
+ * To keep characters small, a color is stored in 16 bits.  The colors of
+ * the default, system and 256 color spaces are numbered consecutively,
+ * while RGB colors are numbered by their position in a table of the RGB
+ * colors in use.  The position of an RGB color in that table is only valid
+ * in the current process, see trueColorIndex().
+ *
+ * Positions which are no longer used by any screen or history are given to
+ * other colors when the table fills up, see beginTrueColorReclaim().  An
+ * RGB color which does not fit into the table even so is approximated by
+ * the closest color of the 256 color space, with a warning.
  */
-class CharacterColor
+class KONSOLEPRIVATE_EXPORT CharacterColor
 {
     friend class Character;
 
 public:
     /** Constructs a new CharacterColor whose color and color space are undefined. */
     CharacterColor()
-        : _colorSpace(COLOR_SPACE_UNDEFINED),
-          _u(0),
-          _v(0),
-          _w(0)
+        : _code(UNDEFINED_CODE)
     {}
 
     /**
@@ -169,28 +181,20 @@ public:
      * TODO : Add documentation about available color spaces.
      */
     CharacterColor(quint8 colorSpace, int co)
-        : _colorSpace(colorSpace),
-          _u(0),
-          _v(0),
-          _w(0) {
+        : _code(UNDEFINED_CODE) {
         switch (colorSpace) {
         case COLOR_SPACE_DEFAULT:
-            _u = co & 1;
+            _code = DEFAULT_CODE + (co & 1);
             break;
         case COLOR_SPACE_SYSTEM:
-            _u = co & 7;
-            _v = (co >> 3) & 1;
+            _code = SYSTEM_CODE + (co & 15);
             break;
         case COLOR_SPACE_256:
-            _u = co & 255;
+            _code = INDEX_CODE + (co & 255);
             break;
         case COLOR_SPACE_RGB:
-            _u = co >> 16;
-            _v = co >> 8;
-            _w = co;
+            _code = trueColorCode(co & 0xFFFFFF);
             break;
-        default:
-            _colorSpace = COLOR_SPACE_UNDEFINED;
         }
     }
 
@@ -198,9 +202,12 @@ public:
      * Returns true if this character color entry is valid.
      */
     bool isValid() const {
-        return _colorSpace != COLOR_SPACE_UNDEFINED;
+        return _code != UNDEFINED_CODE;
     }
 
+    /** Returns the color space of this color. */
+    quint8 colorSpace() const;
+
     /**
      * Set this color as an intensive system color.
      *
@@ -217,6 +224,56 @@ public:
      */
     QColor color(const ColorEntry* palette) const;
 
+    /**
+     * For colors of the COLOR_SPACE_RGB color space, returns the position of
+     * the color in the table of RGB colors, otherwise returns -1.
+     */
+    int trueColorIndex() const {
+        return _code >= RGB_CODE ? _code - RGB_CODE : -1;
+    }
+
+    /**
+     * Returns the color at position @p index in the table of RGB colors.
+     * Together with trueColorIndex(), this allows storing colors with a
+     * table of RGB colors other than that of the current process.
+     */
+    static CharacterColor fromTrueColorIndex(int index);
+    /** Returns the number of positions which fromTrueColorIndex() accepts. */
+    static int trueColorIndexLimit() {
+        return 0x10000 - RGB_CODE;
+    }
+    /** Returns the color of the 256 color space which is closest to @p rgb. */
+    static CharacterColor nearestIndexedColor(QRgb rgb);
+
+    /**
+     * Returns true once positions in the table of RGB colors should be
+     * reclaimed, because the table is filling up or a color had to be
+     * approximated.  This only returns true once until the next
+     * reclamation, the caller is expected to start one.
+     */
+    static bool trueColorReclaimNeeded();
+    /**
+     * Starts reclaiming the positions in the table of RGB colors.  The
+     * positions which are in use are then collected and passed to
+     * endTrueColorReclaim() together with the returned generation.
+     * Positions which are handed out in between are never reclaimed, so
+     * the screens can be changed while they are collected.
+     */
+    static quint32 beginTrueColorReclaim();
+    /**
+     * Frees the positions in the table of RGB colors which are not in
+     * @p usedIndexes and were not handed out since @p generation was
+     * returned by beginTrueColorReclaim().  Returns the number of positions
+     * which have been freed.
+     */
+    static int endTrueColorReclaim(quint32 generation, const QSet<int>& usedIndexes);
+    /**
+     * Returns the number of reclamations which have freed positions.  Copies
+     * of characters which were made before this changed may refer to other
+     * colors now.
+     */
+    static int trueColorReclaimCount();
+
     /**
      * Compares two colors and returns true if they represent the same color value and
      * use the same color space.
@@ -229,20 +286,31 @@ public:
     friend bool operator != (const CharacterColor& a, const CharacterColor& b);
 
 private:
-    quint8 _colorSpace;
+    // first codes of each color space
+    enum {
+        UNDEFINED_CODE = 0,
+        DEFAULT_CODE = 1,                   // + color + 2 * intense
+        SYSTEM_CODE = DEFAULT_CODE + 4,     // + color + 8 * intense
+        INDEX_CODE = SYSTEM_CODE + 16,      // + index
+        RGB_CODE = INDEX_CODE + 256         // + position in the table
+    };
+
+    // returns the code of the RGB color @p rgb, adding it to the table
+    // of RGB colors if it is not in there yet.  Colors which do not fit
+    // are approximated
+    static quint16 trueColorCode(QRgb rgb);
+    static QRgb trueColor(int index);
 
-    // bytes storing the character color
-    quint8 _u;
-    quint8 _v;
-    quint8 _w;
+    // for colors of the default and system color spaces, returns the
+    // index of the color in a palette, otherwise returns -1
+    int paletteIndex() const;
+
+    quint16 _code;
 };
 
 inline bool operator == (const CharacterColor& a, const CharacterColor& b)
 {
-    return     a._colorSpace == b._colorSpace &&
-               a._u == b._u &&
-               a._v == b._v &&
-               a._w == b._w;
+    return a._code == b._code;
 }
 inline bool operator != (const CharacterColor& a, const CharacterColor& b)
 {
@@ -275,31 +343,52 @@ inline const QColor color256(quint8 u, const ColorEntry* base)
     return QColor(gray, gray, gray);
 }
 
-inline QColor CharacterColor::color(const ColorEntry* base) const
+inline quint8 CharacterColor::colorSpace() const
 {
-    switch (_colorSpace) {
-    case COLOR_SPACE_DEFAULT:
-        return base[_u + 0 + (_v ? BASE_COLORS : 0)].color;
-    case COLOR_SPACE_SYSTEM:
-        return base[_u + 2 + (_v ? BASE_COLORS : 0)].color;
-    case COLOR_SPACE_256:
-        return color256(_u, base);
-    case COLOR_SPACE_RGB:
-        return QColor(_u, _v, _w);
-    case COLOR_SPACE_UNDEFINED:
-        return QColor();
-    }
+    if (_code >= RGB_CODE)
+        return COLOR_SPACE_RGB;
+    else if (_code >= INDEX_CODE)
+        return COLOR_SPACE_256;
+    else if (_code >= SYSTEM_CODE)
+        return COLOR_SPACE_SYSTEM;
+    else if (_code >= DEFAULT_CODE)
+        return COLOR_SPACE_DEFAULT;
+    else
+        return COLOR_SPACE_UNDEFINED;
+}
 
-    Q_ASSERT(false); // invalid color space
+inline int CharacterColor::paletteIndex() const
+{
+    if (_code >= INDEX_CODE || _code == UNDEFINED_CODE)
+        return -1;
+
+    if (_code >= SYSTEM_CODE) {
+        const int color = _code - SYSTEM_CODE;
+        return (color & 7) + 2 + ((color & 8) ? BASE_COLORS : 0);
+    } else {
+        const int color = _code - DEFAULT_CODE;
+        return (color & 1) + ((color & 2) ? BASE_COLORS : 0);
+    }
+}
 
-    return QColor();
+inline QColor CharacterColor::color(const ColorEntry* base) const
+{
+    if (_code >= RGB_CODE)
+        return QColor(trueColor(_code - RGB_CODE));
+    else if (_code >= INDEX_CODE)
+        return color256(_code - INDEX_CODE, base);
+    else if (_code != UNDEFINED_CODE)
+        return base[paletteIndex()].color;
+    else
+        return QColor();
 }
 
 inline void CharacterColor::setIntensive()
 {
-    if (_colorSpace == COLOR_SPACE_SYSTEM || _colorSpace == COLOR_SPACE_DEFAULT) {
-        _v = 1;
-    }
+    if (_code >= SYSTEM_CODE && _code < SYSTEM_CODE + 8)
+        _code += 8;
+    else if (_code >= DEFAULT_CODE && _code < DEFAULT_CODE + 2)
+        _code += 2;
 }
 }
 
@@ -22,39 +22,61 @@
 // Own
 #include "Emulation.h"
 
+// System
+#include <string.h>
+
 // Qt
+#include <QtCore/QThread>
 #include <QtGui/QKeyEvent>
 
+// KDE
+#include <KGlobal>
+
 // Konsole
 #include "KeyboardTranslator.h"
 #include "KeyboardTranslatorManager.h"
 #include "Screen.h"
 #include "ScreenWindow.h"
+#include "UpdateScheduler.h"
 
 using namespace Konsole;
 
+// all emulations, whose screens are looked at when the positions in the
+// table of RGB colors are reclaimed
+typedef QList<Emulation*> EmulationList;
+K_GLOBAL_STATIC(EmulationList, theEmulations)
+
 Emulation::Emulation() :
     _currentScreen(0),
     _codec(0),
     _decoder(0),
     _keyTranslator(0),
+    _tokensProcessed(0),
+    _screenLock(QMutex::Recursive),
     _usesMouse(false),
     _bracketedPasteMode(false),
-    _imageSizeInitialized(false)
+    _updatesThrottled(false),
+    _imageSizeInitialized(false),
+    _bytesReceived(0),
+    _asciiCompatibleCodec(false),
+    _decoderIdle(true)
 {
     // create screens with a default size
     _screen[0] = new Screen(40, 80);
     _screen[1] = new Screen(40, 80);
     _currentScreen = _screen[0];
 
-    QObject::connect(&_bulkTimer1, SIGNAL(timeout()), this, SLOT(showBulk()));
-    QObject::connect(&_bulkTimer2, SIGNAL(timeout()), this, SLOT(showBulk()));
+    // the alternate screen is redrawn by full screen programs when it is
+    // resized, only the lines on the primary screen are reflowed
+    _screen[0]->setReflowLines(true);
 
     // listen for mouse status changes
     connect(this , SIGNAL(programUsesMouseChanged(bool)) ,
             SLOT(usesMouseChanged(bool)));
     connect(this , SIGNAL(programBracketedPasteModeChanged(bool)) ,
             SLOT(bracketedPasteModeChanged(bool)));
+
+    theEmulations->append(this);
 }
 
 bool Emulation::programUsesMouse() const
@@ -77,9 +99,46 @@ void Emulation::bracketedPasteModeChanged(bool bracketedPasteMode)
     _bracketedPasteMode = bracketedPasteMode;
 }
 
+void Emulation::setUpdatesThrottled(bool throttled)
+{
+    if (throttled == _updatesThrottled)
+        return;
+
+    _updatesThrottled = throttled;
+
+    // catch up with the output which was held back
+    if (!throttled)
+        bufferedUpdate();
+}
+
+bool Emulation::updatesThrottled() const
+{
+    return _updatesThrottled;
+}
+
+qint64 Emulation::bytesReceived() const
+{
+    QMutexLocker locker(&_screenLock);
+    return _bytesReceived;
+}
+
+qint64 Emulation::tokensProcessed() const
+{
+    QMutexLocker locker(&_screenLock);
+    return _tokensProcessed;
+}
+
+void Emulation::processOutput(const char* data, int length)
+{
+    receiveData(data, length);
+}
+
 ScreenWindow* Emulation::createWindow()
 {
+    QMutexLocker locker(&_screenLock);
+
     ScreenWindow* window = new ScreenWindow();
+    window->setScreenLock(&_screenLock);
     window->setScreen(_currentScreen);
     _windows << window;
 
@@ -96,17 +155,24 @@ ScreenWindow* Emulation::createWindow()
 
 void Emulation::checkScreenInUse()
 {
+    QMutexLocker locker(&_screenLock);
     emit primaryScreenInUse(_currentScreen == _screen[0]);
 }
 
 void Emulation::checkSelectedText()
 {
+    QMutexLocker locker(&_screenLock);
     QString text = _currentScreen->selectedText(true);
     emit selectionChanged(text);
 }
 
 Emulation::~Emulation()
 {
+    UpdateScheduler::instance()->cancelUpdate(this);
+
+    if (!theEmulations.isDestroyed())
+        theEmulations->removeAll(this);
+
     foreach(ScreenWindow* window, _windows) {
         delete window;
     }
@@ -118,6 +184,8 @@ Emulation::~Emulation()
 
 void Emulation::setScreen(int index)
 {
+    QMutexLocker locker(&_screenLock);
+
     Screen* oldScreen = _currentScreen;
     _currentScreen = _screen[index & 1];
     if (_currentScreen != oldScreen) {
@@ -133,27 +201,105 @@ void Emulation::setScreen(int index)
 
 void Emulation::clearHistory()
 {
+    QMutexLocker locker(&_screenLock);
     _screen[0]->setScroll(_screen[0]->getScroll() , false);
 }
 void Emulation::setHistory(const HistoryType& history)
 {
+    QMutexLocker locker(&_screenLock);
+
     _screen[0]->setScroll(history);
 
+    // large histories are converted in the background
+    if (_screen[0]->isMigratingHistory())
+        QTimer::singleShot(0, this, SLOT(migrateHistory()));
+
     showBulk();
 }
 
+void Emulation::migrateHistory()
+{
+    QMutexLocker locker(&_screenLock);
+
+    if (!_screen[0]->isMigratingHistory())
+        return;
+
+    if (!_screen[0]->migrateHistory(HistoryScrollMigration::MIGRATION_BATCH_LINES))
+        QTimer::singleShot(0, this, SLOT(migrateHistory()));
+}
+
 const HistoryType& Emulation::history() const
 {
+    QMutexLocker locker(&_screenLock);
     return _screen[0]->getScroll();
 }
 
+qint64 Emulation::historyMemoryUsage() const
+{
+    QMutexLocker locker(&_screenLock);
+    return _screen[0]->historyMemoryUsage() + _screen[1]->historyMemoryUsage();
+}
+
+qint64 Emulation::historyUncompressedMemoryUsage() const
+{
+    QMutexLocker locker(&_screenLock);
+    return _screen[0]->historyUncompressedMemoryUsage() + _screen[1]->historyUncompressedMemoryUsage();
+}
+
+qint64 Emulation::historyLinesAdded() const
+{
+    QMutexLocker locker(&_screenLock);
+    return _screen[0]->historyLinesAdded() + _screen[1]->historyLinesAdded();
+}
+
+bool Emulation::saveHistory()
+{
+    QMutexLocker locker(&_screenLock);
+    return _screen[0]->saveHistory();
+}
+
+void Emulation::discardSavedHistory()
+{
+    QMutexLocker locker(&_screenLock);
+    _screen[0]->discardSavedHistory();
+}
+
 void Emulation::setCodec(const QTextCodec * codec)
 {
+    QMutexLocker locker(&_screenLock);
+
     if (codec) {
         _codec = codec;
 
         delete _decoder;
         _decoder = _codec->makeDecoder();
+        _decoderIdle = true;
+
+        // codecs which map every byte in 0x20..0x7E to the same ASCII character
+        // regardless of the surrounding bytes
+        switch (_codec->mibEnum()) {
+        case 3:     // US-ASCII
+        case 4:     // ISO-8859-1 .. ISO-8859-9
+        case 5:
+        case 6:
+        case 7:
+        case 8:
+        case 9:
+        case 10:
+        case 11:
+        case 12:
+        case 106:   // UTF-8
+        case 109:   // ISO-8859-13 .. ISO-8859-15
+        case 110:
+        case 111:
+        case 2084:  // KOI8-R
+        case 2088:  // KOI8-U
+            _asciiCompatibleCodec = true;
+            break;
+        default:
+            _asciiCompatibleCodec = (_codec->mibEnum() >= 2250 && _codec->mibEnum() <= 2258); // windows-125x
+            break;
+        }
 
         emit useUtf8Request(utf8());
     } else {
@@ -197,6 +343,11 @@ void Emulation::receiveChar(int c)
     }
 }
 
+void Emulation::receiveCharacters(const quint16* chars, int count)
+{
+    _currentScreen->displayCharacters(chars, count);
+}
+
 void Emulation::sendKeyEvent(QKeyEvent* ev)
 {
     emit stateSet(NOTIFYNORMAL);
@@ -223,29 +374,128 @@ void Emulation::sendMouseEvent(int /*buttons*/, int /*column*/, int /*row*/, int
    We are doing code conversion from locale to unicode first.
 */
 
+static inline bool isPrintableAscii(char c)
+{
+    return c >= 0x20 && c <= 0x7e;
+}
+
+// Returns the end of the run of printable ASCII characters starting at 'begin'.
+// The bulk of the run is tested eight bytes at a time.
+static const char* printableAsciiRunEnd(const char* begin, const char* end)
+{
+    const quint64 ones = Q_UINT64_C(0x0101010101010101);
+    const char* p = begin;
+
+    while (end - p >= 8) {
+        quint64 word;
+        memcpy(&word, p, sizeof(word));
+        // sets the high bit of every byte which is >= 0x80, < 0x20 or == 0x7F.
+        // As long as no byte is in one of those ranges the subtraction and
+        // addition do not carry from one byte to the next.
+        if ((word | (word - 0x20 * ones) | (word + ones)) & (0x80 * ones))
+            break;
+        p += 8;
+    }
+    while (p < end && isPrintableAscii(*p))
+        p++;
+
+    return p;
+}
+
+/*
+   Runs of printable ASCII are passed straight to receiveCharacters() when the
+   codec maps them to themselves, everything else goes through the decoder and
+   receiveChar() one character at a time.
+*/
 void Emulation::receiveData(const char* text, int length)
 {
+    QMutexLocker locker(&_screenLock);
+
     emit stateSet(NOTIFYACTIVITY);
 
     bufferedUpdate();
 
-    QString unicodeText = _decoder->toUnicode(text, length);
+    _bytesReceived += length;
 
-    //send characters to terminal emulator
-    for (int i = 0; i < unicodeText.length(); i++)
-        receiveChar(unicodeText[i].unicode());
+    const char* const end = text + length;
+    const char* pending = text; // start of the bytes not yet decoded
+    const char* p = text;
 
-    //look for z-modem indicator
-    //-- someone who understands more about z-modems that I do may be able to move
-    //this check into the above for loop?
-    for (int i = 0; i < length; i++) {
-        if (text[i] == '\030') {
-            if ((length - i - 1 > 3) && (qstrncmp(text + i + 1, "B00", 3) == 0))
+    while (p < end) {
+        if (*p == '\030') {
+            //look for z-modem indicator
+            if ((end - p - 1 > 3) && (qstrncmp(p + 1, "B00", 3) == 0))
                 emit zmodemDetected();
+            p++;
+            continue;
+        }
+
+        // a run can only bypass the decoder if the decoder is not in the
+        // middle of a multi-byte sequence when the run starts
+        const bool decoderIdle = (p == text) ? _decoderIdle : (static_cast<uchar>(p[-1]) < 0x80);
+        if (!_asciiCompatibleCodec || !decoderIdle || !isPrintableAscii(*p)) {
+            p++;
+            continue;
         }
+
+        const char* runEnd = printableAsciiRunEnd(p + 1, end);
+
+        receiveDecodedData(pending, p - pending);
+
+        const int runLength = runEnd - p;
+        if (_asciiBuffer.size() < runLength)
+            _asciiBuffer.resize(runLength);
+        quint16* chars = _asciiBuffer.data();
+        for (int i = 0; i < runLength; i++)
+            chars[i] = static_cast<uchar>(p[i]);
+        receiveCharacters(chars, runLength);
+
+        pending = p = runEnd;
+    }
+
+    receiveDecodedData(pending, end - pending);
+
+    if (length > 0)
+        _decoderIdle = static_cast<uchar>(end[-1]) < 0x80;
+
+    // the screens of all emulations are looked at in the emulation's thread
+    if (CharacterColor::trueColorReclaimNeeded())
+        QMetaObject::invokeMethod(this, "reclaimTrueColors", Qt::QueuedConnection);
+}
+
+void Emulation::reclaimTrueColors()
+{
+    // each screen is locked in turn, while the others may be changed.
+    // Positions which are handed out meanwhile are kept, see
+    // CharacterColor::beginTrueColorReclaim()
+    const quint32 generation = CharacterColor::beginTrueColorReclaim();
+
+    QSet<int> usedIndexes;
+    foreach(Emulation* emulation, *theEmulations) {
+        QMutexLocker locker(&emulation->_screenLock);
+        emulation->_screen[0]->addUsedTrueColors(usedIndexes);
+        emulation->_screen[1]->addUsedTrueColors(usedIndexes);
+    }
+
+    // the images of the views may still refer to reclaimed positions
+    if (CharacterColor::endTrueColorReclaim(generation, usedIndexes) > 0) {
+        foreach(Emulation* emulation, *theEmulations)
+            emulation->bufferedUpdate();
     }
 }
 
+void Emulation::receiveDecodedData(const char* text, int length)
+{
+    if (length == 0)
+        return;
+
+    const QString unicodeText = _decoder->toUnicode(text, length);
+
+    //send characters to terminal emulator
+    for (int i = 0; i < unicodeText.length(); i++)
+        receiveChar(unicodeText[i].unicode());
+}
+
 //OLDER VERSION
 //This version of onRcvBlock was commented out because
 //    a)  It decoded incoming characters one-by-one, which is slow in the current version of Qt (4.2 tech preview)
@@ -298,19 +548,22 @@ void Emulation::writeToStream(TerminalCharacterDecoder* decoder ,
                               int startLine ,
                               int endLine)
 {
+    QMutexLocker locker(&_screenLock);
     _currentScreen->writeLinesToStream(decoder, startLine, endLine);
 }
 
 int Emulation::lineCount() const
 {
+    QMutexLocker locker(&_screenLock);
+
     // sum number of lines currently on _screen plus number of lines in history
     return _currentScreen->getLines() + _currentScreen->getHistLines();
 }
 
 void Emulation::showBulk()
 {
-    _bulkTimer1.stop();
-    _bulkTimer2.stop();
+    // the views read the screens while they are updated
+    QMutexLocker locker(&_screenLock);
 
     emit outputChanged();
 
@@ -318,17 +571,24 @@ void Emulation::showBulk()
     _currentScreen->resetDroppedLines();
 }
 
-void Emulation::bufferedUpdate()
+void Emulation::flushUpdate()
 {
-    static const int BULK_TIMEOUT1 = 10;
-    static const int BULK_TIMEOUT2 = 40;
+    UpdateScheduler::instance()->cancelUpdate(this);
+    showBulk();
+}
 
-    _bulkTimer1.setSingleShot(true);
-    _bulkTimer1.start(BULK_TIMEOUT1);
-    if (!_bulkTimer2.isActive()) {
-        _bulkTimer2.setSingleShot(true);
-        _bulkTimer2.start(BULK_TIMEOUT2);
+void Emulation::bufferedUpdate()
+{
+    // the update is scheduled in the emulation's thread when the incoming
+    // data is processed in another one, only one call is queued at a time
+    if (QThread::currentThread() != thread()) {
+        if (_updateQueued.testAndSetOrdered(0, 1))
+            QMetaObject::invokeMethod(this, "bufferedUpdate", Qt::QueuedConnection);
+        return;
     }
+
+    _updateQueued.fetchAndStoreOrdered(0);
+    UpdateScheduler::instance()->scheduleUpdate(this);
 }
 
 char Emulation::eraseChar() const
@@ -341,6 +601,8 @@ void Emulation::setImageSize(int lines, int columns)
     if ((lines < 1) || (columns < 1))
         return;
 
+    QMutexLocker locker(&_screenLock);
+
     QSize screenSize[2] = { QSize(_screen[0]->getColumns(),
                                   _screen[0]->getLines()),
                             QSize(_screen[1]->getColumns(),
@@ -378,6 +640,7 @@ void Emulation::setImageSize(int lines, int columns)
 
 QSize Emulation::imageSize() const
 {
+    QMutexLocker locker(&_screenLock);
     return QSize(_currentScreen->getColumns(), _currentScreen->getLines());
 }
 
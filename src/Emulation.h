@@ -24,12 +24,16 @@
 #define EMULATION_H
 
 // Qt
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
 #include <QtCore/QSize>
 #include <QtCore/QTextCodec>
 #include <QtCore/QTimer>
+#include <QtCore/QVector>
 
 // Konsole
 #include "konsole_export.h"
+#include "PtyReader.h"
 
 class QKeyEvent;
 
@@ -113,11 +117,19 @@ enum {
  * is emitted whenever the activity state is set.  This can be used to determine
  * how long the emulation has been active/idle for and also respond to
  * a 'bell' event in different ways.
+ *
+ * The incoming data may be processed in another thread, by passing the emulation
+ * to Pty::setOutputProcessor().  The screens are locked while the data is processed,
+ * and everything else which uses them, including the screen windows, locks them
+ * as well, see ScreenWindow::screenLock().  Updates, replies to the terminal program
+ * and title changes are passed on to the emulation's own thread.
  */
-class KONSOLEPRIVATE_EXPORT Emulation : public QObject
+class KONSOLEPRIVATE_EXPORT Emulation : public QObject, public PtyOutputProcessor
 {
     Q_OBJECT
 
+    friend class UpdateScheduler;
+
 public:
     /** Constructs a new terminal emulation */
     Emulation();
@@ -151,6 +163,25 @@ public:
     const HistoryType& history() const;
     /** Clears the history scroll. */
     void clearHistory();
+    /** Returns the number of bytes of memory used by the history store. */
+    qint64 historyMemoryUsage() const;
+    /**
+     * Returns the number of bytes of memory the history store would use
+     * if none of it was compressed.
+     */
+    qint64 historyUncompressedMemoryUsage() const;
+    /**
+     * Returns the number of lines which have been added to the history
+     * store, for diagnostics.
+     */
+    qint64 historyLinesAdded() const;
+    /**
+     * Writes out the history so that it can be reopened when the session
+     * is restored.  Returns false if the history type does not support this.
+     */
+    bool saveHistory();
+    /** Undoes saveHistory(), the stored history is removed with the emulation. */
+    void discardSavedHistory();
 
     /**
      * Copies the output history from @p startLine to @p endLine
@@ -217,6 +248,33 @@ public:
 
     bool programBracketedPasteMode() const;
 
+    /**
+     * Sets whether updates of the views onto this emulation are limited to
+     * the UpdateScheduler's background frame rate.  This is used when none
+     * of the views can be seen.
+     */
+    void setUpdatesThrottled(bool throttled);
+    /** See setUpdatesThrottled() */
+    bool updatesThrottled() const;
+    /**
+     * Updates the views onto this emulation immediately, instead of at the
+     * next frame of the UpdateScheduler, and cancels the pending update.
+     * This must be called from the emulation's thread.
+     */
+    void flushUpdate();
+
+    /** Returns the number of bytes passed to receiveData(), for diagnostics. */
+    qint64 bytesReceived() const;
+    /**
+     * Returns the number of control characters and escape sequences which
+     * have been processed, for diagnostics.  Printable characters are not
+     * counted.
+     */
+    qint64 tokensProcessed() const;
+
+    /** Calls receiveData(), see Pty::setOutputProcessor() */
+    virtual void processOutput(const char* data, int length);
+
 public slots:
 
     /** Change the size of the emulation's image */
@@ -252,7 +310,8 @@ public slots:
     /**
      * Processes an incoming stream of characters.  receiveData() decodes the incoming
      * character buffer using the current codec(), and then calls receiveChar() for
-     * each unicode character in the resulting buffer.
+     * each unicode character in the resulting buffer.  Runs of printable ASCII
+     * characters are passed to receiveCharacters() instead where the codec allows it.
      *
      * receiveData() also starts a timer which causes the outputChanged() signal
      * to be emitted when it expires.  The timer allows multiple updates in quick
@@ -424,6 +483,17 @@ protected:
      */
     virtual void receiveChar(int ch);
 
+    /**
+     * Processes a run of printable ASCII characters.  See receiveData()
+     *
+     * This is equivalent to calling receiveChar() for each character in turn,
+     * but allows the emulation to pass the whole run to the screen at once.
+     *
+     * @p chars The characters, all in the range 0x20 to 0x7E.
+     * @p count The number of characters in @p chars
+     */
+    virtual void receiveCharacters(const quint16* chars, int count);
+
     /**
      * Sets the active screen.  The terminal has two screens, primary and alternate.
      * The primary screen is used by default.  When certain interactive programs such
@@ -457,11 +527,20 @@ protected:
     QTextDecoder* _decoder;
     const KeyboardTranslator* _keyTranslator; // the keyboard layout
 
+    // incremented by subclasses for each control character and escape
+    // sequence, see tokensProcessed()
+    qint64 _tokensProcessed;
+
+    // locks the screens and the state of the emulation while the incoming
+    // data is processed, see ScreenWindow::screenLock()
+    mutable QMutex _screenLock;
+
 protected slots:
     /**
      * Schedules an update of attached views.
      * Repeated calls to bufferedUpdate() in close succession will result in only a single update,
-     * much like the Qt buffered update of widgets.
+     * much like the Qt buffered update of widgets.  The updates of all emulations are paced
+     * together by the UpdateScheduler.
      */
     void bufferedUpdate();
 
@@ -472,20 +551,44 @@ protected slots:
     void checkSelectedText();
 
 private slots:
-    // triggered by timer, causes the emulation to send an updated screen image to each
-    // view
+    // called by the UpdateScheduler, causes the emulation to send an updated screen
+    // image to each view
     void showBulk();
 
     void usesMouseChanged(bool usesMouse);
 
     void bracketedPasteModeChanged(bool bracketedPasteMode);
 
+    // copies the next batch of lines into a history store set with
+    // setHistory(), until the conversion is complete
+    void migrateHistory();
+
+    // frees the positions in the table of RGB colors which are not used by
+    // the screens of any emulation, see CharacterColor::trueColorReclaimNeeded()
+    void reclaimTrueColors();
+
 private:
+    // decodes 'text' using _decoder and calls receiveChar() for each character
+    void receiveDecodedData(const char* text, int length);
+
     bool _usesMouse;
     bool _bracketedPasteMode;
-    QTimer _bulkTimer1;
-    QTimer _bulkTimer2;
+    bool _updatesThrottled;
     bool _imageSizeInitialized;
+
+    qint64 _bytesReceived;
+
+    // true if printable ASCII bytes in the incoming stream can be passed
+    // to receiveCharacters() without going through _decoder
+    bool _asciiCompatibleCodec;
+    // true if the last byte given to _decoder left it without a partial
+    // multi-byte sequence
+    bool _decoderIdle;
+    // printable ASCII run being passed to receiveCharacters()
+    QVector<quint16> _asciiBuffer;
+
+    // set while a call of bufferedUpdate() from another thread is queued
+    QAtomicInt _updateQueued;
 };
 }
 
@@ -22,6 +22,10 @@
 // Own
 #include "ExtendedCharTable.h"
 
+// Qt
+#include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+
 // KDE
 #include <KDebug>
 
@@ -34,6 +38,7 @@
 using namespace Konsole;
 
 ExtendedCharTable::ExtendedCharTable()
+    : cleaningUp(false)
 {
 }
 
@@ -52,6 +57,8 @@ ExtendedCharTable ExtendedCharTable::instance;
 
 ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushort length)
 {
+    QMutexLocker locker(&mutex);
+
     // look for this sequence of points in the table
     ushort hash = extendedCharHash(unicodePoints, length);
     const ushort initialHash = hash;
@@ -62,6 +69,8 @@ ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushor
         if (extendedCharMatch(hash, unicodePoints, length)) {
             // this sequence already has an entry in the table,
             // return its hash
+            if (cleaningUp)
+                charsUsedWhileCleaningUp << hash;
             return hash;
         } else {
             // if hash is already used by another, different sequence of unicode character
@@ -69,22 +78,34 @@ ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushor
             hash++;
 
             if (hash == initialHash) {
-                if (!triedCleaningSolution) {
+                // the sessions can only be looked at from the main thread
+                if (!triedCleaningSolution && QThread::currentThread() == QCoreApplication::instance()->thread()) {
                     triedCleaningSolution = true;
                     // All the hashes are full, go to all Screens and try to free any
-                    // This is slow but should happen very rarely
+                    // This is slow but should happen very rarely.  The table is
+                    // unlocked meanwhile, as the screens are locked for the
+                    // threads which may be adding characters to it.  The
+                    // characters which those threads use in the meantime may
+                    // be missed by the walk, so they are kept as well
+                    cleaningUp = true;
+                    charsUsedWhileCleaningUp.clear();
+                    locker.unlock();
                     QSet<ushort> usedExtendedChars;
                     const SessionManager* sm = SessionManager::instance();
                     foreach(const Session * s, sm->sessions()) {
                         foreach(const TerminalDisplay * td, s->views()) {
+                            QMutexLocker screenLocker(td->screenWindow()->screenLock());
                             usedExtendedChars += td->screenWindow()->screen()->usedExtendedChars();
                         }
                     }
+                    locker.relock();
+                    cleaningUp = false;
 
                     QHash<ushort, ushort*>::iterator it = extendedCharTable.begin();
                     QHash<ushort, ushort*>::iterator itEnd = extendedCharTable.end();
                     while (it != itEnd) {
-                        if (usedExtendedChars.contains(it.key())) {
+                        if (usedExtendedChars.contains(it.key()) ||
+                                charsUsedWhileCleaningUp.contains(it.key())) {
                             ++it;
                         } else {
                             it = extendedCharTable.erase(it);
@@ -106,6 +127,8 @@ ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushor
         buffer[i + 1] = unicodePoints[i];
 
     extendedCharTable.insert(hash, buffer);
+    if (cleaningUp)
+        charsUsedWhileCleaningUp << hash;
 
     return hash;
 }
@@ -113,7 +136,10 @@ ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushor
 ushort* ExtendedCharTable::lookupExtendedChar(ushort hash , ushort& length) const
 {
     // look up index in table and if found, set the length
-    // argument and return a pointer to the character sequence
+    // argument and return a pointer to the character sequence.  the
+    // buffers are never freed while the table exists, so the pointer
+    // stays valid after the table is unlocked
+    QMutexLocker locker(&mutex);
 
     ushort* buffer = extendedCharTable[hash];
     if (buffer) {
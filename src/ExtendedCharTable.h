@@ -24,6 +24,8 @@
 
 // Qt
 #include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
 
 namespace Konsole
 {
@@ -32,6 +34,8 @@ namespace Konsole
  * by hash keys.  The hash key itself is the same size as a unicode
  * character ( ushort ) so that it can occupy the same space in
  * a structure.
+ *
+ * The table can be used from any thread, see Emulation::processOutput().
  */
 class ExtendedCharTable
 {
@@ -76,6 +80,12 @@ private:
     // in each value is the length of the buffer, followed by the ushorts in the buffer
     // themselves.
     QHash<ushort, ushort*> extendedCharTable;
+    // locks extendedCharTable
+    mutable QMutex mutex;
+    // set while the screens are walked to find the characters which are in
+    // use, during which the hashes which are returned are collected as well
+    bool cleaningUp;
+    QSet<ushort> charsUsedWhileCleaningUp;
 };
 }
 #endif  // end of EXTENDEDCHARTABLE_H
@@ -24,8 +24,11 @@
 #include <QAction>
 #include <QApplication>
 #include <QtGui/QClipboard>
+#include <QtCore/QBitArray>
+#include <QtCore/QHash>
 #include <QtCore/QString>
 #include <QtCore/QTextStream>
+#include <QtCore/QtAlgorithms>
 
 // KDE
 #include <KLocalizedString>
@@ -50,6 +53,8 @@ FilterChain::~FilterChain()
 
 void FilterChain::addFilter(Filter* filter)
 {
+    // the filter may have been in the chain before, with other text
+    filter->setOutdated(true);
     append(filter);
 }
 void FilterChain::removeFilter(Filter* filter)
@@ -71,8 +76,11 @@ void FilterChain::setBuffer(const QString* buffer , const QList<int>* linePositi
 void FilterChain::process()
 {
     QListIterator<Filter*> iter(*this);
-    while (iter.hasNext())
-        iter.next()->process();
+    while (iter.hasNext()) {
+        Filter* filter = iter.next();
+        filter->process();
+        filter->setOutdated(false);
+    }
 }
 void FilterChain::clear()
 {
@@ -106,6 +114,8 @@ QList<Filter::HotSpot*> FilterChain::hotSpots() const
 TerminalImageFilterChain::TerminalImageFilterChain()
     : _buffer(0)
     , _linePositions(0)
+    , _imageStamp(0)
+    , _columns(0)
 {
 }
 
@@ -115,17 +125,98 @@ TerminalImageFilterChain::~TerminalImageFilterChain()
     delete _linePositions;
 }
 
-void TerminalImageFilterChain::setImage(const Character* const image , int lines , int columns, const QVector<LineProperty>& lineProperties)
+void TerminalImageFilterChain::setImage(const Character* const image , int lines , int columns,
+                                        const QVector<LineProperty>& lineProperties,
+                                        const QVector<quint64>& lineStamps,
+                                        quint64 imageStamp)
 {
     if (empty())
         return;
 
-    // reset all filters and hotspots
-    reset();
+    bool outdated = (columns != _columns || imageStamp != _imageStamp);
+    QListIterator<Filter*> iter(*this);
+    while (iter.hasNext())
+        outdated = iter.next()->isOutdated() || outdated;
+
+    // find the lines of the previous image which are still in this one
+    QHash<quint64, int> oldLineNumbers;
+    if (!outdated) {
+        for (int i = 0 ; i < _lineStamps.count() ; i++) {
+            if (_lineStamps[i] != 0)
+                oldLineNumbers.insert(_lineStamps[i], i);
+        }
+    }
+
+    QVector<QString> lineTexts(lines);
+    QVector<quint64> stamps(lines);
+    QVector<LineProperty> properties(lines);
+    QVector<int> oldLines(lines, -1);
 
+    // only the lines which have changed are decoded again
     PlainTextDecoder decoder;
     decoder.setTrailingWhitespace(false);
 
+    QString text;
+    QTextStream lineStream(&text);
+    decoder.begin(&lineStream);
+
+    for (int i = 0 ; i < lines ; i++) {
+        stamps[i] = lineStamps.value(i, 0);
+        properties[i] = lineProperties.value(i, LINE_DEFAULT);
+
+        const int oldLine = stamps[i] != 0 ? oldLineNumbers.value(stamps[i], -1) : -1;
+        if (oldLine != -1) {
+            lineTexts[i] = _lineTexts[oldLine];
+            oldLines[i] = oldLine;
+        } else {
+            decoder.decodeLine(image + i * columns, columns, LINE_DEFAULT);
+            lineTexts[i] = text;
+            text.clear();
+        }
+    }
+    decoder.end();
+
+    // lines which are wrapped are searched together with the lines which
+    // continue them.  The hotspots of such a block of lines are kept if all
+    // of its lines were in the previous image as the same block
+    QVector<int> newLines(_lineTexts.count(), -1);
+    QBitArray processLines(lines, true);
+
+    int blockStart = 0;
+    for (int i = 0 ; i < lines ; i++) {
+        if ((properties[i] & LINE_WRAPPED) && i < lines - 1)
+            continue;
+
+        const int oldStart = oldLines[blockStart];
+        bool unchanged = (oldStart != -1) &&
+                         (oldStart == 0 || !(_lineProperties[oldStart - 1] & LINE_WRAPPED));
+        for (int line = blockStart ; unchanged && line <= i ; line++) {
+            const int oldLine = oldStart + line - blockStart;
+            unchanged = oldLines[line] == oldLine &&
+                        (_lineProperties[oldLine] & LINE_WRAPPED) == (properties[line] & LINE_WRAPPED);
+        }
+        const int oldEnd = oldStart + i - blockStart;
+        unchanged = unchanged && (oldEnd == _lineTexts.count() - 1 ||
+                                  !(_lineProperties[oldEnd] & LINE_WRAPPED));
+
+        if (unchanged) {
+            for (int line = blockStart ; line <= i ; line++) {
+                newLines[oldLines[line]] = line;
+                processLines.clearBit(line);
+            }
+        }
+
+        blockStart = i + 1;
+    }
+
+    if (outdated) {
+        reset();
+    } else {
+        iter.toFront();
+        while (iter.hasNext())
+            iter.next()->moveHotSpots(newLines);
+    }
+
     // setup new shared buffers for the filters to process on
     QString* newBuffer = new QString();
     QList<int>* newLinePositions = new QList<int>();
@@ -138,32 +229,33 @@ void TerminalImageFilterChain::setImage(const Character* const image , int lines
     _buffer = newBuffer;
     _linePositions = newLinePositions;
 
-    QTextStream lineStream(_buffer);
-    decoder.begin(&lineStream);
-
+    // the buffer only holds the text of the lines which are processed, the
+    // other lines are empty
     for (int i = 0 ; i < lines ; i++) {
         _linePositions->append(_buffer->length());
-        decoder.decodeLine(image + i * columns, columns, LINE_DEFAULT);
+        if (!processLines.testBit(i))
+            continue;
+
+        _buffer->append(lineTexts[i]);
 
-        // pretend that each line ends with a newline character.
-        // this prevents a link that occurs at the end of one line
+        // pretend that each line which is not wrapped ends with a newline
+        // character.  This prevents a link that occurs at the end of one line
         // being treated as part of a link that occurs at the start of the next line
-        //
-        // the downside is that links which are spread over more than one line are not
-        // highlighted.
-        //
-        // TODO - Use the "line wrapped" attribute associated with lines in a
-        // terminal image to avoid adding this imaginary character for wrapped
-        // lines
-        if (!(lineProperties.value(i, LINE_DEFAULT) & LINE_WRAPPED))
-            lineStream << QChar('\n');
+        if (!(properties[i] & LINE_WRAPPED))
+            _buffer->append(QChar('\n'));
     }
-    decoder.end();
+
+    _lineTexts = lineTexts;
+    _lineStamps = stamps;
+    _lineProperties = properties;
+    _imageStamp = imageStamp;
+    _columns = columns;
 }
 
 Filter::Filter() :
     _linePositions(0),
-    _buffer(0)
+    _buffer(0),
+    _outdated(true)
 {
 }
 
@@ -186,25 +278,55 @@ void Filter::setBuffer(const QString* buffer , const QList<int>* linePositions)
     _linePositions = linePositions;
 }
 
+void Filter::moveHotSpots(const QVector<int>& newLines)
+{
+    _hotspots.clear();
+
+    // like reset(), this does not delete the hotspots which are removed
+    QMutableListIterator<HotSpot*> iter(_hotspotList);
+    while (iter.hasNext()) {
+        HotSpot* spot = iter.next();
+        const int newLine = newLines.value(spot->startLine(), -1);
+        if (newLine == -1) {
+            iter.remove();
+            continue;
+        }
+
+        spot->moveLines(newLine - spot->startLine());
+        for (int line = spot->startLine() ; line <= spot->endLine() ; line++)
+            _hotspots.insert(line, spot);
+    }
+}
+
+void Filter::setOutdated(bool outdated)
+{
+    _outdated = outdated;
+}
+
+bool Filter::isOutdated() const
+{
+    return _outdated;
+}
+
 void Filter::getLineColumn(int position , int& startLine , int& startColumn)
 {
     Q_ASSERT(_linePositions);
     Q_ASSERT(_buffer);
 
-    for (int i = 0 ; i < _linePositions->count() ; i++) {
-        int nextLine = 0;
+    // lines which are not in the buffer start at the same position as the
+    // next line, so this finds the last line which starts at or before
+    // 'position'
+    QList<int>::const_iterator next = qUpperBound(_linePositions->constBegin(),
+                                      _linePositions->constEnd(), position);
+    if (next == _linePositions->constBegin())
+        return;
 
-        if (i == _linePositions->count() - 1)
-            nextLine = _buffer->length() + 1;
-        else
-            nextLine = _linePositions->value(i + 1);
+    startLine = (next - _linePositions->constBegin()) - 1;
 
-        if (_linePositions->value(i) <= position && position < nextLine) {
-            startLine = i;
-            startColumn = string_width(buffer()->mid(_linePositions->value(i), position - _linePositions->value(i)));
-            return;
-        }
-    }
+    const int lineStart = _linePositions->at(startLine);
+    startColumn = 0;
+    for (int i = lineStart ; i < position && i < _buffer->length() ; i++)
+        startColumn += konsole_wcwidth(_buffer->at(i).unicode());
 }
 
 /*void Filter::addLine(const QString& text)
@@ -285,6 +407,11 @@ Filter::HotSpot::Type Filter::HotSpot::type() const
 {
     return _type;
 }
+void Filter::HotSpot::moveLines(int lines)
+{
+    _startLine += lines;
+    _endLine += lines;
+}
 void Filter::HotSpot::setType(Type type)
 {
     _type = type;
@@ -315,6 +442,9 @@ QStringList RegExpFilter::HotSpot::capturedTexts() const
 
 void RegExpFilter::setRegExp(const QRegExp& regExp)
 {
+    if (regExp != _searchText)
+        setOutdated(true);
+
     _searchText = regExp;
 }
 QRegExp RegExpFilter::regExp() const
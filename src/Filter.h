@@ -26,6 +26,7 @@
 #include <QtCore/QStringList>
 #include <QtCore/QRegExp>
 #include <QtCore/QMultiHash>
+#include <QtCore/QVector>
 
 // Konsole
 #include "Character.h"
@@ -119,6 +120,11 @@ public:
         void setType(Type type);
 
     private:
+        friend class Filter;
+
+        // moves the hotspot down by 'lines' lines, see Filter::moveHotSpots()
+        void moveLines(int lines);
+
         int    _startLine;
         int    _startColumn;
         int    _endLine;
@@ -152,10 +158,32 @@ public:
     QList<HotSpot*> hotSpotsAtLine(int line) const;
 
     /**
-     * TODO: Document me
+     * Sets the text which process() searches.  @p linePositions holds the
+     * position within @p buffer at which each line starts.  Lines whose text
+     * is not in the buffer, because it has been processed before, start at
+     * the same position as the following line.
      */
     void setBuffer(const QString* buffer , const QList<int>* linePositions);
 
+    /**
+     * Moves the hotspots to the lines which the text they were found in
+     * has moved to.
+     *
+     * @p newLines holds the new line of each line of the text which was
+     * processed last, or -1 if the line is gone.  Hotspots which start on
+     * a line which is gone are removed.
+     */
+    void moveHotSpots(const QVector<int>& newLines);
+
+    /**
+     * Sets whether the hotspots of the filter are out of date, for example
+     * because the filter has been changed since they were found.  The text
+     * which has been processed before then has to be processed again.
+     */
+    void setOutdated(bool outdated);
+    /** See setOutdated() */
+    bool isOutdated() const;
+
 protected:
     /** Adds a new hotspot to the list */
     void addHotSpot(HotSpot*);
@@ -170,6 +198,7 @@ private:
 
     const QList<int>* _linePositions;
     const QString* _buffer;
+    bool _outdated;
 };
 
 /**
@@ -353,13 +382,30 @@ public:
      * @param lines The number of lines in the terminal image
      * @param columns The number of columns in the terminal image
      * @param lineProperties The line properties to set for image
+     * @param lineStamps The stamp of each line in the image, see
+     * Screen::getLineStamps().  The lines which have the same stamp as in the
+     * previous image keep their hotspots, unless a line which they are
+     * wrapped together with has changed.
+     * @param imageStamp The stamp of the image, see Screen::imageStamp().
+     * Line stamps are only compared with those of the previous image if the
+     * image stamp has not changed.
      */
     void setImage(const Character* const image , int lines , int columns,
-                  const QVector<LineProperty>& lineProperties);
+                  const QVector<LineProperty>& lineProperties,
+                  const QVector<quint64>& lineStamps = QVector<quint64>(),
+                  quint64 imageStamp = 0);
 
 private:
     QString* _buffer;
     QList<int>* _linePositions;
+
+    // the decoded text, stamp and properties of each line of the
+    // previous image
+    QVector<QString> _lineTexts;
+    QVector<quint64> _lineStamps;
+    QVector<LineProperty> _lineProperties;
+    quint64 _imageStamp;
+    int _columns;
 };
 }
 #endif //FILTER_H
@@ -0,0 +1,107 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "GlyphAtlas.h"
+
+// Qt
+#include <QtGui/QPainter>
+
+using namespace Konsole;
+
+// we use this to force QPainter to display text in LTR mode, see TerminalDisplay.cpp
+static const QChar LTR_OVERRIDE_CHAR(0x202D);
+
+GlyphAtlas::GlyphAtlas(const QFont& font, int glyphWidth, int glyphHeight)
+    : _glyphWidth(glyphWidth)
+    , _glyphHeight(glyphHeight)
+{
+    for (int style = 0; style <= (Bold | Italic | Underline); style++) {
+        _fonts[style] = font;
+        _fonts[style].setBold(style & Bold);
+        _fonts[style].setItalic(style & Italic);
+        _fonts[style].setUnderline(style & Underline);
+    }
+
+    clear();
+}
+
+QRect GlyphAtlas::glyph(quint16 character, int style, QRgb color)
+{
+    const quint64 key = (quint64(color) << 32) | (quint64(style) << 16) | character;
+
+    QHash<quint64, int>::const_iterator iter = _glyphs.constFind(key);
+    if (iter != _glyphs.constEnd())
+        return glyphRect(iter.value());
+
+    // make room for the new glyph
+    const int index = _glyphs.count();
+    if (index == GLYPHS_PER_ROW * MAXIMUM_ROWS) {
+        clear();
+        return glyph(character, style, color);
+    }
+    if (index == GLYPHS_PER_ROW * (_image.height() / _glyphHeight)) {
+        const QImage oldImage = _image;
+        _image = QImage(oldImage.width(), oldImage.height() * 2, QImage::Format_ARGB32_Premultiplied);
+        _image.fill(0);
+
+        QPainter painter(&_image);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.drawImage(0, 0, oldImage);
+    }
+
+    // render the glyph the same way as TerminalDisplay::drawCharacters()
+    // renders text, aligned to the bottom of its cell
+    const QRect rect = glyphRect(index);
+
+    QPainter painter(&_image);
+    painter.setLayoutDirection(Qt::LeftToRight);
+    painter.setFont(_fonts[style]);
+    painter.setPen(QColor(color));
+    painter.setClipRect(rect);
+    painter.drawText(rect, Qt::AlignBottom, LTR_OVERRIDE_CHAR + QChar(character));
+
+    _glyphs.insert(key, index);
+    return rect;
+}
+
+const QImage& GlyphAtlas::image() const
+{
+    return _image;
+}
+
+QSize GlyphAtlas::glyphSize() const
+{
+    return QSize(_glyphWidth, _glyphHeight);
+}
+
+void GlyphAtlas::clear()
+{
+    _glyphs.clear();
+
+    _image = QImage(GLYPHS_PER_ROW * _glyphWidth, INITIAL_ROWS * _glyphHeight,
+                    QImage::Format_ARGB32_Premultiplied);
+    _image.fill(0);
+}
+
+QRect GlyphAtlas::glyphRect(int index) const
+{
+    return QRect((index % GLYPHS_PER_ROW) * _glyphWidth,
+                 (index / GLYPHS_PER_ROW) * _glyphHeight,
+                 _glyphWidth,
+                 _glyphHeight);
+}
@@ -0,0 +1,95 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtGui/QFont>
+#include <QtGui/QImage>
+
+namespace Konsole
+{
+/**
+ * An image holding the glyphs of a fixed pitch font, each rendered once
+ * in a cell of the same size, so that a line of text can be drawn by
+ * copying the glyphs from the atlas instead of laying out the text.
+ *
+ * Glyphs are rendered in a particular color and style when they are first
+ * requested with glyph().  When the atlas is full it is emptied and
+ * filled again.
+ */
+class GlyphAtlas
+{
+public:
+    /**
+     * The atlas is a grid of GLYPHS_PER_ROW glyphs in each row.  It starts
+     * with INITIAL_ROWS rows and doubles in height when it is full, up to
+     * MAXIMUM_ROWS, after which it is emptied.
+     */
+    static const int GLYPHS_PER_ROW = 64;
+    static const int INITIAL_ROWS = 4;
+    static const int MAXIMUM_ROWS = 64;
+
+    /** Styles in which a glyph can be rendered. */
+    enum StyleFlag {
+        Bold = 1,
+        Italic = 2,
+        Underline = 4
+    };
+
+    /**
+     * Constructs a new, empty atlas.
+     *
+     * @param font The font to render the glyphs with
+     * @param glyphWidth The width of a cell in the atlas
+     * @param glyphHeight The height of a cell in the atlas.  Glyphs are
+     * aligned to the bottom of their cell.
+     */
+    GlyphAtlas(const QFont& font, int glyphWidth, int glyphHeight);
+
+    /**
+     * Returns the area of image() which holds @p character rendered in
+     * @p color and @p style, a combination of StyleFlag values.  The
+     * glyph is rendered if it is not in the atlas yet.
+     */
+    QRect glyph(quint16 character, int style, QRgb color);
+
+    /**
+     * Returns the image holding the glyphs.  The image may be reallocated
+     * by glyph().
+     */
+    const QImage& image() const;
+
+    /** Returns the size of a glyph in the atlas. */
+    QSize glyphSize() const;
+
+private:
+    void clear();
+    QRect glyphRect(int index) const;
+
+    QFont _fonts[(Bold | Italic | Underline) + 1];
+    int _glyphWidth;
+    int _glyphHeight;
+
+    QImage _image;
+    QHash<quint64, int> _glyphs; // maps character, style and color to a glyph index
+};
+}
+
+#endif // GLYPHATLAS_H
@@ -0,0 +1,117 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "GlyphRunCache.h"
+
+// KDE
+#include <KGlobal>
+
+using namespace Konsole;
+
+// Enough for the distinct fragments of a few screens full of a
+// full screen application, in several fonts
+static const int DEFAULT_MAX_COST = 4096;
+
+GlyphRunCache::GlyphRunCache()
+    : _cache(DEFAULT_MAX_COST)
+    , _lastFontIndex(-1)
+    , _hits(0)
+    , _misses(0)
+{
+}
+
+K_GLOBAL_STATIC(GlyphRunCache , theGlyphRunCache)
+
+GlyphRunCache* GlyphRunCache::instance()
+{
+    return theGlyphRunCache;
+}
+
+const QStaticText* GlyphRunCache::staticText(const QString& text, const QFont& font)
+{
+    // the key is the text, preceded by the index of the font
+    QString key;
+    key.reserve(text.length() + 1);
+    key += QChar(fontIndex(font));
+    key += text;
+
+    QStaticText* staticText = _cache.object(key);
+    if (staticText) {
+        _hits++;
+        return staticText;
+    }
+
+    _misses++;
+
+    staticText = new QStaticText(text);
+    staticText->setTextFormat(Qt::PlainText);
+    staticText->prepare(QTransform(), font);
+
+    _cache.insert(key, staticText);
+    return staticText;
+}
+
+int GlyphRunCache::fontIndex(const QFont& font)
+{
+    // a display draws most of its fragments with the same font
+    if (_lastFontIndex != -1 && font == _lastFont)
+        return _lastFontIndex;
+
+    const QString fontKey = font.key();
+    QHash<QString, int>::const_iterator iter = _fontIndexes.constFind(fontKey);
+    if (iter != _fontIndexes.constEnd()) {
+        _lastFontIndex = iter.value();
+    } else {
+        // the index must fit into a QChar, start again if it does not
+        if (_fontIndexes.count() > 0xffff) {
+            _fontIndexes.clear();
+            _cache.clear();
+        }
+
+        _lastFontIndex = _fontIndexes.count();
+        _fontIndexes.insert(fontKey, _lastFontIndex);
+    }
+
+    _lastFont = font;
+    return _lastFontIndex;
+}
+
+void GlyphRunCache::setMaxCost(int maxCost)
+{
+    _cache.setMaxCost(maxCost);
+}
+
+int GlyphRunCache::maxCost() const
+{
+    return _cache.maxCost();
+}
+
+void GlyphRunCache::clear()
+{
+    _cache.clear();
+}
+
+quint64 GlyphRunCache::hits() const
+{
+    return _hits;
+}
+
+quint64 GlyphRunCache::misses() const
+{
+    return _misses;
+}
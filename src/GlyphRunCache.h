@@ -0,0 +1,85 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef GLYPHRUNCACHE_H
+#define GLYPHRUNCACHE_H
+
+// Qt
+#include <QtCore/QCache>
+#include <QtCore/QHash>
+#include <QtGui/QFont>
+#include <QtGui/QStaticText>
+
+namespace Konsole
+{
+/**
+ * A cache of laid out text fragments, which is shared by all terminal
+ * displays.
+ *
+ * Laying out text is the most expensive part of drawing a fragment of the
+ * terminal image.  Full screen applications redraw the same fragments -
+ * menu bars, borders, status lines - over and over again, so the laid out
+ * fragments are kept in a cache of limited size which discards the least
+ * recently used ones first.
+ */
+class GlyphRunCache
+{
+public:
+    /** Constructs a new, empty cache. */
+    GlyphRunCache();
+
+    /**
+     * Returns @p text laid out with @p font.  The text is laid out and added
+     * to the cache if it is not there already.
+     *
+     * The returned object is owned by the cache and may be deleted by the
+     * next call to staticText(), so it must be drawn straight away.
+     */
+    const QStaticText* staticText(const QString& text, const QFont& font);
+
+    /** Sets the maximum number of fragments which are kept in the cache. */
+    void setMaxCost(int maxCost);
+    /** Returns the maximum number of fragments which are kept in the cache. */
+    int maxCost() const;
+
+    /** Removes all fragments from the cache. */
+    void clear();
+
+    /** Returns the number of times a fragment was found in the cache. */
+    quint64 hits() const;
+    /** Returns the number of times a fragment had to be laid out. */
+    quint64 misses() const;
+
+    /** Returns the global GlyphRunCache instance. */
+    static GlyphRunCache* instance();
+
+private:
+    // returns a small number which identifies 'font' in the cache keys
+    int fontIndex(const QFont& font);
+
+    QCache<QString, QStaticText> _cache;
+
+    QHash<QString, int> _fontIndexes; // maps QFont::key() to a font index
+    QFont _lastFont;
+    int _lastFontIndex;
+
+    quint64 _hits;
+    quint64 _misses;
+};
+}
+
+#endif // GLYPHRUNCACHE_H
@@ -0,0 +1,111 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "Histogram.h"
+
+// Standard
+#include <limits.h>
+
+using namespace Konsole;
+
+Histogram::Histogram()
+    : _count(0)
+    , _maximum(0)
+{
+    for (int i = 0; i < RANGE_COUNT; i++)
+        _counts[i] = 0;
+}
+
+int Histogram::rangeIndex(int value)
+{
+    int index = 0;
+    while (value > 0 && index < RANGE_COUNT - 1) {
+        value >>= 1;
+        index++;
+    }
+    return index;
+}
+
+int Histogram::rangeLimit(int index)
+{
+    // the last range holds all of the larger values
+    if (index == RANGE_COUNT - 1)
+        return INT_MAX;
+    else
+        return (1 << index) - 1;
+}
+
+void Histogram::addValue(int value)
+{
+    value = qMax(value, 0);
+
+    _counts[rangeIndex(value)]++;
+    _count++;
+    _maximum = qMax(_maximum, value);
+}
+
+void Histogram::add(const Histogram& other)
+{
+    for (int i = 0; i < RANGE_COUNT; i++)
+        _counts[i] += other._counts[i];
+
+    _count += other._count;
+    _maximum = qMax(_maximum, other._maximum);
+}
+
+int Histogram::count() const
+{
+    return _count;
+}
+
+int Histogram::maximum() const
+{
+    return _maximum;
+}
+
+int Histogram::percentile(int percent) const
+{
+    // the number of values which must be less than or equal to the result
+    const qint64 needed = (qint64(_count) * percent + 99) / 100;
+
+    qint64 counted = 0;
+    for (int i = 0; i < RANGE_COUNT; i++) {
+        counted += _counts[i];
+        if (counted >= needed && counted > 0)
+            return qMin(rangeLimit(i), _maximum);
+    }
+
+    return _maximum;
+}
+
+QString Histogram::toString() const
+{
+    QString text = QString("count %1 p50 %2 p90 %3 p99 %4 max %5 ranges")
+                   .arg(_count)
+                   .arg(percentile(50))
+                   .arg(percentile(90))
+                   .arg(percentile(99))
+                   .arg(_maximum);
+
+    for (int i = 0; i < RANGE_COUNT; i++) {
+        if (_counts[i] > 0)
+            text += QString(" %1:%2").arg(rangeLimit(i)).arg(_counts[i]);
+    }
+
+    return text;
+}
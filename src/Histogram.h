@@ -0,0 +1,80 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+// Qt
+#include <QtCore/QString>
+
+// Konsole
+#include "konsole_export.h"
+
+namespace Konsole
+{
+/**
+ * Counts how often values, such as times in milliseconds, fall into ranges
+ * which double in size: 0, 1, 2-3, 4-7, 8-15 and so on.  This is cheap
+ * enough to record every paint or key press of a terminal display, for
+ * diagnostics.
+ */
+class KONSOLEPRIVATE_EXPORT Histogram
+{
+public:
+    Histogram();
+
+    /** Counts @p value.  Negative values are counted as 0. */
+    void addValue(int value);
+    /** Adds the counts of @p other to this histogram. */
+    void add(const Histogram& other);
+
+    /** Returns the number of values which have been counted. */
+    int count() const;
+    /** Returns the largest value which has been counted. */
+    int maximum() const;
+
+    /**
+     * Returns a value which at least @p percent percent of the counted
+     * values are less than or equal to.  This is the upper limit of the
+     * range into which that share of the values falls.
+     */
+    int percentile(int percent) const;
+
+    /**
+     * Returns a single line description of the histogram with its count,
+     * some percentiles and the number of values in each range, such as
+     * "count 3 p50 1 p90 5 p99 5 max 5 ranges 1:2 7:1".  Each range is
+     * given by its upper limit, and the percentiles are never larger than
+     * the maximum.
+     */
+    QString toString() const;
+
+private:
+    // range i holds the values from 2^(i-1) to 2^i - 1, except for the
+    // last one which holds all larger values as well
+    static const int RANGE_COUNT = 16;
+
+    static int rangeIndex(int value);
+    static int rangeLimit(int index);
+
+    int _counts[RANGE_COUNT];
+    int _count;
+    int _maximum;
+};
+}
+
+#endif // HISTOGRAM_H
@@ -23,20 +23,28 @@
 
 // System
 #include <stdlib.h>
+#include <limits.h>
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/file.h>
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
+#include <stddef.h>
+
+// Qt
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSet>
 
 // KDE
 #include <kde_file.h>
 #include <KDebug>
 #include <KStandardDirs>
 
-// Reasonable line size
-static const int LINE_SIZE = 1024;
-
 using namespace Konsole;
 
 /*
@@ -58,113 +66,278 @@ using namespace Konsole;
 HistoryFile::HistoryFile()
     : _fd(-1),
       _length(0),
-      _fileMap(0),
-      _readWriteBalance(0)
+      _fileLength(0),
+      _file(0),
+      _maxMappedSegments(MAX_MAPPED_SEGMENTS),
+      _useCounter(0),
+      _mapFailed(false)
 {
     const QString tmpFormat = KStandardDirs::locateLocal("tmp", QString())
                               + "konsole-XXXXXX.history";
-    _tmpFile.setFileTemplate(tmpFormat);
-    if (_tmpFile.open()) {
-        _tmpFile.setAutoRemove(true);
-        _fd = _tmpFile.handle();
+    QTemporaryFile* tmpFile = new QTemporaryFile(tmpFormat);
+    if (tmpFile->open()) {
+        tmpFile->setAutoRemove(true);
+        _fd = tmpFile->handle();
+    }
+    _file = tmpFile;
+}
+
+HistoryFile::HistoryFile(const QString& fileName)
+    : _fd(-1),
+      _length(0),
+      _fileLength(0),
+      _file(new QFile(fileName)),
+      _maxMappedSegments(MAX_MAPPED_SEGMENTS),
+      _useCounter(0),
+      _mapFailed(false)
+{
+    // the history may hold passwords which were typed or pasted, so the
+    // file is created readable by its owner only, and files written by
+    // earlier versions are restricted as well
+    const int fd = KDE_open(QFile::encodeName(fileName), O_RDWR | O_CREAT, 0600);
+    if (fd >= 0)
+        ::close(fd);
+
+    if (_file->open(QIODevice::ReadWrite)) {
+        _file->setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+        _fd = _file->handle();
+        _length = _fileLength = _file->size();
+
+        // marks the file as being in use, see isInUse()
+        if (flock(_fd, LOCK_SH | LOCK_NB) < 0)
+            perror("HistoryFile.flock");
+
+        const int segmentCount = (_length + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+        _segments.resize(segmentCount);
+    } else {
+        kWarning() << "Unable to open history file" << fileName << ":" << _file->errorString();
     }
 }
 
 HistoryFile::~HistoryFile()
 {
-    if (_fileMap)
-        unmap();
+    flush();
+    unmapAll();
+    delete _file;
+}
+
+void HistoryFile::unmapAll()
+{
+    while (!_mappedSegments.isEmpty())
+        unmapSegment(_mappedSegments.last());
 }
 
-//TODO:  Mapping the entire file in will cause problems if the history file becomes exceedingly large,
-//(ie. larger than available memory).  HistoryFile::map() should only map in sections of the file at a time,
-//to avoid this.
-void HistoryFile::map()
+const char* HistoryFile::segmentData(int segment)
 {
-    Q_ASSERT(_fileMap == 0);
+    Segment& entry = _segments[segment];
+    entry.lastUse = ++_useCounter;
 
-    _fileMap = (char*)mmap(0 , _length , PROT_READ , MAP_PRIVATE , _fd , 0);
+    if (entry.data)
+        return entry.data;
+
+    if (_mappedSegments.size() >= _maxMappedSegments)
+        evictSegment();
+
+    // The whole window is mapped even if the file does not extend that far
+    // yet.  It is shared so that data appended later with write() becomes
+    // visible through it, which means appends never need to remap.
+    // Pages past the end of the file are never touched since reads are
+    // bounded by _length.
+    void* data = mmap(0 , SEGMENT_SIZE , PROT_READ , MAP_SHARED , _fd , segment * SEGMENT_SIZE);
 
     //if mmap'ing fails, fall back to the read-lseek combination
-    if (_fileMap == MAP_FAILED) {
-        _readWriteBalance = 0;
-        _fileMap = 0;
+    if (data == MAP_FAILED) {
+        _mapFailed = true;
         kWarning() << "mmap'ing history failed.  errno = " << errno;
+        return 0;
     }
+
+    entry.data = static_cast<char*>(data);
+    _mappedSegments.append(segment);
+    return entry.data;
 }
 
-void HistoryFile::unmap()
+void HistoryFile::unmapSegment(int segment)
 {
-    int result = munmap(_fileMap , _length);
+    Segment& entry = _segments[segment];
+    Q_ASSERT(entry.data != 0);
+
+    int result = munmap(entry.data , SEGMENT_SIZE);
     Q_ASSERT(result == 0);
     Q_UNUSED(result);
 
-    _fileMap = 0;
+    entry.data = 0;
+    _mappedSegments.remove(_mappedSegments.indexOf(segment));
 }
 
-bool HistoryFile::isMapped() const
+void HistoryFile::evictSegment()
 {
-    return (_fileMap != 0);
+    Q_ASSERT(!_mappedSegments.isEmpty());
+
+    int oldest = _mappedSegments.first();
+    foreach(int segment, _mappedSegments) {
+        if (_segments[segment].lastUse < _segments[oldest].lastUse)
+            oldest = segment;
+    }
+    unmapSegment(oldest);
 }
 
 void HistoryFile::add(const unsigned char* buffer, int count)
 {
-    if (_fileMap)
-        unmap();
+    if (_fd < 0)
+        return;
 
-    _readWriteBalance++;
+    _writeBuffer.append(reinterpret_cast<const char*>(buffer), count);
+    _length += count;
 
-    int rc = 0;
+    if (_writeBuffer.size() >= WRITE_BUFFER_SIZE)
+        flush();
+}
 
-    rc = KDE_lseek(_fd, _length, SEEK_SET);
-    if (rc < 0) {
-        perror("HistoryFile::add.seek");
-        return;
-    }
-    rc = write(_fd, buffer, count);
-    if (rc < 0) {
-        perror("HistoryFile::add.write");
+void HistoryFile::flush()
+{
+    if (_writeBuffer.isEmpty())
         return;
+
+    int rc = -1;
+    if (KDE_lseek(_fd, _fileLength, SEEK_SET) < 0) {
+        perror("HistoryFile::flush.seek");
+    } else {
+        rc = write(_fd, _writeBuffer.constData(), _writeBuffer.size());
+        if (rc < 0)
+            perror("HistoryFile::flush.write");
     }
-    _length += rc;
+    _writeBuffer.clear();
+
+    // anything which could not be written is lost
+    if (rc > 0)
+        _fileLength += rc;
+    _length = _fileLength;
+
+    const int segmentCount = (_fileLength + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+    if (_segments.size() < segmentCount)
+        _segments.resize(segmentCount);
 }
 
-void HistoryFile::get(unsigned char* buffer, int size, int loc)
+void HistoryFile::get(unsigned char* buffer, int size, qint64 loc)
 {
-    //count number of get() calls vs. number of add() calls.
-    //If there are many more get() calls compared with add()
-    //calls (decided by using MAP_THRESHOLD) then mmap the log
-    //file to improve performance.
-    _readWriteBalance--;
-    if (!_fileMap && _readWriteBalance < MAP_THRESHOLD)
-        map();
-
-    if (_fileMap) {
-        for (int i = 0; i < size; i++)
-            buffer[i] = _fileMap[loc + i];
-    } else {
-        int rc = 0;
+    if (loc < 0 || size < 0 || loc + size > _length) {
+        fprintf(stderr, "getHist(...,%d,%lld): invalid args.\n", size, static_cast<long long>(loc));
+        return;
+    }
 
-        if (loc < 0 || size < 0 || loc + size > _length)
-            fprintf(stderr, "getHist(...,%d,%d): invalid args.\n", size, loc);
-        rc = KDE_lseek(_fd, loc, SEEK_SET);
-        if (rc < 0) {
-            perror("HistoryFile::get.seek");
+    if (loc + size > _fileLength) {
+        flush();
+        if (loc + size > _fileLength)
             return;
+    }
+
+    if (!_mapFailed) {
+        // copy the requested range window by window, a read may
+        // straddle the boundary between two segments
+        while (size > 0) {
+            const int segment = loc / SEGMENT_SIZE;
+            const char* data = segmentData(segment);
+            if (!data)
+                break;
+
+            const int offset = loc % SEGMENT_SIZE;
+            const int count = qMin<qint64>(size, SEGMENT_SIZE - offset);
+            memcpy(buffer, data + offset, count);
+
+            buffer += count;
+            loc += count;
+            size -= count;
         }
-        rc = read(_fd, buffer, size);
-        if (rc < 0) {
-            perror("HistoryFile::get.read");
+        if (size == 0)
             return;
-        }
+    }
+
+    if (KDE_lseek(_fd, loc, SEEK_SET) < 0) {
+        perror("HistoryFile::get.seek");
+        return;
+    }
+    int rc = read(_fd, buffer, size);
+    if (rc < 0) {
+        perror("HistoryFile::get.read");
+        return;
     }
 }
 
-int HistoryFile::len() const
+qint64 HistoryFile::len() const
 {
     return _length;
 }
 
+void HistoryFile::set(const unsigned char* buffer, int count, qint64 loc)
+{
+    Q_ASSERT(loc >= 0 && loc + count <= _length);
+    flush();
+
+    // the mmap'ed windows are shared, so they pick up the new data
+    if (KDE_lseek(_fd, loc, SEEK_SET) < 0) {
+        perror("HistoryFile::set.seek");
+        return;
+    }
+    if (write(_fd, buffer, count) < 0)
+        perror("HistoryFile::set.write");
+}
+
+void HistoryFile::truncate()
+{
+    _writeBuffer.clear();
+    unmapAll();
+    _segments.clear();
+
+    if (ftruncate(_fd, 0) < 0)
+        perror("HistoryFile::truncate");
+    _length = _fileLength = 0;
+}
+
+void HistoryFile::sync()
+{
+    flush();
+    if (fsync(_fd) < 0)
+        perror("HistoryFile::sync");
+}
+
+void HistoryFile::remove()
+{
+    _writeBuffer.clear();
+    unmapAll();
+    _segments.clear();
+
+    _file->remove();
+    _fd = -1;
+    _length = _fileLength = 0;
+}
+
+bool HistoryFile::isInUse(const QString& fileName)
+{
+    const int fd = KDE_open(QFile::encodeName(fileName), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    // every HistoryFile holds a shared lock on its file, which is
+    // released when the file is closed or the process ends
+    const bool inUse = (flock(fd, LOCK_EX | LOCK_NB) < 0 && errno == EWOULDBLOCK);
+    close(fd);
+    return inUse;
+}
+
+void HistoryFile::setMaxMappedSegments(int count)
+{
+    _maxMappedSegments = qMax(count, 1);
+
+    while (_mappedSegments.size() > _maxMappedSegments)
+        evictSegment();
+}
+
+int HistoryFile::mappedSegmentCount() const
+{
+    return _mappedSegments.size();
+}
+
 // History Scroll abstract base class //////////////////////////////////////
 
 HistoryScroll::HistoryScroll(HistoryType* t)
@@ -182,81 +355,395 @@ bool HistoryScroll::hasScroll()
     return true;
 }
 
+void HistoryScroll::addUsedTrueColors(QSet<int>& indexes)
+{
+    QVector<Character> cells;
+    const int lines = getLines();
+    for (int i = 0; i < lines; i++) {
+        const int length = getLineLen(i);
+        cells.resize(length);
+        getCells(i, 0, length, cells.data());
+        addTrueColorIndexes(cells.constData(), length, indexes);
+    }
+}
+
+// returns true if any of the 'count' cells is the second half of a double
+// width character
+static bool hasWidePlaceholders(const Character cells[], int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (cells[i].isWidePlaceholder())
+            return true;
+    }
+    return false;
+}
+
+bool HistoryScroll::hasWideCharacters(int lineno)
+{
+    QVector<Character> cells(getLineLen(lineno));
+    getCells(lineno, 0, cells.count(), cells.data());
+    return hasWidePlaceholders(cells.constData(), cells.count());
+}
+
 // History Scroll File //////////////////////////////////////
 
 /*
-   The history scroll makes a Row(Row(Cell)) from
-   two history buffers. The index buffer contains
-   start of line positions which refer to the cells
-   buffer.
-
-   Note that index[0] addresses the second line
-   (line #1), while the first line (line #0) starts
-   at 0 in cells.
+   The history scroll makes a Row(Row(Cell)) from a single
+   history file.  The cells of each line are appended to the
+   file as they arrive, while the position, length and flags of
+   each line are collected in LineEntry records which are written
+   out in chunks of LINES_PER_CHUNK lines.  See the description
+   of the file layout in History.h.
 */
 
+static const char HISTORY_FILE_MAGIC[8] = { 'K', 'O', 'N', 'S', 'H', 'I', 'S', 'T' };
+static const char HISTORY_CHECKPOINT_MAGIC[8] = { 'K', 'O', 'N', 'S', 'C', 'K', 'P', 'T' };
+
 HistoryScrollFile::HistoryScrollFile(const QString& logFileName)
-    : HistoryScroll(new HistoryTypeFile(logFileName))
+    : HistoryScroll(new HistoryTypeFile(logFileName)),
+      _file(logFileName.isEmpty() ? new HistoryFile() : new HistoryFile(logFileName)),
+      _lineStart(0),
+      _lineHasWideCharacters(false),
+      _persistent(false),
+      _lastCheckpoint(0),
+      _checkpointChunks(0),
+      _checkpointTrueColors(0),
+      _trueColorsApproximated(false)
 {
+    if (!reopen()) {
+        _chunks.clear();
+        _pendingLines.clear();
+        _trueColors.clear();
+        _trueColorIndexes.clear();
+        _lastCheckpoint = 0;
+        _checkpointChunks = 0;
+        _checkpointTrueColors = 0;
+
+        _file->truncate();
+        writeHeader();
+    }
+    _lineStart = _file->len();
 }
 
 HistoryScrollFile::~HistoryScrollFile()
 {
+    if (_persistent)
+        writeCheckpoint(false);
+    else
+        _file->remove();
+
+    delete _file;
+}
+
+void HistoryScrollFile::writeHeader()
+{
+    Header header;
+    memcpy(header.magic, HISTORY_FILE_MAGIC, sizeof(header.magic));
+    header.version = FILE_VERSION;
+    header.cellSize = sizeof(Character);
+    header.checkpoint = 0;
+
+    _file->add((unsigned char*)&header, sizeof(Header));
+}
+
+bool HistoryScrollFile::reopen()
+{
+    if (_file->len() < qint64(sizeof(Header)))
+        return false;
+
+    Header header;
+    _file->get((unsigned char*)&header, sizeof(Header), 0);
+    if (memcmp(header.magic, HISTORY_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != FILE_VERSION ||
+            header.cellSize != sizeof(Character)) {
+        kWarning() << "Incompatible history file, discarding its contents.";
+        return false;
+    }
+
+    // a file which was never checkpointed has no usable lines
+    if (header.checkpoint == 0)
+        return false;
+
+    Checkpoint checkpoint;
+    if (!readCheckpoint(header.checkpoint, checkpoint))
+        return false;
+
+    const int chunkCount = checkpoint.chunkCount;
+    const int pendingCount = checkpoint.lineCount - qint64(chunkCount) * LINES_PER_CHUNK;
+    if (pendingCount < 0 || pendingCount >= LINES_PER_CHUNK ||
+            checkpoint.pendingLinesOffset + pendingCount * qint64(sizeof(LineEntry)) > header.checkpoint)
+        return false;
+
+    _chunks.resize(chunkCount);
+    _trueColors.resize(checkpoint.trueColorCount);
+    _pendingLines.resize(pendingCount);
+    _file->get((unsigned char*)_pendingLines.data(), pendingCount * sizeof(LineEntry), checkpoint.pendingLinesOffset);
+
+    _lastCheckpoint = header.checkpoint;
+    _checkpointChunks = chunkCount;
+    _checkpointTrueColors = _trueColors.size();
+
+    // each checkpoint holds the chunks and colors added since the one before
+    qint64 offset = header.checkpoint;
+    while (offset != 0) {
+        Checkpoint previous;
+        memset(&previous, 0, sizeof(Checkpoint));
+        if (checkpoint.previousCheckpoint != 0 && !readCheckpoint(checkpoint.previousCheckpoint, previous))
+            return false;
+
+        const qint64 newChunks = checkpoint.chunkCount - previous.chunkCount;
+        const qint64 newTrueColors = checkpoint.trueColorCount - previous.trueColorCount;
+        if (newChunks < 0 || newTrueColors < 0 ||
+                checkpoint.chunkCount > chunkCount || checkpoint.trueColorCount > _trueColors.size() ||
+                checkpoint.newChunksOffset + newChunks * qint64(sizeof(qint64)) > offset ||
+                checkpoint.newTrueColorsOffset + newTrueColors * qint64(sizeof(QRgb)) > offset)
+            return false;
+
+        _file->get((unsigned char*)(_chunks.data() + previous.chunkCount),
+                   newChunks * sizeof(qint64), checkpoint.newChunksOffset);
+        _file->get((unsigned char*)(_trueColors.data() + previous.trueColorCount),
+                   newTrueColors * sizeof(QRgb), checkpoint.newTrueColorsOffset);
+
+        offset = checkpoint.previousCheckpoint;
+        checkpoint = previous;
+    }
+
+    for (int i = 0; i < _trueColors.size(); i++)
+        _trueColorIndexes.insert(_trueColors[i], i);
+
+    // reopened histories stay persistent until told otherwise
+    _persistent = true;
+    return true;
+}
+
+bool HistoryScrollFile::readCheckpoint(qint64 offset, Checkpoint& checkpoint)
+{
+    if (offset < qint64(sizeof(Header)) || offset + qint64(sizeof(Checkpoint)) > _file->len())
+        return false;
+
+    _file->get((unsigned char*)&checkpoint, sizeof(Checkpoint), offset);
+
+    // everything a checkpoint refers to was written before it
+    return memcmp(checkpoint.magic, HISTORY_CHECKPOINT_MAGIC, sizeof(checkpoint.magic)) == 0 &&
+           checkpoint.lineCount >= 0 && checkpoint.chunkCount >= 0 && checkpoint.trueColorCount >= 0 &&
+           checkpoint.previousCheckpoint >= 0 && checkpoint.previousCheckpoint < offset &&
+           checkpoint.newChunksOffset >= 0 && checkpoint.newChunksOffset <= offset &&
+           checkpoint.pendingLinesOffset >= 0 && checkpoint.pendingLinesOffset <= offset &&
+           checkpoint.newTrueColorsOffset >= 0 && checkpoint.newTrueColorsOffset <= offset;
+}
+
+bool HistoryScrollFile::checkpoint()
+{
+    if (fileName().isEmpty())
+        return false;
+
+    writeCheckpoint(true);
+    return true;
+}
+
+void HistoryScrollFile::writeCheckpoint(bool sync)
+{
+    // checkpoints must not be written in the middle of a line
+    Q_ASSERT(_lineStart == _file->len());
+
+    Checkpoint checkpoint;
+    memcpy(checkpoint.magic, HISTORY_CHECKPOINT_MAGIC, sizeof(checkpoint.magic));
+    checkpoint.lineCount = getLines();
+    checkpoint.previousCheckpoint = _lastCheckpoint;
+
+    checkpoint.chunkCount = _chunks.size();
+    checkpoint.newChunksOffset = _file->len();
+    _file->add((unsigned char*)(_chunks.constData() + _checkpointChunks),
+               (_chunks.size() - _checkpointChunks) * sizeof(qint64));
+    checkpoint.trueColorCount = _trueColors.size();
+    checkpoint.newTrueColorsOffset = _file->len();
+    _file->add((unsigned char*)(_trueColors.constData() + _checkpointTrueColors),
+               (_trueColors.size() - _checkpointTrueColors) * sizeof(QRgb));
+    checkpoint.pendingLinesOffset = _file->len();
+    _file->add((unsigned char*)_pendingLines.constData(), _pendingLines.size() * sizeof(LineEntry));
+
+    const qint64 checkpointOffset = _file->len();
+    _file->add((unsigned char*)&checkpoint, sizeof(Checkpoint));
+
+    // when the history is saved for good, make sure the checkpoint is on
+    // disk before the header refers to it.  The checkpoints written while
+    // lines are added only need to survive Konsole crashing, which
+    // written data does without being synced.
+    if (sync)
+        _file->sync();
+    _file->set((unsigned char*)&checkpointOffset, sizeof(qint64), offsetof(Header, checkpoint));
+    if (sync)
+        _file->sync();
+
+    _lastCheckpoint = checkpointOffset;
+    _checkpointChunks = _chunks.size();
+    _checkpointTrueColors = _trueColors.size();
+
+    _lineStart = _file->len();
+    _persistent = true;
+}
+
+QString HistoryScrollFile::fileName() const
+{
+    return static_cast<const HistoryTypeFile&>(getType()).fileName();
+}
+
+void HistoryScrollFile::setPersistent(bool persistent)
+{
+    _persistent = persistent && !fileName().isEmpty();
+}
+
+void HistoryScrollFile::flushLines()
+{
+    _chunks.append(_file->len());
+    _file->add((unsigned char*)_pendingLines.constData(), _pendingLines.size() * sizeof(LineEntry));
+    _pendingLines.clear();
+    _lineStart = _file->len();
+
+    if (_persistent && _chunks.size() % CHECKPOINT_INTERVAL == 0)
+        writeCheckpoint(false);
+}
+
+HistoryScrollFile::LineEntry HistoryScrollFile::lineEntry(int lineno)
+{
+    Q_ASSERT(lineno >= 0 && lineno < getLines());
+
+    const int chunk = lineno / LINES_PER_CHUNK;
+    if (chunk < _chunks.size()) {
+        LineEntry entry;
+        const qint64 offset = _chunks[chunk] + (lineno % LINES_PER_CHUNK) * qint64(sizeof(LineEntry));
+        _file->get((unsigned char*)&entry, sizeof(LineEntry), offset);
+        return entry;
+    } else {
+        return _pendingLines[lineno % LINES_PER_CHUNK];
+    }
 }
 
 int HistoryScrollFile::getLines()
 {
-    return _index.len() / sizeof(int);
+    return _chunks.size() * LINES_PER_CHUNK + _pendingLines.size();
 }
 
 int HistoryScrollFile::getLineLen(int lineno)
 {
-    return (startOfLine(lineno + 1) - startOfLine(lineno)) / sizeof(Character);
+    if (lineno < 0 || lineno >= getLines())
+        return 0;
+
+    return lineEntry(lineno).length;
 }
 
 bool HistoryScrollFile::isWrappedLine(int lineno)
 {
-    if (lineno >= 0 && lineno <= getLines()) {
-        unsigned char flag;
-        _lineflags.get((unsigned char*)&flag, sizeof(unsigned char), (lineno)*sizeof(unsigned char));
-        return flag;
-    }
-    return false;
+    if (lineno < 0 || lineno >= getLines())
+        return false;
+
+    return lineEntry(lineno).flags & LINE_WRAPPED;
 }
 
-int HistoryScrollFile::startOfLine(int lineno)
+bool HistoryScrollFile::hasWideCharacters(int lineno)
 {
-    if (lineno <= 0) return 0;
-    if (lineno <= getLines()) {
-        if (!_index.isMapped())
-            _index.map();
+    if (lineno < 0 || lineno >= getLines())
+        return false;
 
-        int res;
-        _index.get((unsigned char*)&res, sizeof(int), (lineno - 1)*sizeof(int));
-        return res;
-    }
-    return _cells.len();
+    return lineEntry(lineno).flags & LINE_WIDE_CHARACTERS;
 }
 
 void HistoryScrollFile::getCells(int lineno, int colno, int count, Character res[])
 {
-    _cells.get((unsigned char*)res, count * sizeof(Character), startOfLine(lineno) + colno * sizeof(Character));
+    const LineEntry entry = lineEntry(lineno);
+    Q_ASSERT(colno >= 0 && colno + count <= int(entry.length));
+
+    _file->get((unsigned char*)res, count * sizeof(Character), entry.offset + colno * qint64(sizeof(Character)));
+
+    if (_trueColors.isEmpty())
+        return;
+
+    for (int i = 0; i < count; i++) {
+        res[i].foregroundColor = fromFileColor(res[i].foregroundColor);
+        res[i].backgroundColor = fromFileColor(res[i].backgroundColor);
+    }
 }
 
 void HistoryScrollFile::addCells(const Character text[], int count)
 {
-    _cells.add((unsigned char*)text, count * sizeof(Character));
+    if (!_lineHasWideCharacters)
+        _lineHasWideCharacters = hasWidePlaceholders(text, count);
+
+    int i = 0;
+    while (i < count && text[i].foregroundColor.trueColorIndex() == -1 &&
+            text[i].backgroundColor.trueColorIndex() == -1)
+        i++;
+
+    if (i == count) {
+        _file->add((unsigned char*)text, count * sizeof(Character));
+        return;
+    }
+
+    _buffer.resize(count);
+    for (i = 0; i < count; i++) {
+        _buffer[i] = text[i];
+        _buffer[i].foregroundColor = toFileColor(text[i].foregroundColor);
+        _buffer[i].backgroundColor = toFileColor(text[i].backgroundColor);
+    }
+    _file->add((unsigned char*)_buffer.constData(), count * sizeof(Character));
 }
 
-void HistoryScrollFile::addLine(bool previousWrapped)
+CharacterColor HistoryScrollFile::toFileColor(const CharacterColor& color)
 {
-    if (_index.isMapped())
-        _index.unmap();
+    if (color.trueColorIndex() == -1)
+        return color;
+
+    const QRgb rgb = color.color(0).rgb();
+    QHash<QRgb, int>::const_iterator iter = _trueColorIndexes.constFind(rgb);
+    if (iter != _trueColorIndexes.constEnd())
+        return CharacterColor::fromTrueColorIndex(iter.value());
+
+    // unlike the table of the process, that of the file can not be
+    // reclaimed, as the lines in the file are never changed
+    const int index = _trueColors.size();
+    if (index >= CharacterColor::trueColorIndexLimit()) {
+        if (!_trueColorsApproximated) {
+            kWarning() << "The history file" << fileName() << "holds too many RGB colors,"
+                       << "further ones are approximated";
+            _trueColorsApproximated = true;
+        }
+        return CharacterColor::nearestIndexedColor(rgb);
+    }
 
-    int locn = _cells.len();
-    _index.add((unsigned char*)&locn, sizeof(int));
-    unsigned char flags = previousWrapped ? 0x01 : 0x00;
-    _lineflags.add((unsigned char*)&flags, sizeof(unsigned char));
+    _trueColors.append(rgb);
+    _trueColorIndexes.insert(rgb, index);
+    return CharacterColor::fromTrueColorIndex(index);
+}
+
+CharacterColor HistoryScrollFile::fromFileColor(const CharacterColor& color)
+{
+    const int index = color.trueColorIndex();
+    if (index == -1)
+        return color;
+
+    return CharacterColor(COLOR_SPACE_RGB, _trueColors.value(index));
+}
+
+void HistoryScrollFile::addUsedTrueColors(QSet<int>& indexes)
+{
+    // the file refers to RGB colors by their positions in its own table
+    Q_UNUSED(indexes);
+}
+
+void HistoryScrollFile::addLine(bool previousWrapped)
+{
+    LineEntry entry;
+    entry.offset = _lineStart;
+    entry.length = (_file->len() - _lineStart) / sizeof(Character);
+    entry.flags = previousWrapped ? LINE_WRAPPED : 0;
+    if (_lineHasWideCharacters)
+        entry.flags |= LINE_WIDE_CHARACTERS;
+    _pendingLines.append(entry);
+    _lineStart = _file->len();
+    _lineHasWideCharacters = false;
+
+    if (_pendingLines.size() == LINES_PER_CHUNK)
+        flushLines();
 }
 
 // History Scroll None //////////////////////////////////////
@@ -302,6 +789,124 @@ void HistoryScrollNone::addLine(bool)
 {
 }
 
+// History Scroll Migration //////////////////////////////////////
+
+HistoryScrollMigration::HistoryScrollMigration(HistoryScroll* source, HistoryScroll* target, HistoryType* type)
+    : HistoryScroll(type),
+      _source(source),
+      _target(target),
+      _newLines(new CompactHistoryScroll(INT_MAX)),
+      _copiedLines(0)
+{
+}
+
+HistoryScrollMigration::~HistoryScrollMigration()
+{
+    delete _source;
+    delete _target;
+    delete _newLines;
+}
+
+int HistoryScrollMigration::getLines()
+{
+    return _source->getLines() + _newLines->getLines();
+}
+
+int HistoryScrollMigration::getLineLen(int lineno)
+{
+    const int sourceLines = _source->getLines();
+    if (lineno < sourceLines)
+        return _source->getLineLen(lineno);
+    else
+        return _newLines->getLineLen(lineno - sourceLines);
+}
+
+void HistoryScrollMigration::getCells(int lineno, int colno, int count, Character res[])
+{
+    const int sourceLines = _source->getLines();
+    if (lineno < sourceLines)
+        _source->getCells(lineno, colno, count, res);
+    else
+        _newLines->getCells(lineno - sourceLines, colno, count, res);
+}
+
+bool HistoryScrollMigration::isWrappedLine(int lineno)
+{
+    const int sourceLines = _source->getLines();
+    if (lineno < sourceLines)
+        return _source->isWrappedLine(lineno);
+    else
+        return _newLines->isWrappedLine(lineno - sourceLines);
+}
+
+bool HistoryScrollMigration::hasWideCharacters(int lineno)
+{
+    const int sourceLines = _source->getLines();
+    if (lineno < sourceLines)
+        return _source->hasWideCharacters(lineno);
+    else
+        return _newLines->hasWideCharacters(lineno - sourceLines);
+}
+
+void HistoryScrollMigration::addCells(const Character a[], int count)
+{
+    _newLines->addCells(a, count);
+}
+
+void HistoryScrollMigration::addLine(bool previousWrapped)
+{
+    _newLines->addLine(previousWrapped);
+}
+
+qint64 HistoryScrollMigration::memoryUsage()
+{
+    return _source->memoryUsage() + _newLines->memoryUsage() + _target->memoryUsage();
+}
+
+void HistoryScrollMigration::addUsedTrueColors(QSet<int>& indexes)
+{
+    _source->addUsedTrueColors(indexes);
+    _newLines->addUsedTrueColors(indexes);
+    if (_target)
+        _target->addUsedTrueColors(indexes);
+}
+
+void HistoryScrollMigration::copyLine(HistoryScroll* scroll, int lineno)
+{
+    const int length = scroll->getLineLen(lineno);
+    if (_buffer.size() < length)
+        _buffer.resize(length);
+
+    scroll->getCells(lineno, 0, length, _buffer.data());
+    _target->addCells(_buffer.constData(), length);
+    _target->addLine(scroll->isWrappedLine(lineno));
+}
+
+bool HistoryScrollMigration::migrate(int lineCount)
+{
+    const int sourceLines = _source->getLines();
+    const int totalLines = getLines();
+    const int end = qMin(totalLines, _copiedLines + lineCount);
+
+    for (; _copiedLines < end; _copiedLines++) {
+        if (_copiedLines < sourceLines)
+            copyLine(_source, _copiedLines);
+        else
+            copyLine(_newLines, _copiedLines - sourceLines);
+    }
+
+    return _copiedLines == totalLines;
+}
+
+HistoryScroll* HistoryScrollMigration::takeTarget()
+{
+    Q_ASSERT(_copiedLines == getLines());
+
+    HistoryScroll* target = _target;
+    _target = 0;
+    return target;
+}
+
 ////////////////////////////////////////////////////////////////
 // Compact History Scroll //////////////////////////////////////
 ////////////////////////////////////////////////////////////////
@@ -324,12 +929,47 @@ void CompactHistoryBlock::deallocate()
     Q_ASSERT(_allocCount >= 0);
 }
 
+void CompactHistoryBlock::freeze()
+{
+    if (!_resident)
+        return;
+
+    // the contents of a block never change once it is full, so
+    // the compressed copy only needs to be made once
+    if (_compressed.isEmpty())
+        _compressed = qCompress(_blockStart, _tail - _blockStart, 1);
+
+    // drop the pages but keep the address range, they read
+    // back as zeros until the block is thawed again
+    madvise(_blockStart, _blockLength, MADV_DONTNEED);
+    _resident = false;
+}
+
+void CompactHistoryBlock::thaw()
+{
+    if (_resident)
+        return;
+
+    const QByteArray data = qUncompress(_compressed);
+    Q_ASSERT(data.size() == _tail - _blockStart);
+    memcpy(_blockStart, data.constData(), data.size());
+    _resident = true;
+}
+
 void* CompactHistoryBlockList::allocate(size_t size)
 {
+    // keep every allocation suitably aligned for the next one
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
     CompactHistoryBlock* block;
     if (list.isEmpty() || list.last()->remaining() < size) {
         block = new CompactHistoryBlock();
         list.append(block);
+
+        // the block which just left the set of recent blocks
+        // is full and can now be compressed
+        if (list.size() > HOT_BLOCK_COUNT)
+            list.at(list.size() - 1 - HOT_BLOCK_COUNT)->freeze();
         //kDebug() << "new block created, remaining " << block->remaining() << "number of blocks=" << list.size();
     } else {
         block = list.last();
@@ -342,19 +982,17 @@ void CompactHistoryBlockList::deallocate(void* ptr)
 {
     Q_ASSERT(!list.isEmpty());
 
-    int i = 0;
-    CompactHistoryBlock* block = list.at(i);
-    while (i < list.size() && !block->contains(ptr)) {
-        i++;
-        block = list.at(i);
-    }
-
-    Q_ASSERT(i < list.size());
+    // allocations are released in FIFO order, so the memory
+    // being released always belongs to the oldest block
+    CompactHistoryBlock* block = list.first();
+    Q_ASSERT(block->contains(ptr));
+    Q_UNUSED(ptr);
 
     block->deallocate();
 
     if (!block->isInUse()) {
-        list.removeAt(i);
+        list.removeFirst();
+        _thawedBlocks.removeOne(block);
         delete block;
         //kDebug() << "block deleted, new size = " << list.size();
     }
@@ -366,62 +1004,118 @@ CompactHistoryBlockList::~CompactHistoryBlockList()
     list.clear();
 }
 
-void* CompactHistoryLine::operator new(size_t size, CompactHistoryBlockList& blockList)
+void CompactHistoryBlockList::touch(CompactHistoryBlock* block)
 {
-    return blockList.allocate(size);
+    if (!_thawedBlocks.isEmpty() && _thawedBlocks.first() == block)
+        return;
+
+    if (block->isResident()) {
+        _thawedBlocks.removeOne(block);
+    } else {
+        block->thaw();
+        if (_thawedBlocks.size() == THAWED_BLOCK_CACHE_SIZE)
+            _thawedBlocks.takeLast()->freeze();
+    }
+    _thawedBlocks.prepend(block);
 }
 
-CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlockList& bList)
-    : _blockListRef(bList),
-      _formatLength(0)
+void CompactHistoryBlockList::addUsedTrueColors(QSet<int>& indexes) const
 {
-    _length = line.size();
+    foreach(CompactHistoryBlock* block, list) {
+        indexes.unite(block->trueColorIndexes());
+    }
+}
 
-    if (line.size() > 0) {
-        _formatLength = 1;
-        int k = 1;
+qint64 CompactHistoryBlockList::memoryUsage() const
+{
+    qint64 usage = 0;
+    foreach(CompactHistoryBlock* block, list) {
+        if (block->isResident())
+            usage += block->length();
+        usage += block->compressedSize();
+    }
+    return usage;
+}
 
-        // count number of different formats in this text line
-        Character c = line[0];
-        while (k < _length) {
-            if (!(line[k].equalsFormat(c))) {
-                _formatLength++; // format change detected
-                c = line[k];
-            }
-            k++;
+qint64 CompactHistoryBlockList::uncompressedMemoryUsage() const
+{
+    qint64 usage = 0;
+    foreach(CompactHistoryBlock* block, list) {
+        usage += block->length();
+    }
+    return usage;
+}
+
+int CompactHistoryLine::formatCount(const TextLine& line)
+{
+    if (line.isEmpty())
+        return 0;
+
+    // count number of different formats in this text line
+    int count = 1;
+    const Character* c = &line[0];
+    for (int k = 1; k < line.size(); k++) {
+        if (!(line[k].equalsFormat(*c))) {
+            count++; // format change detected
+            c = &line[k];
         }
+    }
+    return count;
+}
 
-        //kDebug() << "number of different formats in string: " << _formatLength;
-        _formatArray = (CharacterFormat*) _blockListRef.allocate(sizeof(CharacterFormat) * _formatLength);
-        Q_ASSERT(_formatArray != 0);
-        _text = (quint16*) _blockListRef.allocate(sizeof(quint16) * line.size());
-        Q_ASSERT(_text != 0);
+void* CompactHistoryLine::operator new(size_t size, CompactHistoryBlockList& blockList, const TextLine& line)
+{
+    return blockList.allocate(size
+                              + sizeof(quint16) * line.size()
+                              + sizeof(CharacterFormat) * formatCount(line));
+}
 
-        _length = line.size();
-        _wrapped = false;
+CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlockList& bList)
+    : _blockListRef(bList),
+      _formatArray(0),
+      _length(line.size()),
+      _text(0),
+      _formatLength(0),
+      _wrapped(false)
+{
+    if (_length > 0) {
+        // the text and format arrays live directly after the line itself,
+        // in the memory reserved by operator new
+        _text = reinterpret_cast<quint16*>(this + 1);
+        _formatArray = reinterpret_cast<CharacterFormat*>(_text + _length);
 
         // record formats and their positions in the format array
-        c = line[0];
+        Character c = line[0];
         _formatArray[0].setFormat(c);
         _formatArray[0].startPos = 0;                      // there's always at least 1 format (for the entire line, unless a change happens)
+        _formatLength = 1;
 
-        k = 1;                                            // look for possible format changes
-        int j = 1;
-        while (k < _length && j < _formatLength) {
+        for (int k = 1; k < _length; k++) {               // look for possible format changes
             if (!(line[k].equalsFormat(c))) {
                 c = line[k];
-                _formatArray[j].setFormat(c);
-                _formatArray[j].startPos = k;
-                //kDebug() << "format entry " << j << " at pos " << _formatArray[j].startPos << " " << &(_formatArray[j].startPos) ;
-                j++;
+                _formatArray[_formatLength].setFormat(c);
+                _formatArray[_formatLength].startPos = k;
+                _formatLength++;
             }
-            k++;
         }
 
         // copy character values
-        for (int i = 0; i < line.size(); i++) {
+        for (int i = 0; i < _length; i++) {
             _text[i] = line[i].character;
-            //kDebug() << "char " << i << " at mem " << &(text[i]);
+        }
+
+        // record the RGB colors in the block holding the line, so that
+        // CompactHistoryScroll::addUsedTrueColors() does not need to
+        // thaw it once it has been frozen
+        CompactHistoryBlock* block = _blockListRef.lastBlock();
+        Q_ASSERT(block->contains(this));
+        for (int k = 0; k < _formatLength; k++) {
+            const int foreground = _formatArray[k].fgColor.trueColorIndex();
+            if (foreground != -1)
+                block->addTrueColorIndex(foreground);
+            const int background = _formatArray[k].bgColor.trueColorIndex();
+            if (background != -1)
+                block->addTrueColorIndex(background);
         }
     }
     //kDebug() << "line created, length " << length << " at " << &(length);
@@ -429,25 +1123,34 @@ CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlock
 
 CompactHistoryLine::~CompactHistoryLine()
 {
-    if (_length > 0) {
-        _blockListRef.deallocate(_text);
-        _blockListRef.deallocate(_formatArray);
+    // the line's memory is released by CompactHistoryScroll::removeFirstLine()
+}
+
+int CompactHistoryLine::formatIndex(int column) const
+{
+    // binary search for the last format run starting at or before column
+    int first = 0;
+    int last = _formatLength - 1;
+    while (first < last) {
+        const int middle = (first + last + 1) / 2;
+        if (_formatArray[middle].startPos <= column)
+            first = middle;
+        else
+            last = middle - 1;
     }
-    _blockListRef.deallocate(this);
+    return first;
 }
 
 void CompactHistoryLine::getCharacter(int index, Character& r)
 {
     Q_ASSERT(index < _length);
-    int formatPos = 0;
-    while ((formatPos + 1) < _formatLength && index >= _formatArray[formatPos + 1].startPos)
-        formatPos++;
+    const CharacterFormat& format = _formatArray[formatIndex(index)];
 
     r.character = _text[index];
-    r.rendition = _formatArray[formatPos].rendition;
-    r.foregroundColor = _formatArray[formatPos].fgColor;
-    r.backgroundColor = _formatArray[formatPos].bgColor;
-    r.isRealCharacter = _formatArray[formatPos].isRealCharacter;
+    r.rendition = format.rendition;
+    r.foregroundColor = format.fgColor;
+    r.backgroundColor = format.bgColor;
+    r.isRealCharacter = format.isRealCharacter;
 }
 
 void CompactHistoryLine::getCharacters(Character* array, int size, int startColumn)
@@ -455,15 +1158,40 @@ void CompactHistoryLine::getCharacters(Character* array, int size, int startColu
     Q_ASSERT(startColumn >= 0 && size >= 0);
     Q_ASSERT(startColumn + size <= static_cast<int>(getLength()));
 
-    for (int i = startColumn; i < size + startColumn; i++) {
-        getCharacter(i, array[i - startColumn]);
+    if (size == 0)
+        return;
+
+    // Expand the line run by run instead of looking up the format of each
+    // character.  Within a run every cell shares the same attributes, so
+    // the inner loop is a plain copy which the compiler can vectorize.
+    const int endColumn = startColumn + size;
+    int formatPos = formatIndex(startColumn);
+    int column = startColumn;
+    while (column < endColumn) {
+        const CharacterFormat& format = _formatArray[formatPos];
+        formatPos++;
+        const int runEnd = (formatPos < _formatLength) ? qMin<int>(_formatArray[formatPos].startPos, endColumn)
+                                                       : endColumn;
+
+        const Character cell(0, format.fgColor, format.bgColor, format.rendition, format.isRealCharacter);
+        Character* dest = array + (column - startColumn);
+        const quint16* text = _text + column;
+        const int count = runEnd - column;
+        for (int i = 0; i < count; i++) {
+            dest[i] = cell;
+            dest[i].character = text[i];
+        }
+        column = runEnd;
     }
 }
 
 CompactHistoryScroll::CompactHistoryScroll(unsigned int maxLineCount)
     : HistoryScroll(new CompactHistoryType(maxLineCount))
     , _lines()
+    , _head(0)
+    , _lineCount(0)
     , _blockList()
+    , _maxLineCount(0)
 {
     //kDebug() << "scroll of length " << maxLineCount << " created";
     setMaxNbLines(maxLineCount);
@@ -471,19 +1199,56 @@ CompactHistoryScroll::CompactHistoryScroll(unsigned int maxLineCount)
 
 CompactHistoryScroll::~CompactHistoryScroll()
 {
-    qDeleteAll(_lines.begin(), _lines.end());
-    _lines.clear();
+    // lines must be released oldest first, see CompactHistoryBlockList
+    while (_lineCount > 0)
+        removeFirstLine();
+}
+
+void CompactHistoryScroll::removeFirstLine()
+{
+    Q_ASSERT(_lineCount > 0);
+
+    // Lines are plain data allocated from the block list, so releasing
+    // their memory is all that is needed to get rid of them.  This avoids
+    // touching, and thus decompressing, the line if its block is frozen.
+    LineEntry& entry = _lines[_head];
+    _blockList.deallocate(entry.line);
+    entry.line = 0;
+    entry.block = 0;
+
+    _head++;
+    if (_head == _lines.size())
+        _head = 0;
+    _lineCount--;
 }
 
 void CompactHistoryScroll::addCellsVector(const TextLine& cells)
 {
-    CompactHistoryLine* line;
-    line = new(_blockList) CompactHistoryLine(cells, _blockList);
+    if (_maxLineCount == 0)
+        return;
 
-    if (_lines.size() > static_cast<int>(_maxLineCount)) {
-        delete _lines.takeAt(0);
+    if (_lineCount == static_cast<int>(_maxLineCount))
+        removeFirstLine();
+
+    LineEntry entry;
+    entry.line = new(_blockList, cells) CompactHistoryLine(cells, _blockList);
+    entry.block = _blockList.lastBlock();
+    entry.length = entry.line->getLength();
+    entry.wrapped = false;
+    entry.wideCharacters = hasWidePlaceholders(cells.constData(), entry.length);
+
+    if (_lineCount < _lines.size()) {
+        // reuse the slot freed by the oldest line
+        int index = _head + _lineCount;
+        if (index >= _lines.size())
+            index -= _lines.size();
+        _lines[index] = entry;
+    } else {
+        // still growing towards _maxLineCount
+        Q_ASSERT(_head == 0);
+        _lines.append(entry);
     }
-    _lines.append(line);
+    _lineCount++;
 }
 
 void CompactHistoryScroll::addCells(const Character a[], int count)
@@ -495,33 +1260,35 @@ void CompactHistoryScroll::addCells(const Character a[], int count)
 
 void CompactHistoryScroll::addLine(bool previousWrapped)
 {
-    CompactHistoryLine* line = _lines.last();
-    //kDebug() << "last line at address " << line;
-    line->setWrapped(previousWrapped);
+    if (_lineCount == 0)
+        return;
+
+    // the last line is in one of the blocks which are never frozen
+    LineEntry& entry = entryAt(_lineCount - 1);
+    entry.line->setWrapped(previousWrapped);
+    entry.wrapped = previousWrapped;
 }
 
 int CompactHistoryScroll::getLines()
 {
-    return _lines.size();
+    return _lineCount;
 }
 
 int CompactHistoryScroll::getLineLen(int lineNumber)
 {
-    if ((lineNumber < 0) || (lineNumber >= _lines.size())) {
-        kDebug() << "requested line invalid: 0 < " << lineNumber << " < " <<_lines.size();
-        //Q_ASSERT(lineNumber >= 0 && lineNumber < _lines.size());
+    if ((lineNumber < 0) || (lineNumber >= _lineCount)) {
+        kDebug() << "requested line invalid: 0 < " << lineNumber << " < " << _lineCount;
+        //Q_ASSERT(lineNumber >= 0 && lineNumber < _lineCount);
         return 0;
     }
-    CompactHistoryLine* line = _lines[lineNumber];
-    //kDebug() << "request for line at address " << line;
-    return line->getLength();
+    return entryAt(lineNumber).length;
 }
 
 void CompactHistoryScroll::getCells(int lineNumber, int startColumn, int count, Character buffer[])
 {
     if (count == 0) return;
-    Q_ASSERT(lineNumber < _lines.size());
-    CompactHistoryLine* line = _lines[lineNumber];
+    Q_ASSERT(lineNumber < _lineCount);
+    CompactHistoryLine* line = lineAt(lineNumber);
     Q_ASSERT(startColumn >= 0);
     Q_ASSERT((unsigned int)startColumn <= line->getLength() - count);
     line->getCharacters(buffer, count, startColumn);
@@ -531,16 +1298,665 @@ void CompactHistoryScroll::setMaxNbLines(unsigned int lineCount)
 {
     _maxLineCount = lineCount;
 
-    while (_lines.size() > static_cast<int>(lineCount)) {
-        delete _lines.takeAt(0);
+    while (_lineCount > static_cast<int>(lineCount)) {
+        removeFirstLine();
+    }
+
+    // unroll the circular buffer so that it can grow up to the new limit
+    HistoryArray lines;
+    lines.reserve(_lineCount);
+    for (int i = 0; i < _lineCount; i++) {
+        int index = _head + i;
+        if (index >= _lines.size())
+            index -= _lines.size();
+        lines.append(_lines[index]);
     }
+    _lines = lines;
+    _head = 0;
     //kDebug() << "set max lines to: " << _maxLineCount;
 }
 
 bool CompactHistoryScroll::isWrappedLine(int lineNumber)
 {
-    Q_ASSERT(lineNumber < _lines.size());
-    return _lines[lineNumber]->isWrapped();
+    Q_ASSERT(lineNumber < _lineCount);
+    return entryAt(lineNumber).wrapped;
+}
+
+bool CompactHistoryScroll::hasWideCharacters(int lineNumber)
+{
+    Q_ASSERT(lineNumber < _lineCount);
+    return entryAt(lineNumber).wideCharacters;
+}
+
+qint64 CompactHistoryScroll::memoryUsage()
+{
+    return _blockList.memoryUsage() + _lines.size() * sizeof(LineEntry);
+}
+
+qint64 CompactHistoryScroll::uncompressedMemoryUsage()
+{
+    return _blockList.uncompressedMemoryUsage() + _lines.size() * sizeof(LineEntry);
+}
+
+void CompactHistoryScroll::addUsedTrueColors(QSet<int>& indexes)
+{
+    // the blocks record the colors of their lines, reading the lines
+    // would thaw every frozen block
+    _blockList.addUsedTrueColors(indexes);
+}
+
+////////////////////////////////////////////////////////////////
+// History Wrap Index //////////////////////////////////////////
+////////////////////////////////////////////////////////////////
+
+// number of widths, besides the current one, for which the wrapped
+// lines are counted
+static const int CACHED_WIDTH_COUNT = 4;
+
+// the entries of dropped lines are discarded in batches of at least this size
+static const int COMPACT_THRESHOLD = 1024;
+
+// number of logical lines with double width characters whose wrapped lines
+// are cached
+static const int WIDE_LINE_CACHE_SIZE = 1024;
+
+HistoryWrapIndex::HistoryWrapIndex()
+    : _scroll(0)
+    , _width(1)
+    , _lineBase(0)
+    , _firstLine(0)
+    , _lineCount(0)
+    , _firstLogicalLine(0)
+    , _droppedLength(0)
+    , _droppedWrappedLines(0)
+    , _lastLineWrapped(false)
+{
+    _wrappedLineCounts << 0;
+}
+
+void HistoryWrapIndex::setScroll(HistoryScroll* scroll)
+{
+    _scroll = scroll;
+}
+
+void HistoryWrapIndex::reset()
+{
+    _lineOffsets.clear();
+    _lineBase = 0;
+    _firstLine = 0;
+    _lineCount = 0;
+
+    _logicalLineStarts.clear();
+    _logicalLineLengths.clear();
+    _logicalLineWide.clear();
+    _firstLogicalLine = 0;
+    _droppedLength = 0;
+    _droppedWrappedLines = 0;
+    _lastLineWrapped = false;
+    _wideLineStarts.clear();
+
+    _wrappedLineCounts.clear();
+    _wrappedLineCounts << 0;
+    _otherWidths.clear();
+
+    if (!_scroll)
+        return;
+
+    // the scrolls keep the lengths and flags of their lines apart from the
+    // characters, so this does not read the lines themselves
+    const int lineCount = _scroll->getLines();
+    _lineOffsets.reserve(lineCount);
+    for (int line = 0; line < lineCount; line++) {
+        appendLine(_scroll->getLineLen(line), _scroll->isWrappedLine(line),
+                   _scroll->hasWideCharacters(line));
+    }
+}
+
+void HistoryWrapIndex::setWidth(int width)
+{
+    width = qMax(width, 1);
+    if (width == _width)
+        return;
+
+    // keep the counts for the current width, and pick up those for the
+    // new width if it has been used recently
+    QVector<qint64> wrappedLineCounts;
+    for (int i = 0; i < _otherWidths.count(); i++) {
+        if (_otherWidths[i].first == width) {
+            wrappedLineCounts = _otherWidths.takeAt(i).second;
+            break;
+        }
+    }
+
+    _otherWidths.prepend(qMakePair(_width, _wrappedLineCounts));
+    while (_otherWidths.count() > CACHED_WIDTH_COUNT)
+        _otherWidths.removeLast();
+
+    if (wrappedLineCounts.isEmpty())
+        wrappedLineCounts << 0;
+
+    _width = width;
+    _wrappedLineCounts = wrappedLineCounts;
+    _wideLineStarts.clear();
+
+    // the lines dropped from the oldest logical line at the new width
+    const int first = _firstLogicalLine;
+    if (_droppedLength == 0 || first >= _logicalLineLengths.count()) {
+        _droppedWrappedLines = 0;
+    } else if (!_logicalLineWide[first]) {
+        _droppedWrappedLines = _droppedLength / _width;
+    } else if (_wrappedLineCounts.count() > first + 1) {
+        // the count of the line was kept from before some of it was dropped
+        _droppedWrappedLines = (_wrappedLineCounts[first + 1] - _wrappedLineCounts[first]) -
+                               wideLineStarts(first).count();
+    } else {
+        // the dropped characters are no longer known, so the line is
+        // wrapped as if it started with the first remaining character
+        _droppedWrappedLines = 0;
+    }
+
+    updateWrappedLineCounts();
+}
+
+int HistoryWrapIndex::width() const
+{
+    return _width;
+}
+
+int HistoryWrapIndex::wrappedLineCount(int logicalLine) const
+{
+    if (_logicalLineWide[logicalLine]) {
+        const int count = wideLineStarts(logicalLine).count();
+        if (logicalLine == _firstLogicalLine)
+            return _droppedWrappedLines + count;
+        else
+            return count;
+    }
+
+    // an empty line still takes up a line
+    const int length = _logicalLineLengths[logicalLine];
+    if (length == 0)
+        return 1;
+    else
+        return (length + _width - 1) / _width;
+}
+
+QVector<int> HistoryWrapIndex::wideLineStarts(int logicalLine) const
+{
+    const qint64 key = _logicalLineStarts[logicalLine];
+    QHash<qint64, QVector<int> >::iterator iter = _wideLineStarts.find(key);
+    if (iter == _wideLineStarts.end()) {
+        if (_wideLineStarts.count() >= WIDE_LINE_CACHE_SIZE)
+            _wideLineStarts.clear();
+
+        const int start = (logicalLine == _firstLogicalLine) ? _droppedLength : 0;
+        iter = _wideLineStarts.insert(key, QVector<int>() << start);
+    }
+
+    // Continue after the last wrapped line, which is all that needs to be
+    // done when the logical line has grown since.  A wrapped line is one
+    // character shorter if the character after it is the second half of a
+    // double width character, so only that one character is read.
+    QVector<int>& starts = iter.value();
+    const int length = _logicalLineLengths[logicalLine];
+    int start = starts.last();
+    while (length - start > _width) {
+        Character next;
+        getLogicalCells(logicalLine, start + _width, 1, &next);
+        start += (_width > 1 && next.isWidePlaceholder()) ? _width - 1 : _width;
+        starts << start;
+    }
+
+    return starts;
+}
+
+void HistoryWrapIndex::updateWrappedLineCounts()
+{
+    const int logicalLineCount = _logicalLineLengths.count();
+
+    _wrappedLineCounts.reserve(logicalLineCount + 1);
+    for (int i = _wrappedLineCounts.count() - 1; i < logicalLineCount; i++)
+        _wrappedLineCounts << _wrappedLineCounts[i] + wrappedLineCount(i);
+}
+
+bool HistoryWrapIndex::lineAdded()
+{
+    const int lineCount = _scroll->getLines();
+    if (lineCount == 0)
+        return true;
+
+    // The oldest lines are dropped when the scroll is full.  The scroll has
+    // done that already, so they are dropped from the index first to keep
+    // the lines of both in step, as the characters of lines with double
+    // width characters are read from the scroll.
+    bool unchanged = true;
+    while (_lineCount > lineCount - 1) {
+        if (!dropFirstLine())
+            unchanged = false;
+    }
+
+    if (!appendLine(_scroll->getLineLen(lineCount - 1),
+                    _scroll->isWrappedLine(lineCount - 1),
+                    _scroll->hasWideCharacters(lineCount - 1)))
+        unchanged = false;
+
+    return unchanged;
+}
+
+bool HistoryWrapIndex::appendLine(int length, bool wrapped, bool wideCharacters)
+{
+    const qint64 line = _firstLine + _lineCount;
+    const int lastLogicalLine = _logicalLineLengths.count() - 1;
+    const bool continued = (_lastLineWrapped && lastLogicalLine >= _firstLogicalLine);
+    int oldLength = 0;
+
+    if (continued) {
+        oldLength = _logicalLineLengths[lastLogicalLine];
+
+        _lineOffsets << oldLength;
+        _logicalLineLengths[lastLogicalLine] = oldLength + length;
+        if (wideCharacters)
+            _logicalLineWide[lastLogicalLine] = true;
+
+        _wrappedLineCounts.resize(lastLogicalLine + 1);
+        for (int i = 0; i < _otherWidths.count(); i++) {
+            QVector<qint64>& wrappedLineCounts = _otherWidths[i].second;
+            if (wrappedLineCounts.count() > lastLogicalLine + 1)
+                wrappedLineCounts.resize(lastLogicalLine + 1);
+        }
+    } else {
+        _lineOffsets << 0;
+        _logicalLineStarts << line;
+        _logicalLineLengths << length;
+        _logicalLineWide << wideCharacters;
+    }
+
+    _lastLineWrapped = wrapped;
+    _lineCount++;
+
+    updateWrappedLineCounts();
+
+    if (!continued)
+        return true;
+
+    // the line continues the last logical line, whose last wrapped line
+    // changes unless it ended where the added line starts
+    if (oldLength == 0)
+        return false;
+
+    if (_logicalLineWide[lastLogicalLine]) {
+        const QVector<int> starts = wideLineStarts(lastLogicalLine);
+        return qBinaryFind(starts, oldLength) != starts.constEnd();
+    } else {
+        return oldLength % _width == 0;
+    }
+}
+
+bool HistoryWrapIndex::dropFirstLine()
+{
+    Q_ASSERT(_lineCount > 0);
+
+    const qint64 nextLine = _firstLine + 1;
+    const int firstLogicalLine = _firstLogicalLine;
+    const int nextLogicalLine = firstLogicalLine + 1;
+    bool unchanged = true;
+
+    _firstLine++;
+    _lineCount--;
+
+    if (_logicalLineWide[firstLogicalLine])
+        _wideLineStarts.remove(_logicalLineStarts[firstLogicalLine]);
+
+    if (_lineCount == 0 || (nextLogicalLine < _logicalLineStarts.count() &&
+                            _logicalLineStarts[nextLogicalLine] == nextLine)) {
+        _firstLogicalLine = nextLogicalLine;
+        _droppedLength = 0;
+        _droppedWrappedLines = 0;
+    } else if (_logicalLineWide[firstLogicalLine]) {
+        // the characters which are left are wrapped again from the first
+        // one on, the lines before them are counted as dropped so that the
+        // numbers of the following lines stay the same
+        const int wrappedLines = _wrappedLineCounts[firstLogicalLine + 1] -
+                                 _wrappedLineCounts[firstLogicalLine];
+        _droppedLength = _lineOffsets[nextLine - _lineBase];
+        _droppedWrappedLines = wrappedLines - wideLineStarts(firstLogicalLine).count();
+        unchanged = false;
+    } else {
+        // only part of the oldest logical line is left, the wrapped lines
+        // which are left are the same unless one of them was split
+        _droppedLength = _lineOffsets[nextLine - _lineBase];
+        _droppedWrappedLines = _droppedLength / _width;
+        unchanged = (_droppedLength % _width == 0);
+    }
+
+    compact();
+
+    return unchanged;
+}
+
+void HistoryWrapIndex::compact()
+{
+    const int droppedLines = _firstLine - _lineBase;
+    if (droppedLines >= COMPACT_THRESHOLD && droppedLines * 2 >= _lineOffsets.count()) {
+        _lineOffsets.remove(0, droppedLines);
+        _lineBase = _firstLine;
+    }
+
+    const int droppedLogicalLines = _firstLogicalLine;
+    if (droppedLogicalLines >= COMPACT_THRESHOLD &&
+            droppedLogicalLines * 2 >= _logicalLineStarts.count()) {
+        _logicalLineStarts.remove(0, droppedLogicalLines);
+        _logicalLineLengths.remove(0, droppedLogicalLines);
+        _logicalLineWide.remove(0, droppedLogicalLines);
+        _firstLogicalLine = 0;
+
+        // the counts keep their values, so that the serial numbers of the
+        // wrapped lines do not change
+        _wrappedLineCounts.remove(0, droppedLogicalLines);
+        for (int i = 0; i < _otherWidths.count(); i++) {
+            QVector<qint64>& wrappedLineCounts = _otherWidths[i].second;
+            if (wrappedLineCounts.count() > droppedLogicalLines) {
+                wrappedLineCounts.remove(0, droppedLogicalLines);
+            } else {
+                wrappedLineCounts.clear();
+                wrappedLineCounts << 0;
+            }
+        }
+    }
+}
+
+int HistoryWrapIndex::getLines() const
+{
+    if (_lineCount == 0)
+        return 0;
+
+    return _wrappedLineCounts.last() - firstLineSerial();
+}
+
+qint64 HistoryWrapIndex::firstLineSerial() const
+{
+    return _wrappedLineCounts[_firstLogicalLine] + _droppedWrappedLines;
+}
+
+void HistoryWrapIndex::findLine(int lineno, int& logicalLine, int& start, int& end) const
+{
+    Q_ASSERT(lineno >= 0 && lineno < getLines());
+
+    // the wrapped lines of logical line i are numbered from
+    // _wrappedLineCounts[i] onwards
+    const qint64 serial = firstLineSerial() + lineno;
+    QVector<qint64>::const_iterator first = _wrappedLineCounts.constBegin() + _firstLogicalLine;
+    QVector<qint64>::const_iterator next = qUpperBound(first, _wrappedLineCounts.constEnd(), serial);
+    logicalLine = (next - _wrappedLineCounts.constBegin()) - 1;
+
+    int index = serial - _wrappedLineCounts[logicalLine];
+    const int length = _logicalLineLengths[logicalLine];
+
+    if (_logicalLineWide[logicalLine]) {
+        if (logicalLine == _firstLogicalLine)
+            index -= _droppedWrappedLines;
+
+        const QVector<int> starts = wideLineStarts(logicalLine);
+        Q_ASSERT(index >= 0 && index < starts.count());
+        start = starts[index];
+        end = (index + 1 < starts.count()) ? starts[index + 1] : length;
+    } else {
+        start = index * _width;
+        if (logicalLine == _firstLogicalLine)
+            start = qMax(start, _droppedLength);
+        end = qMax(start, qMin((index + 1) * _width, length));
+    }
+}
+
+int HistoryWrapIndex::getLineLen(int lineno) const
+{
+    int logicalLine, start, end;
+    findLine(lineno, logicalLine, start, end);
+    return end - start;
+}
+
+bool HistoryWrapIndex::isWrappedLine(int lineno) const
+{
+    int logicalLine, start, end;
+    findLine(lineno, logicalLine, start, end);
+
+    if (logicalLine == _logicalLineLengths.count() - 1 && _lastLineWrapped)
+        return true;
+    else
+        return end < _logicalLineLengths[logicalLine];
+}
+
+void HistoryWrapIndex::getCells(int lineno, int colno, int count, Character res[]) const
+{
+    int logicalLine, start, end;
+    findLine(lineno, logicalLine, start, end);
+
+    Q_ASSERT(colno >= 0 && count >= 0 && start + colno + count <= end);
+
+    getLogicalCells(logicalLine, start + colno, count, res);
+}
+
+void HistoryWrapIndex::getLogicalCells(int logicalLine, int offset, int count, Character res[]) const
+{
+    // the lines of the logical line which are still in the scroll
+    const qint64 firstLine = qMax(_logicalLineStarts[logicalLine], _firstLine);
+    const qint64 endLine = (logicalLine + 1 < _logicalLineStarts.count()) ?
+                           _logicalLineStarts[logicalLine + 1] : _firstLine + _lineCount;
+
+    // find the line which holds the first character
+    QVector<int>::const_iterator lineOffset = qUpperBound(_lineOffsets.constBegin() + (firstLine - _lineBase),
+                                                          _lineOffsets.constBegin() + (endLine - _lineBase),
+                                                          offset) - 1;
+    qint64 line = (lineOffset - _lineOffsets.constBegin()) + _lineBase;
+
+    while (count > 0 && line < endLine) {
+        const int lineStart = _lineOffsets[line - _lineBase];
+        const int lineEnd = (line + 1 < endLine) ? _lineOffsets[line + 1 - _lineBase] :
+                            _logicalLineLengths[logicalLine];
+        const int length = qMin(count, lineEnd - offset);
+
+        if (length > 0) {
+            _scroll->getCells(line - _firstLine, offset - lineStart, length, res);
+            res += length;
+            offset += length;
+            count -= length;
+        }
+        line++;
+    }
+}
+
+int HistoryWrapIndex::scrollLine(int lineno) const
+{
+    int logicalLine, start, end;
+    findLine(lineno, logicalLine, start, end);
+
+    const qint64 firstLine = qMax(_logicalLineStarts[logicalLine], _firstLine);
+    const qint64 endLine = (logicalLine + 1 < _logicalLineStarts.count()) ?
+                           _logicalLineStarts[logicalLine + 1] : _firstLine + _lineCount;
+
+    QVector<int>::const_iterator lineOffset = qUpperBound(_lineOffsets.constBegin() + (firstLine - _lineBase),
+                                                          _lineOffsets.constBegin() + (endLine - _lineBase),
+                                                          start) - 1;
+    return (lineOffset - _lineOffsets.constBegin()) + _lineBase - _firstLine;
+}
+
+int HistoryWrapIndex::wrappedLine(int scrollLine) const
+{
+    Q_ASSERT(scrollLine >= 0 && scrollLine < _lineCount);
+
+    const qint64 line = _firstLine + scrollLine;
+    QVector<qint64>::const_iterator next = qUpperBound(_logicalLineStarts.constBegin() + _firstLogicalLine,
+                                                       _logicalLineStarts.constEnd(), line);
+    const int logicalLine = (next - _logicalLineStarts.constBegin()) - 1;
+
+    const int offset = _lineOffsets[line - _lineBase];
+    int index;
+    if (_logicalLineWide[logicalLine]) {
+        const QVector<int> starts = wideLineStarts(logicalLine);
+        index = qMax(0, int(qUpperBound(starts, offset) - starts.constBegin()) - 1);
+        if (logicalLine == _firstLogicalLine)
+            index += _droppedWrappedLines;
+    } else {
+        // an empty line at the end of a logical line belongs to its last wrapped line
+        index = qMin(offset / _width, wrappedLineCount(logicalLine) - 1);
+    }
+
+    return qMax(qint64(0), _wrappedLineCounts[logicalLine] + index - firstLineSerial());
+}
+
+//////////////////////////////////////////////////////////////////////
+// Search index over the history
+//////////////////////////////////////////////////////////////////////
+
+// number of lines in each block of the index
+static const int SEARCH_INDEX_BLOCK_LINES = 128;
+// number of bits which the trigrams of a block are hashed into
+static const int SEARCH_INDEX_BLOCK_BITS = 16384;
+
+static inline int trigramKey(ushort first, ushort second, ushort third)
+{
+    quint32 hash = first * 2654435761U;
+    hash ^= second * 2246822519U;
+    hash ^= third * 3266489917U;
+    hash ^= hash >> 15;
+    return hash % SEARCH_INDEX_BLOCK_BITS;
+}
+
+// appends the key of each trigram of 'text' which does not contain a space
+static void appendTrigramKeys(const QString& text, QVector<int>& keys)
+{
+    for (int i = 0; i + 2 < text.length(); i++) {
+        const ushort first = text.at(i).toLower().unicode();
+        const ushort second = text.at(i + 1).toLower().unicode();
+        const ushort third = text.at(i + 2).toLower().unicode();
+
+        if (first != ' ' && second != ' ' && third != ' ')
+            keys << trigramKey(first, second, third);
+    }
+}
+
+HistorySearchIndex::HistorySearchIndex()
+    : _removedLines(0)
+    , _lineCount(0)
+{
+}
+
+void HistorySearchIndex::clear()
+{
+    _blocks.clear();
+    _continuedBlocks.clear();
+    _removedLines = 0;
+    _lineCount = 0;
+    _lastLineEnd.clear();
+}
+
+void HistorySearchIndex::addLine(const QString& text, bool wrapped)
+{
+    if ((_removedLines + _lineCount) % SEARCH_INDEX_BLOCK_LINES == 0) {
+        _blocks << QBitArray(SEARCH_INDEX_BLOCK_BITS);
+        _continuedBlocks << !_lastLineEnd.isEmpty();
+    }
+
+    // trigrams which start on a wrapped line and end on this one are
+    // indexed with this line
+    const QString line = _lastLineEnd + text;
+
+    QVector<int> keys;
+    appendTrigramKeys(line, keys);
+
+    QBitArray& bits = _blocks.last();
+    foreach(int key, keys)
+        bits.setBit(key);
+
+    if (wrapped)
+        _lastLineEnd = line.right(2);
+    else
+        _lastLineEnd.clear();
+
+    _lineCount++;
+}
+
+void HistorySearchIndex::removeLines(int count)
+{
+    count = qMin(count, _lineCount);
+
+    _removedLines += count;
+    _lineCount -= count;
+
+    while (_removedLines >= SEARCH_INDEX_BLOCK_LINES) {
+        _blocks.removeFirst();
+        _continuedBlocks.removeFirst();
+        _removedLines -= SEARCH_INDEX_BLOCK_LINES;
+    }
+}
+
+int HistorySearchIndex::lineCount() const
+{
+    return _lineCount;
+}
+
+QVector<int> HistorySearchIndex::trigramKeys(const QString& text)
+{
+    QVector<int> keys;
+    appendTrigramKeys(text, keys);
+
+    QVector<int> uniqueKeys;
+    foreach(int key, keys) {
+        if (!uniqueKeys.contains(key))
+            uniqueKeys << key;
+    }
+    return uniqueKeys;
+}
+
+bool HistorySearchIndex::blockMayContain(int block, const QVector<int>& keys, int& firstBlock) const
+{
+    // text which continues from one line onto the next may be spread over
+    // the blocks of both lines
+    firstBlock = block;
+    while (firstBlock > 0 && _continuedBlocks[firstBlock])
+        firstBlock--;
+
+    foreach(int key, keys) {
+        bool found = false;
+        for (int i = firstBlock; i <= block && !found; i++)
+            found = _blocks[i].testBit(key);
+
+        if (!found)
+            return false;
+    }
+
+    return true;
+}
+
+int HistorySearchIndex::findLine(int startLine, int endLine, const QVector<int>& keys) const
+{
+    Q_ASSERT(startLine >= 0 && startLine < _lineCount);
+    Q_ASSERT(endLine >= 0 && endLine < _lineCount);
+
+    if (keys.isEmpty())
+        return startLine;
+
+    const int startBlock = (_removedLines + startLine) / SEARCH_INDEX_BLOCK_LINES;
+    const int endBlock = (_removedLines + endLine) / SEARCH_INDEX_BLOCK_LINES;
+    const int step = (startBlock <= endBlock) ? 1 : -1;
+
+    for (int block = startBlock; ; block += step) {
+        int firstBlock;
+        if (blockMayContain(block, keys, firstBlock)) {
+            if (step > 0) {
+                const int line = firstBlock * SEARCH_INDEX_BLOCK_LINES - _removedLines;
+                return qMax(startLine, line);
+            } else {
+                const int line = (block + 1) * SEARCH_INDEX_BLOCK_LINES - _removedLines - 1;
+                return qMin(startLine, line);
+            }
+        }
+
+        if (block == endBlock)
+            break;
+    }
+
+    return -1;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -589,32 +2005,33 @@ bool HistoryTypeFile::isEnabled() const
     return true;
 }
 
+QString HistoryTypeFile::fileName() const
+{
+    return _fileName;
+}
+
 HistoryScroll* HistoryTypeFile::scroll(HistoryScroll* old) const
 {
-    if (dynamic_cast<HistoryFile *>(old))
+    // a migration into the same file counts as unchanged as well
+    const HistoryTypeFile* oldType = old ? dynamic_cast<const HistoryTypeFile*>(&old->getType()) : 0;
+    if (oldType && oldType->fileName() == _fileName)
         return old; // Unchanged.
 
     HistoryScroll* newScroll = new HistoryScrollFile(_fileName);
+    if (old == 0)
+        return newScroll;
 
-    Character line[LINE_SIZE];
-    int lines = (old != 0) ? old->getLines() : 0;
-    for (int i = 0; i < lines; i++) {
-        int size = old->getLineLen(i);
-        if (size > LINE_SIZE) {
-            Character* tmp_line = new Character[size];
-            old->getCells(i, 0, size, tmp_line);
-            newScroll->addCells(tmp_line, size);
-            newScroll->addLine(old->isWrappedLine(i));
-            delete [] tmp_line;
-        } else {
-            old->getCells(i, 0, size, line);
-            newScroll->addCells(line, size);
-            newScroll->addLine(old->isWrappedLine(i));
-        }
+    HistoryScrollMigration* migration = new HistoryScrollMigration(old, newScroll, new HistoryTypeFile(_fileName));
+
+    // small histories are converted right away
+    if (old->getLines() <= HistoryScrollMigration::SYNCHRONOUS_MIGRATION_LINES &&
+            migration->migrate(HistoryScrollMigration::SYNCHRONOUS_MIGRATION_LINES)) {
+        newScroll = migration->takeTarget();
+        delete migration;
+        return newScroll;
     }
 
-    delete old;
-    return newScroll;
+    return migration;
 }
 
 int HistoryTypeFile::maximumLineCount() const
@@ -622,6 +2039,23 @@ int HistoryTypeFile::maximumLineCount() const
     return -1;
 }
 
+void HistoryTypeFile::removeUnusedFiles(const QString& directory, const QStringList& usedFiles)
+{
+    QSet<QString> keep;
+    foreach(const QString& fileName, usedFiles)
+        keep << QFileInfo(fileName).absoluteFilePath();
+
+    const QDir dir(directory);
+    foreach(const QString& name, dir.entryList(QStringList() << "*.history", QDir::Files)) {
+        const QString fileName = dir.absoluteFilePath(name);
+        if (keep.contains(fileName) || HistoryFile::isInUse(fileName))
+            continue;
+
+        if (!QFile::remove(fileName))
+            kWarning() << "Unable to remove unused history file" << fileName;
+    }
+}
+
 //////////////////////////////
 
 CompactHistoryType::CompactHistoryType(unsigned int nbLines)
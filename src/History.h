@@ -25,8 +25,14 @@
 #include <sys/mman.h>
 
 // Qt
+#include <QtCore/QBitArray>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
 #include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QStringList>
 #include <QtCore/QVector>
+#include <QtCore/QFile>
 #include <QtCore/QTemporaryFile>
 
 #include "konsole_export.h"
@@ -38,42 +44,94 @@ namespace Konsole
 {
 /*
    An extendable tmpfile(1) based buffer.
+
+   Reads are served through fixed-size, read-only mmap'ed windows
+   (segments) onto the file which are mapped in on demand.  Appending
+   to the file never invalidates the existing windows, and only a
+   bounded number of segments are kept mapped at a time; the least
+   recently used one is unmapped when that limit is reached.
+
+   Appended data is collected in a write buffer and written out in
+   large sequential writes, or as soon as it is read back.
 */
 
 class HistoryFile
 {
 public:
     HistoryFile();
+    //opens @p fileName, creating it if necessary.  Existing contents are kept
+    //and the file is not removed when the HistoryFile is deleted.
+    explicit HistoryFile(const QString& fileName);
     virtual ~HistoryFile();
 
     virtual void add(const unsigned char* bytes, int len);
-    virtual void get(unsigned char* bytes, int len, int loc);
-    virtual int  len() const;
-
-    //mmaps the file in read-only mode
-    void map();
-    //un-mmaps the file
-    void unmap();
-    //returns true if the file is mmap'ed
-    bool isMapped() const;
-
+    virtual void get(unsigned char* bytes, int len, qint64 loc);
+    virtual qint64 len() const;
+
+    //overwrites @p len bytes which are already part of the file at @p loc
+    void set(const unsigned char* bytes, int len, qint64 loc);
+    //discards the contents of the file
+    void truncate();
+    //flushes the contents of the file to disk
+    void sync();
+    //deletes the file, it can not be used afterwards
+    void remove();
+
+    //returns true if @p fileName is opened by a HistoryFile, in this or
+    //any other process
+    static bool isInUse(const QString& fileName);
+
+    //sets the maximum number of windows which are kept mapped at the same time
+    void setMaxMappedSegments(int count);
+    //returns the number of windows which are currently mapped
+    int mappedSegmentCount() const;
 
 private:
-    int  _fd;
-    int  _length;
-    QTemporaryFile _tmpFile;
+    struct Segment {
+        Segment() : data(0), lastUse(0) {}
 
-    //pointer to start of mmap'ed file data, or 0 if the file is not mmap'ed
-    char* _fileMap;
+        //pointer to start of the mmap'ed window, or 0 if it is not mapped
+        char* data;
+        //value of _useCounter when the segment was last read from
+        quint32 lastUse;
+    };
+
+    //returns the mmap'ed data of @p segment, mapping it in if necessary,
+    //or 0 if mmap'ing fails
+    const char* segmentData(int segment);
+    //un-mmaps a single segment
+    void unmapSegment(int segment);
+    //un-mmaps the least recently used segment
+    void evictSegment();
 
-    //incremented whenever 'add' is called and decremented whenever
-    //'get' is called.
-    //this is used to detect when a large number of lines are being read and processed from the history
-    //and automatically mmap the file for better performance (saves the overhead of many lseek-read calls).
-    int _readWriteBalance;
+    void unmapAll();
+    //writes out the contents of the write buffer
+    void flush();
 
-    //when _readWriteBalance goes below this threshold, the file will be mmap'ed automatically
-    static const int MAP_THRESHOLD = -1000;
+    int  _fd;
+    //length of the file, including the contents of the write buffer
+    qint64 _length;
+    //number of bytes which have actually been written to the file
+    qint64 _fileLength;
+    QFile* _file;
+    QByteArray _writeBuffer;
+
+    //one entry for every SEGMENT_SIZE bytes of the file
+    QVector<Segment> _segments;
+    //indexes of the segments which are currently mapped
+    QVector<int> _mappedSegments;
+    int _maxMappedSegments;
+    quint32 _useCounter;
+
+    //set when mmap'ing fails, in which case the file is read using lseek-read calls
+    bool _mapFailed;
+
+    //size of each mmap'ed window, must be a multiple of the page size
+    static const qint64 SEGMENT_SIZE = 1 << 20;
+    //default maximum number of windows which are kept mapped at the same time
+    static const int MAX_MAPPED_SEGMENTS = 32;
+    //the write buffer is flushed once it holds this many bytes
+    static const int WRITE_BUFFER_SIZE = 64 * 1024;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -96,6 +154,9 @@ public:
     virtual int  getLineLen(int lineno) = 0;
     virtual void getCells(int lineno, int colno, int count, Character res[]) = 0;
     virtual bool isWrappedLine(int lineno) = 0;
+    // returns true if the line holds double width characters, which must
+    // not be split when the line is wrapped
+    virtual bool hasWideCharacters(int lineno);
 
     // adding lines.
     virtual void addCells(const Character a[], int count) = 0;
@@ -107,6 +168,38 @@ public:
 
     virtual void addLine(bool previousWrapped = false) = 0;
 
+    // memory statistics, used for diagnostics
+    /** Returns the number of bytes of memory currently used to hold the history. */
+    virtual qint64 memoryUsage() {
+        return 0;
+    }
+    /** Returns the number of bytes the history would use if none of it was compressed. */
+    virtual qint64 uncompressedMemoryUsage() {
+        return memoryUsage();
+    }
+
+    /**
+     * Writes out everything needed for the history to be reopened later
+     * by its HistoryType, and makes the history persistent.
+     * Returns false if this type of history can not be stored.
+     */
+    virtual bool checkpoint() {
+        return false;
+    }
+
+    /**
+     * Adds the positions in the table of RGB colors of the colors which
+     * the history holds to @p indexes, see CharacterColor::trueColorIndex().
+     */
+    virtual void addUsedTrueColors(QSet<int>& indexes);
+    /**
+     * Sets whether the stored history outlives this scroll.  Histories
+     * which are not persistent are removed when the scroll is deleted.
+     */
+    virtual void setPersistent(bool persistent) {
+        Q_UNUSED(persistent);
+    }
+
     //
     // FIXME:  Passing around constant references to HistoryType instances
     // is very unsafe, because those references will no longer
@@ -127,6 +220,12 @@ protected:
 class KONSOLEPRIVATE_EXPORT HistoryScrollFile : public HistoryScroll
 {
 public:
+    /**
+     * Constructs a file based history.  If @p logFileName is empty, the
+     * history is kept in a temporary file.  Otherwise the history stored in
+     * @p logFileName by an earlier checkpoint() is reopened if there is one,
+     * and new lines are appended to it.
+     */
     explicit HistoryScrollFile(const QString& logFileName);
     virtual ~HistoryScrollFile();
 
@@ -134,16 +233,114 @@ public:
     virtual int  getLineLen(int lineno);
     virtual void getCells(int lineno, int colno, int count, Character res[]);
     virtual bool isWrappedLine(int lineno);
+    virtual bool hasWideCharacters(int lineno);
 
     virtual void addCells(const Character a[], int count);
     virtual void addLine(bool previousWrapped = false);
 
-private:
-    int startOfLine(int lineno);
+    virtual bool checkpoint();
+    virtual void setPersistent(bool persistent);
+    virtual void addUsedTrueColors(QSet<int>& indexes);
 
-    HistoryFile _index; // lines Row(int)
-    HistoryFile _cells; // text  Row(Character)
-    HistoryFile _lineflags; // flags Row(unsigned char)
+    /** Returns the history file, or an empty string if a temporary file is used. */
+    QString fileName() const;
+
+private:
+    /*
+       On-disk layout of the history file.  The file is only ever appended
+       to, except for the checkpoint offset in the header.
+
+       Header
+       cells of line 0, cells of line 1, ...
+       index chunk (LINES_PER_CHUNK LineEntry records)
+       more cells and index chunks ...
+       checkpoint: offsets of the index chunks written since the previous
+                   checkpoint, RGB colors added to the file's table since
+                   then, LineEntry records of the lines not in a chunk
+                   yet, Checkpoint
+       more cells, index chunks and checkpoints ...
+
+       Each checkpoint only holds what was added since the previous one, so
+       that writing one does not take longer as the history grows.
+       Reopening the file reads the header and walks back from the
+       checkpoint it points to through the earlier ones, the lines
+       themselves are read on demand.  Anything written after the last
+       checkpoint is ignored.
+
+       RGB colors are stored as positions in a table of the file's own,
+       since the positions used by CharacterColor are only valid in one
+       process.
+    */
+    struct Header {
+        char magic[8];
+        quint32 version;
+        quint32 cellSize;   // sizeof(Character)
+        qint64 checkpoint;  // offset of the last Checkpoint, or 0
+    };
+    struct Checkpoint {
+        char magic[8];
+        qint64 lineCount;
+        qint64 previousCheckpoint;  // offset of the checkpoint before, or 0
+        qint64 chunkCount;          // number of index chunks in the file
+        qint64 newChunksOffset;     // chunks since the previous checkpoint
+        qint64 pendingLinesOffset;
+        qint64 trueColorCount;      // number of colors in the file's table
+        qint64 newTrueColorsOffset; // colors since the previous checkpoint
+    };
+    struct LineEntry {
+        qint64 offset;      // offset of the line's cells in the file
+        quint32 length;     // number of cells in the line
+        quint32 flags;      // LINE_WRAPPED if the line wraps into the next one,
+                            // LINE_WIDE_CHARACTERS if it holds double width
+                            // characters
+    };
+    static const quint32 LINE_WIDE_CHARACTERS = 1 << 16;
+
+    // reads the last checkpoint of an existing history file
+    bool reopen();
+    // reads the checkpoint at 'offset', returns false if it is not valid
+    bool readCheckpoint(qint64 offset, Checkpoint& checkpoint);
+    // writes a checkpoint, and flushes the file to disk first if 'sync' is set
+    void writeCheckpoint(bool sync);
+    void writeHeader();
+    // writes the pending line entries out as an index chunk
+    void flushLines();
+    LineEntry lineEntry(int lineno);
+    // translate the RGB colors of cells between the table of the process
+    // and that of the file
+    CharacterColor toFileColor(const CharacterColor& color);
+    CharacterColor fromFileColor(const CharacterColor& color);
+
+    HistoryFile* _file;
+    // file offsets of the index chunks
+    QVector<qint64> _chunks;
+    // entries of the lines which are not part of an index chunk yet
+    QVector<LineEntry> _pendingLines;
+    // file offset of the first cell of the line being added
+    qint64 _lineStart;
+    // whether the line being added holds double width characters
+    bool _lineHasWideCharacters;
+    // whether the history file is kept when the scroll is deleted
+    bool _persistent;
+    // the last checkpoint written, and the numbers of index chunks and of
+    // RGB colors in the file at that point
+    qint64 _lastCheckpoint;
+    int _checkpointChunks;
+    int _checkpointTrueColors;
+    // the RGB colors used in the file, and their positions in the file's
+    // table
+    QVector<QRgb> _trueColors;
+    QHash<QRgb, int> _trueColorIndexes;
+    // whether colors have been approximated because the file's table is full
+    bool _trueColorsApproximated;
+    // cells which are translated before they are written
+    QVector<Character> _buffer;
+
+    static const quint32 FILE_VERSION = 3;
+    static const int LINES_PER_CHUNK = 1024;
+    // once persistent, a checkpoint is written every CHECKPOINT_INTERVAL
+    // index chunks so that little is lost if Konsole crashes
+    static const int CHECKPOINT_INTERVAL = 16;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -166,6 +363,73 @@ public:
     virtual void addLine(bool previousWrapped = false);
 };
 
+//////////////////////////////////////////////////////////////////////
+// History which is being converted from one type to another
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * Copies the contents of one history scroll into another in batches,
+ * so that converting a large history does not block the caller.
+ *
+ * Until the conversion is complete, lines are read from the source scroll,
+ * which is no longer modified, and new lines are held in a separate buffer.
+ * Call migrate() until it returns true, then replace the migration with
+ * the scroll returned by takeTarget().
+ */
+class KONSOLEPRIVATE_EXPORT HistoryScrollMigration : public HistoryScroll
+{
+public:
+    /**
+     * Constructs a migration of @p source into @p target, taking ownership
+     * of both.  @p type is the type of the target scroll.
+     */
+    HistoryScrollMigration(HistoryScroll* source, HistoryScroll* target, HistoryType* type);
+    virtual ~HistoryScrollMigration();
+
+    // histories of up to this many lines are converted at once when the
+    // history type is changed, see HistoryTypeFile::scroll()
+    static const int SYNCHRONOUS_MIGRATION_LINES = 2000;
+    // number of lines which are converted in each step of the conversion
+    // of larger histories, see Emulation::setHistory()
+    static const int MIGRATION_BATCH_LINES = 5000;
+
+    virtual int  getLines();
+    virtual int  getLineLen(int lineno);
+    virtual void getCells(int lineno, int colno, int count, Character res[]);
+    virtual bool isWrappedLine(int lineno);
+    virtual bool hasWideCharacters(int lineno);
+
+    virtual void addCells(const Character a[], int count);
+    virtual void addLine(bool previousWrapped = false);
+
+    virtual qint64 memoryUsage();
+    virtual void addUsedTrueColors(QSet<int>& indexes);
+
+    /**
+     * Copies up to @p lineCount more lines into the target scroll.
+     * Returns true once all lines have been copied.
+     */
+    bool migrate(int lineCount);
+    /**
+     * Returns the target scroll, which now holds all lines, and releases
+     * ownership of it.  Only valid once migrate() has returned true.
+     */
+    HistoryScroll* takeTarget();
+
+private:
+    // copies line @p lineno of @p scroll into the target
+    void copyLine(HistoryScroll* scroll, int lineno);
+
+    HistoryScroll* _source;
+    HistoryScroll* _target;
+    // lines added while the migration is in progress
+    HistoryScroll* _newLines;
+    // number of lines which have been copied into the target
+    int _copiedLines;
+    // buffer used to copy lines
+    QVector<Character> _buffer;
+};
+
 //////////////////////////////////////////////////////////////////////
 // History using compact storage
 // This implementation uses a list of fixed-sized blocks
@@ -207,6 +471,7 @@ public:
         Q_ASSERT(_head != MAP_FAILED);
         _tail = _blockStart = _head;
         _allocCount = 0;
+        _resident = true;
     }
 
     virtual ~CompactHistoryBlock() {
@@ -229,14 +494,71 @@ public:
         return _allocCount != 0;
     };
 
+    /**
+     * Compresses the contents of the block, if that was not done already,
+     * and releases the memory holding the uncompressed contents.
+     *
+     * The address range of the block stays reserved, so pointers into
+     * the block remain valid once thaw() has been called.
+     */
+    void freeze();
+    /** Restores the contents of a frozen block from its compressed copy. */
+    void thaw();
+    /** Returns true if the block has been compressed by freeze(). */
+    bool isFrozen() const {
+        return !_compressed.isEmpty();
+    }
+    /** Returns true if the uncompressed contents of the block are in memory. */
+    bool isResident() const {
+        return _resident;
+    }
+    /** Returns the number of bytes used by the compressed copy of the block. */
+    int compressedSize() const {
+        return _compressed.size();
+    }
+
+    /**
+     * Records that a line stored in the block uses the RGB color at
+     * position @p index in the table of RGB colors.  The positions stay
+     * recorded until the block is deleted, so they can be reported by
+     * trueColorIndexes() without thawing the block.
+     */
+    void addTrueColorIndex(int index) {
+        _trueColorIndexes << index;
+    }
+    /** Returns the positions recorded by addTrueColorIndex(). */
+    const QSet<int>& trueColorIndexes() const {
+        return _trueColorIndexes;
+    }
+
 private:
     size_t _blockLength;
     quint8* _head;
     quint8* _tail;
     quint8* _blockStart;
     int _allocCount;
+
+    QByteArray _compressed;
+    bool _resident;
+
+    QSet<int> _trueColorIndexes;
 };
 
+/**
+ * A pool of CompactHistoryBlocks used as a FIFO arena.
+ *
+ * Memory is always handed out from the most recently created block and
+ * must be released in the same order it was allocated in, which is the
+ * order in which history lines are evicted.  This means a deallocation
+ * always belongs to the oldest block, so no search is needed and blocks
+ * are freed as a whole as soon as their last allocation is released.
+ *
+ * Only the most recent blocks are kept uncompressed.  Older blocks are
+ * frozen (see CompactHistoryBlock::freeze()) and must be thawed with
+ * makeResident() before their contents are read.  A few thawed blocks
+ * are cached, the least recently used one is frozen again when the
+ * cache is full.
+ */
 class CompactHistoryBlockList
 {
 public:
@@ -248,8 +570,35 @@ public:
     int length() {
         return list.size();
     }
+    // returns the block which the last allocation was made from
+    CompactHistoryBlock* lastBlock() const {
+        return list.last();
+    }
+    // ensures that the contents of @p block can be read
+    void makeResident(CompactHistoryBlock* block) {
+        if (block->isFrozen())
+            touch(block);
+    }
+
+    // adds the RGB colors used by the lines in all blocks, without
+    // thawing any of them, see HistoryScroll::addUsedTrueColors()
+    void addUsedTrueColors(QSet<int>& indexes) const;
+
+    // memory statistics, see HistoryScroll::memoryUsage()
+    qint64 memoryUsage() const;
+    qint64 uncompressedMemoryUsage() const;
+
 private:
+    void touch(CompactHistoryBlock* block);
+
     QList<CompactHistoryBlock*> list;
+    // thawed frozen blocks, most recently used first
+    QList<CompactHistoryBlock*> _thawedBlocks;
+
+    // number of most recent blocks which are never compressed
+    static const int HOT_BLOCK_COUNT = 2;
+    // maximum number of frozen blocks which are kept thawed
+    static const int THAWED_BLOCK_CACHE_SIZE = 4;
 };
 
 class CompactHistoryLine
@@ -258,11 +607,16 @@ public:
     CompactHistoryLine(const TextLine&, CompactHistoryBlockList& blockList);
     virtual ~CompactHistoryLine();
 
-    // custom new operator to allocate memory from custom pool instead of heap
-    static void* operator new(size_t size, CompactHistoryBlockList& blockList);
+    // custom new operator to allocate memory from custom pool instead of heap.
+    // The line's format and text arrays are allocated in the same chunk,
+    // directly after the line itself.
+    static void* operator new(size_t size, CompactHistoryBlockList& blockList, const TextLine& line);
     static void operator delete(void *) {
         /* do nothing, deallocation from pool is done in destructor*/
     };
+    static void operator delete(void *, CompactHistoryBlockList&, const TextLine&) {
+        /* do nothing, matches the placement new operator above */
+    };
 
     virtual void getCharacters(Character* array, int length, int startColumn);
     virtual void getCharacter(int index, Character& r);
@@ -277,6 +631,11 @@ public:
     };
 
 protected:
+    // returns the number of distinct format runs in @p line
+    static int formatCount(const TextLine& line);
+    // returns the index of the format run which contains @p column
+    int formatIndex(int column) const;
+
     CompactHistoryBlockList& _blockListRef;
     CharacterFormat* _formatArray;
     quint16 _length;
@@ -287,7 +646,17 @@ protected:
 
 class KONSOLEPRIVATE_EXPORT CompactHistoryScroll : public HistoryScroll
 {
-    typedef QList<CompactHistoryLine*> HistoryArray;
+    // The length and flags of a line are kept in its entry as well, so
+    // that they can be read without thawing the block holding the line
+    struct LineEntry {
+        CompactHistoryLine* line;
+        // the block holding the line
+        CompactHistoryBlock* block;
+        quint16 length;
+        bool wrapped;
+        bool wideCharacters;
+    };
+    typedef QVector<LineEntry> HistoryArray;
 
 public:
     explicit CompactHistoryScroll(unsigned int maxNbLines = 1000);
@@ -297,21 +666,251 @@ public:
     virtual int  getLineLen(int lineno);
     virtual void getCells(int lineno, int colno, int count, Character res[]);
     virtual bool isWrappedLine(int lineno);
+    virtual bool hasWideCharacters(int lineno);
 
     virtual void addCells(const Character a[], int count);
     virtual void addCellsVector(const TextLine& cells);
     virtual void addLine(bool previousWrapped = false);
 
+    virtual qint64 memoryUsage();
+    virtual qint64 uncompressedMemoryUsage();
+
+    virtual void addUsedTrueColors(QSet<int>& indexes);
+
     void setMaxNbLines(unsigned int nbLines);
 
 private:
     bool hasDifferentColors(const TextLine& line) const;
+
+    // returns the entry of the line with the given index, where 0 is the
+    // oldest line
+    LineEntry& entryAt(int lineNumber) {
+        int index = _head + lineNumber;
+        if (index >= _lines.size())
+            index -= _lines.size();
+        return _lines[index];
+    }
+    // returns the line with the given index after making sure its
+    // contents can be read
+    CompactHistoryLine* lineAt(int lineNumber) {
+        const LineEntry& entry = entryAt(lineNumber);
+        _blockList.makeResident(entry.block);
+        return entry.line;
+    }
+    // deletes the oldest line
+    void removeFirstLine();
+
+    // Circular buffer of lines.  It grows until it holds _maxLineCount lines,
+    // after which the oldest line (at _head) is overwritten by each new one.
     HistoryArray _lines;
+    int _head;
+    int _lineCount;
     CompactHistoryBlockList _blockList;
 
     unsigned int _maxLineCount;
 };
 
+//////////////////////////////////////////////////////////////////////
+// History lines wrapped to the width of the screen
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * Presents the lines of a history scroll re-wrapped to a given width.
+ *
+ * A history scroll holds lines as they were laid out when they were added,
+ * at the width the screen had at that time.  A line which was wrapped
+ * continues on the next line, together they form a logical line.  This index
+ * wraps the logical lines again at the current width of the screen.
+ *
+ * Only the lengths of the logical lines are needed to number the wrapped
+ * lines, so the characters are only fetched from the scroll when the wrapped
+ * lines are read.  The numbering is kept for a few recently used widths,
+ * which keeps resizing back and forth cheap even for very large histories.
+ *
+ * The exception are logical lines with double width characters.  Like
+ * Screen does it, a double width character which does not fit at the end
+ * of a wrapped line is moved to the next one, so the positions at which
+ * these lines are wrapped depend on their characters.
+ *
+ * lineAdded() must be called after each line which is added to the scroll,
+ * and reset() after the scroll has been changed in any other way.
+ */
+class KONSOLEPRIVATE_EXPORT HistoryWrapIndex
+{
+public:
+    HistoryWrapIndex();
+
+    /**
+     * Sets the scroll whose lines are wrapped.  The scroll is expected to
+     * hold the same lines as the previous one, otherwise reset() must be
+     * called.
+     */
+    void setScroll(HistoryScroll* scroll);
+    /** Rebuilds the index from all of the lines in the scroll. */
+    void reset();
+
+    /** Sets the width at which lines are wrapped. */
+    void setWidth(int width);
+    /** Returns the width at which lines are wrapped. */
+    int width() const;
+
+    /**
+     * Updates the index after a line has been added to the scroll, which
+     * may have caused the oldest lines to be dropped.
+     *
+     * Returns false if wrapped lines which were already in the index have
+     * changed, which happens when the added line continues a logical line
+     * whose last wrapped line was not full, or when part of a wrapped line
+     * is dropped.
+     */
+    bool lineAdded();
+
+    /** Returns the number of wrapped lines. */
+    int getLines() const;
+    /** Returns the length of wrapped line @p lineno, where 0 is the oldest line */
+    int getLineLen(int lineno) const;
+    /**
+     * Copies @p count characters of wrapped line @p lineno, starting at
+     * column @p colno, into @p res.
+     */
+    void getCells(int lineno, int colno, int count, Character res[]) const;
+    /** Returns true if wrapped line @p lineno continues on the next line. */
+    bool isWrappedLine(int lineno) const;
+
+    /** Returns the line of the scroll in which wrapped line @p lineno starts. */
+    int scrollLine(int lineno) const;
+    /** Returns the wrapped line in which line @p scrollLine of the scroll starts. */
+    int wrappedLine(int scrollLine) const;
+
+    /**
+     * Returns a number which identifies the oldest wrapped line.  The numbers
+     * of the following lines increase by one for each line.  A line keeps its
+     * number until the width is changed, or lineAdded() returns false.
+     */
+    qint64 firstLineSerial() const;
+
+private:
+    // adds a line of 'length' characters to the end of the index
+    // returns false if existing wrapped lines have changed
+    bool appendLine(int length, bool wrapped, bool wideCharacters);
+    // removes the oldest line from the index
+    // returns false if existing wrapped lines have changed
+    bool dropFirstLine();
+    // finds the logical line and the range of characters of wrapped line 'lineno'
+    void findLine(int lineno, int& logicalLine, int& start, int& end) const;
+    // returns the number of wrapped lines of logical line 'logicalLine'
+    int wrappedLineCount(int logicalLine) const;
+    // returns the offsets at which the wrapped lines of logical line
+    // 'logicalLine', which holds double width characters, start.  For the
+    // oldest logical line only those which are still in the scroll
+    QVector<int> wideLineStarts(int logicalLine) const;
+    // copies 'count' characters of logical line 'logicalLine', starting at
+    // 'offset', into 'res'
+    void getLogicalCells(int logicalLine, int offset, int count, Character res[]) const;
+    // completes the wrapped line counts for the current width
+    void updateWrappedLineCounts();
+    // discards the entries of lines which have been dropped
+    void compact();
+
+    HistoryScroll* _scroll;
+    int _width;
+
+    // the offset of each line within its logical line, indexed by the line's
+    // serial number minus _lineBase
+    QVector<int> _lineOffsets;
+    qint64 _lineBase;
+    qint64 _firstLine; // serial number of the oldest line which is in the scroll
+    int _lineCount;    // number of lines which are in the scroll
+
+    // the serial number of the first line and the length of each logical
+    // line, and whether it holds double width characters
+    QVector<qint64> _logicalLineStarts;
+    QVector<int> _logicalLineLengths;
+    QVector<bool> _logicalLineWide;
+    int _firstLogicalLine;  // the oldest logical line which is still in the scroll
+    int _droppedLength;     // number of characters dropped from the oldest logical line
+    int _droppedWrappedLines; // number of wrapped lines dropped from it at the current width
+    bool _lastLineWrapped;  // the last line continues on the screen
+
+    // the starts of the wrapped lines of recently used logical lines with
+    // double width characters at the current width, keyed by the serial
+    // number of the first line of the logical line
+    mutable QHash<qint64, QVector<int> > _wideLineStarts;
+
+    // _wrappedLineCounts[i] is the number of wrapped lines of the logical
+    // lines before i at the current width, it is complete up to the last
+    // logical line.  The counts for other widths are kept in _otherWidths,
+    // the most recently used first, and may be incomplete.
+    QVector<qint64> _wrappedLineCounts;
+    QList<QPair<int, QVector<qint64> > > _otherWidths;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Search index over the history
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * Records which sequences of three characters, or trigrams, occur in the
+ * lines of a history scroll, so that a search for a piece of text can skip
+ * the lines which cannot contain it.
+ *
+ * The lines are indexed in blocks.  The trigrams of each block are hashed into
+ * a fixed number of bits, and a block which lacks the bit of one of the
+ * trigrams of a piece of text does not contain the text.  Letters are indexed
+ * in lower case, so the index also serves searches which ignore case.
+ * Trigrams which contain a space are not indexed.
+ */
+class KONSOLEPRIVATE_EXPORT HistorySearchIndex
+{
+public:
+    HistorySearchIndex();
+
+    /** Removes all lines from the index. */
+    void clear();
+
+    /**
+     * Adds a line to the end of the index.  @p text is the text of the line
+     * as PlainTextDecoder decodes it, @p wrapped is true if the line continues
+     * on the next line.
+     */
+    void addLine(const QString& text, bool wrapped);
+    /** Removes the oldest @p count lines from the index. */
+    void removeLines(int count);
+    /** Returns the number of lines in the index. */
+    int lineCount() const;
+
+    /**
+     * Returns the keys under which the trigrams of @p text are indexed.  The
+     * list is empty if the text is too short to be looked up.
+     */
+    static QVector<int> trigramKeys(const QString& text);
+
+    /**
+     * Returns the first line from @p startLine to @p endLine which may contain
+     * text with the trigram keys @p keys, or -1 if none of the lines may.  If
+     * @p endLine is before @p startLine the lines are looked at backwards, and
+     * the last line which may contain the text is returned.
+     *
+     * The text may also start on an earlier line, which the returned line
+     * continues.
+     */
+    int findLine(int startLine, int endLine, const QVector<int>& keys) const;
+
+private:
+    // returns true if block 'block', or the blocks which it continues,
+    // contain all of 'keys'.  'firstBlock' is set to the first of these blocks
+    bool blockMayContain(int block, const QVector<int>& keys, int& firstBlock) const;
+
+    QList<QBitArray> _blocks;
+    QList<bool> _continuedBlocks; // the first line of the block continues a line
+    int _removedLines;            // lines removed from the first block
+    int _lineCount;
+
+    // the end of the last line, if it is wrapped, as it forms trigrams
+    // with the start of the next line
+    QString _lastLineEnd;
+};
+
 //////////////////////////////////////////////////////////////////////
 // History type
 //////////////////////////////////////////////////////////////////////
@@ -364,8 +963,25 @@ public:
     virtual bool isEnabled() const;
     virtual int maximumLineCount() const;
 
+    /**
+     * Converts @p old into a file based history.  If @p old holds many lines
+     * a HistoryScrollMigration is returned, which must be completed by calling
+     * its migrate() method.
+     */
     virtual HistoryScroll* scroll(HistoryScroll *) const;
 
+    /**
+     * Returns the file the history is stored in, or an empty string if
+     * a temporary file is used.
+     */
+    QString fileName() const;
+
+    /**
+     * Removes the history files in @p directory, except for those listed in
+     * @p usedFiles and those which are open in this or another process.
+     */
+    static void removeUnusedFiles(const QString& directory, const QStringList& usedFiles);
+
 protected:
     QString _fileName;
 };
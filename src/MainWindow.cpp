@@ -53,6 +53,7 @@
 #include "ViewManager.h"
 #include "SessionManager.h"
 #include "ProfileManager.h"
+#include "UpdateScheduler.h"
 #include "KonsoleSettings.h"
 #include "settings/GeneralSettings.h"
 #include "settings/TabBarSettings.h"
@@ -548,6 +549,7 @@ bool MainWindow::queryClose()
         }
     }
     if (processesRunning.count() == 0) {
+        discardSavedHistory();
         return true;
     }
 
@@ -575,6 +577,7 @@ bool MainWindow::queryClose()
 
     switch (result) {
     case KMessageBox::Yes:
+        discardSavedHistory();
         return true;
     case KMessageBox::No:
         if (_pluggedController && _pluggedController->session()) {
@@ -586,9 +589,20 @@ bool MainWindow::queryClose()
         return false;
     }
 
+    discardSavedHistory();
     return true;
 }
 
+void MainWindow::discardSavedHistory()
+{
+    // unlike when the session manager closes the window, its sessions
+    // are not going to be restored
+    foreach(Session* session, _viewManager->sessions()) {
+        if (session)
+            session->discardSavedHistory();
+    }
+}
+
 void MainWindow::saveProperties(KConfigGroup& group)
 {
     _viewManager->saveSessions(group);
@@ -693,6 +707,9 @@ void MainWindow::applyKonsoleSettings()
     setNavigationBehavior(KonsoleSettings::newTabBehavior());
     setShowQuickButtons(KonsoleSettings::showQuickButtons());
 
+    UpdateScheduler::instance()->setTargetFrameRate(KonsoleSettings::targetFrameRate());
+    UpdateScheduler::instance()->setBackgroundFrameRate(KonsoleSettings::backgroundFrameRate());
+
     // setAutoSaveSettings("MainWindow", KonsoleSettings::saveGeometryOnExit());
 
     updateWindowCaption();
@@ -182,6 +182,9 @@ private:
     void setupActions();
     void setupMainWidget();
     QString activeSessionDir() const;
+    // throws away the histories stored for the window's sessions by the
+    // session manager, when the window is closed for good
+    void discardSavedHistory();
 
     /**
      * Returns the search bar.
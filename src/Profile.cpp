@@ -78,6 +78,7 @@ const Profile::PropertyInfo Profile::DefaultPropertyNames[] = {
     , { ColorScheme , "colors" , 0 , QVariant::String }
     , { AntiAliasFonts, "AntiAliasFonts" , APPEARANCE_GROUP , QVariant::Bool }
     , { BoldIntense, "BoldIntense", APPEARANCE_GROUP, QVariant::Bool }
+    , { GlyphAtlasEnabled, "GlyphAtlasEnabled", APPEARANCE_GROUP, QVariant::Bool }
     , { LineSpacing , "LineSpacing" , APPEARANCE_GROUP , QVariant::Int }
 
     // Keyboard
@@ -92,6 +93,7 @@ const Profile::PropertyInfo Profile::DefaultPropertyNames[] = {
     // Terminal Features
     , { BlinkingTextEnabled , "BlinkingTextEnabled" , TERMINAL_GROUP , QVariant::Bool }
     , { FlowControlEnabled , "FlowControlEnabled" , TERMINAL_GROUP , QVariant::Bool }
+    , { ThreadedReadingEnabled , "ThreadedReadingEnabled" , TERMINAL_GROUP , QVariant::Bool }
     , { BidiRenderingEnabled , "BidiRenderingEnabled" , TERMINAL_GROUP , QVariant::Bool }
     , { BlinkingCursorEnabled , "BlinkingCursorEnabled" , TERMINAL_GROUP , QVariant::Bool }
     , { BellMode , "BellMode" , TERMINAL_GROUP , QVariant::Int }
@@ -173,6 +175,7 @@ FallbackProfile::FallbackProfile()
     setProperty(ScrollFullPage, false);
 
     setProperty(FlowControlEnabled, true);
+    setProperty(ThreadedReadingEnabled, false);
     setProperty(BlinkingTextEnabled, true);
     setProperty(UnderlineLinksEnabled, true);
     setProperty(OpenLinksByDirectClickEnabled, false);
@@ -195,6 +198,7 @@ FallbackProfile::FallbackProfile()
     setProperty(DefaultEncoding, QString(QTextCodec::codecForLocale()->name()));
     setProperty(AntiAliasFonts, true);
     setProperty(BoldIntense, true);
+    setProperty(GlyphAtlasEnabled, false);
 
     // default taken from KDE 3
     setProperty(WordCharacters, ":@-./_~?&=%+#");
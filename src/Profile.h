@@ -167,6 +167,11 @@ public:
          * Ctrl+Q) have any effect.  Also known as Xon/Xoff
          */
         FlowControlEnabled,
+        /** (bool) Specifies whether the output of the terminal process is
+         * read and processed in a separate thread, so that a session which
+         * produces a lot of output does not hold up the others.
+         */
+        ThreadedReadingEnabled,
         /** (int) Specifies the pixels between the terminal lines.
          */
         LineSpacing,
@@ -228,6 +233,11 @@ public:
         /** (bool) Whether character with intense colors should be rendered
          * in bold font or just in bright color. */
         BoldIntense,
+        /** (bool) Whether text should be drawn by copying glyphs from an
+         * atlas in which each glyph is rendered once, instead of laying
+         * out the text every time it is drawn.
+         */
+        GlyphAtlasEnabled,
         /** (bool) Whether new sessions should be started in the same
          * directory as the currently active session.
          */
@@ -446,6 +456,11 @@ public:
         return property<bool>(Profile::FlowControlEnabled);
     }
 
+    /** Convenience method for property<bool>(Profile::ThreadedReadingEnabled) */
+    bool threadedReadingEnabled() const {
+        return property<bool>(Profile::ThreadedReadingEnabled);
+    }
+
     /** Convenience method for property<bool>(Profile::UseCustomCursorColor) */
     bool useCustomCursorColor() const {
         return property<bool>(Profile::UseCustomCursorColor);
@@ -485,6 +500,11 @@ public:
         return property<bool>(Profile::BoldIntense);
     }
 
+    /** Convenience method for property<bool>(Profile::GlyphAtlasEnabled) */
+    bool glyphAtlasEnabled() const {
+        return property<bool>(Profile::GlyphAtlasEnabled);
+    }
+
     /** Convenience method for property<bool>(Profile::StartInCurrentSessionDir) */
     bool startInCurrentSessionDir() const {
         return property<bool>(Profile::StartInCurrentSessionDir);
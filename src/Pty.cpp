@@ -33,8 +33,22 @@
 #include <KPtyDevice>
 #include <kde_file.h>
 
+// Konsole
+#include "PtyReader.h"
+
 using Konsole::Pty;
 
+// number of bytes of output which are passed on at once, before the
+// event loop gets control again
+static const int READ_BUFFER_SIZE = 65536;
+
+// number of bytes of output which may be waiting to be passed on before
+// the pty device stops reading from the terminal process
+static const int MAX_PENDING_BYTES = 1024 * 1024;
+
+// interval in milliseconds over which receiveRate() is measured
+static const int RECEIVE_RATE_INTERVAL = 1000;
+
 Pty::Pty(int masterFd, QObject* aParent)
     : KPtyProcess(masterFd, aParent)
 {
@@ -54,6 +68,18 @@ void Pty::init()
     _eraseChar     = 0;
     _xonXoff       = true;
     _utf8          = true;
+    _reader        = 0;
+    _outputProcessor = 0;
+
+    _readBuffer.resize(READ_BUFFER_SIZE);
+    _readScheduled = false;
+    _readSuspended = false;
+    _passingOnData = false;
+
+    _bytesReceived = 0;
+    _rateStartBytes = 0;
+    _receiveRate   = 0;
+    _rateClock.start();
 
     setEraseChar(_eraseChar);
     setFlowControlEnabled(_xonXoff);
@@ -69,6 +95,8 @@ void Pty::init()
 
 Pty::~Pty()
 {
+    // the reader must be stopped before the pty is closed
+    delete _reader;
 }
 
 void Pty::sendData(const char* data, int length)
@@ -84,8 +112,153 @@ void Pty::sendData(const char* data, int length)
 
 void Pty::dataReceived()
 {
-    QByteArray data = pty()->readAll();
-    emit receivedData(data.constData(), data.count());
+    _readScheduled = false;
+
+    // the read buffer is still in use if a receiver of receivedData() lets
+    // the event loop run
+    if (_passingOnData) {
+        scheduleRead();
+        return;
+    }
+
+    // no more than one buffer of output is passed on at once, so that a
+    // process which floods the terminal does not hold up input and the
+    // other sessions.  The rest is passed on in the next iteration of the
+    // event loop.
+    qint64 length;
+    if (_reader)
+        length = _reader->takeData(_readBuffer.data(), _readBuffer.size());
+    else
+        length = pty()->read(_readBuffer.data(), _readBuffer.size());
+
+    if (length > 0)
+        passOnData(length);
+
+    // stop reading from the terminal process while too much of its output
+    // is waiting to be passed on, which blocks it when it writes more
+    if (!_reader) {
+        const qint64 pending = pty()->bytesAvailable();
+
+        if (!_readSuspended && pending >= MAX_PENDING_BYTES) {
+            _readSuspended = true;
+            pty()->setSuspended(true);
+        } else if (_readSuspended && pending < MAX_PENDING_BYTES / 2) {
+            _readSuspended = false;
+            pty()->setSuspended(false);
+        }
+    }
+
+    if (pendingBytes() > 0)
+        scheduleRead();
+}
+
+void Pty::scheduleRead()
+{
+    if (_readScheduled)
+        return;
+
+    _readScheduled = true;
+    QMetaObject::invokeMethod(this, "dataReceived", Qt::QueuedConnection);
+}
+
+void Pty::passOnData(int length)
+{
+    _bytesReceived += length;
+    updateReceiveRate();
+
+    _passingOnData = true;
+    emit receivedData(_readBuffer.constData(), length);
+    _passingOnData = false;
+}
+
+int Pty::pendingBytes() const
+{
+    if (_reader)
+        return _reader->pendingBytes();
+    else
+        return pty()->bytesAvailable();
+}
+
+qint64 Pty::bytesReceived() const
+{
+    if (_reader)
+        return _bytesReceived + _reader->bytesProcessed();
+    else
+        return _bytesReceived;
+}
+
+void Pty::updateReceiveRate() const
+{
+    const qint64 elapsed = _rateClock.elapsed();
+    if (elapsed < RECEIVE_RATE_INTERVAL)
+        return;
+
+    const qint64 received = bytesReceived();
+    _receiveRate = (received - _rateStartBytes) * 1000 / elapsed;
+    _rateStartBytes = received;
+    _rateClock.restart();
+}
+
+int Pty::receiveRate() const
+{
+    // the output which is passed to the output processor does not go
+    // through passOnData()
+    updateReceiveRate();
+
+    return _receiveRate;
+}
+
+void Pty::setThreadedReading(bool threaded)
+{
+    if (threaded == (_reader != 0))
+        return;
+
+    if (threaded) {
+        if (pty()->masterFd() < 0)
+            return;
+
+        pty()->setSuspended(true);
+        _readSuspended = false;
+
+        // pass on what was read before the reader takes over
+        while (pty()->bytesAvailable() > 0)
+            passOnData(pty()->read(_readBuffer.data(), _readBuffer.size()));
+
+        _reader = new PtyReader(pty()->masterFd(), this);
+        _reader->setProcessor(_outputProcessor);
+        connect(_reader, SIGNAL(dataAvailable()), this, SLOT(dataReceived()),
+                Qt::QueuedConnection);
+        _reader->start();
+    } else {
+        PtyReader* reader = _reader;
+        _reader = 0;
+        reader->stop();
+
+        // what the reader read but did not process is passed on below
+        reader->setProcessor(0);
+        _bytesReceived += reader->bytesProcessed();
+
+        int length;
+        while ((length = reader->takeData(_readBuffer.data(), _readBuffer.size())) > 0)
+            passOnData(length);
+
+        delete reader;
+
+        pty()->setSuspended(false);
+    }
+}
+
+bool Pty::threadedReading() const
+{
+    return _reader != 0;
+}
+
+void Pty::setOutputProcessor(PtyOutputProcessor* processor)
+{
+    _outputProcessor = processor;
+
+    if (_reader)
+        _reader->setProcessor(_outputProcessor);
 }
 
 void Pty::setWindowSize(int columns, int lines)
@@ -270,6 +443,7 @@ void Pty::setWriteable(bool writeable)
 
 void Pty::closePty()
 {
+    setThreadedReading(false);
     pty()->close();
 }
 
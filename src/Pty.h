@@ -24,6 +24,8 @@
 #define PTY_H
 
 // Qt
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QSize>
 
 // KDE
@@ -36,6 +38,9 @@ class QStringList;
 
 namespace Konsole
 {
+class PtyOutputProcessor;
+class PtyReader;
+
 /**
  * The Pty class is used to start the terminal process,
  * send data to it, receive data from it and manipulate
@@ -136,6 +141,49 @@ public:
      */
     int foregroundProcessGroup() const;
 
+    /**
+     * Sets whether the output of the terminal process is read in a thread
+     * of its own.  The output is still passed on with receivedData() in
+     * the thread which owns the Pty, unless an output processor is set.
+     */
+    void setThreadedReading(bool threaded);
+    /** See setThreadedReading() */
+    bool threadedReading() const;
+
+    /**
+     * Sets the processor which the output of the terminal process is
+     * passed to in the reading thread while threadedReading() is enabled.
+     * The output is not passed on with receivedData() then.  Pass 0 to
+     * pass it on with receivedData() again.
+     *
+     * When the processor is changed, this waits until the reading thread
+     * has finished passing output to the previous one.
+     */
+    void setOutputProcessor(PtyOutputProcessor* processor);
+
+    /**
+     * Returns the number of bytes of output which have been read from the
+     * terminal process but not passed on with receivedData() yet.
+     *
+     * No more than a limited amount of output is passed on at once, before
+     * the event loop gets control again.  When too much output is waiting,
+     * the Pty stops reading, and the terminal process blocks when it
+     * writes more.
+     */
+    int pendingBytes() const;
+
+    /**
+     * Returns the number of bytes of output which have been passed on,
+     * including those which have been passed to the output processor.
+     */
+    qint64 bytesReceived() const;
+
+    /**
+     * Returns the number of bytes of output per second which have been
+     * passed on recently.
+     */
+    int receiveRate() const;
+
     /**
      * Close the underlying pty master/slave pair.
      */
@@ -176,6 +224,13 @@ private slots:
 private:
     void init();
 
+    // calls dataReceived() in the next iteration of the event loop
+    void scheduleRead();
+    // emits receivedData() for the first 'length' bytes of _readBuffer
+    void passOnData(int length);
+    // starts a new interval of receiveRate() once the current one is over
+    void updateReceiveRate() const;
+
     // takes a list of key=value pairs and adds them
     // to the environment for the process
     void addEnvironmentVariables(const QStringList& environment);
@@ -185,6 +240,19 @@ private:
     char _eraseChar;
     bool _xonXoff;
     bool _utf8;
+
+    PtyReader* _reader;
+    PtyOutputProcessor* _outputProcessor;
+
+    QByteArray _readBuffer;
+    bool _readScheduled;
+    bool _readSuspended;  // set when reading stopped because output is waiting
+    bool _passingOnData;
+
+    qint64 _bytesReceived;  // not including the output processed by _reader
+    mutable qint64 _rateStartBytes;  // bytesReceived() when _rateClock was started
+    mutable int _receiveRate;
+    mutable QElapsedTimer _rateClock;
 };
 }
 
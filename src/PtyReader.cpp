@@ -0,0 +1,238 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "PtyReader.h"
+
+// System
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+// KDE
+#include <KDebug>
+
+using namespace Konsole;
+
+// number of bytes which are read from the pty at once
+static const int READ_SIZE = 16384;
+
+// number of bytes which may be queued before the reader stops reading
+static const int MAX_PENDING_BYTES = 1024 * 1024;
+
+// if the wake-up pipe could not be created, the thread checks whether
+// it was stopped at this interval (in milliseconds)
+static const int STOP_POLL_INTERVAL = 100;
+
+PtyReader::PtyReader(int fd, QObject* parent)
+    : QThread(parent)
+    , _fd(fd)
+    , _stopped(false)
+    , _processor(0)
+    , _processing(false)
+    , _bytesProcessed(0)
+{
+    if (::pipe(_wakeupPipe) != 0) {
+        kWarning() << "Unable to create pipe for the pty reader.";
+        _wakeupPipe[0] = -1;
+        _wakeupPipe[1] = -1;
+    } else {
+        ::fcntl(_wakeupPipe[0], F_SETFD, FD_CLOEXEC);
+        ::fcntl(_wakeupPipe[1], F_SETFD, FD_CLOEXEC);
+    }
+}
+
+PtyReader::~PtyReader()
+{
+    stop();
+
+    if (_wakeupPipe[0] >= 0) {
+        ::close(_wakeupPipe[0]);
+        ::close(_wakeupPipe[1]);
+    }
+}
+
+void PtyReader::stop()
+{
+    {
+        QMutexLocker locker(&_mutex);
+        _stopped = true;
+        _spaceAvailable.wakeAll();
+    }
+
+    if (_wakeupPipe[1] >= 0) {
+        const char wakeup = 0;
+        while (::write(_wakeupPipe[1], &wakeup, 1) < 0 && errno == EINTR)
+            ;
+    }
+
+    wait();
+}
+
+int PtyReader::takeData(char* buffer, int maxLength)
+{
+    QMutexLocker locker(&_mutex);
+
+    // the queued output belongs to the processor once one is set
+    if (_processor)
+        return 0;
+
+    const int length = qMin(maxLength, _data.size());
+    memcpy(buffer, _data.constData(), length);
+    _data.remove(0, length);
+
+    if (_data.size() < MAX_PENDING_BYTES)
+        _spaceAvailable.wakeAll();
+
+    return length;
+}
+
+int PtyReader::pendingBytes() const
+{
+    QMutexLocker locker(&_mutex);
+    return _processor ? 0 : _data.size();
+}
+
+void PtyReader::setProcessor(PtyOutputProcessor* processor)
+{
+    {
+        QMutexLocker locker(&_mutex);
+        while (_processing)
+            _processingDone.wait(&_mutex);
+
+        _processor = processor;
+        _spaceAvailable.wakeAll();
+
+        if (!_processor || _data.isEmpty())
+            return;
+    }
+
+    // wake up the thread from poll() to pass on the queued output
+    if (_wakeupPipe[1] >= 0) {
+        const char wakeup = 0;
+        while (::write(_wakeupPipe[1], &wakeup, 1) < 0 && errno == EINTR)
+            ;
+    }
+}
+
+qint64 PtyReader::bytesProcessed() const
+{
+    QMutexLocker locker(&_mutex);
+    return _bytesProcessed;
+}
+
+void PtyReader::process(PtyOutputProcessor* processor, const char* data, int length)
+{
+    processor->processOutput(data, length);
+
+    QMutexLocker locker(&_mutex);
+    _bytesProcessed += length;
+    _processing = false;
+    _processingDone.wakeAll();
+}
+
+int PtyReader::maximumPendingBytes()
+{
+    return MAX_PENDING_BYTES;
+}
+
+void PtyReader::run()
+{
+    char buffer[READ_SIZE];
+
+    while (true) {
+        PtyOutputProcessor* processor = 0;
+        QByteArray queuedData;
+        {
+            QMutexLocker locker(&_mutex);
+            while (!_stopped && !_processor && _data.size() >= MAX_PENDING_BYTES)
+                _spaceAvailable.wait(&_mutex);
+
+            if (_stopped)
+                break;
+
+            // output which was queued before the processor was set is
+            // passed to it before anything else
+            if (_processor && !_data.isEmpty()) {
+                processor = _processor;
+                _processing = true;
+                queuedData = _data;
+                _data.clear();
+            }
+        }
+
+        if (processor) {
+            process(processor, queuedData.constData(), queuedData.size());
+            continue;
+        }
+
+        struct pollfd fds[2];
+        fds[0].fd = _fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = _wakeupPipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        const int timeout = (_wakeupPipe[0] >= 0) ? -1 : STOP_POLL_INTERVAL;
+        const int result = ::poll(fds, 2, timeout);
+
+        if (result < 0 && errno != EINTR) {
+            kWarning() << "Unable to wait for output from the pty.";
+            break;
+        }
+
+        if (result > 0 && fds[1].revents != 0) {
+            char wakeup[16];
+            while (::read(_wakeupPipe[0], wakeup, sizeof(wakeup)) < 0 && errno == EINTR)
+                ;
+        }
+
+        if (result <= 0 || fds[0].revents == 0)
+            continue;
+
+        const ssize_t length = ::read(_fd, buffer, READ_SIZE);
+        if (length < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+
+        // the pty is closed once there are no processes left which have
+        // the slave side open
+        if (length <= 0)
+            break;
+
+        bool wasEmpty = false;
+        {
+            QMutexLocker locker(&_mutex);
+            if (_processor && _data.isEmpty()) {
+                processor = _processor;
+                _processing = true;
+            } else {
+                wasEmpty = _data.isEmpty();
+                _data.append(buffer, length);
+            }
+        }
+
+        if (processor)
+            process(processor, buffer, length);
+        else if (wasEmpty)
+            emit dataAvailable();
+    }
+}
+
+#include "PtyReader.moc"
@@ -0,0 +1,142 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef PTYREADER_H
+#define PTYREADER_H
+
+// Qt
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+// Konsole
+#include "konsole_export.h"
+
+namespace Konsole
+{
+/**
+ * Processes the output of a terminal process in the thread of a PtyReader,
+ * see PtyReader::setProcessor()
+ */
+class KONSOLEPRIVATE_EXPORT PtyOutputProcessor
+{
+public:
+    virtual ~PtyOutputProcessor() {}
+
+    /**
+     * Processes @p length bytes of output from @p data.  This is called
+     * from the reader's thread.
+     */
+    virtual void processOutput(const char* data, int length) = 0;
+};
+
+/**
+ * Reads the output of a terminal process from a pty master in a thread of
+ * its own.
+ *
+ * The data which is read is queued until it is taken with takeData() in the
+ * thread which owns the reader.  dataAvailable() is emitted whenever data is
+ * added to an empty queue.  Once maximumPendingBytes() bytes are queued, the
+ * reader stops reading until some of them are taken.  The terminal process
+ * then blocks when it writes more output, instead of the queue growing
+ * without limit.
+ *
+ * Alternatively the output can be processed in the reader's thread as soon
+ * as it is read, see setProcessor().
+ */
+class KONSOLEPRIVATE_EXPORT PtyReader : public QThread
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Constructs a reader for the pty master @p fd.  Call start() to start
+     * reading from it.  The reader does not take ownership of @p fd, which
+     * must stay open until the reader is stopped.
+     */
+    explicit PtyReader(int fd, QObject* parent = 0);
+    /** Stops the reader and waits for its thread to finish. */
+    ~PtyReader();
+
+    /**
+     * Stops reading from the pty and waits for the thread to finish.  Data
+     * which has already been read can still be taken with takeData().
+     */
+    void stop();
+
+    /**
+     * Removes up to @p maxLength bytes from the start of the queue and
+     * copies them to @p buffer.  Returns the number of bytes copied.
+     */
+    int takeData(char* buffer, int maxLength);
+
+    /**
+     * Returns the number of bytes which have been read but not taken yet.
+     * This is 0 while a processor is set.
+     */
+    int pendingBytes() const;
+
+    /**
+     * Sets the processor which the output is passed to in the reader's
+     * thread, instead of being queued for takeData().  Output which is
+     * still queued when a processor is set is passed to it first.
+     *
+     * When the processor is changed, this waits until the thread has
+     * finished passing output to the previous one.  Pass 0 to queue the
+     * output again.
+     */
+    void setProcessor(PtyOutputProcessor* processor);
+
+    /** Returns the number of bytes which have been passed to a processor. */
+    qint64 bytesProcessed() const;
+
+    /** Returns the number of bytes after which the reader stops reading. */
+    static int maximumPendingBytes();
+
+signals:
+    /**
+     * Emitted from the reader's thread when data is added to an empty
+     * queue.  Connect to this with a queued connection.
+     */
+    void dataAvailable();
+
+protected:
+    virtual void run();
+
+private:
+    // passes 'length' bytes from 'data' to 'processor', which has been
+    // taken from _processor while _processing was set
+    void process(PtyOutputProcessor* processor, const char* data, int length);
+
+    const int _fd;
+    // written to by stop() to wake up the thread from poll()
+    int _wakeupPipe[2];
+
+    mutable QMutex _mutex;
+    QWaitCondition _spaceAvailable;
+    QWaitCondition _processingDone;
+    QByteArray _data;
+    bool _stopped;
+
+    PtyOutputProcessor* _processor;
+    bool _processing;  // set while output is being passed to _processor
+    qint64 _bytesProcessed;
+};
+}
+
+#endif // PTYREADER_H
@@ -24,6 +24,7 @@
 #include "Screen.h"
 
 // Qt
+#include <QtCore/QAtomicInt>
 #include <QtCore/QTextStream>
 
 // Konsole
@@ -57,6 +58,23 @@ const Character Screen::DefaultChar = Character(' ',
                                       DEFAULT_RENDITION,
                                       false);
 
+// number of history lines which are added to the search index by each
+// search until all of them are indexed
+static const int SEARCH_INDEX_BATCH_LINES = 10000;
+
+// stamps of history lines have the top bit set, so that they never collide
+// with the stamps of screen lines
+static const quint64 HISTORY_LINE_STAMP = Q_UINT64_C(1) << 63;
+
+// the stamps of a screen count its changes in the lower bits and hold the
+// number of the screen in the bits above them, up to HISTORY_LINE_STAMP
+static const int STAMP_COUNTER_BITS = 40;
+static const quint64 STAMP_COUNTER_MASK = (Q_UINT64_C(1) << STAMP_COUNTER_BITS) - 1;
+static const quint64 SCREEN_NUMBER_MASK = (Q_UINT64_C(1) << (63 - STAMP_COUNTER_BITS)) - 1;
+
+// screens are numbered in any thread which processes terminal output
+static QAtomicInt lastScreenNumber;
+
 Screen::Screen(int lines, int columns):
     _lines(lines),
     _columns(columns),
@@ -64,7 +82,13 @@ Screen::Screen(int lines, int columns):
     _screenLinesSize(_lines),
     _scrolledLines(0),
     _droppedLines(0),
+    _historyLinesAdded(0),
+    _imageStamp(0),
+    _stampBase(((lastScreenNumber.fetchAndAddOrdered(1) + 1) & SCREEN_NUMBER_MASK) << STAMP_COUNTER_BITS),
+    _lastStamp(0),
     _history(new HistoryScrollNone()),
+    _searchIndexEnabled(false),
+    _reflowLines(false),
     _cuX(0),
     _cuY(0),
     _currentRendition(DEFAULT_RENDITION),
@@ -83,6 +107,15 @@ Screen::Screen(int lines, int columns):
     for (int i = 0; i < _lines + 1; i++)
         _lineProperties[i] = LINE_DEFAULT;
 
+    _imageStamp = nextStamp();
+
+    _lineStamps.resize(_lines + 1);
+    for (int i = 0; i < _lines + 1; i++)
+        _lineStamps[i] = nextStamp();
+
+    _wrapIndex.setScroll(_history);
+    _wrapIndex.setWidth(_columns);
+
     initTabStops();
     clearSelection();
     reset();
@@ -204,6 +237,7 @@ void Screen::deleteChars(int n)
     Q_ASSERT(_cuX + n <= _screenLines[_cuY].count());
 
     _screenLines[_cuY].remove(_cuX, n);
+    lineChanged(_cuY);
 }
 
 void Screen::insertChars(int n)
@@ -217,6 +251,8 @@ void Screen::insertChars(int n)
 
     if (_screenLines[_cuY].count() > _columns)
         _screenLines[_cuY].resize(_columns);
+
+    lineChanged(_cuY);
 }
 
 void Screen::deleteLines(int n)
@@ -233,6 +269,9 @@ void Screen::insertLines(int n)
 
 void Screen::setMode(int m)
 {
+    if (m == MODE_Screen && !_currentModes[m])
+        imageChanged();
+
     _currentModes[m] = true;
     switch (m) {
     case MODE_Origin :
@@ -244,6 +283,9 @@ void Screen::setMode(int m)
 
 void Screen::resetMode(int m)
 {
+    if (m == MODE_Screen && _currentModes[m])
+        imageChanged();
+
     _currentModes[m] = false;
     switch (m) {
     case MODE_Origin :
@@ -260,6 +302,9 @@ void Screen::saveMode(int m)
 
 void Screen::restoreMode(int m)
 {
+    if (m == MODE_Screen && _currentModes[m] != _savedModes[m])
+        imageChanged();
+
     _currentModes[m] = _savedModes[m];
 }
 
@@ -291,45 +336,202 @@ void Screen::resizeImage(int new_lines, int new_columns)
 {
     if ((new_lines == _lines) && (new_columns == _columns)) return;
 
-    if (_cuY > new_lines - 1) {
-        // attempt to preserve focus and _lines
-        _bottomMargin = _lines - 1; //FIXME: margin lost
-        for (int i = 0; i < _cuY - (new_lines - 1); i++) {
-            addHistLine();
-            scrollUp(0, 1);
+    const bool defaultMargins = (_topMargin == 0 && _bottomMargin == _lines - 1);
+    const int topMargin = _topMargin;
+    const int bottomMargin = _bottomMargin;
+
+    // the history is wrapped at the new width from now on
+    _wrapIndex.setWidth(new_columns);
+
+    if (_reflowLines && new_columns != _columns) {
+        reflowLines(new_lines, new_columns);
+    } else {
+        if (_cuY > new_lines - 1) {
+            // attempt to preserve focus and _lines
+            _topMargin = 0;
+            _bottomMargin = _lines - 1;
+            for (int i = 0; i < _cuY - (new_lines - 1); i++) {
+                addHistLine();
+                scrollUp(0, 1);
+            }
         }
-    }
 
-    // create new screen _lines and copy from old to new
+        // create new screen _lines and copy from old to new
 
-    ImageLine* newScreenLines = new ImageLine[new_lines + 1];
-    for (int i = 0; i < qMin(_lines, new_lines + 1) ; i++)
-        newScreenLines[i] = _screenLines[i];
-    for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
-        newScreenLines[i].resize(new_columns);
+        ImageLine* newScreenLines = new ImageLine[new_lines + 1];
+        for (int i = 0; i < qMin(_lines, new_lines + 1) ; i++)
+            newScreenLines[i] = _screenLines[i];
+        for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
+            newScreenLines[i].resize(new_columns);
 
-    _lineProperties.resize(new_lines + 1);
-    for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
-        _lineProperties[i] = LINE_DEFAULT;
+        _lineProperties.resize(new_lines + 1);
+        for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
+            _lineProperties[i] = LINE_DEFAULT;
 
-    clearSelection();
+        delete[] _screenLines;
+        _screenLines = newScreenLines;
+        _screenLinesSize = new_lines;
+    }
 
-    delete[] _screenLines;
-    _screenLines = newScreenLines;
-    _screenLinesSize = new_lines;
+    _lineStamps.resize(new_lines + 1);
+    for (int i = 0; i < new_lines + 1; i++)
+        _lineStamps[i] = nextStamp();
+
+    clearSelection();
+    imageChanged();
 
     _lines = new_lines;
     _columns = new_columns;
     _cuX = qMin(_cuX, _columns - 1);
     _cuY = qMin(_cuY, _lines - 1);
 
-    // FIXME: try to keep values, evtl.
-    _topMargin = 0;
-    _bottomMargin = _lines - 1;
+    // margins which covered the whole screen keep doing so, others are
+    // kept as long as they still fit
+    if (defaultMargins || bottomMargin > _lines - 1) {
+        _topMargin = 0;
+        _bottomMargin = _lines - 1;
+    } else {
+        _topMargin = topMargin;
+        _bottomMargin = bottomMargin;
+    }
     initTabStops();
     clearSelection();
 }
 
+void Screen::setReflowLines(bool reflow)
+{
+    _reflowLines = reflow;
+}
+
+// returns the length of 'line' without its trailing blanks
+static int contentLength(const QVector<Character>& line)
+{
+    int length = line.count();
+    while (length > 0 && line[length - 1] == Screen::DefaultChar)
+        length--;
+    return length;
+}
+
+void Screen::reflowLines(int new_lines, int new_columns)
+{
+    // blank lines below the cursor are not kept
+    int lastLine = _cuY;
+    for (int line = _lines - 1; line > _cuY; line--) {
+        if (contentLength(_screenLines[line]) > 0) {
+            lastLine = line;
+            break;
+        }
+    }
+
+    QVector<ImageLine> lines;
+    QVector<LineProperty> properties;
+    int cursorLine = 0;
+    int cursorColumn = 0;
+
+    int line = 0;
+    while (line <= lastLine) {
+        // join the screen lines which make up one logical line.  Lines which
+        // were wrapped are full, the last one loses its trailing blanks
+        const LineProperty property = _lineProperties[line] & ~LINE_WRAPPED;
+        ImageLine text;
+        int cursorOffset = -1;
+
+        while (true) {
+            const ImageLine& screenLine = _screenLines[line];
+            if (line == _cuY)
+                cursorOffset = text.count() + _cuX;
+
+            if ((_lineProperties[line] & LINE_WRAPPED) && line < lastLine) {
+                // a double width character which did not fit at the end of
+                // the line was moved to the next one, leaving a blank cell
+                const ImageLine& nextLine = _screenLines[line + 1];
+                int end = _columns;
+                if (nextLine.count() > 1 && nextLine[1].isWidePlaceholder() &&
+                        (screenLine.count() < _columns || screenLine[_columns - 1] == DefaultChar))
+                    end = _columns - 1;
+
+                const int length = qMin(screenLine.count(), end);
+                text += screenLine.mid(0, length);
+                for (int i = length; i < end; i++)
+                    text << DefaultChar;
+                line++;
+            } else {
+                text += screenLine.mid(0, contentLength(screenLine));
+                line++;
+                break;
+            }
+        }
+
+        // and split it again at the new width.  Like displayCharacter() does
+        // it, a double width character which does not fit at the end of a
+        // line is moved to the next one
+        QVector<int> pieceStarts;
+        pieceStarts << 0;
+        while (text.count() - pieceStarts.last() > new_columns) {
+            const int start = pieceStarts.last();
+            if (new_columns > 1 && text[start + new_columns].isWidePlaceholder())
+                pieceStarts << start + new_columns - 1;
+            else
+                pieceStarts << start + new_columns;
+        }
+
+        if (cursorOffset != -1) {
+            // the cursor may be beyond the end of the text
+            while (cursorOffset - pieceStarts.last() >= new_columns)
+                pieceStarts << pieceStarts.last() + new_columns;
+
+            const int piece = (qUpperBound(pieceStarts, cursorOffset) - pieceStarts.constBegin()) - 1;
+            cursorLine = lines.count() + piece;
+            cursorColumn = cursorOffset - pieceStarts[piece];
+        }
+
+        const int pieceCount = pieceStarts.count();
+        for (int piece = 0; piece < pieceCount; piece++) {
+            const int start = pieceStarts[piece];
+            const int end = (piece + 1 < pieceCount) ? pieceStarts[piece + 1] : text.count();
+            lines << text.mid(start, qMax(0, end - start));
+            LineProperty pieceProperty = (piece == 0) ? property : LineProperty(LINE_DEFAULT);
+            if (piece < pieceCount - 1)
+                pieceProperty |= LINE_WRAPPED;
+            properties << pieceProperty;
+        }
+    }
+
+    // lines which no longer fit are moved into the history, as long as
+    // the cursor stays on the screen
+    const int linesToMove = qMin(qMax(0, lines.count() - new_lines), cursorLine);
+    if (hasScroll()) {
+        for (int i = 0; i < linesToMove; i++) {
+            const int oldScrollLines = _history->getLines();
+            _history->addCellsVector(lines[i]);
+            _history->addLine(properties[i] & LINE_WRAPPED);
+            _wrapIndex.lineAdded();
+            addToSearchIndex(lines[i], properties[i] & LINE_WRAPPED, oldScrollLines);
+            _historyLinesAdded++;
+        }
+    }
+
+    ImageLine* newScreenLines = new ImageLine[new_lines + 1];
+    _lineProperties.resize(new_lines + 1);
+    for (int i = 0; i < new_lines + 1; i++) {
+        const int index = i + linesToMove;
+        if (i < new_lines && index < lines.count()) {
+            newScreenLines[i] = lines[index];
+            _lineProperties[i] = properties[index];
+        } else {
+            _lineProperties[i] = LINE_DEFAULT;
+        }
+    }
+
+    delete[] _screenLines;
+    _screenLines = newScreenLines;
+    _screenLinesSize = new_lines;
+
+    _cuY = cursorLine - linesToMove;
+    _cuX = cursorColumn;
+    _lastPos = -1;
+}
+
 void Screen::setDefaultMargins()
 {
     _topMargin = 0;
@@ -396,25 +598,19 @@ void Screen::updateEffectiveRendition()
 
 void Screen::copyFromHistory(Character* dest, int startLine, int count) const
 {
-    Q_ASSERT(startLine >= 0 && count > 0 && startLine + count <= _history->getLines());
+    Q_ASSERT(startLine >= 0 && count > 0 && startLine + count <= _wrapIndex.getLines());
 
     for (int line = startLine; line < startLine + count; line++) {
-        const int length = qMin(_columns, _history->getLineLen(line));
+        const int length = qMin(_columns, _wrapIndex.getLineLen(line));
         const int destLineOffset  = (line - startLine) * _columns;
 
-        _history->getCells(line, 0, length, dest + destLineOffset);
+        _wrapIndex.getCells(line, 0, length, dest + destLineOffset);
 
         for (int column = length; column < _columns; column++)
             dest[destLineOffset + column] = Screen::DefaultChar;
 
         // invert selected text
-        if (_selBegin != -1) {
-            for (int column = 0; column < _columns; column++) {
-                if (isSelected(column, line)) {
-                    reverseRendition(dest[destLineOffset + column]);
-                }
-            }
-        }
+        reverseSelection(dest + destLineOffset, line);
     }
 }
 
@@ -423,34 +619,76 @@ void Screen::copyFromScreen(Character* dest , int startLine , int count) const
     Q_ASSERT(startLine >= 0 && count > 0 && startLine + count <= _lines);
 
     for (int line = startLine; line < (startLine + count) ; line++) {
-        int srcLineStartIndex  = line * _columns;
-        int destLineStartIndex = (line - startLine) * _columns;
-
-        for (int column = 0; column < _columns; column++) {
-            int srcIndex = srcLineStartIndex + column;
-            int destIndex = destLineStartIndex + column;
+        Character* destLine = dest + (line - startLine) * _columns;
+        const ImageLine& srcLine = _screenLines[line];
+        const int length = qMin(_columns, srcLine.count());
 
-            dest[destIndex] = _screenLines[srcIndex / _columns].value(srcIndex % _columns, Screen::DefaultChar);
+        memcpy(destLine, srcLine.constData(), length * sizeof(Character));
+        fillWithDefaultChar(destLine + length, _columns - length);
 
-            // invert selected text
-            if (_selBegin != -1 && isSelected(column, line + _history->getLines()))
-                reverseRendition(dest[destIndex]);
-        }
+        // invert selected text
+        reverseSelection(destLine, line + _wrapIndex.getLines());
     }
 }
 
 void Screen::getImage(Character* dest, int size, int startLine, int endLine) const
 {
     Q_ASSERT(startLine >= 0);
-    Q_ASSERT(endLine >= startLine && endLine < _history->getLines() + _lines);
+    Q_ASSERT(endLine >= startLine && endLine < _wrapIndex.getLines() + _lines);
+
+    const int mergedLines = endLine - startLine + 1;
+
+    Q_ASSERT(size >= mergedLines * _columns);
+    Q_UNUSED(size);
+
+    copyImageLines(dest, startLine, mergedLines);
+
+    // mark the character at the current cursor position
+    const int cursorIndex = cursorImageIndex(startLine, mergedLines);
+    if (getMode(MODE_Cursor) && cursorIndex < _columns * mergedLines)
+        dest[cursorIndex].rendition |= RE_CURSOR;
+}
+
+void Screen::getImage(Character* dest, int size, int startLine, int endLine,
+                      const QBitArray& linesToCopy) const
+{
+    Q_ASSERT(startLine >= 0);
+    Q_ASSERT(endLine >= startLine && endLine < _wrapIndex.getLines() + _lines);
 
     const int mergedLines = endLine - startLine + 1;
 
     Q_ASSERT(size >= mergedLines * _columns);
+    Q_ASSERT(linesToCopy.size() >= mergedLines);
     Q_UNUSED(size);
 
-    const int linesInHistoryBuffer = qBound(0, _history->getLines() - startLine, mergedLines);
-    const int linesInScreenBuffer = mergedLines - linesInHistoryBuffer;
+    // copy runs of consecutive lines at once
+    int line = 0;
+    while (line < mergedLines) {
+        if (!linesToCopy.testBit(line)) {
+            line++;
+            continue;
+        }
+
+        int runEnd = line + 1;
+        while (runEnd < mergedLines && linesToCopy.testBit(runEnd))
+            runEnd++;
+
+        copyImageLines(dest + line * _columns, startLine + line, runEnd - line);
+        line = runEnd;
+    }
+
+    // mark the character at the current cursor position, unless the
+    // line which holds it has been left alone
+    const int cursorIndex = cursorImageIndex(startLine, mergedLines);
+    if (getMode(MODE_Cursor) && cursorIndex < _columns * mergedLines &&
+            linesToCopy.testBit(cursorIndex / _columns))
+        dest[cursorIndex].rendition |= RE_CURSOR;
+}
+
+void Screen::copyImageLines(Character* dest, int startLine, int count) const
+{
+    const int linesInHistoryBuffer = qBound(0, _wrapIndex.getLines() - startLine, count);
+    const int linesInScreenBuffer = count - linesInHistoryBuffer;
 
     // copy _lines from history buffer
     if (linesInHistoryBuffer > 0)
@@ -459,28 +697,30 @@ void Screen::getImage(Character* dest, int size, int startLine, int endLine) con
     // copy _lines from screen buffer
     if (linesInScreenBuffer > 0)
         copyFromScreen(dest + linesInHistoryBuffer * _columns,
-                       startLine + linesInHistoryBuffer - _history->getLines(),
+                       startLine + linesInHistoryBuffer - _wrapIndex.getLines(),
                        linesInScreenBuffer);
 
     // invert display when in screen mode
     if (getMode(MODE_Screen)) {
-        for (int i = 0; i < mergedLines * _columns; i++)
+        for (int i = 0; i < count * _columns; i++)
             reverseRendition(dest[i]); // for reverse display
     }
+}
 
-    // mark the character at the current cursor position
-    int cursorIndex = loc(_cuX, _cuY + linesInHistoryBuffer);
-    if (getMode(MODE_Cursor) && cursorIndex < _columns * mergedLines)
-        dest[cursorIndex].rendition |= RE_CURSOR;
+int Screen::cursorImageIndex(int startLine, int count) const
+{
+    const int linesInHistoryBuffer = qBound(0, _wrapIndex.getLines() - startLine, count);
+
+    return loc(_cuX, _cuY + linesInHistoryBuffer);
 }
 
 QVector<LineProperty> Screen::getLineProperties(int startLine , int endLine) const
 {
     Q_ASSERT(startLine >= 0);
-    Q_ASSERT(endLine >= startLine && endLine < _history->getLines() + _lines);
+    Q_ASSERT(endLine >= startLine && endLine < _wrapIndex.getLines() + _lines);
 
     const int mergedLines = endLine - startLine + 1;
-    const int linesInHistory = qBound(0, _history->getLines() - startLine, mergedLines);
+    const int linesInHistory = qBound(0, _wrapIndex.getLines() - startLine, mergedLines);
     const int linesInScreen = mergedLines - linesInHistory;
 
     QVector<LineProperty> result(mergedLines);
@@ -489,14 +729,14 @@ QVector<LineProperty> Screen::getLineProperties(int startLine , int endLine) con
     // copy properties for _lines in history
     for (int line = startLine; line < startLine + linesInHistory; line++) {
         //TODO Support for line properties other than wrapped _lines
-        if (_history->isWrappedLine(line)) {
+        if (_wrapIndex.isWrappedLine(line)) {
             result[index] = (LineProperty)(result[index] | LINE_WRAPPED);
         }
         index++;
     }
 
     // copy properties for _lines in screen buffer
-    const int firstScreenLine = startLine + linesInHistory - _history->getLines();
+    const int firstScreenLine = startLine + linesInHistory - _wrapIndex.getLines();
     for (int line = firstScreenLine; line < firstScreenLine + linesInScreen; line++) {
         result[index] = _lineProperties[line];
         index++;
@@ -505,6 +745,55 @@ QVector<LineProperty> Screen::getLineProperties(int startLine , int endLine) con
     return result;
 }
 
+QVector<quint64> Screen::getLineStamps(int startLine , int endLine) const
+{
+    Q_ASSERT(startLine >= 0);
+    Q_ASSERT(endLine >= startLine && endLine < _wrapIndex.getLines() + _lines);
+
+    const int historyLines = _wrapIndex.getLines();
+    const int mergedLines = endLine - startLine + 1;
+    const int linesInHistory = qBound(0, historyLines - startLine, mergedLines);
+
+    QVector<quint64> result(mergedLines);
+
+    // lines in the history do not change once they have been added, so
+    // their stamp is simply their position in the sequence of added lines
+    const quint64 firstHistoryLine = _wrapIndex.firstLineSerial();
+    for (int index = 0; index < linesInHistory; index++)
+        result[index] = HISTORY_LINE_STAMP | (firstHistoryLine + startLine + index);
+
+    const int firstScreenLine = startLine + linesInHistory - historyLines;
+    for (int index = linesInHistory; index < mergedLines; index++)
+        result[index] = _lineStamps[firstScreenLine + index - linesInHistory];
+
+    // the line which getImage() draws the cursor into
+    const int cursorIndex = cursorImageIndex(startLine, mergedLines) / _columns;
+    if (cursorIndex < mergedLines)
+        result[cursorIndex] = 0;
+
+    return result;
+}
+
+quint64 Screen::imageStamp() const
+{
+    return _imageStamp;
+}
+
+quint64 Screen::nextStamp()
+{
+    return _stampBase | (++_lastStamp & STAMP_COUNTER_MASK);
+}
+
+void Screen::lineChanged(int line)
+{
+    _lineStamps[line] = nextStamp();
+}
+
+void Screen::imageChanged()
+{
+    _imageStamp = nextStamp();
+}
+
 void Screen::reset(bool clearScreen)
 {
     setMode(MODE_Wrap);
@@ -547,6 +836,7 @@ void Screen::backspace()
     if (BS_CLEARS) {
         _screenLines[_cuY][_cuX].character = ' ';
         _screenLines[_cuY][_cuX].rendition = _screenLines[_cuY][_cuX].rendition & ~RE_EXTENDED_CHAR;
+        lineChanged(_cuY);
     }
 }
 
@@ -612,7 +902,7 @@ void Screen::checkSelection(int from, int to)
 {
     if (_selBegin == -1)
         return;
-    const int scr_TL = loc(0, _history->getLines());
+    const int scr_TL = loc(0, _wrapIndex.getLines());
     //Clear entire selection if it overlaps region [from, to]
     if ((_selBottomRight >= (from + scr_TL)) && (_selTopLeft <= (to + scr_TL)))
         clearSelection();
@@ -674,12 +964,14 @@ void Screen::displayCharacter(unsigned short c)
                 delete[] chars;
             }
         }
+        lineChanged(charToCombineWithY);
         return;
     }
 
     if (_cuX + w > _columns) {
         if (getMode(MODE_Wrap)) {
             _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] | LINE_WRAPPED);
+            lineChanged(_cuY);
             nextLine();
         } else {
             _cuX = _columns - w;
@@ -698,6 +990,8 @@ void Screen::displayCharacter(unsigned short c)
     // check if selection is still valid.
     checkSelection(_lastPos, _lastPos);
 
+    lineChanged(_cuY);
+
     Character& currentChar = _screenLines[_cuY][_cuX];
 
     currentChar.character = c;
@@ -726,6 +1020,50 @@ void Screen::displayCharacter(unsigned short c)
     _cuX = newCursorX;
 }
 
+void Screen::displayCharacters(const quint16* chars, int count)
+{
+    // all characters of the run share the current rendition
+    const Character cell(' ', _effectiveForeground, _effectiveBackground, _effectiveRendition, true);
+
+    int i = 0;
+    while (i < count) {
+        // Wide characters, characters which combine with the previous one,
+        // wrapping and insert mode are left to displayCharacter().
+        if (konsole_wcwidth(chars[i]) != 1 || _cuX >= _columns || getMode(MODE_Insert)) {
+            displayCharacter(chars[i++]);
+            continue;
+        }
+
+        // the rest of the run which fits on the current line
+        int runEnd = i + 1;
+        const int lineEnd = qMin(count, i + _columns - _cuX);
+        while (runEnd < lineEnd && konsole_wcwidth(chars[runEnd]) == 1)
+            runEnd++;
+        const int runLength = runEnd - i;
+
+        ImageLine& line = _screenLines[_cuY];
+        if (line.size() < _cuX + runLength)
+            line.resize(_cuX + runLength);
+
+        const int firstPos = loc(_cuX, _cuY);
+        _lastPos = firstPos + runLength - 1;
+
+        // check if selection is still valid.
+        checkSelection(firstPos, _lastPos);
+
+        lineChanged(_cuY);
+
+        Character* dest = line.data() + _cuX;
+        for (int j = 0; j < runLength; j++) {
+            dest[j] = cell;
+            dest[j].character = chars[i + j];
+        }
+
+        _cuX += runLength;
+        i = runEnd;
+    }
+}
+
 int Screen::scrolledLines() const
 {
     return _scrolledLines;
@@ -743,6 +1081,22 @@ void Screen::resetScrolledLines()
     _scrolledLines = 0;
 }
 
+void Screen::addUsedTrueColors(QSet<int>& indexes)
+{
+    for (int i = 0; i < _lines; i++)
+        addTrueColorIndexes(_screenLines[i].constData(), _screenLines[i].count(), indexes);
+
+    // the colors for the characters which are yet to be displayed
+    const Character rendition(' ', _currentForeground, _currentBackground);
+    const Character effective(' ', _effectiveForeground, _effectiveBackground);
+    const Character saved(' ', _savedState.foreground, _savedState.background);
+    addTrueColorIndexes(&rendition, 1, indexes);
+    addTrueColorIndexes(&effective, 1, indexes);
+    addTrueColorIndexes(&saved, 1, indexes);
+
+    _history->addUsedTrueColors(indexes);
+}
+
 void Screen::scrollUp(int n)
 {
     if (n == 0) n = 1; // Default
@@ -831,7 +1185,7 @@ int Screen::getCursorY() const
 
 void Screen::clearImage(int loca, int loce, char c)
 {
-    const int scr_TL = loc(0, _history->getLines());
+    const int scr_TL = loc(0, _wrapIndex.getLines());
     //FIXME: check positions
 
     //Clear entire selection if it overlaps region to be moved...
@@ -850,6 +1204,7 @@ void Screen::clearImage(int loca, int loce, char c)
 
     for (int y = topLine; y <= bottomLine; y++) {
         _lineProperties[y] = 0;
+        lineChanged(y);
 
         const int endCol = (y == bottomLine) ? loce % _columns : _columns - 1;
         const int startCol = (y == topLine) ? loca % _columns : 0;
@@ -884,11 +1239,13 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
         for (int i = 0; i <= lines; i++) {
             _screenLines[(dest / _columns) + i ] = _screenLines[(sourceBegin / _columns) + i ];
             _lineProperties[(dest / _columns) + i] = _lineProperties[(sourceBegin / _columns) + i];
+            _lineStamps[(dest / _columns) + i] = _lineStamps[(sourceBegin / _columns) + i];
         }
     } else {
         for (int i = lines; i >= 0; i--) {
             _screenLines[(dest / _columns) + i ] = _screenLines[(sourceBegin / _columns) + i ];
             _lineProperties[(dest / _columns) + i] = _lineProperties[(sourceBegin / _columns) + i];
+            _lineStamps[(dest / _columns) + i] = _lineStamps[(sourceBegin / _columns) + i];
         }
     }
 
@@ -901,9 +1258,12 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
 
     // Adjust selection to follow scroll.
     if (_selBegin != -1) {
+        // the selection does not necessarily move along with the lines
+        imageChanged();
+
         const bool beginIsTL = (_selBegin == _selTopLeft);
         const int diff = dest - sourceBegin; // Scroll by this amount
-        const int scr_TL = loc(0, _history->getLines());
+        const int scr_TL = loc(0, _wrapIndex.getLines());
         const int srca = sourceBegin + scr_TL; // Translate index from screen to global
         const int srce = sourceEnd + scr_TL; // Translate index from screen to global
         const int desta = srca + diff;
@@ -1020,6 +1380,9 @@ void Screen::setBackColor(int space, int color)
 
 void Screen::clearSelection()
 {
+    if (_selBegin != -1)
+        imageChanged();
+
     _selBottomRight = -1;
     _selTopLeft = -1;
     _selBegin = -1;
@@ -1054,6 +1417,8 @@ void Screen::setSelectionStart(const int x, const int y, const bool blockSelecti
     _selBottomRight = _selBegin;
     _selTopLeft = _selBegin;
     _blockSelectionMode = blockSelectionMode;
+
+    imageChanged();
 }
 
 void Screen::setSelectionEnd(const int x, const int y)
@@ -1085,6 +1450,40 @@ void Screen::setSelectionEnd(const int x, const int y)
         _selTopLeft = loc(qMin(topColumn, bottomColumn), topRow);
         _selBottomRight = loc(qMax(topColumn, bottomColumn), bottomRow);
     }
+
+    imageChanged();
+}
+
+bool Screen::selectedColumns(int line, int& startColumn, int& endColumn) const
+{
+    if (_selBegin == -1)
+        return false;
+
+    const int topLine = _selTopLeft / _columns;
+    const int bottomLine = _selBottomRight / _columns;
+    if (line < topLine || line > bottomLine)
+        return false;
+
+    if (_blockSelectionMode) {
+        startColumn = _selTopLeft % _columns;
+        endColumn = _selBottomRight % _columns;
+    } else {
+        startColumn = (line == topLine) ? _selTopLeft % _columns : 0;
+        endColumn = (line == bottomLine) ? _selBottomRight % _columns : _columns - 1;
+    }
+
+    return startColumn <= endColumn;
+}
+
+void Screen::reverseSelection(Character* dest, int line) const
+{
+    int startColumn;
+    int endColumn;
+    if (!selectedColumns(line, startColumn, endColumn))
+        return;
+
+    for (int column = startColumn; column <= endColumn; column++)
+        reverseRendition(dest[column]);
 }
 
 bool Screen::isSelected(const int x, const int y) const
@@ -1196,8 +1595,8 @@ int Screen::copyLineToStream(int line ,
     LineProperty currentLineProperties = 0;
 
     //determine if the line is in the history buffer or the screen image
-    if (line < _history->getLines()) {
-        const int lineLength = _history->getLineLen(line);
+    if (line < _wrapIndex.getLines()) {
+        const int lineLength = _wrapIndex.getLineLen(line);
 
         // ensure that start position is before end of line
         start = qMin(start, qMax(0, lineLength - 1));
@@ -1214,11 +1613,11 @@ int Screen::copyLineToStream(int line ,
         // safety checks
         Q_ASSERT(start >= 0);
         Q_ASSERT(count >= 0);
-        Q_ASSERT((start + count) <= _history->getLineLen(line));
+        Q_ASSERT((start + count) <= _wrapIndex.getLineLen(line));
 
-        _history->getCells(line, start, count, characterBuffer);
+        _wrapIndex.getCells(line, start, count, characterBuffer);
 
-        if (_history->isWrappedLine(line))
+        if (_wrapIndex.isWrappedLine(line))
             currentLineProperties |= LINE_WRAPPED;
     } else {
         if (count == -1)
@@ -1226,7 +1625,7 @@ int Screen::copyLineToStream(int line ,
 
         Q_ASSERT(count >= 0);
 
-        int screenLine = line - _history->getLines();
+        int screenLine = line - _wrapIndex.getLines();
 
         Q_ASSERT(screenLine <= _screenLinesSize);
 
@@ -1290,19 +1689,34 @@ void Screen::addHistLine()
     // we have to take care about scrolling, too...
 
     if (hasScroll()) {
-        const int oldHistLines = _history->getLines();
+        const int oldHistLines = _wrapIndex.getLines();
+        const qint64 oldFirstLine = _wrapIndex.firstLineSerial();
+        const int oldScrollLines = _history->getLines();
 
         _history->addCellsVector(_screenLines[0]);
         _history->addLine(_lineProperties[0] & LINE_WRAPPED);
+        const bool historyUnchanged = _wrapIndex.lineAdded();
+        addToSearchIndex(_screenLines[0], _lineProperties[0] & LINE_WRAPPED, oldScrollLines);
+        _historyLinesAdded++;
 
-        const int newHistLines = _history->getLines();
-
-        const bool beginIsTL = (_selBegin == _selTopLeft);
+        const int newHistLines = _wrapIndex.getLines();
+        const int droppedLines = _wrapIndex.firstLineSerial() - oldFirstLine;
 
         // If the history is full, increment the count
         // of dropped _lines
-        if (newHistLines == oldHistLines)
-            _droppedLines++;
+        _droppedLines += droppedLines;
+
+        // The line usually becomes one more line in the history.  When it
+        // is re-wrapped into some other number of lines, or lines already in
+        // the history are re-wrapped, the selection can not follow
+        if (!historyUnchanged || newHistLines - oldHistLines + droppedLines != 1 ||
+                droppedLines > 1) {
+            clearSelection();
+            imageChanged();
+            return;
+        }
+
+        const bool beginIsTL = (_selBegin == _selTopLeft);
 
         // Adjust selection for the new point of reference
         if (newHistLines > oldHistLines) {
@@ -1313,6 +1727,8 @@ void Screen::addHistLine()
         }
 
         if (_selBegin != -1) {
+            imageChanged();
+
             // Scroll selection in history up
             const int top_BR = loc(0, 1 + newHistLines);
 
@@ -1339,12 +1755,117 @@ void Screen::addHistLine()
 
 int Screen::getHistLines() const
 {
-    return _history->getLines();
+    return _wrapIndex.getLines();
+}
+
+// returns the text of 'line' as PlainTextDecoder decodes it, so that the
+// trigrams in the search index match those of the text which is searched
+static QString searchIndexText(const QVector<Character>& line)
+{
+    QString text;
+    text.reserve(line.count());
+
+    for (int i = 0; i < line.count();) {
+        const Character& character = line[i];
+        if (character.rendition & RE_EXTENDED_CHAR) {
+            ushort extendedCharLength = 0;
+            const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(character.character, extendedCharLength);
+            if (chars) {
+                const QString s = QString::fromUtf16(chars, extendedCharLength);
+                text.append(s);
+                i += qMax(1, string_width(s));
+            } else {
+                i++;
+            }
+        } else {
+            text.append(QChar(character.character));
+            i += qMax(1, konsole_wcwidth(character.character));
+        }
+    }
+
+    return text;
+}
+
+void Screen::addToSearchIndex(const QVector<Character>& line, bool wrapped, int oldScrollLines)
+{
+    if (!_searchIndexEnabled)
+        return;
+
+    if (_searchIndex.lineCount() == oldScrollLines) {
+        _searchIndex.addLine(searchIndexText(line), wrapped);
+
+        // the oldest lines are dropped when the history is full
+        const int historyLines = _history->getLines();
+        if (_searchIndex.lineCount() > historyLines)
+            _searchIndex.removeLines(_searchIndex.lineCount() - historyLines);
+    } else {
+        // the index is still being filled by indexHistory(), which also
+        // picks up the new line
+        const int droppedLines = oldScrollLines + 1 - _history->getLines();
+        if (droppedLines > 0)
+            _searchIndex.removeLines(qMin(droppedLines, _searchIndex.lineCount()));
+    }
+}
+
+bool Screen::indexHistory(int lineCount)
+{
+    const int historyLines = _history->getLines();
+    const int end = qMin(historyLines, _searchIndex.lineCount() + lineCount);
+
+    ImageLine line;
+    for (int i = _searchIndex.lineCount(); i < end; i++) {
+        line.resize(_history->getLineLen(i));
+        _history->getCells(i, 0, line.count(), line.data());
+        _searchIndex.addLine(searchIndexText(line), _history->isWrappedLine(i));
+    }
+
+    return _searchIndex.lineCount() == historyLines;
+}
+
+int Screen::findSearchLine(const QString& text, int startLine, int endLine)
+{
+    const int histLines = _wrapIndex.getLines();
+    const QVector<int> keys = HistorySearchIndex::trigramKeys(text);
+
+    // lines on the screen are not indexed
+    if (keys.isEmpty() || startLine >= histLines)
+        return startLine;
+
+    // The history is only indexed once it is searched, and then a batch of
+    // lines at a time, so that neither the output nor the first search in
+    // a large history are held up.  No lines are skipped until the index
+    // is complete.
+    _searchIndexEnabled = true;
+    if (!indexHistory(SEARCH_INDEX_BATCH_LINES))
+        return startLine;
+
+    const bool forwards = (startLine <= endLine);
+    const int lastHistLine = qBound(0, endLine, histLines - 1);
+    const int line = _searchIndex.findLine(_wrapIndex.scrollLine(startLine),
+                                           _wrapIndex.scrollLine(lastHistLine), keys);
+
+    if (forwards) {
+        if (line != -1)
+            return qMax(startLine, _wrapIndex.wrappedLine(line));
+        else
+            return (endLine >= histLines) ? histLines : -1;
+    } else {
+        if (line == -1)
+            return -1;
+
+        // the text may continue on the wrapped lines up to the next line
+        // of the scroll
+        if (line + 1 < _searchIndex.lineCount())
+            return qMin(startLine, _wrapIndex.wrappedLine(line + 1));
+        else
+            return startLine;
+    }
 }
 
 void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
 {
     clearSelection();
+    imageChanged();
 
     if (copyPreviousScroll) {
         _history = t.scroll(_history);
@@ -1353,6 +1874,34 @@ void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
         _history = t.scroll(0);
         delete oldScroll;
     }
+
+    _wrapIndex.setScroll(_history);
+    _wrapIndex.reset();
+
+    // the lines are indexed again by the next searches
+    _searchIndex.clear();
+}
+
+bool Screen::isMigratingHistory() const
+{
+    return dynamic_cast<HistoryScrollMigration*>(_history) != 0;
+}
+
+bool Screen::migrateHistory(int lineCount)
+{
+    HistoryScrollMigration* migration = dynamic_cast<HistoryScrollMigration*>(_history);
+    if (!migration)
+        return true;
+
+    if (!migration->migrate(lineCount))
+        return false;
+
+    // the new scroll holds the same lines, so the selection and the
+    // wrapped lines remain valid
+    _history = migration->takeTarget();
+    _wrapIndex.setScroll(_history);
+    delete migration;
+    return true;
 }
 
 bool Screen::hasScroll() const
@@ -1365,12 +1914,39 @@ const HistoryType& Screen::getScroll() const
     return _history->getType();
 }
 
+qint64 Screen::historyMemoryUsage() const
+{
+    return _history->memoryUsage();
+}
+
+qint64 Screen::historyUncompressedMemoryUsage() const
+{
+    return _history->uncompressedMemoryUsage();
+}
+
+qint64 Screen::historyLinesAdded() const
+{
+    return _historyLinesAdded;
+}
+
+bool Screen::saveHistory()
+{
+    return _history->checkpoint();
+}
+
+void Screen::discardSavedHistory()
+{
+    _history->setPersistent(false);
+}
+
 void Screen::setLineProperty(LineProperty property , bool enable)
 {
     if (enable)
         _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] | property);
     else
         _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] & ~property);
+
+    lineChanged(_cuY);
 }
 void Screen::fillWithDefaultChar(Character* dest, int count)
 {
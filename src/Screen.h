@@ -32,6 +32,8 @@
 
 // Konsole
 #include "Character.h"
+#include "History.h"
+#include "konsole_export.h"
 
 #define MODE_Origin    0
 #define MODE_Wrap      1
@@ -45,8 +47,6 @@ namespace Konsole
 {
 class TerminalCharacterDecoder;
 class TerminalDisplay;
-class HistoryType;
-class HistoryScroll;
 
 /**
     \brief An image of characters with associated attributes.
@@ -71,7 +71,7 @@ class HistoryScroll;
     using selectedText().  When getImage() is used to retrieve the visible image,
     characters which are part of the selection have their colors inverted.
 */
-class Screen
+class KONSOLEPRIVATE_EXPORT Screen
 {
 public:
     /** Construct a new screen image of size @p lines by @p columns. */
@@ -346,18 +346,56 @@ public:
      */
     void displayCharacter(unsigned short c);
 
+    /**
+     * Displays @p count characters from @p chars at the current cursor position,
+     * as if displayCharacter() had been called for each of them in turn.
+     *
+     * Runs of single width characters are written to the current line in one go,
+     * resizing the line and checking the selection once for the whole run.
+     */
+    void displayCharacters(const quint16* chars, int count);
+
     /**
      * Resizes the image to a new fixed size of @p new_lines by @p new_columns.
-     * In the case that @p new_columns is smaller than the current number of columns,
+     *
+     * If reflowing lines is enabled, see setReflowLines(), lines which were
+     * wrapped are joined and wrapped again at the new width.  Otherwise, in the
+     * case that @p new_columns is smaller than the current number of columns,
      * existing lines are not truncated.  This prevents characters from being lost
      * if the terminal display is resized smaller and then larger again.
      *
-     * The top and bottom margins are reset to the top and bottom of the new
-     * screen size.  Tab stops are also reset and the current selection is
-     * cleared.
+     * Lines in the history are always wrapped again at the new width, when
+     * they are read.
+     *
+     * The top and bottom margins are kept if they still fit, otherwise they
+     * are reset to the top and bottom of the new screen size.  Tab stops are
+     * also reset and the current selection is cleared.
      */
     void resizeImage(int new_lines, int new_columns);
 
+    /**
+     * Sets whether resizeImage() wraps the lines of the screen again at the
+     * new width.  This is useful for the primary screen, whose output stays
+     * around, but not for the alternate screen, which is usually redrawn by
+     * the program after a resize anyway.
+     */
+    void setReflowLines(bool reflow);
+
+    /**
+     * Returns the first line from @p startLine to @p endLine which may
+     * contain @p text, or -1 if none of the lines may contain it.  If
+     * @p endLine is before @p startLine, the last line which may contain the
+     * text is returned instead.
+     *
+     * Lines in the history which do not contain all sequences of three
+     * characters of @p text, ignoring case, are skipped.  Lines on the screen
+     * may always contain the text.
+     *
+     * The history is indexed for this in batches, starting with the first
+     * search.  Until all of it is indexed, no lines are skipped.
+     */
+    int findSearchLine(const QString& text, int startLine, int endLine);
+
     /**
      * Returns the current screen image.
      * The result is an array of Characters of size [getLines()][getColumns()] which
@@ -370,6 +408,15 @@ public:
      */
     void getImage(Character* dest , int size , int startLine , int endLine) const;
 
+    /**
+     * Like getImage(), but only copies the lines for which the corresponding
+     * bit in @p linesToCopy is set.  The other lines of @p dest are left
+     * untouched.  This is used to update an image which was retrieved
+     * earlier, when getLineStamps() shows that most lines have not changed.
+     */
+    void getImage(Character* dest , int size , int startLine , int endLine ,
+                  const QBitArray& linesToCopy) const;
+
     /**
      * Returns the additional attributes associated with lines in the image.
      * The most important attribute is LINE_WRAPPED which specifies that the
@@ -378,6 +425,26 @@ public:
      */
     QVector<LineProperty> getLineProperties(int startLine , int endLine) const;
 
+    /**
+     * Returns a stamp for each line in the image between @p startLine and
+     * @p endLine, numbered as for getImage().
+     *
+     * A line's stamp changes whenever the characters or properties of the
+     * line change, so a line which has the same stamp in two images, taken
+     * while imageStamp() was the same, is identical in both.  The line which
+     * holds the cursor always has the stamp 0, which never compares equal
+     * to an earlier stamp.
+     */
+    QVector<quint64> getLineStamps(int startLine , int endLine) const;
+
+    /**
+     * Returns a stamp which changes whenever the image returned by getImage()
+     * changes in a way which is not covered by the line stamps, for example
+     * because the selection, the screen mode, the history or the size of
+     * the screen has changed.
+     */
+    quint64 imageStamp() const;
+
     /** Return the number of lines. */
     int getLines() const {
         return _lines;
@@ -396,6 +463,37 @@ public:
     void setScroll(const HistoryType& , bool copyPreviousScroll = true);
     /** Returns the type of storage used to keep lines in the history. */
     const HistoryType& getScroll() const;
+    /**
+     * Returns true if the history is still being converted after a call to
+     * setScroll(), see migrateHistory().
+     */
+    bool isMigratingHistory() const;
+    /**
+     * Continues converting the history into the type set with setScroll(),
+     * copying up to @p lineCount lines.  Returns true once the conversion
+     * is complete.
+     */
+    bool migrateHistory(int lineCount);
+    /** Returns the number of bytes of memory used by the history buffer. */
+    qint64 historyMemoryUsage() const;
+    /**
+     * Returns the number of bytes of memory the history buffer would use
+     * if none of it was compressed.
+     */
+    qint64 historyUncompressedMemoryUsage() const;
+    /**
+     * Returns the number of lines which have been added to the history
+     * buffer, for diagnostics.
+     */
+    qint64 historyLinesAdded() const;
+    /**
+     * Writes out the history so that it can be reopened later on, and keeps
+     * it when the screen is deleted.  Returns false if the history type
+     * does not support this.
+     */
+    bool saveHistory();
+    /** Undoes saveHistory(), the stored history is removed along with the screen. */
+    void discardSavedHistory();
     /**
      * Returns true if this screen keeps lines that are scrolled off the screen
      * in a history buffer.
@@ -583,6 +681,13 @@ public:
         return result;
     }
 
+    /**
+     * Adds the positions in the table of RGB colors of the colors which
+     * the screen and its history hold to @p indexes, see
+     * CharacterColor::beginTrueColorReclaim().
+     */
+    void addUsedTrueColors(QSet<int>& indexes);
+
     static const Character DefaultChar;
 
 private:
@@ -632,6 +737,19 @@ private:
     void reverseRendition(Character& p) const;
 
     bool isSelectionValid() const;
+    // finds the columns of 'line' which are selected, where 0 is the first
+    // line in the history.  returns false if no part of the line is selected
+    bool selectedColumns(int line, int& startColumn, int& endColumn) const;
+    // reverses the rendition of the selected part of 'line', which has
+    // been copied into 'dest'
+    void reverseSelection(Character* dest, int line) const;
+
+    // returns a stamp which the screen has not used before
+    quint64 nextStamp();
+    // gives 'line' of the screen a new stamp
+    void lineChanged(int line);
+    // gives the image a new stamp, see imageStamp()
+    void imageChanged();
     // copies text from 'startIndex' to 'endIndex' to a stream
     // startIndex and endIndex are positions generated using the loc(x,y) macro
     void writeToStream(TerminalCharacterDecoder* decoder, int startIndex,
@@ -642,6 +760,22 @@ private:
     // copies 'count' lines from the history buffer into 'dest',
     // starting from 'startLine', where 0 is the first line in the history
     void copyFromHistory(Character* dest, int startLine, int count) const;
+    // copies 'count' lines of the image into 'dest', starting from
+    // 'startLine', where 0 is the first line in the history
+    void copyImageLines(Character* dest, int startLine, int count) const;
+    // returns the index of the character which getImage() marks as the
+    // cursor in an image of 'count' lines starting from 'startLine'
+    int cursorImageIndex(int startLine, int count) const;
+    // wraps the lines of the screen again at 'new_columns' and fits them
+    // into 'new_lines', moving lines at the top into the history if needed
+    void reflowLines(int new_lines, int new_columns);
+
+    // adds a line which has been added to the history, which held
+    // 'oldScrollLines' lines before, to _searchIndex
+    void addToSearchIndex(const QVector<Character>& line, bool wrapped, int oldScrollLines);
+    // adds up to 'lineCount' more lines of the history to _searchIndex,
+    // returns true once all of them are indexed
+    bool indexHistory(int lineCount);
 
     // screen image ----------------
     int _lines;
@@ -655,11 +789,29 @@ private:
     QRect _lastScrolledRegion;
 
     int _droppedLines;
+    qint64 _historyLinesAdded;
 
     QVarLengthArray<LineProperty, 64> _lineProperties;
 
+    QVector<quint64> _lineStamps;         // [lines], see getLineStamps()
+    quint64 _imageStamp;                  // see imageStamp()
+
+    // stamps hold a number which is unique to the screen, so that lines of
+    // different screens never have the same stamp.  Unlike a counter shared
+    // by all screens, this needs no lock when the screens are changed in
+    // different threads, see Emulation::processOutput()
+    quint64 _stampBase;
+    quint64 _lastStamp;
+
     // history buffer ---------------
     HistoryScroll* _history;
+    // the lines of _history wrapped at the current width
+    HistoryWrapIndex _wrapIndex;
+    HistorySearchIndex _searchIndex;
+    // whether _searchIndex is kept, which it is once the history is searched
+    bool _searchIndexEnabled;
+
+    bool _reflowLines;
 
     // cursor location
     int _cuX;
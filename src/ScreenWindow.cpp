@@ -27,9 +27,12 @@ using namespace Konsole;
 
 ScreenWindow::ScreenWindow(QObject* parent)
     : QObject(parent)
+    , _screenLock(0)
     , _windowBuffer(0)
     , _windowBufferSize(0)
     , _bufferNeedsUpdate(true)
+    , _imageStamp(0)
+    , _bufferScrollCount(0)
     , _windowLines(1)
     , _currentLine(0)
     , _currentResultLine(-1)
@@ -46,6 +49,7 @@ void ScreenWindow::setScreen(Screen* screen)
 {
     Q_ASSERT(screen);
 
+    QMutexLocker locker(_screenLock);
     _screen = screen;
 }
 
@@ -54,22 +58,62 @@ Screen* ScreenWindow::screen() const
     return _screen;
 }
 
+void ScreenWindow::setScreenLock(QMutex* lock)
+{
+    _screenLock = lock;
+}
+
+QMutex* ScreenWindow::screenLock() const
+{
+    return _screenLock;
+}
+
 Character* ScreenWindow::getImage()
 {
+    QMutexLocker locker(_screenLock);
+
     // reallocate internal buffer if the window size has changed
     int size = windowLines() * windowColumns();
+    bool bufferValid = true;
     if (_windowBuffer == 0 || _windowBufferSize != size) {
         delete[] _windowBuffer;
         _windowBufferSize = size;
         _windowBuffer = new Character[size];
         _bufferNeedsUpdate = true;
+        bufferValid = false;
     }
 
     if (!_bufferNeedsUpdate)
         return _windowBuffer;
 
-    _screen->getImage(_windowBuffer, size,
-                      currentLine(), endWindowLine());
+    QVector<quint64> lineStamps = _screen->getLineStamps(currentLine(), endWindowLine());
+    lineStamps.resize(windowLines());
+
+    // the lines of the existing buffer can be reused if they still have the
+    // same stamp, see Screen::getLineStamps()
+    bufferValid = bufferValid
+                  && _imageStamp == _screen->imageStamp()
+                  && _lineStamps.count() == windowLines();
+
+    if (bufferValid) {
+        scrollWindowBuffer(_bufferScrollCount);
+
+        QBitArray linesToCopy(windowLines());
+        for (int line = 0; line < windowLines(); line++) {
+            if (lineStamps[line] == 0 || lineStamps[line] != _lineStamps[line])
+                linesToCopy.setBit(line);
+        }
+
+        _screen->getImage(_windowBuffer, size,
+                          currentLine(), endWindowLine(), linesToCopy);
+    } else {
+        _screen->getImage(_windowBuffer, size,
+                          currentLine(), endWindowLine());
+    }
+
+    _lineStamps = lineStamps;
+    _imageStamp = _screen->imageStamp();
+    _bufferScrollCount = 0;
 
     // this window may look beyond the end of the screen, in which
     // case there will be an unused area which needs to be filled
@@ -97,6 +141,42 @@ void ScreenWindow::fillUnusedArea()
     Screen::fillWithDefaultChar(_windowBuffer + _windowBufferSize - charsToFill, charsToFill);
 }
 
+// moves the lines of the window buffer, together with their stamps, up by
+// 'lines' lines if it is positive or down otherwise.  the lines which are
+// exposed keep their old content but get the stamp 0 so that they are
+// fetched again from the screen.
+void ScreenWindow::scrollWindowBuffer(int lines)
+{
+    const int windowLineCount = windowLines();
+    const int columns = windowColumns();
+
+    if (lines == 0)
+        return;
+
+    if (qAbs(lines) >= windowLineCount) {
+        _lineStamps.fill(0);
+        return;
+    }
+
+    const int linesToMove = windowLineCount - qAbs(lines);
+
+    if (lines > 0) {
+        memmove(_windowBuffer, _windowBuffer + lines * columns,
+                linesToMove * columns * sizeof(Character));
+        memmove(_lineStamps.data(), _lineStamps.data() + lines,
+                linesToMove * sizeof(quint64));
+        for (int line = linesToMove; line < windowLineCount; line++)
+            _lineStamps[line] = 0;
+    } else {
+        memmove(_windowBuffer - lines * columns, _windowBuffer,
+                linesToMove * columns * sizeof(Character));
+        memmove(_lineStamps.data() - lines, _lineStamps.data(),
+                linesToMove * sizeof(quint64));
+        for (int line = 0; line < -lines; line++)
+            _lineStamps[line] = 0;
+    }
+}
+
 // return the index of the line at the end of this window, or if this window
 // goes beyond the end of the screen, the index of the line at the end
 // of the screen.
@@ -111,6 +191,8 @@ int ScreenWindow::endWindowLine() const
 }
 QVector<LineProperty> ScreenWindow::getLineProperties()
 {
+    QMutexLocker locker(_screenLock);
+
     QVector<LineProperty> result = _screen->getLineProperties(currentLine(), endWindowLine());
 
     if (result.count() != windowLines())
@@ -119,23 +201,40 @@ QVector<LineProperty> ScreenWindow::getLineProperties()
     return result;
 }
 
+QVector<quint64> ScreenWindow::getLineStamps() const
+{
+    return _lineStamps;
+}
+
+quint64 ScreenWindow::imageStamp() const
+{
+    return _imageStamp;
+}
+
 QString ScreenWindow::selectedText(bool preserveLineBreaks, bool trimTrailingSpaces) const
 {
+    QMutexLocker locker(_screenLock);
     return _screen->selectedText(preserveLineBreaks, trimTrailingSpaces);
 }
 
 void ScreenWindow::getSelectionStart(int& column , int& line)
 {
+    QMutexLocker locker(_screenLock);
+
     _screen->getSelectionStart(column, line);
     line -= currentLine();
 }
 void ScreenWindow::getSelectionEnd(int& column , int& line)
 {
+    QMutexLocker locker(_screenLock);
+
     _screen->getSelectionEnd(column, line);
     line -= currentLine();
 }
 void ScreenWindow::setSelectionStart(int column , int line , bool columnMode)
 {
+    QMutexLocker locker(_screenLock);
+
     _screen->setSelectionStart(column , line + currentLine() , columnMode);
 
     _bufferNeedsUpdate = true;
@@ -144,6 +243,8 @@ void ScreenWindow::setSelectionStart(int column , int line , bool columnMode)
 
 void ScreenWindow::setSelectionEnd(int column , int line)
 {
+    QMutexLocker locker(_screenLock);
+
     _screen->setSelectionEnd(column , line + currentLine());
 
     _bufferNeedsUpdate = true;
@@ -152,6 +253,8 @@ void ScreenWindow::setSelectionEnd(int column , int line)
 
 void ScreenWindow::setSelectionByLineRange(int start, int end)
 {
+    QMutexLocker locker(_screenLock);
+
     clearSelection();
 
     _screen->setSelectionStart(0 , start , false);
@@ -163,11 +266,14 @@ void ScreenWindow::setSelectionByLineRange(int start, int end)
 
 bool ScreenWindow::isSelected(int column , int line)
 {
+    QMutexLocker locker(_screenLock);
     return _screen->isSelected(column , qMin(line + currentLine(), endWindowLine()));
 }
 
 void ScreenWindow::clearSelection()
 {
+    QMutexLocker locker(_screenLock);
+
     _screen->clearSelection();
 
     emit selectionChanged();
@@ -185,21 +291,26 @@ int ScreenWindow::windowLines() const
 
 int ScreenWindow::windowColumns() const
 {
+    QMutexLocker locker(_screenLock);
     return _screen->getColumns();
 }
 
 int ScreenWindow::lineCount() const
 {
+    QMutexLocker locker(_screenLock);
     return _screen->getHistLines() + _screen->getLines();
 }
 
 int ScreenWindow::columnCount() const
 {
+    QMutexLocker locker(_screenLock);
     return _screen->getColumns();
 }
 
 QPoint ScreenWindow::cursorPosition() const
 {
+    QMutexLocker locker(_screenLock);
+
     QPoint position;
 
     position.setX(_screen->getCursorX());
@@ -210,6 +321,7 @@ QPoint ScreenWindow::cursorPosition() const
 
 int ScreenWindow::currentLine() const
 {
+    QMutexLocker locker(_screenLock);
     return qBound(0, _currentLine, lineCount() - windowLines());
 }
 
@@ -230,6 +342,8 @@ void ScreenWindow::setCurrentResultLine(int line)
 
 void ScreenWindow::scrollBy(RelativeScrollMode mode, int amount, bool fullPage)
 {
+    QMutexLocker locker(_screenLock);
+
     if (mode == ScrollLines) {
         scrollTo(currentLine() + amount);
     } else if (mode == ScrollPages) {
@@ -242,11 +356,14 @@ void ScreenWindow::scrollBy(RelativeScrollMode mode, int amount, bool fullPage)
 
 bool ScreenWindow::atEndOfOutput() const
 {
+    QMutexLocker locker(_screenLock);
     return currentLine() == (lineCount() - windowLines());
 }
 
 void ScreenWindow::scrollTo(int line)
 {
+    QMutexLocker locker(_screenLock);
+
     int maxCurrentLineNumber = lineCount() - windowLines();
     line = qBound(0, line, maxCurrentLineNumber);
 
@@ -256,6 +373,7 @@ void ScreenWindow::scrollTo(int line)
     // keep track of number of lines scrolled by,
     // this can be reset by calling resetScrollCount()
     _scrollCount += delta;
+    _bufferScrollCount += delta;
 
     _bufferNeedsUpdate = true;
 
@@ -284,6 +402,8 @@ void ScreenWindow::resetScrollCount()
 
 QRect ScreenWindow::scrollRegion() const
 {
+    QMutexLocker locker(_screenLock);
+
     bool equalToScreenSize = windowLines() == _screen->getLines();
 
     if (atEndOfOutput() && equalToScreenSize)
@@ -294,10 +414,13 @@ QRect ScreenWindow::scrollRegion() const
 
 void ScreenWindow::notifyOutputChanged()
 {
+    QMutexLocker locker(_screenLock);
+
     // move window to the bottom of the screen and update scroll count
     // if this window is currently tracking the bottom of the screen
     if (_trackOutput) {
         _scrollCount -= _screen->scrolledLines();
+        _bufferScrollCount -= _screen->scrolledLines();
         _currentLine = qMax(0, _screen->getHistLines() - (windowLines() - _screen->getLines()));
     } else {
         // if the history is not unlimited then it may
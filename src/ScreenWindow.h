@@ -21,6 +21,7 @@
 #define SCREENWINDOW_H
 
 // Qt
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtCore/QPoint>
 #include <QtCore/QRect>
@@ -71,6 +72,21 @@ public:
     /** Returns the screen which this window looks onto */
     Screen* screen() const;
 
+    /**
+     * Sets the lock which protects the screen while the incoming data of
+     * the terminal is processed in another thread, see
+     * Emulation::processOutput().  The window holds the lock whenever it
+     * uses the screen.
+     */
+    void setScreenLock(QMutex* lock);
+    /**
+     * Returns the lock set with setScreenLock(), or 0.  Hold it while using
+     * screen() directly or while calling several methods of the window
+     * which need to see the same state of the screen.  The lock can be
+     * passed to QMutexLocker either way.
+     */
+    QMutex* screenLock() const;
+
     /**
      * Returns the image of characters which are currently visible through this window
      * onto the screen.
@@ -86,6 +102,19 @@ public:
      */
     QVector<LineProperty> getLineProperties();
 
+    /**
+     * Returns a stamp for each line of the image returned by the last call
+     * to getImage().  See Screen::getLineStamps().  Lines which lie beyond
+     * the end of the screen have the stamp 0.
+     */
+    QVector<quint64> getLineStamps() const;
+
+    /**
+     * Returns the stamp of the image returned by the last call to getImage().
+     * See Screen::imageStamp().
+     */
+    quint64 imageStamp() const;
+
     /**
      * Returns the number of lines which the region of the window
      * specified by scrollRegion() has been scrolled by since the last call
@@ -263,11 +292,17 @@ signals:
 private:
     int endWindowLine() const;
     void fillUnusedArea();
+    void scrollWindowBuffer(int lines);
 
     Screen* _screen; // see setScreen() , screen()
+    QMutex* _screenLock; // see setScreenLock()
     Character* _windowBuffer;
     int _windowBufferSize;
     bool _bufferNeedsUpdate;
+    QVector<quint64> _lineStamps;
+    quint64 _imageStamp;
+    int _bufferScrollCount; // count of lines which the window has been scrolled by
+    // since _windowBuffer was last updated
 
     int  _windowLines;
     int  _currentLine; // see scrollTo() , currentLine()
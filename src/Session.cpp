@@ -32,9 +32,11 @@
 // Qt
 #include <QApplication>
 #include <QtGui/QColor>
+#include <QtCore/QDateTime>
 #include <QtCore/QDir>
 #include <QtCore/QFile>
 #include <QtCore/QStringList>
+#include <QtCore/QTextStream>
 #include <QtDBus/QtDBus>
 
 // KDE
@@ -50,10 +52,13 @@
 // Konsole
 #include <sessionadaptor.h>
 
+#include "GlyphRunCache.h"
+#include "Histogram.h"
 #include "ProcessInfo.h"
 #include "Pty.h"
 #include "TerminalDisplay.h"
 #include "ShellCommand.h"
+#include "UpdateScheduler.h"
 #include "Vt102Emulation.h"
 #include "ZModemDialog.h"
 #include "History.h"
@@ -103,10 +108,12 @@ Session::Session(QObject* parent) :
     , _monitorSilence(false)
     , _notifiedActivity(false)
     , _silenceSeconds(10)
+    , _statisticsTimer(0)
     , _autoClose(true)
     , _closePerUserRequest(false)
     , _addToUtmp(true)
     , _flowControlEnabled(true)
+    , _threadedReadingEnabled(false)
     , _sessionId(0)
     , _sessionProcessInfo(0)
     , _foregroundProcessInfo(0)
@@ -160,9 +167,15 @@ Session::Session(QObject* parent) :
 
 Session::~Session()
 {
+    // waits until the output which is being processed in the reading
+    // thread has reached the emulation
+    if (_shellProcess)
+        _shellProcess->setOutputProcessor(0);
+
     delete _foregroundProcessInfo;
     delete _sessionProcessInfo;
     delete _emulation;
+    _emulation = 0;
     delete _shellProcess;
     delete _zmodemProc;
 }
@@ -182,6 +195,8 @@ void Session::openTeletype(int fd)
         _shellProcess = new Pty(fd);
 
     _shellProcess->setUtf8Mode(_emulation->utf8());
+    _shellProcess->setThreadedReading(_threadedReadingEnabled);
+    _shellProcess->setOutputProcessor(_emulation);
 
     // connect the I/O between emulator and pty process
     connect(_shellProcess, SIGNAL(receivedData(const char*,int)),
@@ -339,6 +354,10 @@ void Session::addView(TerminalDisplay* widget)
 
     connect(widget, SIGNAL(destroyed(QObject*)),
             this, SLOT(viewDestroyed(QObject*)));
+
+    // watch for the view being shown and hidden
+    widget->installEventFilter(this);
+    updateThrottling();
 }
 
 void Session::viewDestroyed(QObject* view)
@@ -369,12 +388,37 @@ void Session::removeView(TerminalDisplay* widget)
     // disconnect state change signals emitted by emulation
     disconnect(_emulation, 0, widget, 0);
 
+    widget->removeEventFilter(this);
+    updateThrottling();
+
     // close the session automatically when the last view is removed
     if (_views.count() == 0) {
         close();
     }
 }
 
+bool Session::eventFilter(QObject* object, QEvent* event)
+{
+    if (event->type() == QEvent::Show || event->type() == QEvent::Hide)
+        updateThrottling();
+
+    return QObject::eventFilter(object, event);
+}
+
+void Session::updateThrottling()
+{
+    // a session without views, such as one driven over D-Bus, is never throttled
+    bool throttled = !_views.isEmpty();
+    foreach(TerminalDisplay* view, _views) {
+        if (view->isVisible()) {
+            throttled = false;
+            break;
+        }
+    }
+
+    _emulation->setUpdatesThrottled(throttled);
+}
+
 // Upon a KPty error, there is no description on what that error was...
 // Check to see if the given program is executable.
 QString Session::checkProgram(const QString& program)
@@ -836,6 +880,12 @@ void Session::done(int exitCode, QProcess::ExitStatus exitStatus)
     disconnect(_shellProcess, SIGNAL(finished(int,QProcess::ExitStatus)),
                this, SLOT(done(int,QProcess::ExitStatus)));
 
+    // a session whose program exits by itself is not restored.  Sessions
+    // which are closed keep their history if the session manager is
+    // closing them, see MainWindow::queryClose()
+    if (!_closePerUserRequest)
+        discardSavedHistory();
+
     if (!_autoClose) {
         _userTitle = i18nc("@info:shell This session is done", "Finished");
         emit titleChanged();
@@ -1064,7 +1114,36 @@ QString Session::iconText() const
 
 void Session::setHistoryType(const HistoryType& hType)
 {
-    _emulation->setHistory(hType);
+    // unlimited history is kept in a file named after the session,
+    // so that it can be reopened when the session is restored
+    const HistoryTypeFile* fileHistory = dynamic_cast<const HistoryTypeFile*>(&hType);
+    if (fileHistory && fileHistory->fileName().isEmpty())
+        _emulation->setHistory(HistoryTypeFile(historyFileName()));
+    else
+        _emulation->setHistory(hType);
+}
+
+QString Session::historyFileName() const
+{
+    QString uuid = _uniqueIdentifier.toString();
+    uuid.remove('{').remove('}');
+
+    return historyDirectory() + uuid + QLatin1String(".history");
+}
+
+QString Session::historyDirectory()
+{
+    // the histories are only accessible to the user, see HistoryFile
+    const QString directory = KStandardDirs::locateLocal("data", QLatin1String("konsole/history/"));
+    QFile::setPermissions(directory, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+    return directory;
+}
+
+void Session::discardSavedHistory()
+{
+    // done() may be called while the session is being deleted
+    if (_emulation)
+        _emulation->discardSavedHistory();
 }
 
 const HistoryType& Session::historyType() const
@@ -1164,6 +1243,20 @@ bool Session::flowControlEnabled() const
     else
         return _flowControlEnabled;
 }
+
+void Session::setThreadedReadingEnabled(bool enabled)
+{
+    _threadedReadingEnabled = enabled;
+
+    if (_shellProcess)
+        _shellProcess->setThreadedReading(_threadedReadingEnabled);
+}
+
+bool Session::threadedReadingEnabled() const
+{
+    return _threadedReadingEnabled;
+}
+
 void Session::fireZModemDetected()
 {
     if (!_zmodemBusy) {
@@ -1198,6 +1291,8 @@ void Session::startZModem(const QString& zmodem, const QString& dir, const QStri
 
     _zmodemProc->start();
 
+    // the output goes to the zmodem process instead of the emulation
+    _shellProcess->setOutputProcessor(0);
     disconnect(_shellProcess, SIGNAL(receivedData(const char*,int)),
                this, SLOT(onReceiveBlock(const char*,int)));
     connect(_shellProcess, SIGNAL(receivedData(const char*,int)),
@@ -1268,6 +1363,7 @@ void Session::zmodemFinished()
                    this , SLOT(zmodemReceiveBlock(const char*,int)));
         connect(_shellProcess, SIGNAL(receivedData(const char*,int)),
                 this, SLOT(onReceiveBlock(const char*,int)));
+        _shellProcess->setOutputProcessor(_emulation);
 
         _shellProcess->sendData("\030\030\030\030", 4); // Abort
         _shellProcess->sendData("\001\013\n", 3); // Try to get prompt back
@@ -1388,6 +1484,104 @@ int Session::historySize() const
     }
 }
 
+qlonglong Session::historyMemoryUsage() const
+{
+    return _emulation->historyMemoryUsage();
+}
+
+int Session::updateRate() const
+{
+    const UpdateScheduler* scheduler = UpdateScheduler::instance();
+
+    if (_emulation->updatesThrottled())
+        return scheduler->backgroundFrameRate();
+    else
+        return scheduler->frameRate();
+}
+
+int Session::outputRate() const
+{
+    if (_shellProcess)
+        return _shellProcess->receiveRate();
+    else
+        return 0;
+}
+
+int Session::pendingOutputBytes() const
+{
+    if (_shellProcess)
+        return _shellProcess->pendingBytes();
+    else
+        return 0;
+}
+
+QString Session::statistics() const
+{
+    qint64 paintedFrames = 0;
+    Histogram paintTimes;
+    Histogram inputLatencies;
+
+    foreach(TerminalDisplay* view, _views) {
+        paintedFrames += view->paintedFrames();
+        paintTimes.add(view->paintTimes());
+        inputLatencies.add(view->inputLatencies());
+    }
+
+    const qint64 bytesRead = _shellProcess ? _shellProcess->bytesReceived() : 0;
+    // the cache is shared by all the views of all sessions
+    const GlyphRunCache* glyphRunCache = GlyphRunCache::instance();
+
+    QStringList lines;
+    lines << QString("bytesRead %1").arg(bytesRead)
+          << QString("bytesParsed %1").arg(_emulation->bytesReceived())
+          << QString("tokensProcessed %1").arg(_emulation->tokensProcessed())
+          << QString("historyLines %1").arg(_emulation->historyLinesAdded())
+          << QString("paintedFrames %1").arg(paintedFrames)
+          << QString("glyphCacheHits %1").arg(glyphRunCache->hits())
+          << QString("glyphCacheMisses %1").arg(glyphRunCache->misses())
+          << QString("paintTime %1").arg(paintTimes.toString())
+          << QString("inputLatency %1").arg(inputLatencies.toString());
+
+    return lines.join("\n");
+}
+
+void Session::setStatisticsFile(const QString& fileName, int interval)
+{
+    _statisticsFile = fileName;
+
+    if (fileName.isEmpty() || interval <= 0) {
+        delete _statisticsTimer;
+        _statisticsTimer = 0;
+        return;
+    }
+
+    if (!_statisticsTimer) {
+        _statisticsTimer = new QTimer(this);
+        connect(_statisticsTimer, SIGNAL(timeout()), this, SLOT(writeStatistics()));
+    }
+
+    _statisticsTimer->start(interval * 1000);
+}
+
+void Session::writeStatistics()
+{
+    QFile file(_statisticsFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        kWarning() << "Unable to write statistics to" << _statisticsFile;
+        return;
+    }
+
+    QTextStream stream(&file);
+    stream << "time " << QDateTime::currentDateTime().toString(Qt::ISODate) << '\n'
+           << "session " << _sessionId << '\n'
+           << statistics() << "\n\n";
+}
+
+qlonglong Session::historyUncompressedMemoryUsage() const
+{
+    return _emulation->historyUncompressedMemoryUsage();
+}
+
 int Session::foregroundProcessId()
 {
     int pid;
@@ -1427,6 +1621,13 @@ void Session::saveSession(KConfigGroup& group)
     group.writeEntry("RemoteTab",      tabTitleFormat(RemoteTabTitle));
     group.writeEntry("SessionGuid",    _uniqueIdentifier.toString());
     group.writeEntry("Encoding",       QString(codec()));
+
+    if (_emulation->saveHistory()) {
+        const HistoryTypeFile& fileHistory = static_cast<const HistoryTypeFile&>(historyType());
+        group.writePathEntry("HistoryFile", fileHistory.fileName());
+    } else {
+        group.deleteEntry("HistoryFile");
+    }
 }
 
 void Session::restoreSession(KConfigGroup& group)
@@ -1443,6 +1644,8 @@ void Session::restoreSession(KConfigGroup& group)
     if (!value.isEmpty()) _uniqueIdentifier = QUuid(value);
     value = group.readEntry("Encoding");
     if (!value.isEmpty()) setCodec(value.toUtf8());
+    value = group.readPathEntry("HistoryFile", QString());
+    if (!value.isEmpty() && historyType().isUnlimited()) setHistoryType(HistoryTypeFile(value));
 }
 
 SessionGroup::SessionGroup(QObject* parent)
@@ -220,6 +220,11 @@ public:
      * Clears the history store used by this session.
      */
     void clearHistory();
+    /**
+     * Throws away the history stored by saveSession(), it will not be
+     * needed since the session is not going to be restored.
+     */
+    void discardSavedHistory();
 
     /**
      * Sets the key bindings used by this session.  The bindings
@@ -356,6 +361,13 @@ public:
     void saveSession(KConfigGroup& group);
     void restoreSession(KConfigGroup& group);
 
+    /**
+     * Returns the directory in which sessions keep unlimited history,
+     * see setHistoryType().  The directory is created if necessary, and is
+     * only accessible to the user.
+     */
+    static QString historyDirectory();
+
     void sendSignal(int signal);
 
 public slots:
@@ -459,6 +471,15 @@ public slots:
     /** Returns whether flow control is enabled for this terminal session. */
     Q_SCRIPTABLE bool flowControlEnabled() const;
 
+    /**
+     * Sets whether the output of the terminal process is read and passed
+     * to the emulation in a separate thread.  See Pty::setThreadedReading()
+     * and Emulation::processOutput()
+     */
+    void setThreadedReadingEnabled(bool enabled);
+    /** See setThreadedReadingEnabled() */
+    bool threadedReadingEnabled() const;
+
     /**
      * Sends @p text to the current foreground terminal program.
      */
@@ -552,6 +573,66 @@ public slots:
      */
     Q_SCRIPTABLE int historySize() const;
 
+    /**
+     * Returns the number of bytes of memory used by the history of this
+     * session, for diagnostics.
+     */
+    Q_SCRIPTABLE qlonglong historyMemoryUsage() const;
+
+    /**
+     * Returns the number of bytes of memory the history of this session
+     * would use if none of it was compressed, for diagnostics.
+     */
+    Q_SCRIPTABLE qlonglong historyUncompressedMemoryUsage() const;
+
+    /**
+     * Returns the number of times per second that the views onto this
+     * session are currently updated at most, for diagnostics.  This is
+     * lowered when the views cannot keep up with the output, or when
+     * none of them can be seen.
+     */
+    Q_SCRIPTABLE int updateRate() const;
+
+    /**
+     * Returns the number of bytes of output per second which the terminal
+     * process has recently produced, for diagnostics.
+     */
+    Q_SCRIPTABLE int outputRate() const;
+
+    /**
+     * Returns the number of bytes of output which have been read from the
+     * terminal process but not processed yet, for diagnostics.
+     */
+    Q_SCRIPTABLE int pendingOutputBytes() const;
+
+    /**
+     * Returns counters of the work done for this session, one per line as
+     * "name value", for diagnostics:
+     *
+     *    bytesRead: bytes read from the terminal process
+     *    bytesParsed: bytes parsed by the emulation
+     *    tokensProcessed: control characters and escape sequences processed
+     *                     (printable characters are not counted)
+     *    historyLines: lines added to the history, including those moved
+     *                  there when the lines are wrapped again on resize
+     *    paintedFrames: number of times the views were painted
+     *    glyphCacheHits, glyphCacheMisses: how often the laid out text
+     *                  fragments shared by all views were found in their cache
+     *    paintTime: histogram of the paint times in milliseconds
+     *    inputLatency: histogram of the latency from a key press to its
+     *                  echo in milliseconds
+     *
+     * See Histogram::toString() for the format of the histograms.
+     */
+    Q_SCRIPTABLE QString statistics() const;
+
+    /**
+     * Appends statistics() to @p fileName every @p interval seconds,
+     * together with the time and the session's id.  An empty file name or
+     * an interval of 0 stops writing the statistics.
+     */
+    Q_SCRIPTABLE void setStatisticsFile(const QString& fileName, int interval);
+
 signals:
 
     /** Emitted when the terminal process starts. */
@@ -651,6 +732,10 @@ signals:
      */
     void selectionChanged(const QString& text);
 
+protected:
+    // throttles the updates of the views while none of them are visible
+    virtual bool eventFilter(QObject* object, QEvent* event);
+
 private slots:
     void done(int, QProcess::ExitStatus);
 
@@ -678,13 +763,20 @@ private slots:
     // signal relayer
     void onPrimaryScreenInUse(bool use);
 
+    // appends the statistics to the file set with setStatisticsFile()
+    void writeStatistics();
+
 private:
     // checks that the binary 'program' is available and can be executed
     // returns the binary name if available or an empty string otherwise
     static QString checkProgram(const QString& program);
 
     void updateTerminalSize();
+    // throttles the emulation's updates if none of the views are visible
+    void updateThrottling();
     WId windowId() const;
+    // returns the file used to store unlimited history for this session
+    QString historyFileName() const;
     bool kill(int signal);
     // print a warning message in the terminal.  This is used
     // if the program fails to start, or if the shell exits in
@@ -710,6 +802,9 @@ private:
     QTimer*        _silenceTimer;
     QTimer*        _activityTimer;
 
+    QString        _statisticsFile;
+    QTimer*        _statisticsTimer;
+
     bool           _autoClose;
     bool           _closePerUserRequest;
 
@@ -724,6 +819,7 @@ private:
     QString        _iconText; // not actually used
     bool           _addToUtmp;
     bool           _flowControlEnabled;
+    bool           _threadedReadingEnabled;
 
     QString        _program;
     QStringList    _arguments;
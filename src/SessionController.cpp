@@ -69,6 +69,7 @@
 #include "HistorySizeDialog.h"
 #include "IncrementalSearchBar.h"
 #include "RenameTabDialog.h"
+#include "Screen.h"
 #include "ScreenWindow.h"
 #include "Session.h"
 #include "ProfileList.h"
@@ -903,6 +904,9 @@ void SessionController::closeSession()
         return;
 
     if (confirmClose()) {
+        // the user closed the session, so its history will not be restored
+        _session->discardSavedHistory();
+
         if (_session->closeInNormalWay()) {
             return;
         } else if (confirmForceClose()) {
@@ -1804,6 +1808,20 @@ void SearchHistoryTask::execute()
     }
 }
 
+// returns the text which a search for 'regExp' has to find, if it can be
+// looked up in the search index of the screen, or an empty string otherwise
+static QString indexedSearchText(const QRegExp& regExp)
+{
+    const QString pattern = regExp.pattern();
+
+    if (regExp.patternSyntax() == QRegExp::FixedString)
+        return pattern;
+    else if (regExp.patternSyntax() == QRegExp::RegExp && QRegExp::escape(pattern) == pattern)
+        return pattern;
+    else
+        return QString();
+}
+
 void SearchHistoryTask::executeOnScreenWindow(SessionPtr session , ScreenWindowPtr window)
 {
     Q_ASSERT(session);
@@ -1836,11 +1854,18 @@ void SearchHistoryTask::executeOnScreenWindow(SessionPtr session , ScreenWindowP
         //setup first and last lines depending on search direction
         int line = startLine;
 
+        // when searching for plain text, the search index of the screen
+        // tells which lines can not contain it
+        const QString indexedText = indexedSearchText(_regExp);
+        Screen* screen = window->screen();
+
         //read through and search history in blocks of 10K lines.
         //this balances the need to retrieve lots of data from the history each time
         //(for efficient searching)
         //without using silly amounts of memory if the history is very large.
-        const int maxDelta = qMin(window->lineCount(), 10000);
+        //smaller blocks are used with the search index, as only those
+        //blocks which may contain the text are read
+        const int maxDelta = qMin(window->lineCount(), indexedText.isEmpty() ? 10000 : 1000);
         int delta = forwards ? maxDelta : -maxDelta;
 
         int endLine = line;
@@ -1879,17 +1904,33 @@ void SearchHistoryTask::executeOnScreenWindow(SessionPtr session , ScreenWindowP
                 }
             }
 
-            decoder.begin(&searchStream);
-            emulation->writeToStream(&decoder, qMin(endLine, line) , qMax(endLine, line));
-            decoder.end();
+            int blockStart = qMin(endLine, line);
+            int blockEnd = qMax(endLine, line);
 
-            // line number search below assumes that the buffer ends with a new-line
-            string.append('\n');
+            // the block must not change between looking it up in the
+            // index and reading it
+            QMutexLocker locker(window->screenLock());
 
-            if (forwards)
-                pos = string.indexOf(_regExp);
-            else
-                pos = string.lastIndexOf(_regExp);
+            if (!indexedText.isEmpty()) {
+                blockStart = screen->findSearchLine(indexedText, blockStart, blockEnd);
+                if (blockStart != -1)
+                    blockEnd = qMax(blockStart, screen->findSearchLine(indexedText, blockEnd, blockStart));
+            }
+
+            if (blockStart != -1) {
+                decoder.begin(&searchStream);
+                emulation->writeToStream(&decoder, blockStart , blockEnd);
+                decoder.end();
+                locker.unlock();
+
+                // line number search below assumes that the buffer ends with a new-line
+                string.append('\n');
+
+                if (forwards)
+                    pos = string.indexOf(_regExp);
+                else
+                    pos = string.lastIndexOf(_regExp);
+            }
 
             //if a match is found, position the cursor on that line and update the screen
             if (pos != -1) {
@@ -1901,7 +1942,7 @@ void SearchHistoryTask::executeOnScreenWindow(SessionPtr session , ScreenWindowP
                 // ignore the new line at the start of the buffer
                 newLines--;
 
-                int findPos = qMin(line, endLine) + newLines;
+                int findPos = blockStart + newLines;
 
                 highlightResult(window, findPos);
 
@@ -32,6 +32,7 @@
 #include <KConfigGroup>
 #include <KGlobal>
 #include <KDebug>
+#include <KStandardDirs>
 
 // Konsole
 #include "Session.h"
@@ -232,6 +233,9 @@ void SessionManager::applyProfile(Session* session, const Profile::Ptr profile ,
     if (apply.shouldApply(Profile::FlowControlEnabled))
         session->setFlowControlEnabled(profile->flowControlEnabled());
 
+    if (apply.shouldApply(Profile::ThreadedReadingEnabled))
+        session->setThreadedReadingEnabled(profile->threadedReadingEnabled());
+
     // Encoding
     if (apply.shouldApply(Profile::DefaultEncoding)) {
         QByteArray name = profile->defaultEncoding().toUtf8();
@@ -290,6 +294,27 @@ void SessionManager::saveSessions(KConfig* config)
 
     KConfigGroup group(config, "Number");
     group.writeEntry("NumberOfSessions", _sessions.count());
+
+    removeUnusedHistoryFiles();
+}
+
+void SessionManager::removeUnusedHistoryFiles()
+{
+    // the session manager keeps a config file for each saved Konsole,
+    // the histories they refer to are needed when it is restored
+    QStringList usedFiles;
+    const QStringList configFiles = KGlobal::dirs()->findAllResources("config", "session/konsole_*");
+    foreach(const QString& configFile, configFiles) {
+        KConfig config(configFile, KConfig::SimpleConfig);
+        foreach(const QString& groupName, config.groupList()) {
+            const QString fileName = config.group(groupName).readPathEntry("HistoryFile", QString());
+            if (!fileName.isEmpty())
+                usedFiles << fileName;
+        }
+    }
+
+    // the histories of running sessions are open, and are kept as well
+    HistoryTypeFile::removeUnusedFiles(Session::historyDirectory(), usedFiles);
 }
 
 int SessionManager::getRestoreId(Session* session)
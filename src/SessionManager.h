@@ -95,6 +95,13 @@ public:
     int  getRestoreId(Session* session);
     Session* idToSession(int id);
 
+    /**
+     * Removes the history files which are neither used by a running
+     * session nor referred to by a session saved by the session manager.
+     * These are left behind if Konsole crashes, for example.
+     */
+    void removeUnusedHistoryFiles();
+
 signals:
     /**
      * Emitted when a session's settings are updated to match
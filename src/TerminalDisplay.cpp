@@ -68,6 +68,8 @@
 #include "LineFont.h"
 #include "SessionController.h"
 #include "ExtendedCharTable.h"
+#include "GlyphAtlas.h"
+#include "GlyphRunCache.h"
 #include "TerminalDisplayAccessible.h"
 #include "SessionManager.h"
 #include "Session.h"
@@ -171,6 +173,20 @@ static inline bool isLineCharString(const QString& string)
     return isSupportedLineChar(string.at(0).unicode());
 }
 
+// returns true if 'string' may contain characters which are reordered by
+// bidirectional text layout, which the glyph atlas does not do
+static bool hasRightToLeftText(const QString& string)
+{
+    // scripts which are written right to left start at U+0590
+    const QChar* chars = string.constData();
+    for (int i = 0; i < string.length(); i++) {
+        if (chars[i].unicode() >= 0x0590)
+            return true;
+    }
+
+    return false;
+}
+
 void TerminalDisplay::fontChange(const QFont&)
 {
     QFontMetrics fm(font());
@@ -197,6 +213,10 @@ void TerminalDisplay::fontChange(const QFont&)
 
     _fontAscent = fm.ascent();
 
+    // the glyphs have to be rendered again with the new font
+    delete _glyphAtlas;
+    _glyphAtlas = 0;
+
     emit changedFontMetricSignal(_fontHeight, _fontWidth);
     propagateSize();
     update();
@@ -236,6 +256,41 @@ void TerminalDisplay::setFont(const QFont &)
     // ignore font change request if not coming from konsole itself
 }
 
+void TerminalDisplay::setGlyphAtlasEnabled(bool enabled)
+{
+    if (_glyphAtlasEnabled == enabled)
+        return;
+
+    _glyphAtlasEnabled = enabled;
+
+    if (!enabled) {
+        delete _glyphAtlas;
+        _glyphAtlas = 0;
+    }
+
+    update();
+}
+
+bool TerminalDisplay::isGlyphAtlasEnabled() const
+{
+    return _glyphAtlasEnabled;
+}
+
+qint64 TerminalDisplay::paintedFrames() const
+{
+    return _paintedFrames;
+}
+
+const Histogram& TerminalDisplay::paintTimes() const
+{
+    return _paintTimes;
+}
+
+const Histogram& TerminalDisplay::inputLatencies() const
+{
+    return _inputLatencies;
+}
+
 void TerminalDisplay::increaseFontSize()
 {
     QFont font = getVTFont();
@@ -305,10 +360,17 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     , _usedLines(1)
     , _usedColumns(1)
     , _image(0)
+    , _imageStamp(0)
+    , _trueColorReclaimCount(0)
+    , _imageUpdatePending(false)
     , _randomSeed(0)
     , _resizing(false)
     , _showTerminalSizeHint(true)
     , _bidiEnabled(false)
+    , _glyphAtlasEnabled(false)
+    , _glyphAtlas(0)
+    , _paintedFrames(0)
+    , _keyPressOutputChanged(false)
     , _actSel(0)
     , _wordSelectionMode(false)
     , _lineSelectionMode(false)
@@ -352,6 +414,9 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
 
     _contentRect = QRect(_margin, _margin, 1, 1);
 
+    // no key press is waiting to be echoed
+    _keyPressTime.invalidate();
+
     // create scroll bar for scrolling output up and down
     _scrollBar = new QScrollBar(this);
     // set the scroll bar's slider to occupy the whole area of the scroll bar initially
@@ -413,6 +478,7 @@ TerminalDisplay::~TerminalDisplay()
     disconnect(_blinkCursorTimer);
 
     delete[] _image;
+    delete _glyphAtlas;
 
     delete _gridLayout;
     delete _outputSuspendedLabel;
@@ -694,13 +760,9 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
 
     // setup bold and underline
     bool useBold;
-    ColorEntry::FontWeight weight = style->fontWeight(_colorTable);
-    if (weight == ColorEntry::UseCurrentFormat)
-        useBold = ((style->rendition & RE_BOLD) && _boldIntense) || font().bold();
-    else
-        useBold = (weight == ColorEntry::Bold) ? true : false;
-    const bool useUnderline = style->rendition & RE_UNDERLINE || font().underline();
-    const bool useItalic = style->rendition & RE_ITALIC || font().italic();
+    bool useUnderline;
+    bool useItalic;
+    textStyle(style, useBold, useUnderline, useItalic);
 
     QFont font = painter.font();
     if (font.bold() != useBold
@@ -743,7 +805,21 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
         } else {
             // See bug 280896 for more info
 #if QT_VERSION >= 0x040800
-            painter.drawText(rect, Qt::AlignBottom, LTR_OVERRIDE_CHAR + text);
+            // reuse the layout of fragments which have been drawn before.
+            // underlined text, scaled lines and text which does not fit
+            // into the rect are left to drawText(), which takes care of the
+            // decoration, the scaling and the clipping
+            const QStaticText* staticText = 0;
+            if (!useUnderline && painter.worldTransform().type() <= QTransform::TxTranslate)
+                staticText = GlyphRunCache::instance()->staticText(LTR_OVERRIDE_CHAR + text, font);
+
+            if (staticText && staticText->size().width() <= rect.width()) {
+                // align the text to the bottom of the rect, as drawText() does
+                const int top = rect.y() + rect.height() - painter.fontMetrics().height();
+                painter.drawStaticText(rect.x(), top, *staticText);
+            } else {
+                painter.drawText(rect, Qt::AlignBottom, LTR_OVERRIDE_CHAR + text);
+            }
 #else
             painter.drawText(rect, 0, LTR_OVERRIDE_CHAR + text);
 #endif
@@ -751,6 +827,18 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
     }
 }
 
+void TerminalDisplay::textStyle(const Character* style, bool& useBold, bool& useUnderline,
+                                bool& useItalic) const
+{
+    ColorEntry::FontWeight weight = style->fontWeight(_colorTable);
+    if (weight == ColorEntry::UseCurrentFormat)
+        useBold = ((style->rendition & RE_BOLD) && _boldIntense) || font().bold();
+    else
+        useBold = (weight == ColorEntry::Bold) ? true : false;
+    useUnderline = style->rendition & RE_UNDERLINE || font().underline();
+    useItalic = style->rendition & RE_ITALIC || font().italic();
+}
+
 void TerminalDisplay::drawTextFragment(QPainter& painter ,
                                        const QRect& rect,
                                        const QString& text,
@@ -779,6 +867,65 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
     painter.restore();
 }
 
+void TerminalDisplay::drawAtlasTextFragment(QPainter& painter,
+                                            const QRect& rect,
+                                            const QString& text,
+                                            const Character* style)
+{
+    painter.save();
+
+    // setup painter
+    const QColor foregroundColor = style->foregroundColor.color(_colorTable);
+    const QColor backgroundColor = style->backgroundColor.color(_colorTable);
+
+    // draw background if different from the display's background color
+    if (backgroundColor != palette().background().color())
+        drawBackground(painter, rect, backgroundColor,
+                       false /* do not use transparency */);
+
+    // draw cursor shape if the current character is the cursor
+    // this may alter the foreground and background colors
+    bool invertCharacterColor = false;
+    if (style->rendition & RE_CURSOR)
+        drawCursor(painter, rect, foregroundColor, backgroundColor, invertCharacterColor);
+
+    // don't draw text which is currently blinking
+    if (!(_textBlinking && (style->rendition & RE_BLINK))) {
+        if (!_glyphAtlas)
+            _glyphAtlas = new GlyphAtlas(font(), _fontWidth, QFontMetrics(font()).height());
+
+        bool useBold;
+        bool useUnderline;
+        bool useItalic;
+        textStyle(style, useBold, useUnderline, useItalic);
+
+        int glyphStyle = 0;
+        if (useBold)
+            glyphStyle |= GlyphAtlas::Bold;
+        if (useItalic)
+            glyphStyle |= GlyphAtlas::Italic;
+        if (useUnderline)
+            glyphStyle |= GlyphAtlas::Underline;
+
+        const QRgb color = (invertCharacterColor ? backgroundColor : foregroundColor).rgb();
+
+        // glyphs are aligned to the bottom of the rect, as drawCharacters() does
+        const int top = rect.y() + rect.height() - _glyphAtlas->glyphSize().height();
+
+        for (int i = 0; i < text.length(); i++) {
+            // blank cells only need to be drawn if they are underlined
+            if (text[i] == QLatin1Char(' ') && !useUnderline)
+                continue;
+
+            const QRect source = _glyphAtlas->glyph(text[i].unicode(), glyphStyle, color);
+            painter.drawImage(rect.x() + i * _fontWidth, top, _glyphAtlas->image(), source.x(),
+                              source.y(), source.width(), source.height());
+        }
+    }
+
+    painter.restore();
+}
+
 void TerminalDisplay::drawPrinterFriendlyTextFragment(QPainter& painter,
         const QRect& rect,
         const QString& text,
@@ -881,6 +1028,10 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
 
         //scroll internal image down
         memmove(firstCharPos , lastCharPos , bytesToMove);
+        memmove(&_lineStamps[region.top()], &_lineStamps[region.top() + lines],
+                linesToMove * sizeof(quint64));
+        memmove(&_blinkingLines[region.top()], &_blinkingLines[region.top() + lines],
+                linesToMove * sizeof(bool));
 
         //set region of display to scroll
         scrollRect.setTop(top);
@@ -891,6 +1042,10 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
 
         //scroll internal image up
         memmove(lastCharPos , firstCharPos , bytesToMove);
+        memmove(&_lineStamps[region.top() - lines], &_lineStamps[region.top()],
+                linesToMove * sizeof(quint64));
+        memmove(&_blinkingLines[region.top() - lines], &_blinkingLines[region.top()],
+                linesToMove * sizeof(bool));
 
         //set region of the display to scroll
         scrollRect.setTop(top + abs(lines) * _fontHeight);
@@ -942,6 +1097,13 @@ void TerminalDisplay::processFilters()
     if (!_screenWindow)
         return;
 
+    QMutexLocker locker(_screenWindow->screenLock());
+
+    if (!isShownOnScreen()) {
+        _imageUpdatePending = true;
+        return;
+    }
+
     QRegion preUpdateHotSpots = hotSpotRegion();
 
     // use _screenWindow->getImage() here rather than _image because
@@ -949,10 +1111,15 @@ void TerminalDisplay::processFilters()
     // ScreenWindow emits a scrolled() signal - which will happen before
     // updateImage() is called on the display and therefore _image is
     // out of date at this point
-    _filterChain->setImage(_screenWindow->getImage(),
+    //
+    // only the lines which changed since the last call are searched again
+    const Character* image = _screenWindow->getImage();
+    _filterChain->setImage(image,
                            _screenWindow->windowLines(),
                            _screenWindow->windowColumns(),
-                           _screenWindow->getLineProperties());
+                           _screenWindow->getLineProperties(),
+                           _screenWindow->getLineStamps(),
+                           _screenWindow->imageStamp());
     _filterChain->process();
 
     QRegion postUpdateHotSpots = hotSpotRegion();
@@ -965,6 +1132,16 @@ void TerminalDisplay::updateImage()
     if (!_screenWindow)
         return;
 
+    // the screen must not change between the calls of the screen window
+    // below, see ScreenWindow::screenLock()
+    QMutexLocker locker(_screenWindow->screenLock());
+
+    // the display is brought up to date in one pass when it is shown again
+    if (!isShownOnScreen()) {
+        _imageUpdatePending = true;
+        return;
+    }
+
     // optimization - scroll the existing image where possible and
     // avoid expensive text drawing for parts of the image that
     // can simply be moved up or down
@@ -984,6 +1161,19 @@ void TerminalDisplay::updateImage()
     const int lines = _screenWindow->windowLines();
     const int columns = _screenWindow->windowColumns();
 
+    // lines whose stamp is unchanged since they were copied into _image
+    // are identical to the lines in the new image, unless the image stamp
+    // has changed as well
+    const QVector<quint64> newLineStamps = _screenWindow->getLineStamps();
+    const bool lineStampsValid = (_screenWindow->imageStamp() == _imageStamp);
+    _imageStamp = _screenWindow->imageStamp();
+
+    // the RGB colors in _image may have been reclaimed and given to other
+    // colors since, in which case the lines are repainted entirely
+    const int trueColorReclaimCount = CharacterColor::trueColorReclaimCount();
+    const bool imageColorsValid = (trueColorReclaimCount == _trueColorReclaimCount);
+    _trueColorReclaimCount = trueColorReclaimCount;
+
     setScroll(_screenWindow->currentLine() , _screenWindow->lineCount());
 
     Q_ASSERT(this->_usedLines <= this->_lines);
@@ -1013,7 +1203,19 @@ void TerminalDisplay::updateImage()
         const Character* currentLine = &_image[y * this->_columns];
         const Character* const newLine = &newimg[y * columns];
 
+        //both the top and bottom halves of double height _lines must always be redrawn
+        //(see below)
+        const bool doubleHeight = _lineProperties.count() > y && (_lineProperties[y] & LINE_DOUBLEHEIGHT);
+
+        // skip comparing and copying lines which have not changed
+        if (lineStampsValid && imageColorsValid && !doubleHeight && y < newLineStamps.count() &&
+                newLineStamps[y] != 0 && newLineStamps[y] == _lineStamps[y]) {
+            _hasTextBlinker |= _blinkingLines[y];
+            continue;
+        }
+
         bool updateLine = false;
+        bool lineHasBlinker = false;
 
         // The dirty mask indicates which characters need repainting. We also
         // mark surrounding neighbors dirty, in case the character exceeds
@@ -1028,7 +1230,7 @@ void TerminalDisplay::updateImage()
 
         if (!_resizing) // not while _resizing, we're expecting a paintEvent
             for (x = 0; x < columnsToUpdate; ++x) {
-                _hasTextBlinker |= (newLine[x].rendition & RE_BLINK);
+                lineHasBlinker |= (newLine[x].rendition & RE_BLINK);
 
                 // Start drawing if this character or the next one differs.
                 // We also take the next one into account to handle the situation
@@ -1076,8 +1278,7 @@ void TerminalDisplay::updateImage()
         //although both top and bottom halves contain the same characters, only
         //the top one is actually
         //drawn.
-        if (_lineProperties.count() > y)
-            updateLine |= (_lineProperties[y] & LINE_DOUBLEHEIGHT);
+        updateLine |= doubleHeight || !imageColorsValid;
 
         // if the characters on the line are different in the old and the new _image
         // then this line must be repainted.
@@ -1097,6 +1298,12 @@ void TerminalDisplay::updateImage()
         // replace the line of characters in the old _image with the
         // current line of the new _image
         memcpy((void*)currentLine, (const void*)newLine, columnsToUpdate * sizeof(Character));
+
+        // the blinking text is not looked for while resizing, so the line
+        // must be compared again next time
+        _lineStamps[y] = (_resizing || y >= newLineStamps.count()) ? 0 : newLineStamps[y];
+        _blinkingLines[y] = lineHasBlinker;
+        _hasTextBlinker |= lineHasBlinker;
     }
 
     // if the new _image is smaller than the previous _image, then ensure that the area
@@ -1119,6 +1326,9 @@ void TerminalDisplay::updateImage()
 
     dirtyRegion |= _inputMethodData.previousPreeditRect;
 
+    if (_keyPressTime.isValid() && !dirtyRegion.isEmpty())
+        _keyPressOutputChanged = true;
+
     // update the parts of the display which have changed
     update(dirtyRegion);
 
@@ -1166,6 +1376,9 @@ void TerminalDisplay::showResizeNotification()
 
 void TerminalDisplay::paintEvent(QPaintEvent* pe)
 {
+    QElapsedTimer paintTime;
+    paintTime.start();
+
     QPainter paint(this);
 
     foreach(const QRect & rect, (pe->region() & contentsRect()).rects()) {
@@ -1176,6 +1389,15 @@ void TerminalDisplay::paintEvent(QPaintEvent* pe)
     drawCurrentResultRect(paint);
     drawInputMethodPreeditString(paint, preeditRect());
     paintFilters(paint);
+
+    _paintedFrames++;
+    _paintTimes.addValue(paintTime.elapsed());
+
+    if (_keyPressOutputChanged) {
+        _inputLatencies.addValue(_keyPressTime.elapsed());
+        _keyPressTime.invalidate();
+        _keyPressOutputChanged = false;
+    }
 }
 
 void TerminalDisplay::printContent(QPainter& painter, bool friendly)
@@ -1447,12 +1669,24 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
             //(instead of textArea.topLeft() * painter-scale)
             textArea.moveTopLeft(textScale.inverted().map(textArea.topLeft()));
 
+            // the glyph atlas only holds single width characters of
+            // a fixed pitch font, drawn without scaling
+            const bool useGlyphAtlas = _glyphAtlasEnabled && save__fixedFont &&
+                                       !lineDraw && !doubleWidth && unistr.length() == len &&
+                                       textScale.isIdentity() &&
+                                       (!_bidiEnabled || !hasRightToLeftText(unistr));
+
             //paint text fragment
             if (_printerFriendly) {
                 drawPrinterFriendlyTextFragment(paint,
                                                 textArea,
                                                 unistr,
                                                 &_image[loc(x, y)]);
+            } else if (useGlyphAtlas) {
+                drawAtlasTextFragment(paint,
+                                      textArea,
+                                      unistr,
+                                      &_image[loc(x, y)]);
             } else {
                 drawTextFragment(paint,
                                  textArea,
@@ -1605,6 +1839,29 @@ void TerminalDisplay::updateCursor()
 void TerminalDisplay::resizeEvent(QResizeEvent*)
 {
     updateImageSize();
+    updatePendingImage();
+}
+
+bool TerminalDisplay::isShownOnScreen() const
+{
+    return isVisible() && !visibleRegion().isEmpty();
+}
+
+void TerminalDisplay::updatePendingImage()
+{
+    if (!_imageUpdatePending || !isShownOnScreen())
+        return;
+
+    _imageUpdatePending = false;
+
+    // lines which have scrolled while the display was hidden are found by
+    // comparing the line stamps, the whole display is repainted anyway
+    if (_screenWindow)
+        _screenWindow->resetScrollCount();
+
+    updateLineProperties();
+    updateImage();
+    processFilters();
 }
 
 void TerminalDisplay::propagateSize()
@@ -1670,6 +1927,10 @@ void TerminalDisplay::makeImage()
     // certain boundary conditions: _image[_imageSize] is a valid but unused position
     _image = new Character[_imageSize + 1];
 
+    // the stamps are not known until the image is updated
+    _lineStamps.fill(0, _lines);
+    _blinkingLines.fill(false, _lines);
+
     clearImage();
 }
 
@@ -1759,6 +2020,7 @@ QSize TerminalDisplay::sizeHint() const
 //the same signal as the one for a content size change
 void TerminalDisplay::showEvent(QShowEvent*)
 {
+    updatePendingImage();
     emit changedContentSizeSignal(_contentRect.height(), _contentRect.width());
 }
 void TerminalDisplay::hideEvent(QHideEvent*)
@@ -2425,6 +2687,8 @@ void TerminalDisplay::viewScrolledByUser()
 */
 QPoint TerminalDisplay::findLineStart(const QPoint &pnt)
 {
+    QMutexLocker locker(_screenWindow->screenLock());
+
     const int visibleScreenLines = _lineProperties.size();
     const int topVisibleLine = _screenWindow->currentLine();
     Screen *screen = _screenWindow->screen();
@@ -2457,6 +2721,8 @@ QPoint TerminalDisplay::findLineStart(const QPoint &pnt)
 */
 QPoint TerminalDisplay::findLineEnd(const QPoint &pnt)
 {
+    QMutexLocker locker(_screenWindow->screenLock());
+
     const int visibleScreenLines = _lineProperties.size();
     const int topVisibleLine = _screenWindow->currentLine();
     const int maxY = _screenWindow->lineCount() - 1;
@@ -2482,6 +2748,8 @@ QPoint TerminalDisplay::findLineEnd(const QPoint &pnt)
 
 QPoint TerminalDisplay::findWordStart(const QPoint &pnt)
 {
+    QMutexLocker locker(_screenWindow->screenLock());
+
     const int regSize = qMax(_screenWindow->windowLines(), 10);
     const int curLine = _screenWindow->currentLine();
     int i = pnt.y();
@@ -2535,6 +2803,8 @@ out:
 
 QPoint TerminalDisplay::findWordEnd(const QPoint &pnt)
 {
+    QMutexLocker locker(_screenWindow->screenLock());
+
     const int regSize = qMax(_screenWindow->windowLines(), 10);
     const int curLine = _screenWindow->currentLine();
     int i = pnt.y();
@@ -2951,6 +3221,10 @@ void TerminalDisplay::keyPressEvent(QKeyEvent* event)
         Q_ASSERT(_cursorBlinking == false);
     }
 
+    // the time until the typed text is echoed is measured
+    if (!event->text().isEmpty() && !_keyPressTime.isValid())
+        _keyPressTime.start();
+
     emit keyPressedSignal(event);
 
 #if QT_VERSION >= 0x040800 // added in Qt 4.8.0
@@ -23,6 +23,7 @@
 
 // Qt
 #include <QtGui/QColor>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QPointer>
 #include <QWidget>
 
@@ -32,6 +33,7 @@
 #include "ScreenWindow.h"
 #include "ColorScheme.h"
 #include "Enumeration.h"
+#include "Histogram.h"
 
 class QDrag;
 class QDragEnterEvent;
@@ -49,6 +51,7 @@ class QTimerEvent;
 namespace Konsole
 {
 class FilterChain;
+class GlyphAtlas;
 class TerminalImageFilterChain;
 class SessionController;
 /**
@@ -438,6 +441,32 @@ public:
         return _bidiEnabled;
     }
 
+    /**
+     * Sets whether text in a fixed pitch font is drawn by copying glyphs
+     * which have been rendered once into an atlas, instead of laying out
+     * the text each time it is drawn.  Text which the atlas cannot handle,
+     * such as combined, double width and right-to-left characters, is
+     * drawn as usual.
+     * Defaults to disabled.
+     */
+    void setGlyphAtlasEnabled(bool enabled);
+    /**
+     * Returns whether text is drawn from a glyph atlas.
+     * See setGlyphAtlasEnabled()
+     */
+    bool isGlyphAtlasEnabled() const;
+
+    /** Returns the number of times the display has been painted, for diagnostics. */
+    qint64 paintedFrames() const;
+    /** Returns the times in milliseconds which painting the display took. */
+    const Histogram& paintTimes() const;
+    /**
+     * Returns the times in milliseconds from a key press which produces
+     * text to the next repaint after the output changed.  This is the
+     * latency with which typed characters are echoed.
+     */
+    const Histogram& inputLatencies() const;
+
     /**
      * Sets the terminal screen section which is displayed in this widget.
      * When updateImage() is called, the display fetches the latest character image from the
@@ -463,6 +492,8 @@ public slots:
     /**
      * Causes the terminal display to fetch the latest character image from the associated
      * terminal screen ( see setScreenWindow() ) and redraw the display.
+     *
+     * While the display cannot be seen this is deferred until it is shown again.
      */
     void updateImage();
     /**
@@ -697,6 +728,11 @@ private:
     // has a common color and style
     void drawTextFragment(QPainter& painter, const QRect& rect,
                           const QString& text, const Character* style);
+    // draws a section of text like drawTextFragment(), but copies the
+    // glyphs from the glyph atlas.  the text must consist of single width
+    // characters, one for each column of 'rect'
+    void drawAtlasTextFragment(QPainter& painter, const QRect& rect,
+                               const QString& text, const Character* style);
 
     void drawPrinterFriendlyTextFragment(QPainter& painter, const QRect& rect,
                                          const QString& text, const Character* style);
@@ -712,6 +748,10 @@ private:
     // draws the characters or line graphics in a text fragment
     void drawCharacters(QPainter& painter, const QRect& rect,  const QString& text,
                         const Character* style, bool invertCharacterColor);
+    // works out whether text with the given style is drawn in bold,
+    // underlined or italic
+    void textStyle(const Character* style, bool& useBold, bool& useUnderline,
+                   bool& useItalic) const;
     // draws a string of line graphics
     void drawLineCharString(QPainter& painter, int x, int y,
                             const QString& str, const Character* attributes);
@@ -746,6 +786,14 @@ private:
     void calcGeometry();
     void propagateSize();
     void updateImageSize();
+
+    // returns false if the display cannot be seen, because it or one of
+    // its parents is hidden or because it is collapsed to nothing in a
+    // splitter
+    bool isShownOnScreen() const;
+    // brings _image and the filters up to date with the output which was
+    // received while the display could not be seen
+    void updatePendingImage();
     void makeImage();
 
     void paintFilters(QPainter& painter);
@@ -806,12 +854,33 @@ private:
     int _imageSize;
     QVector<LineProperty> _lineProperties;
 
+    // the stamps of the lines in _image, see ScreenWindow::getLineStamps(),
+    // and whether they contain blinking text
+    QVector<quint64> _lineStamps;
+    QVector<bool> _blinkingLines;
+    quint64 _imageStamp;
+    // see CharacterColor::trueColorReclaimCount() when _image was filled
+    int _trueColorReclaimCount;
+    // true if output was received while the display could not be seen,
+    // so that _image and the filters have to catch up when it is shown
+    bool _imageUpdatePending;
+
     ColorEntry _colorTable[TABLE_COLORS];
     uint _randomSeed;
 
     bool _resizing;
     bool _showTerminalSizeHint;
     bool _bidiEnabled;
+    bool _glyphAtlasEnabled;
+    GlyphAtlas* _glyphAtlas; // created when it is first needed
+
+    qint64 _paintedFrames;
+    Histogram _paintTimes;
+    Histogram _inputLatencies;
+    // started by a key press, until the output has changed and the display
+    // has been painted
+    QElapsedTimer _keyPressTime;
+    bool _keyPressOutputChanged;
     bool _mouseMarks;
     bool _bracketedPasteMode;
 
@@ -53,6 +53,7 @@ int TerminalDisplayAccessible::cursorPosition()
     if (!display()->screenWindow())
         return 0;
 
+    QMutexLocker locker(display()->screenWindow()->screenLock());
     int offset = display()->_usedColumns * display()->screenWindow()->screen()->getCursorY();
     return offset + display()->screenWindow()->screen()->getCursorX();
 }
@@ -97,6 +98,7 @@ QString TerminalDisplayAccessible::visibleText() const
     if (!display->screenWindow())
         return QString();
 
+    QMutexLocker locker(display->screenWindow()->screenLock());
     return display->screenWindow()->screen()->text(0, display->_usedColumns * display->_usedLines, true);
 }
 
@@ -155,6 +157,7 @@ void TerminalDisplayAccessible::setCursorPosition(int position)
     if (!display()->screenWindow())
         return;
 
+    QMutexLocker locker(display()->screenWindow()->screenLock());
     display()->screenWindow()->screen()->setCursorYX(lineForOffset(position), columnForOffset(position));
 }
 
@@ -177,6 +180,7 @@ QString TerminalDisplayAccessible::text(int startOffset, int endOffset)
     if (!display()->screenWindow())
         return QString();
 
+    QMutexLocker locker(display()->screenWindow()->screenLock());
     return display()->screenWindow()->screen()->text(startOffset, endOffset, true);
 }
 
@@ -0,0 +1,176 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "UpdateScheduler.h"
+
+// KDE
+#include <KGlobal>
+
+// Konsole
+#include "Emulation.h"
+
+using namespace Konsole;
+
+static const int DEFAULT_TARGET_FRAME_RATE = 60;
+static const int DEFAULT_BACKGROUND_FRAME_RATE = 4;
+
+// the frame rate of emulations which are not throttled is never
+// lowered below 10 frames per second
+static const int MAX_FRAME_INTERVAL = 100;
+
+// after this many milliseconds without an update, the next update
+// starts again at the target frame rate
+static const int IDLE_TIME = 1000;
+
+UpdateScheduler::UpdateScheduler()
+    : _targetFrameRate(DEFAULT_TARGET_FRAME_RATE)
+    , _backgroundFrameRate(DEFAULT_BACKGROUND_FRAME_RATE)
+    , _frameInterval(1000 / DEFAULT_TARGET_FRAME_RATE)
+    , _lastFrameTime(-IDLE_TIME)
+    , _nextFrameTime(0)
+{
+    _clock.start();
+
+    _timer.setSingleShot(true);
+    connect(&_timer, SIGNAL(timeout()), this, SLOT(updateEmulations()));
+}
+
+K_GLOBAL_STATIC(UpdateScheduler , theUpdateScheduler)
+
+UpdateScheduler* UpdateScheduler::instance()
+{
+    return theUpdateScheduler;
+}
+
+void UpdateScheduler::setTargetFrameRate(int framesPerSecond)
+{
+    _targetFrameRate = qBound(1, framesPerSecond, 1000);
+    _frameInterval = 1000 / _targetFrameRate;
+}
+
+int UpdateScheduler::targetFrameRate() const
+{
+    return _targetFrameRate;
+}
+
+void UpdateScheduler::setBackgroundFrameRate(int framesPerSecond)
+{
+    _backgroundFrameRate = qBound(1, framesPerSecond, 1000);
+}
+
+int UpdateScheduler::backgroundFrameRate() const
+{
+    return _backgroundFrameRate;
+}
+
+int UpdateScheduler::frameRate() const
+{
+    return 1000 / qMax(_frameInterval, 1);
+}
+
+void UpdateScheduler::scheduleUpdate(Emulation* emulation)
+{
+    if (!_pendingEmulations.contains(emulation))
+        _pendingEmulations << emulation;
+
+    // the emulation may be due sooner than the pending ones, if it is
+    // no longer throttled
+    scheduleFrame();
+}
+
+void UpdateScheduler::cancelUpdate(Emulation* emulation)
+{
+    _pendingEmulations.removeAll(emulation);
+    _updatingEmulations.removeAll(emulation);
+    _lastUpdateTimes.remove(emulation);
+
+    if (_pendingEmulations.isEmpty())
+        _timer.stop();
+}
+
+qint64 UpdateScheduler::nextUpdateTime(Emulation* emulation) const
+{
+    if (!emulation->updatesThrottled() || !_lastUpdateTimes.contains(emulation))
+        return 0;
+
+    return _lastUpdateTimes.value(emulation) + 1000 / _backgroundFrameRate;
+}
+
+void UpdateScheduler::scheduleFrame()
+{
+    const qint64 now = _clock.elapsed();
+
+    if (!_timer.isActive() && now - _lastFrameTime >= IDLE_TIME)
+        _frameInterval = 1000 / _targetFrameRate;
+
+    qint64 dueTime = -1;
+    foreach(Emulation* emulation, _pendingEmulations) {
+        const qint64 updateTime = nextUpdateTime(emulation);
+        if (dueTime == -1 || updateTime < dueTime)
+            dueTime = updateTime;
+    }
+
+    const qint64 frameTime = qMax(qMax(now, _lastFrameTime + _frameInterval), dueTime);
+    if (_timer.isActive() && frameTime == _nextFrameTime)
+        return;
+
+    _nextFrameTime = frameTime;
+    _timer.start(_nextFrameTime - now);
+}
+
+void UpdateScheduler::updateEmulations()
+{
+    const qint64 frameTime = _clock.elapsed();
+    const qint64 lateness = frameTime - _nextFrameTime;
+
+    _lastFrameTime = frameTime;
+
+    // emulations which are deleted while the views of another one are
+    // updated are removed from _updatingEmulations by cancelUpdate()
+    _updatingEmulations = _pendingEmulations;
+    _pendingEmulations.clear();
+
+    while (!_updatingEmulations.isEmpty()) {
+        Emulation* emulation = _updatingEmulations.takeFirst();
+
+        if (nextUpdateTime(emulation) > frameTime) {
+            _pendingEmulations << emulation;
+            continue;
+        }
+
+        _lastUpdateTimes.insert(emulation, frameTime);
+        emulation->showBulk();
+    }
+
+    // back off quickly when the event loop is busy, and return slowly
+    // to the target frame rate once it is not
+    const qint64 load = (_clock.elapsed() - frameTime) + qMax(lateness, qint64(0));
+    const int targetInterval = 1000 / _targetFrameRate;
+
+    if (load > _frameInterval / 2) {
+        _frameInterval = qMin(MAX_FRAME_INTERVAL, _frameInterval * 3 / 2 + 1);
+        _frameInterval = qMax(_frameInterval, targetInterval);
+    } else if (_frameInterval > targetInterval) {
+        _frameInterval = qMax(targetInterval, _frameInterval * 9 / 10);
+    }
+
+    if (!_pendingEmulations.isEmpty())
+        scheduleFrame();
+}
+
+#include "UpdateScheduler.moc"
@@ -0,0 +1,116 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef UPDATESCHEDULER_H
+#define UPDATESCHEDULER_H
+
+// Qt
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+
+// Konsole
+#include "konsole_export.h"
+
+namespace Konsole
+{
+class Emulation;
+
+/**
+ * Paces the updates of the views onto all emulations.
+ *
+ * Emulations report that their screen has changed with scheduleUpdate(),
+ * and a single timer then updates the views of all changed emulations
+ * together, at most once per frame.
+ *
+ * When updating the views keeps the event loop busy for more than half of
+ * a frame, the frame rate is lowered.  It is raised again towards
+ * targetFrameRate() once the load goes down.  Emulations whose updates are
+ * throttled, because none of their views can be seen, are updated at no
+ * more than backgroundFrameRate().
+ */
+class KONSOLEPRIVATE_EXPORT UpdateScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    UpdateScheduler();
+
+    /**
+     * Schedules an update of the views onto @p emulation.  Repeated calls
+     * before the next frame result in a single update.
+     */
+    void scheduleUpdate(Emulation* emulation);
+    /**
+     * Cancels a pending update of the views onto @p emulation.  This must
+     * be called before the emulation is deleted.
+     */
+    void cancelUpdate(Emulation* emulation);
+
+    /** Sets the number of frames per second which the scheduler aims for. */
+    void setTargetFrameRate(int framesPerSecond);
+    /** Returns the number of frames per second which the scheduler aims for. */
+    int targetFrameRate() const;
+
+    /**
+     * Sets the maximum number of times per second that emulations whose
+     * updates are throttled are updated.
+     */
+    void setBackgroundFrameRate(int framesPerSecond);
+    /** See setBackgroundFrameRate() */
+    int backgroundFrameRate() const;
+
+    /**
+     * Returns the number of frames per second at which emulations which
+     * are not throttled are currently updated.  This is lower than
+     * targetFrameRate() when the event loop cannot keep up.
+     */
+    int frameRate() const;
+
+    /** Returns the global UpdateScheduler instance. */
+    static UpdateScheduler* instance();
+
+private slots:
+    // updates the views onto the emulations which are due at this frame
+    void updateEmulations();
+
+private:
+    // (re)starts the timer for the next frame in which a pending
+    // emulation is due to be updated
+    void scheduleFrame();
+    // returns the earliest time, on _clock, at which 'emulation' may
+    // be updated
+    qint64 nextUpdateTime(Emulation* emulation) const;
+
+    QTimer _timer;
+    QElapsedTimer _clock;
+
+    QList<Emulation*> _pendingEmulations;
+    QList<Emulation*> _updatingEmulations;
+    QHash<Emulation*, qint64> _lastUpdateTimes;
+
+    int _targetFrameRate;
+    int _backgroundFrameRate;
+    int _frameInterval;      // milliseconds, adapted to the load
+    qint64 _lastFrameTime;
+    qint64 _nextFrameTime;
+};
+}
+
+#endif // UPDATESCHEDULER_H
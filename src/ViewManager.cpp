@@ -959,6 +959,7 @@ void ViewManager::applyProfileToView(TerminalDisplay* view , const Profile::Ptr
     // load font
     view->setAntialias(profile->antiAliasFonts());
     view->setBoldIntense(profile->boldIntense());
+    view->setGlyphAtlasEnabled(profile->glyphAtlasEnabled());
     view->setVTFont(profile->font());
 
     // set scroll-bar position
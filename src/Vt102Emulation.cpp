@@ -29,6 +29,7 @@
 
 // Qt
 #include <QtCore/QEvent>
+#include <QtCore/QThread>
 #include <QtCore/QTimer>
 #include <QtGui/QKeyEvent>
 
@@ -81,12 +82,16 @@ Vt102Emulation::~Vt102Emulation()
 
 void Vt102Emulation::clearEntireScreen()
 {
+    QMutexLocker locker(&_screenLock);
+
     _currentScreen->clearEntireScreen();
     bufferedUpdate();
 }
 
 void Vt102Emulation::reset()
 {
+    QMutexLocker locker(&_screenLock);
+
     // Save the current codec so we can set it later.
     // Ideally we would want to use the profile setting
     const QTextCodec* currentCodec = codec();
@@ -182,17 +187,80 @@ void Vt102Emulation::reset()
 
 const int MAX_ARGUMENT = 4096;
 
+// Parser ------------------------------------------------------------------ --
+
+/* The tokens are recognized by a state machine in the style of Paul Williams'
+   DEC compatible parser (http://vt100.net/emu/dec_ansi_parser).
+
+   For every state there is a row in 'transitionTable' which maps each of the
+   256 Latin-1 characters to an action and to the state which follows it.
+   Characters beyond Latin-1 are looked up like any other printable character.
+   receiveChar() therefore does a single table lookup for each character and
+   performs the action, accumulating the CSI parameters as it goes, instead of
+   testing the token buffer against every known sequence.
+
+   The characters of the sequence are still added to 'tokenBuffer', they are
+   needed for the text of window attribute changes and for error reports.
+*/
+
+// Parser states
+enum {
+    Ground,             // printable characters are displayed
+    Escape,             // ESC
+    EscapeCharset,      // ESC followed by one of ( ) + * %
+    EscapeHash,         // ESC #
+    CsiEntry,           // ESC [
+    CsiParam,           // ESC [ followed by parameters
+    CsiPrivate,         // ESC [ ?
+    CsiGreater,         // ESC [ >
+    CsiBang,            // ESC [ !
+    OscString,          // ESC ] followed by the attribute and its value
+    Vt52Ground,         // Ground in VT52 mode
+    Vt52Escape,         // Escape in VT52 mode
+    Vt52CursorRow,      // ESC Y
+    Vt52CursorColumn,   // ESC Y followed by the row
+    ParserStateCount
+};
+
+// Parser actions
+enum {
+    Ignore,             // nothing to do
+    Print,              // display the character after charset translation
+    Execute,            // process a control character, even within a sequence
+    Cancel,             // abort the sequence and process the control character
+    EscapeStart,        // start a new sequence
+    CsiStart,           // start a new CSI sequence (8 bit CSI)
+    Collect,            // add the character to the sequence
+    Param,              // add a digit to the current parameter
+    NextParam,          // start a new parameter
+    EscDispatch,        // ESC <c>
+    CharsetDispatch,    // ESC ( <c> and friends
+    DecDispatch,        // ESC # <c>
+    CsiPnDispatch,      // ESC [ Pn ; Pn <c>
+    CsiPsDispatch,      // ESC [ Ps ; ... <c>
+    CsiResizeDispatch,  // ESC [ 8 ; rows ; columns t
+    CsiPrDispatch,      // ESC [ ? Ps ; ... <c>
+    CsiPgDispatch,      // ESC [ > Ps ; ... <c>
+    CsiPeDispatch,      // ESC [ ! <c>
+    OscEnd,             // ESC ] Ps ; Pt BEL
+    Vt52Print,          // display the character as is
+    Vt52Dispatch,       // ESC <c>
+    Vt52CursorDispatch  // ESC Y <row> <column>
+};
+
 // Tokenizer --------------------------------------------------------------- --
 
 /* The tokenizer's state
 
-   The state is represented by the buffer (tokenBuffer, tokenBufferPos),
-   and accompanied by decoded arguments kept in (argv,argc).
+   The state is represented by the parser state (parserState) and the buffer
+   (tokenBuffer, tokenBufferPos), and accompanied by decoded arguments kept
+   in (argv,argc).
    Note that they are kept internal in the tokenizer.
 */
 
 void Vt102Emulation::resetTokenizer()
 {
+    parserState = Ground;
     tokenBufferPos = 0;
     argc = 0;
     argv[0] = 0;
@@ -217,179 +285,232 @@ void Vt102Emulation::addToCurrentToken(int cc)
     tokenBufferPos = qMin(tokenBufferPos + 1, MAX_TOKEN_LENGTH - 1);
 }
 
-// Character Class flags used while decoding
-const int CTL =  1;  // Control character
-const int CHR =  2;  // Printable character
-const int CPN =  4;  // TODO: Document me
-const int DIG =  8;  // Digit
-const int SCS = 16;  // Select Character Set
-const int GRP = 32;  // TODO: Document me
-const int CPS = 64;  // Character which indicates end of window resize
+#define CNTL(c) ((c)-'@')
+const int ESC = 27;
+const int DEL = 127;
+const int CSI = ESC + 128;
 
-void Vt102Emulation::initTokenizer()
-{
-    int i;
-    quint8* s;
-    for (i = 0; i < 256; ++i)
-        charClass[i] = 0;
-    for (i = 0; i < 32; ++i)
-        charClass[i] |= CTL;
-    for (i = 32; i < 256; ++i)
-        charClass[i] |= CHR;
-    for (s = (quint8*)"@ABCDGHILMPSTXZcdfry"; *s; ++s)
-        charClass[*s] |= CPN;
-    // resize = \e[8;<row>;<col>t
-    for (s = (quint8*)"t"; *s; ++s)
-        charClass[*s] |= CPS;
-    for (s = (quint8*)"0123456789"; *s; ++s)
-        charClass[*s] |= DIG;
-    for (s = (quint8*)"()+*%"; *s; ++s)
-        charClass[*s] |= SCS;
-    for (s = (quint8*)"()+*#[]%"; *s; ++s)
-        charClass[*s] |= GRP;
+// Final characters of the CSI sequences which take two numeric parameters
+static const char* const CSI_PN_FINALS = "@ABCDGHILMPSTXZcdfry";
 
-    resetTokenizer();
-}
+// Action (high byte) and next state (low byte) for each state and character
+static quint16 transitionTable[ParserStateCount][256];
 
-/* Ok, here comes the nasty part of the decoder.
+static void setTransitions(int state, int first, int last, int action, int nextState)
+{
+    for (int c = first; c <= last; c++)
+        transitionTable[state][c] = (action << 8) | nextState;
+}
 
-   Instead of keeping an explicit state, we deduce it from the
-   token scanned so far. It is then immediately combined with
-   the current character to form a scanning decision.
+static void setTransitions(int state, const char* chars, int action, int nextState)
+{
+    for (const char* c = chars; *c; c++)
+        setTransitions(state, *c, *c, action, nextState);
+}
 
-   This is done by the following defines.
+static void initTransitionTable()
+{
+    setTransitions(Ground, 0x20, 0xff, Print, Ground);
+    setTransitions(Ground, CSI, CSI, CsiStart, CsiEntry);
+
+    setTransitions(Escape, 0x20, 0xff, EscDispatch, Ground);
+    setTransitions(Escape, "()+*%", Collect, EscapeCharset);
+    setTransitions(Escape, "#", Collect, EscapeHash);
+    setTransitions(Escape, "[", Collect, CsiEntry);
+    setTransitions(Escape, "]", Collect, OscString);
+
+    setTransitions(EscapeCharset, 0x20, 0xff, CharsetDispatch, Ground);
+    setTransitions(EscapeHash, 0x20, 0xff, DecDispatch, Ground);
+
+    for (int state = CsiEntry; state <= CsiParam; state++) {
+        setTransitions(state, 0x20, 0xff, CsiPsDispatch, Ground);
+        setTransitions(state, '0', '9', Param, CsiParam);
+        setTransitions(state, ";", NextParam, CsiParam);
+        setTransitions(state, CSI_PN_FINALS, CsiPnDispatch, Ground);
+        setTransitions(state, "t", CsiResizeDispatch, Ground);
+    }
+    setTransitions(CsiEntry, "?", Collect, CsiPrivate);
+    setTransitions(CsiEntry, ">", Collect, CsiGreater);
+    setTransitions(CsiEntry, "!", Collect, CsiBang);
+
+    setTransitions(CsiPrivate, 0x20, 0xff, CsiPrDispatch, Ground);
+    setTransitions(CsiGreater, 0x20, 0xff, CsiPgDispatch, Ground);
+    for (int state = CsiPrivate; state <= CsiGreater; state++) {
+        setTransitions(state, '0', '9', Param, state);
+        setTransitions(state, ";", NextParam, state);
+    }
+    setTransitions(CsiBang, 0x20, 0xff, CsiPeDispatch, Ground);
 
-   - P is the length of the token scanned so far.
-   - L (often P-1) is the position on which contents we base a decision.
-   - C is a character or a group of characters (taken from 'charClass').
+    setTransitions(OscString, 0x20, 0xff, Collect, OscString);
 
-   - 'cc' is the current character
-   - 's' is a pointer to the start of the token buffer
-   - 'p' is the current position within the token buffer
+    setTransitions(Vt52Ground, 0x20, 0xff, Vt52Print, Ground);
+    setTransitions(Vt52Escape, 0x20, 0xff, Vt52Dispatch, Ground);
+    setTransitions(Vt52Escape, "Y", Collect, Vt52CursorRow);
+    setTransitions(Vt52CursorRow, 0x20, 0xff, Collect, Vt52CursorColumn);
+    setTransitions(Vt52CursorColumn, 0x20, 0xff, Vt52CursorDispatch, Ground);
 
-   Note that they need to applied in proper order.
-*/
+    // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
+    // This means, they neither end the sequence nor become part of it. Some of them, do
+    // of course. Guess this originates from a weakly layered handling of the X-on
+    // X-off protocol, which comes really below this level.
+    for (int state = 0; state < ParserStateCount; state++) {
+        setTransitions(state, 0x00, 0x1f, Execute, state);
+        setTransitions(state, CNTL('X'), CNTL('X'), Cancel, Ground); //VT100: CAN
+        setTransitions(state, CNTL('Z'), CNTL('Z'), Cancel, Ground); //VT100: SUB
+        setTransitions(state, ESC, ESC, EscapeStart, Escape);
+        setTransitions(state, DEL, DEL, Ignore, state);              //VT100: ignore.
+    }
+    setTransitions(OscString, 0x07, 0x07, OscEnd, Ground);
+}
 
-#define lec(P,L,C) (p == (P) && s[(L)] == (C))
-#define lun(     ) (p ==  1  && cc >= 32 )
-#define les(P,L,C) (p == (P) && s[L] < 256 && (charClass[s[(L)]] & (C)) == (C))
-#define eec(C)     (p >=  3  && cc == (C))
-#define ees(C)     (p >=  3  && cc < 256 && (charClass[cc] & (C)) == (C))
-#define eps(C)     (p >=  3  && s[2] != '?' && s[2] != '!' && s[2] != '>' && cc < 256 && (charClass[cc] & (C)) == (C))
-#define epp( )     (p >=  3  && s[2] == '?')
-#define epe( )     (p >=  3  && s[2] == '!')
-#define egt( )     (p >=  3  && s[2] == '>')
-#define Xpe        (tokenBufferPos >= 2 && tokenBuffer[1] == ']')
-#define Xte        (Xpe      && cc ==  7 )
-#define ces(C)     (cc < 256 && (charClass[cc] & (C)) == (C) && !Xte)
+void Vt102Emulation::initTokenizer()
+{
+    static bool transitionTableInitialized = false;
+    if (!transitionTableInitialized) {
+        initTransitionTable();
+        transitionTableInitialized = true;
+    }
 
-#define CNTL(c) ((c)-'@')
-const int ESC = 27;
-const int DEL = 127;
+    resetTokenizer();
+}
 
 // process an incoming unicode character
 void Vt102Emulation::receiveChar(int cc)
 {
-  if (cc == DEL)
-    return; //VT100: ignore.
-
-  if (ces(CTL))
+  int state = parserState;
+  if (!getMode(MODE_Ansi))
   {
-    // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
-    // This means, they do neither a resetTokenizer() nor a pushToToken(). Some of them, do
-    // of course. Guess this originates from a weakly layered handling of the X-on
-    // X-off protocol, which comes really below this level.
-    if (cc == CNTL('X') || cc == CNTL('Z') || cc == ESC)
-        resetTokenizer(); //VT100: CAN or SUB
-    if (cc != ESC)
-    {
-        processToken(TY_CTL(cc+'@' ),0,0);
-        return;
-    }
+    if (state == Ground)
+        state = Vt52Ground;
+    else if (state == Escape)
+        state = Vt52Escape;
   }
-  // advance the state
-  addToCurrentToken(cc);
 
-  int* s = tokenBuffer;
-  const int  p = tokenBufferPos;
+  const quint16 transition = transitionTable[state][cc < 256 ? cc : 0xa0];
+  const int nextState = transition & 0xff;
 
-  if (getMode(MODE_Ansi))
+  switch (transition >> 8)
   {
-    if (lec(1,0,ESC)) { return; }
-    if (lec(1,0,ESC+128)) { s[0] = ESC; receiveChar('['); return; }
-    if (les(2,1,GRP)) { return; }
-    if (Xte         ) { processWindowAttributeChange(); resetTokenizer(); return; }
-    if (Xpe         ) { return; }
-    if (lec(3,2,'?')) { return; }
-    if (lec(3,2,'>')) { return; }
-    if (lec(3,2,'!')) { return; }
-    if (lun(       )) { processToken( TY_CHR(), applyCharset(cc), 0);   resetTokenizer(); return; }
-    if (lec(2,0,ESC)) { processToken( TY_ESC(s[1]), 0, 0);              resetTokenizer(); return; }
-    if (les(3,1,SCS)) { processToken( TY_ESC_CS(s[1],s[2]), 0, 0);      resetTokenizer(); return; }
-    if (lec(3,1,'#')) { processToken( TY_ESC_DE(s[2]), 0, 0);           resetTokenizer(); return; }
-    if (eps(    CPN)) { processToken( TY_CSI_PN(cc), argv[0],argv[1]);  resetTokenizer(); return; }
-
-    // resize = \e[8;<row>;<col>t
-    if (eps(CPS))
-    {
-        processToken( TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
+    case Ignore:
+        break;
+    case Print:
+        _currentScreen->displayCharacter(applyCharset(cc));
+        break;
+    case Execute:
+        processToken(TY_CTL(cc+'@'), 0, 0);
+        break;
+    case Cancel:
         resetTokenizer();
-        return;
-    }
-
-    if (epe(   )) { processToken( TY_CSI_PE(cc), 0, 0); resetTokenizer(); return; }
-    if (ees(DIG)) { addDigit(cc-'0'); return; }
-    if (eec(';')) { addArgument();    return; }
-    for (int i = 0; i <= argc; i++)
-    {
-        if (epp())
-            processToken(TY_CSI_PR(cc,argv[i]), 0, 0);
-        else if (egt())
-            processToken(TY_CSI_PG(cc), 0, 0); // spec. case for ESC]>0c or ESC]>c
-        else if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 2)
-        {
-            // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ... 38;2;<red>;<green>;<blue> ... m
-            i += 2;
-            processToken(TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_RGB, (argv[i] << 16) | (argv[i+1] << 8) | argv[i+2]);
-            i += 2;
-        }
-        else if (cc == 'm' && argc - i >= 2 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 5)
+        processToken(TY_CTL(cc+'@'), 0, 0);
+        break;
+    case EscapeStart:
+        resetTokenizer();
+        addToCurrentToken(ESC);
+        break;
+    case CsiStart:
+        resetTokenizer();
+        addToCurrentToken(ESC);
+        addToCurrentToken('[');
+        break;
+    case Collect:
+        addToCurrentToken(cc);
+        break;
+    case Param:
+        addToCurrentToken(cc);
+        addDigit(cc-'0');
+        break;
+    case NextParam:
+        addToCurrentToken(cc);
+        addArgument();
+        break;
+    case EscDispatch:
+        addToCurrentToken(cc);
+        processToken(TY_ESC(cc), 0, 0);
+        resetTokenizer();
+        break;
+    case CharsetDispatch:
+        addToCurrentToken(cc);
+        processToken(TY_ESC_CS(tokenBuffer[1],cc), 0, 0);
+        resetTokenizer();
+        break;
+    case DecDispatch:
+        addToCurrentToken(cc);
+        processToken(TY_ESC_DE(cc), 0, 0);
+        resetTokenizer();
+        break;
+    case CsiPnDispatch:
+        addToCurrentToken(cc);
+        processToken(TY_CSI_PN(cc), argv[0], argv[1]);
+        resetTokenizer();
+        break;
+    case CsiResizeDispatch:
+        // resize = \e[8;<row>;<col>t
+        addToCurrentToken(cc);
+        processToken(TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
+        resetTokenizer();
+        break;
+    case CsiPsDispatch:
+        addToCurrentToken(cc);
+        for (int i = 0; i <= argc; i++)
         {
-            // ESC[ ... 48;5;<index> ... m -or- ESC[ ... 38;5;<index> ... m
-            i += 2;
-            processToken(TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_256, argv[i]);
+            if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 2)
+            {
+                // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ... 38;2;<red>;<green>;<blue> ... m
+                i += 2;
+                processToken(TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_RGB, (argv[i] << 16) | (argv[i+1] << 8) | argv[i+2]);
+                i += 2;
+            }
+            else if (cc == 'm' && argc - i >= 2 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 5)
+            {
+                // ESC[ ... 48;5;<index> ... m -or- ESC[ ... 38;5;<index> ... m
+                i += 2;
+                processToken(TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_256, argv[i]);
+            }
+            else
+                processToken(TY_CSI_PS(cc,argv[i]), 0, 0);
         }
-        else
-            processToken(TY_CSI_PS(cc,argv[i]), 0, 0);
-    }
-    resetTokenizer();
-  }
-  else
-  {
-    // VT52 Mode
-    if (lec(1,0,ESC))
-        return;
-    if (les(1,0,CHR))
-    {
-        processToken( TY_CHR(), s[0], 0);
         resetTokenizer();
-        return;
-    }
-    if (lec(2,1,'Y'))
-        return;
-    if (lec(3,1,'Y'))
-        return;
-    if (p < 4)
-    {
-        processToken(TY_VT52(s[1] ), 0, 0);
+        break;
+    case CsiPrDispatch:
+        addToCurrentToken(cc);
+        for (int i = 0; i <= argc; i++)
+            processToken(TY_CSI_PR(cc,argv[i]), 0, 0);
         resetTokenizer();
-        return;
-    }
-    processToken(TY_VT52(s[1]), s[2], s[3]);
-    resetTokenizer();
-    return;
+        break;
+    case CsiPgDispatch:
+        addToCurrentToken(cc);
+        for (int i = 0; i <= argc; i++)
+            processToken(TY_CSI_PG(cc), 0, 0); // spec. case for ESC]>0c or ESC]>c
+        resetTokenizer();
+        break;
+    case CsiPeDispatch:
+        addToCurrentToken(cc);
+        processToken(TY_CSI_PE(cc), 0, 0);
+        resetTokenizer();
+        break;
+    case OscEnd:
+        addToCurrentToken(cc);
+        processWindowAttributeChange();
+        resetTokenizer();
+        break;
+    case Vt52Print:
+        _currentScreen->displayCharacter(cc);
+        break;
+    case Vt52Dispatch:
+        addToCurrentToken(cc);
+        processToken(TY_VT52(cc), 0, 0);
+        resetTokenizer();
+        break;
+    case Vt52CursorDispatch:
+        addToCurrentToken(cc);
+        processToken(TY_VT52('Y'), tokenBuffer[2], cc);
+        resetTokenizer();
+        break;
   }
+
+  parserState = nextState;
 }
+
 void Vt102Emulation::processWindowAttributeChange()
 {
   // Describes the window or terminal session attribute to change
@@ -415,17 +536,28 @@ void Vt102Emulation::processWindowAttributeChange()
     newValue[j] = tokenBuffer[i+1+j];
 
   _pendingTitleUpdates[attributeToChange] = newValue;
-  _titleUpdateTimer->start(20);
+
+  // the timer can only be started from the emulation's own thread
+  if (QThread::currentThread() != thread())
+      QMetaObject::invokeMethod(_titleUpdateTimer, "start", Qt::QueuedConnection, Q_ARG(int, 20));
+  else
+      _titleUpdateTimer->start(20);
 }
 
 void Vt102Emulation::updateTitle()
 {
-    QListIterator<int> iter( _pendingTitleUpdates.keys() );
+    QHash<int, QString> titleUpdates;
+    {
+        QMutexLocker locker(&_screenLock);
+        titleUpdates = _pendingTitleUpdates;
+        _pendingTitleUpdates.clear();
+    }
+
+    QListIterator<int> iter( titleUpdates.keys() );
     while (iter.hasNext()) {
         int arg = iter.next();
-        emit titleChanged( arg , _pendingTitleUpdates[arg] );
+        emit titleChanged( arg , titleUpdates[arg] );
     }
-    _pendingTitleUpdates.clear();
 }
 
 // Interpreting Codes ---------------------------------------------------------
@@ -448,6 +580,11 @@ void Vt102Emulation::updateTitle()
 
 void Vt102Emulation::processToken(int token, int p, int q)
 {
+  // printable characters are not counted, most of them are passed to
+  // receiveCharacters() without becoming tokens
+  if (token != TY_CHR())
+    _tokensProcessed++;
+
   switch (token)
   {
     case TY_CHR(         ) : _currentScreen->displayCharacter     (p         ); break; //UTF16
@@ -834,10 +971,21 @@ void Vt102Emulation::clearScreenAndSetColumns(int columnCount)
 
 void Vt102Emulation::sendString(const char* s , int length)
 {
-  if ( length >= 0 )
-    emit sendData(s,length);
+  if ( length < 0 )
+    length = qstrlen(s);
+
+  // replies to the incoming data which is processed in another thread are
+  // sent from the emulation's own thread, 's' is only valid until then
+  if (QThread::currentThread() != thread())
+    QMetaObject::invokeMethod(this, "sendQueuedString", Qt::QueuedConnection,
+                              Q_ARG(QByteArray, QByteArray(s, length)));
   else
-    emit sendData(s,qstrlen(s));
+    emit sendData(s,length);
+}
+
+void Vt102Emulation::sendQueuedString(const QByteArray& data)
+{
+  emit sendData(data.constData(), data.length());
 }
 
 void Vt102Emulation::reportCursorPosition()
@@ -919,6 +1067,8 @@ void Vt102Emulation::sendMouseEvent(int cb, int cx, int cy , int eventType)
     if (cx < 1 || cy < 1)
         return;
 
+    QMutexLocker locker(&_screenLock);
+
     // With the exception of the 1006 mode, button release is encoded in cb.
     // Note that if multiple extensions are enabled, the 1006 is used, so it's okay to check for only that.
     if (eventType == 2 && !getMode(MODE_Mouse1006))
@@ -971,6 +1121,8 @@ void Vt102Emulation::sendText(const QString& text)
 }
 void Vt102Emulation::sendKeyEvent(QKeyEvent* event)
 {
+    QMutexLocker locker(&_screenLock);
+
     const Qt::KeyboardModifiers modifiers = event->modifiers();
     KeyboardTranslator::States states = KeyboardTranslator::NoState;
 
@@ -1095,6 +1247,27 @@ void Vt102Emulation::sendKeyEvent(QKeyEvent* event)
 
 // Apply current character map.
 
+// process a run of printable ASCII characters
+void Vt102Emulation::receiveCharacters(const quint16* chars, int count)
+{
+    int i = 0;
+
+    // complete any escape sequence which is in progress
+    while (i < count && parserState != Ground)
+        receiveChar(chars[i++]);
+
+    // outside of an escape sequence every printable character is displayed
+    // as it is, unless a VT100 charset translates it
+    if (CHARSET.graphic || CHARSET.pound) {
+        while (i < count)
+            receiveChar(chars[i++]);
+        return;
+    }
+
+    if (i < count)
+        _currentScreen->displayCharacters(chars + i, count - i);
+}
+
 unsigned short Vt102Emulation::applyCharset(unsigned short c)
 {
     if (CHARSET.graphic && 0x5f <= c && c <= 0x7e) return vt100_graphics[c - 0x5f];
@@ -73,7 +73,7 @@ struct CharCodes {
  * sequences.
  *
  */
-class Vt102Emulation : public Emulation
+class KONSOLEPRIVATE_EXPORT Vt102Emulation : public Emulation
 {
     Q_OBJECT
 
@@ -99,12 +99,17 @@ protected:
     virtual void setMode(int mode);
     virtual void resetMode(int mode);
     virtual void receiveChar(int cc);
+    virtual void receiveCharacters(const quint16* chars, int count);
 
 private slots:
     //causes changeTitle() to be emitted for each (int,QString) pair in pendingTitleUpdates
     //used to buffer multiple title updates
     void updateTitle();
 
+    // emits sendData() for a reply which sendString() was called with
+    // from another thread
+    void sendQueuedString(const QByteArray& data);
+
 private:
     unsigned short applyCharset(unsigned short c);
     void setCharset(int n, int cs);
@@ -140,10 +145,9 @@ private:
     int argc;
     void initTokenizer();
 
-    // Set of flags for each of the ASCII characters which indicates
-    // what category they fall into (printable character, control, digit etc.)
-    // for the purposes of decoding terminal output
-    int charClass[256];
+    // State of the parser which splits the incoming characters into tokens,
+    // see receiveChar()
+    int parserState;
 
     void reportDecodingError();
 
@@ -69,6 +69,9 @@
 // Own
 #include "konsole_wcwidth.h"
 
+// System
+#include <string.h>
+
 struct interval {
     unsigned long first;
     unsigned long last;
@@ -123,9 +126,12 @@ static int bisearch(unsigned long ucs, const struct interval* table, int max)
  *
  * This implementation assumes that quint16 characters are encoded
  * in ISO 10646.
+ *
+ * calculate_wcwidth() is only used to fill the lookup table behind
+ * konsole_wcwidth().
  */
 
-int konsole_wcwidth(quint16 oucs)
+static int calculate_wcwidth(quint16 oucs)
 {
     /* NOTE: It is not possible to compare quint16 with the new last four lines of characters,
      * therefore this cast is now necessary.
@@ -214,6 +220,66 @@ int konsole_wcwidth(quint16 oucs)
              (ucs >= 0x30000 && ucs <= 0x3fffd)));
 }
 
+/*
+ * Two level lookup table for konsole_wcwidth(), filled from calculate_wcwidth()
+ * when the library is loaded.
+ *
+ * The high byte of a character selects one of the distinct pages of 256 widths
+ * and the low byte the width within that page.  Widths are stored in two bits
+ * each, as width + 1.  Most of the 256 possible pages are identical (all 1 or
+ * all 2), so only a few dozen of the pages below are used.
+ */
+class WidthTable
+{
+public:
+    WidthTable();
+
+    int width(quint16 ucs) const {
+        const quint8 bits = _pages[_pageIndex[ucs >> 8]][(ucs & 0xff) >> 2];
+        return ((bits >> ((ucs & 3) * 2)) & 3) - 1;
+    }
+
+private:
+    static const int PAGE_BYTES = 256 / 4;
+
+    quint8 _pageIndex[256];
+    quint8 _pages[256][PAGE_BYTES];
+};
+
+WidthTable::WidthTable()
+{
+    int pageCount = 0;
+
+    for (int page = 0; page < 256; page++) {
+        quint8* bits = _pages[pageCount];
+        memset(bits, 0, PAGE_BYTES);
+        for (int i = 0; i < 256; i++) {
+            const int w = calculate_wcwidth(static_cast<quint16>((page << 8) | i));
+            bits[i >> 2] |= (w + 1) << ((i & 3) * 2);
+        }
+
+        // share the page with an earlier one if their widths are the same
+        int index = 0;
+        while (index < pageCount && memcmp(_pages[index], bits, PAGE_BYTES) != 0)
+            index++;
+        if (index == pageCount)
+            pageCount++;
+
+        _pageIndex[page] = index;
+    }
+}
+
+static const WidthTable widthTable;
+
+int konsole_wcwidth(quint16 ucs)
+{
+    // printable ASCII does not need the table
+    if (ucs >= 0x20 && ucs < 0x7f)
+        return 1;
+
+    return widthTable.width(ucs);
+}
+
 int string_width(const QString& text)
 {
     int w = 0;
@@ -113,6 +113,69 @@ void CharacterColorTest::testColorSpaceSystem()
     //QCOMPARE(result, expected);
 }
 
+void CharacterColorTest::testColorSpaceRGB()
+{
+    CharacterColor charColor(COLOR_SPACE_RGB, 0x123456);
+    QCOMPARE(charColor.colorSpace(), quint8(COLOR_SPACE_RGB));
+    QCOMPARE(charColor.color(DefaultColorTable), QColor(0x12, 0x34, 0x56));
+
+    // equal colors share their position in the table of RGB colors
+    CharacterColor sameColor(COLOR_SPACE_RGB, 0x123456);
+    QVERIFY(charColor == sameColor);
+    QVERIFY(charColor.trueColorIndex() != -1);
+    QVERIFY(CharacterColor::fromTrueColorIndex(charColor.trueColorIndex()) == charColor);
+
+    CharacterColor otherColor(COLOR_SPACE_RGB, 0x123457);
+    QVERIFY(charColor != otherColor);
+
+    QCOMPARE(CharacterColor(COLOR_SPACE_256, 20).trueColorIndex(), -1);
+}
+
+void CharacterColorTest::testTrueColorReclaim()
+{
+    const CharacterColor usedColor(COLOR_SPACE_RGB, 0x010203);
+    CharacterColor unusedColor(COLOR_SPACE_RGB, 0x040506);
+    const int unusedIndex = unusedColor.trueColorIndex();
+    const int reclaimCount = CharacterColor::trueColorReclaimCount();
+
+    // colors which are handed out while the used ones are collected are kept
+    const quint32 generation = CharacterColor::beginTrueColorReclaim();
+    const CharacterColor newColor(COLOR_SPACE_RGB, 0x070809);
+
+    QSet<int> usedIndexes;
+    usedIndexes << usedColor.trueColorIndex();
+    QVERIFY(CharacterColor::endTrueColorReclaim(generation, usedIndexes) > 0);
+    QCOMPARE(CharacterColor::trueColorReclaimCount(), reclaimCount + 1);
+
+    QCOMPARE(usedColor.color(DefaultColorTable), QColor(0x01, 0x02, 0x03));
+    QCOMPARE(newColor.color(DefaultColorTable), QColor(0x07, 0x08, 0x09));
+
+    // the position of the unused color is given to another one
+    const CharacterColor otherColor(COLOR_SPACE_RGB, 0x0A0B0C);
+    QCOMPARE(otherColor.trueColorIndex(), unusedIndex);
+    QCOMPARE(otherColor.color(DefaultColorTable), QColor(0x0A, 0x0B, 0x0C));
+
+    unusedColor = CharacterColor(COLOR_SPACE_RGB, 0x040506);
+    QCOMPARE(unusedColor.color(DefaultColorTable), QColor(0x04, 0x05, 0x06));
+}
+
+void CharacterColorTest::testSetIntensive()
+{
+    CharacterColor charColor(COLOR_SPACE_SYSTEM, 1);
+    charColor.setIntensive();
+    QCOMPARE(charColor.color(DefaultColorTable), DefaultColorTable[2 + 1 + BASE_COLORS].color);
+    QVERIFY(charColor == CharacterColor(COLOR_SPACE_SYSTEM, 1 + 8));
+
+    CharacterColor defaultColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR);
+    defaultColor.setIntensive();
+    QCOMPARE(defaultColor.color(DefaultColorTable), DefaultColorTable[DEFAULT_BACK_COLOR + BASE_COLORS].color);
+
+    // only system colors have intensive versions
+    CharacterColor indexedColor(COLOR_SPACE_256, 100);
+    indexedColor.setIntensive();
+    QVERIFY(indexedColor == CharacterColor(COLOR_SPACE_256, 100));
+}
+
 QTEST_KDEMAIN_CORE(CharacterColorTest)
 
 #include "CharacterColorTest.moc"
@@ -38,6 +38,9 @@ private slots:
     void testColorSpaceDefault();
     void testColorSpaceSystem_data();
     void testColorSpaceSystem();
+    void testColorSpaceRGB();
+    void testTrueColorReclaim();
+    void testSetIntensive();
 
 private:
     static const ColorEntry DefaultColorTable[];
@@ -0,0 +1,105 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "CharacterWidthTest.h"
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../konsole_wcwidth.h"
+
+using namespace Konsole;
+
+void CharacterWidthTest::testWidth_data()
+{
+    QTest::addColumn<uint>("character");
+    QTest::addColumn<int>("width");
+
+    QTest::newRow("null") << 0x0000u << 0;
+    QTest::newRow("control") << 0x001Bu << -1;
+    QTest::newRow("DEL") << 0x007Fu << -1;
+    QTest::newRow("C1 control") << 0x0085u << -1;
+    QTest::newRow("ASCII") << uint('a') << 1;
+    QTest::newRow("Latin-1") << 0x00E9u << 1;
+    QTest::newRow("soft hyphen") << 0x00ADu << 1;
+    QTest::newRow("combining acute") << 0x0301u << 0;
+    QTest::newRow("Hangul Jamo medial vowel") << 0x1160u << 0;
+    QTest::newRow("Hangul Jamo initial consonant") << 0x1100u << 2;
+    QTest::newRow("zero width space") << 0x200Bu << 0;
+    QTest::newRow("box drawing") << 0x2500u << 1;
+    QTest::newRow("left angle bracket") << 0x2329u << 2;
+    QTest::newRow("CJK ideograph") << 0x4E2Du << 2;
+    QTest::newRow("ideographic half fill space") << 0x303Fu << 1;
+    QTest::newRow("Hangul syllable") << 0xAC00u << 2;
+    QTest::newRow("fullwidth A") << 0xFF21u << 2;
+    QTest::newRow("halfwidth katakana") << 0xFF76u << 1;
+    QTest::newRow("byte order mark") << 0xFEFFu << 0;
+    QTest::newRow("replacement character") << 0xFFFDu << 1;
+}
+
+void CharacterWidthTest::testWidth()
+{
+    QFETCH(uint, character);
+    QFETCH(int, width);
+
+    QCOMPARE(konsole_wcwidth(character), width);
+}
+
+void CharacterWidthTest::testStringWidth()
+{
+    QCOMPARE(string_width(QString()), 0);
+    QCOMPARE(string_width(QString("konsole")), 7);
+    QCOMPARE(string_width(QString::fromUtf8("\xe4\xb8\xad\xe6\x96\x87 text")), 9);
+    QCOMPARE(string_width(QString::fromUtf8("e\xcc\x81")), 1);
+}
+
+void CharacterWidthTest::benchmarkStringWidth_data()
+{
+    QTest::addColumn<QString>("text");
+
+    // lines of typical output, repeated to get a measurable amount of work
+    const int repeat = 1000;
+
+    QTest::newRow("ASCII")
+            << QString("drwxr-xr-x  2 user users  4096 Jun  1 12:00 Documents").repeated(repeat);
+    QTest::newRow("CJK")
+            << QString::fromUtf8("\xe7\xbb\x88\xe7\xab\xaf\xe6\xa8\xa1\xe6\x8b\x9f\xe5\x99\xa8"
+                                 "\xe7\x9a\x84\xe5\xad\x97\xe7\xac\xa6\xe5\xae\xbd\xe5\xba\xa6"
+                                 "\xed\x84\xb0\xeb\xaf\xb8\xeb\x84\x90").repeated(repeat);
+    QTest::newRow("mixed")
+            << QString::fromUtf8("README \xe8\xaf\xb4\xe6\x98\x8e.txt  \xc3\xa9t\xc3\xa9  "
+                                 "\xe2\x94\x80\xe2\x94\x80 done").repeated(repeat);
+}
+
+void CharacterWidthTest::benchmarkStringWidth()
+{
+    QFETCH(QString, text);
+
+    int width = 0;
+    QBENCHMARK {
+        width = string_width(text);
+    }
+
+    QVERIFY(width >= text.length());
+}
+
+QTEST_KDEMAIN_CORE(CharacterWidthTest)
+
+#include "CharacterWidthTest.moc"
+
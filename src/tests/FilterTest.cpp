@@ -0,0 +1,149 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "FilterTest.h"
+
+// Qt
+#include <QtCore/QStringList>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Filter.h"
+
+using namespace Konsole;
+
+static const int COLUMNS = 20;
+
+// sets the image of 'chain' to 'lines', with the given line stamps and
+// properties, and processes it
+static void setImage(TerminalImageFilterChain* chain, const QStringList& lines,
+                     const QVector<quint64>& stamps,
+                     const QVector<LineProperty>& properties = QVector<LineProperty>())
+{
+    QVector<Character> image(lines.count() * COLUMNS);
+    for (int line = 0; line < lines.count(); line++) {
+        for (int i = 0; i < lines[line].length(); i++)
+            image[line * COLUMNS + i].character = lines[line][i].unicode();
+    }
+
+    chain->setImage(image.constData(), lines.count(), COLUMNS, properties, stamps, 1);
+    chain->process();
+}
+
+void FilterTest::testUrlHotSpots()
+{
+    TerminalImageFilterChain chain;
+    chain.addFilter(new UrlFilter());
+
+    setImage(&chain, QStringList() << "see www.kde.org now" << "nothing" << "ask me@kde.org",
+             QVector<quint64>() << 1 << 2 << 3);
+
+    QCOMPARE(chain.hotSpots().count(), 2);
+
+    Filter::HotSpot* spot = chain.hotSpotAt(0, 6);
+    QVERIFY(spot);
+    QCOMPARE(spot->type(), Filter::HotSpot::Link);
+    QCOMPARE(spot->startColumn(), 4);
+    QCOMPARE(spot->endColumn(), 15);
+
+    spot = chain.hotSpotAt(2, 6);
+    QVERIFY(spot);
+    QCOMPARE(spot->startLine(), 2);
+    QCOMPARE(spot->startColumn(), 4);
+
+    QVERIFY(!chain.hotSpotAt(1, 2));
+}
+
+void FilterTest::testUnchangedLinesKeepHotSpots()
+{
+    TerminalImageFilterChain chain;
+    chain.addFilter(new UrlFilter());
+
+    setImage(&chain, QStringList() << "see www.kde.org now" << "nothing" << "ask me@kde.org",
+             QVector<quint64>() << 1 << 2 << 3);
+    Filter::HotSpot* email = chain.hotSpotAt(2, 6);
+
+    // scroll up by one line, only the new last line is searched
+    setImage(&chain, QStringList() << "nothing" << "ask me@kde.org" << "www.kde.org/x",
+             QVector<quint64>() << 2 << 3 << 4);
+
+    QCOMPARE(chain.hotSpots().count(), 2);
+    QCOMPARE(chain.hotSpotAt(1, 6), email);
+    QCOMPARE(email->startLine(), 1);
+    QCOMPARE(email->endLine(), 1);
+    QVERIFY(chain.hotSpotAt(2, 0));
+    QVERIFY(!chain.hotSpotAt(0, 6));
+
+    // a line with a new stamp is searched again
+    setImage(&chain, QStringList() << "nothing" << "ask you@kde.org" << "www.kde.org/x",
+             QVector<quint64>() << 2 << 5 << 4);
+
+    QCOMPARE(chain.hotSpots().count(), 2);
+    QVERIFY(chain.hotSpotAt(1, 6));
+    QCOMPARE(chain.hotSpotAt(1, 6)->endColumn(), 15);
+}
+
+void FilterTest::testWrappedLinesProcessedTogether()
+{
+    TerminalImageFilterChain chain;
+    chain.addFilter(new UrlFilter());
+
+    const QVector<LineProperty> properties = QVector<LineProperty>() << LINE_WRAPPED << LINE_DEFAULT;
+
+    setImage(&chain, QStringList() << "go to http://www.kde" << ".org/a now",
+             QVector<quint64>() << 1 << 2, properties);
+
+    QCOMPARE(chain.hotSpots().count(), 1);
+    Filter::HotSpot* spot = chain.hotSpots().first();
+    QCOMPARE(spot->startLine(), 0);
+    QCOMPARE(spot->endLine(), 1);
+    QCOMPARE(spot->endColumn(), 6);
+
+    // the unchanged first line is searched again with the second one
+    setImage(&chain, QStringList() << "go to http://www.kde" << ".org/abc now",
+             QVector<quint64>() << 1 << 3, properties);
+
+    QCOMPARE(chain.hotSpots().count(), 1);
+    QCOMPARE(chain.hotSpots().first()->startColumn(), 6);
+    QCOMPARE(chain.hotSpots().first()->endColumn(), 8);
+}
+
+void FilterTest::testChangedFilterProcessesAllLines()
+{
+    TerminalImageFilterChain chain;
+    RegExpFilter* filter = new RegExpFilter();
+    filter->setRegExp(QRegExp("kde"));
+    chain.addFilter(filter);
+
+    const QStringList lines = QStringList() << "www.kde.org" << "konsole";
+    const QVector<quint64> stamps = QVector<quint64>() << 1 << 2;
+
+    setImage(&chain, lines, stamps);
+    QCOMPARE(chain.hotSpots().count(), 1);
+
+    filter->setRegExp(QRegExp("o"));
+    setImage(&chain, lines, stamps);
+    QCOMPARE(chain.hotSpots().count(), 3);
+    QVERIFY(chain.hotSpotAt(1, 1));
+}
+
+QTEST_KDEMAIN(FilterTest , GUI)
+
+#include "FilterTest.moc"
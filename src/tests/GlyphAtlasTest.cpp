@@ -0,0 +1,129 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "GlyphAtlasTest.h"
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../GlyphAtlas.h"
+
+using namespace Konsole;
+
+static const int GLYPH_WIDTH = 8;
+static const int GLYPH_HEIGHT = 16;
+
+// returns a different color for each 'index', so that each is a new glyph
+static QRgb glyphColor(int index)
+{
+    return qRgb(index & 0xFF, (index >> 8) & 0xFF, 1);
+}
+
+// returns the number of pixels of 'image' which have been drawn on
+static int inkPixels(const QImage& image)
+{
+    int count = 0;
+    for (int y = 0; y < image.height(); y++) {
+        for (int x = 0; x < image.width(); x++) {
+            if (qAlpha(image.pixel(x, y)) != 0)
+                count++;
+        }
+    }
+    return count;
+}
+
+void GlyphAtlasTest::testGlyphsAreReused()
+{
+    GlyphAtlas atlas(QFont(), GLYPH_WIDTH, GLYPH_HEIGHT);
+    QCOMPARE(atlas.glyphSize(), QSize(GLYPH_WIDTH, GLYPH_HEIGHT));
+
+    const QRect red = atlas.glyph('X', 0, qRgb(0xFF, 0, 0));
+    QCOMPARE(red.size(), atlas.glyphSize());
+    QCOMPARE(atlas.glyph('X', 0, qRgb(0xFF, 0, 0)), red);
+
+    // the glyph is rendered in its color
+    const QImage glyph = atlas.image().copy(red);
+    QVERIFY(inkPixels(glyph) > 0);
+    for (int y = 0; y < glyph.height(); y++) {
+        for (int x = 0; x < glyph.width(); x++)
+            QCOMPARE(qGreen(glyph.pixel(x, y)), 0);
+    }
+
+    // other colors, styles and characters are separate glyphs
+    const QRect green = atlas.glyph('X', 0, qRgb(0, 0xFF, 0));
+    const QRect bold = atlas.glyph('X', GlyphAtlas::Bold, qRgb(0xFF, 0, 0));
+    const QRect other = atlas.glyph('Y', 0, qRgb(0xFF, 0, 0));
+    QVERIFY(green != red);
+    QVERIFY(bold != red && bold != green);
+    QVERIFY(other != red && other != green && other != bold);
+}
+
+void GlyphAtlasTest::testGrowth()
+{
+    GlyphAtlas atlas(QFont(), GLYPH_WIDTH, GLYPH_HEIGHT);
+    QCOMPARE(atlas.image().size(), QSize(GlyphAtlas::GLYPHS_PER_ROW * GLYPH_WIDTH,
+                                         GlyphAtlas::INITIAL_ROWS * GLYPH_HEIGHT));
+
+    const QRect first = atlas.glyph('X', 0, qRgb(0, 0, 0));
+    const QImage firstGlyph = atlas.image().copy(first);
+    QVERIFY(inkPixels(firstGlyph) > 0);
+
+    const int initialGlyphs = GlyphAtlas::GLYPHS_PER_ROW * GlyphAtlas::INITIAL_ROWS;
+    for (int i = 1; i < initialGlyphs; i++)
+        atlas.glyph('a', 0, glyphColor(i));
+    QCOMPARE(atlas.image().height(), GlyphAtlas::INITIAL_ROWS * GLYPH_HEIGHT);
+
+    // the atlas doubles in height once it is full, and keeps the glyphs
+    // which have been rendered so far
+    const QRect next = atlas.glyph('a', 0, glyphColor(initialGlyphs));
+    QCOMPARE(atlas.image().height(), 2 * GlyphAtlas::INITIAL_ROWS * GLYPH_HEIGHT);
+    QCOMPARE(next, QRect(0, GlyphAtlas::INITIAL_ROWS * GLYPH_HEIGHT, GLYPH_WIDTH, GLYPH_HEIGHT));
+    QCOMPARE(atlas.glyph('X', 0, qRgb(0, 0, 0)), first);
+    QCOMPARE(atlas.image().copy(first), firstGlyph);
+
+    const int doubledGlyphs = 2 * initialGlyphs;
+    for (int i = initialGlyphs + 1; i <= doubledGlyphs; i++)
+        atlas.glyph('a', 0, glyphColor(i));
+    QCOMPARE(atlas.image().height(), 4 * GlyphAtlas::INITIAL_ROWS * GLYPH_HEIGHT);
+}
+
+void GlyphAtlasTest::testClear()
+{
+    GlyphAtlas atlas(QFont(), GLYPH_WIDTH, GLYPH_HEIGHT);
+
+    const int maximumGlyphs = GlyphAtlas::GLYPHS_PER_ROW * GlyphAtlas::MAXIMUM_ROWS;
+    for (int i = 0; i < maximumGlyphs; i++)
+        atlas.glyph('a', 0, glyphColor(i));
+    QCOMPARE(atlas.image().height(), GlyphAtlas::MAXIMUM_ROWS * GLYPH_HEIGHT);
+
+    // the atlas is emptied when it can not grow any further
+    const QRect rect = atlas.glyph('X', 0, qRgb(0, 0, 0));
+    QCOMPARE(rect, QRect(0, 0, GLYPH_WIDTH, GLYPH_HEIGHT));
+    QCOMPARE(atlas.image().size(), QSize(GlyphAtlas::GLYPHS_PER_ROW * GLYPH_WIDTH,
+                                         GlyphAtlas::INITIAL_ROWS * GLYPH_HEIGHT));
+    QVERIFY(inkPixels(atlas.image().copy(rect)) > 0);
+    QCOMPARE(inkPixels(atlas.image()), inkPixels(atlas.image().copy(rect)));
+
+    // glyphs from before are rendered again when they are needed
+    QCOMPARE(atlas.glyph('a', 0, glyphColor(0)), QRect(GLYPH_WIDTH, 0, GLYPH_WIDTH, GLYPH_HEIGHT));
+}
+
+QTEST_KDEMAIN(GlyphAtlasTest , GUI)
+
+#include "GlyphAtlasTest.moc"
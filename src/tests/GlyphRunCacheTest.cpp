@@ -0,0 +1,111 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "GlyphRunCacheTest.h"
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../GlyphRunCache.h"
+
+using namespace Konsole;
+
+void GlyphRunCacheTest::testHitAndMiss()
+{
+    GlyphRunCache cache;
+    QFont font;
+
+    const QStaticText* first = cache.staticText("hello", font);
+    QVERIFY(first != 0);
+    QCOMPARE(first->text(), QString("hello"));
+    QCOMPARE(cache.hits(), quint64(0));
+    QCOMPARE(cache.misses(), quint64(1));
+
+    // the same fragment is not laid out again
+    const QStaticText* second = cache.staticText("hello", font);
+    QCOMPARE(second, first);
+    QCOMPARE(cache.hits(), quint64(1));
+    QCOMPARE(cache.misses(), quint64(1));
+
+    cache.staticText("world", font);
+    QCOMPARE(cache.hits(), quint64(1));
+    QCOMPARE(cache.misses(), quint64(2));
+}
+
+void GlyphRunCacheTest::testFonts()
+{
+    GlyphRunCache cache;
+    QFont font;
+    QFont boldFont = font;
+    boldFont.setBold(true);
+
+    // the same text in another font is a different fragment
+    cache.staticText("hello", font);
+    cache.staticText("hello", boldFont);
+    QCOMPARE(cache.misses(), quint64(2));
+
+    cache.staticText("hello", font);
+    cache.staticText("hello", boldFont);
+    QCOMPARE(cache.hits(), quint64(2));
+    QCOMPARE(cache.misses(), quint64(2));
+}
+
+void GlyphRunCacheTest::testEviction()
+{
+    GlyphRunCache cache;
+    cache.setMaxCost(2);
+    QCOMPARE(cache.maxCost(), 2);
+
+    QFont font;
+    cache.staticText("one", font);
+    cache.staticText("two", font);
+
+    // make "one" the most recently used fragment, so that adding a third
+    // fragment to the full cache discards "two"
+    cache.staticText("one", font);
+    QCOMPARE(cache.hits(), quint64(1));
+
+    cache.staticText("three", font);
+    QCOMPARE(cache.misses(), quint64(3));
+
+    cache.staticText("one", font);
+    cache.staticText("three", font);
+    QCOMPARE(cache.hits(), quint64(3));
+    QCOMPARE(cache.misses(), quint64(3));
+
+    cache.staticText("two", font);
+    QCOMPARE(cache.hits(), quint64(3));
+    QCOMPARE(cache.misses(), quint64(4));
+}
+
+void GlyphRunCacheTest::testClear()
+{
+    GlyphRunCache cache;
+    QFont font;
+
+    cache.staticText("hello", font);
+    cache.clear();
+    cache.staticText("hello", font);
+    QCOMPARE(cache.hits(), quint64(0));
+    QCOMPARE(cache.misses(), quint64(2));
+}
+
+QTEST_KDEMAIN(GlyphRunCacheTest , GUI)
+
+#include "GlyphRunCacheTest.moc"
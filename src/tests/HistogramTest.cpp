@@ -0,0 +1,92 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistogramTest.h"
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Histogram.h"
+
+using namespace Konsole;
+
+void HistogramTest::testEmpty()
+{
+    Histogram histogram;
+    QCOMPARE(histogram.count(), 0);
+    QCOMPARE(histogram.maximum(), 0);
+    QCOMPARE(histogram.percentile(50), 0);
+}
+
+void HistogramTest::testPercentile()
+{
+    Histogram histogram;
+    for (int i = 0; i < 90; i++)
+        histogram.addValue(2);
+    for (int i = 0; i < 9; i++)
+        histogram.addValue(12);
+    histogram.addValue(100000);
+
+    QCOMPARE(histogram.count(), 100);
+    QCOMPARE(histogram.maximum(), 100000);
+
+    // percentiles are the upper limits of the ranges 2-3 and 8-15
+    QCOMPARE(histogram.percentile(50), 3);
+    QCOMPARE(histogram.percentile(90), 3);
+    QCOMPARE(histogram.percentile(99), 15);
+    QCOMPARE(histogram.percentile(100), 100000);
+
+    // but never larger than the largest value
+    Histogram small;
+    small.addValue(5);
+    QCOMPARE(small.percentile(50), 5);
+
+    small.addValue(-1);
+    QCOMPARE(small.percentile(50), 0);
+}
+
+void HistogramTest::testAdd()
+{
+    Histogram first;
+    first.addValue(1);
+    first.addValue(1);
+
+    Histogram second;
+    second.addValue(40);
+
+    first.add(second);
+    QCOMPARE(first.count(), 3);
+    QCOMPARE(first.maximum(), 40);
+    QCOMPARE(first.percentile(50), 1);
+    QCOMPARE(first.percentile(100), 40);
+}
+
+void HistogramTest::testToString()
+{
+    Histogram histogram;
+    histogram.addValue(0);
+    histogram.addValue(1);
+    histogram.addValue(5);
+
+    QCOMPARE(histogram.toString(), QString("count 3 p50 1 p90 5 p99 5 max 5 ranges 0:1 1:1 7:1"));
+}
+
+QTEST_KDEMAIN_CORE(HistogramTest)
+
+#include "HistogramTest.moc"
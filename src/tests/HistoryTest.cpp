@@ -22,6 +22,12 @@
 
 #include "qtest_kde.h"
 
+// Qt
+#include <QtCore/QFileInfo>
+
+// KDE
+#include <KTempDir>
+
 // Konsole
 #include "../Session.h"
 #include "../Emulation.h"
@@ -111,7 +117,8 @@ void HistoryTest::testHistoryScroll()
     QCOMPARE(historyTypeNone.maximumLineCount(), 0);
 
     // File
-    historyScroll = new HistoryScrollFile(QString("test.log"));
+    KTempDir tempDir;
+    historyScroll = new HistoryScrollFile(tempDir.name() + "test.log");
     QVERIFY(historyScroll->hasScroll());
     QCOMPARE(historyScroll->getLines(), 0);
     QCOMPARE(historyScroll->getLineLen(0), 0);
@@ -137,6 +144,611 @@ void HistoryTest::testHistoryScroll()
     delete historyScroll;
 }
 
+void HistoryTest::testHistoryFileContents()
+{
+    KTempDir tempDir;
+    HistoryScrollFile historyScroll(tempDir.name() + "test.log");
+
+    // enough lines to span several of the history file's mmap windows
+    const int lineCount = 20000;
+    const int lineLength = 80;
+    Character line[lineLength];
+    for (int i = 0; i < lineCount; i++) {
+        for (int j = 0; j < lineLength; j++)
+            line[j].character = 'a' + (i + j) % 26;
+        historyScroll.addCells(line, lineLength);
+        historyScroll.addLine(i % 2);
+    }
+
+    QCOMPARE(historyScroll.getLines(), lineCount);
+
+    for (int i = 0; i < lineCount; i += 7) {
+        QCOMPARE(historyScroll.getLineLen(i), lineLength);
+        QCOMPARE(historyScroll.isWrappedLine(i), bool(i % 2));
+
+        historyScroll.getCells(i, 0, lineLength, line);
+        for (int j = 0; j < lineLength; j++)
+            QCOMPARE(line[j].character, quint16('a' + (i + j) % 26));
+    }
+}
+
+void HistoryTest::testHistoryFileSegments()
+{
+    HistoryFile file;
+    file.setMaxMappedSegments(2);
+
+    // numbered blocks filling several of the file's 1 MiB mmap windows
+    const int blockSize = 4096;
+    const int blockCount = 6 * 256;
+    QVector<qint32> block(blockSize / sizeof(qint32));
+    for (int i = 0; i < blockCount; i++) {
+        block.fill(i);
+        file.add((const unsigned char*)block.constData(), blockSize);
+    }
+    QCOMPARE(file.len(), qint64(blockSize) * blockCount);
+
+    // read the late windows first, then the early ones, which have to be
+    // mapped in again after being evicted
+    qint32 value;
+    for (int i = blockCount - 1; i >= 0; i -= 37) {
+        file.get((unsigned char*)&value, sizeof(value), qint64(i) * blockSize + 8);
+        QCOMPARE(value, i);
+        QVERIFY(file.mappedSegmentCount() <= 2);
+    }
+    for (int i = 0; i < blockCount; i += 37) {
+        file.get((unsigned char*)&value, sizeof(value), qint64(i) * blockSize + 8);
+        QCOMPARE(value, i);
+        QVERIFY(file.mappedSegmentCount() <= 2);
+    }
+
+    // a read which straddles two windows
+    qint32 values[2];
+    file.get((unsigned char*)values, sizeof(values), (1 << 20) - sizeof(qint32));
+    QCOMPARE(values[0], (1 << 20) / blockSize - 1);
+    QCOMPARE(values[1], (1 << 20) / blockSize);
+    QVERIFY(file.mappedSegmentCount() <= 2);
+
+    file.setMaxMappedSegments(1);
+    QVERIFY(file.mappedSegmentCount() <= 1);
+}
+
+void HistoryTest::testHistoryFileReopen()
+{
+    KTempDir tempDir;
+    const QString fileName = tempDir.name() + "test-reopen.log";
+
+    Character line[10];
+    {
+        HistoryScrollFile historyScroll(fileName);
+        for (int i = 0; i < 3000; i++) {
+            line[0].character = 'a' + i % 26;
+            historyScroll.addCells(line, i % 10);
+            historyScroll.addLine(i % 3 == 0);
+        }
+        QVERIFY(historyScroll.checkpoint());
+    }
+
+    {
+        HistoryScrollFile historyScroll(fileName);
+        QCOMPARE(historyScroll.getLines(), 3000);
+        for (int i = 1; i < 3000; i += 10) {
+            QCOMPARE(historyScroll.getLineLen(i), i % 10);
+            QCOMPARE(historyScroll.isWrappedLine(i), i % 3 == 0);
+            historyScroll.getCells(i, 0, 1, line);
+            QCOMPARE(line[0].character, quint16('a' + i % 26));
+        }
+
+        // enough lines for checkpoints to be written while they are added,
+        // each of which only holds what was added since the one before
+        for (int i = 3000; i < 40000; i++) {
+            line[0].character = 'a' + i % 26;
+            historyScroll.addCells(line, i % 10);
+            historyScroll.addLine(i % 3 == 0);
+        }
+    }
+
+    {
+        HistoryScrollFile historyScroll(fileName);
+        QCOMPARE(historyScroll.getLines(), 40000);
+        for (int i = 1; i < 40000; i += 101) {
+            QCOMPARE(historyScroll.getLineLen(i), i % 10);
+            QCOMPARE(historyScroll.isWrappedLine(i), i % 3 == 0);
+            historyScroll.getCells(i, 0, 1, line);
+            QCOMPARE(line[0].character, quint16('a' + i % 26));
+        }
+        historyScroll.setPersistent(false);
+    }
+    QVERIFY(!QFile::exists(fileName));
+
+    // temporary histories can not be reopened
+    HistoryScrollFile temporaryScroll((QString()));
+    QVERIFY(!temporaryScroll.checkpoint());
+}
+
+void HistoryTest::testHistoryFileTrueColors()
+{
+    KTempDir tempDir;
+    const QString fileName = tempDir.name() + "test-colors.log";
+
+    const CharacterColor red(COLOR_SPACE_RGB, 0xC00000);
+    const CharacterColor green(COLOR_SPACE_RGB, 0x00C000);
+    const CharacterColor blue(COLOR_SPACE_RGB, 0x0000C0);
+    const CharacterColor yellow(COLOR_SPACE_SYSTEM, 3);
+
+    Character line[4];
+    line[0].foregroundColor = green;
+    line[1].foregroundColor = red;
+    line[1].backgroundColor = green;
+    line[2].foregroundColor = yellow;
+
+    {
+        HistoryScrollFile historyScroll(fileName);
+        historyScroll.addCells(line, 4);
+        historyScroll.addLine();
+        QVERIFY(historyScroll.checkpoint());
+    }
+
+    {
+        HistoryScrollFile historyScroll(fileName);
+        Character cells[4];
+        historyScroll.getCells(0, 0, 4, cells);
+        for (int i = 0; i < 4; i++)
+            QVERIFY(cells[i] == line[i]);
+
+        // colors which are added to a reopened history are added to
+        // the table of the file
+        cells[3].backgroundColor = blue;
+        historyScroll.addCells(cells, 4);
+        historyScroll.addLine();
+        QVERIFY(historyScroll.checkpoint());
+    }
+
+    {
+        HistoryScrollFile historyScroll(fileName);
+        QCOMPARE(historyScroll.getLines(), 2);
+
+        Character cells[4];
+        historyScroll.getCells(1, 0, 4, cells);
+        QVERIFY(cells[1] == line[1]);
+        QVERIFY(cells[3].backgroundColor == blue);
+        QCOMPARE(cells[3].backgroundColor.color(0), QColor(0x00, 0x00, 0xC0));
+        historyScroll.setPersistent(false);
+    }
+    QVERIFY(!QFile::exists(fileName));
+}
+
+void HistoryTest::testHistoryFilePermissions()
+{
+    const QFile::Permissions otherUsers = QFile::ReadGroup | QFile::WriteGroup | QFile::ExeGroup |
+                                          QFile::ReadOther | QFile::WriteOther | QFile::ExeOther;
+
+    // the history is only accessible to the user, whatever the umask is
+    KTempDir tempDir;
+    const QString fileName = tempDir.name() + "test-permissions.log";
+    {
+        HistoryScrollFile historyScroll(fileName);
+        Character line[10];
+        historyScroll.addCells(line, 10);
+        historyScroll.addLine();
+        QVERIFY(historyScroll.checkpoint());
+
+        const QFile::Permissions permissions = QFile::permissions(fileName);
+        QCOMPARE(permissions & (QFile::ReadOwner | QFile::WriteOwner), QFile::ReadOwner | QFile::WriteOwner);
+        QCOMPARE(permissions & (otherUsers | QFile::ExeOwner), QFile::Permissions(0));
+    }
+
+    // files written by earlier versions are restricted when reopened
+    QVERIFY(QFile::setPermissions(fileName, QFile::ReadOwner | QFile::WriteOwner | QFile::ReadOther));
+    {
+        HistoryScrollFile historyScroll(fileName);
+        QCOMPARE(historyScroll.getLines(), 1);
+        QCOMPARE(QFile::permissions(fileName) & otherUsers, QFile::Permissions(0));
+        historyScroll.setPersistent(false);
+    }
+
+    const QString directory = Session::historyDirectory();
+    QVERIFY(QFileInfo(directory).isDir());
+    QCOMPARE(QFile::permissions(directory) & otherUsers, QFile::Permissions(0));
+}
+
+void HistoryTest::testRemoveUnusedHistoryFiles()
+{
+    KTempDir tempDir;
+    const QString usedFileName = tempDir.name() + "used.history";
+    const QString openFileName = tempDir.name() + "open.history";
+    const QString unusedFileName = tempDir.name() + "unused.history";
+
+    Character line[10];
+    foreach(const QString& fileName, QStringList() << usedFileName << unusedFileName) {
+        HistoryScrollFile historyScroll(fileName);
+        historyScroll.addCells(line, 10);
+        historyScroll.addLine();
+        QVERIFY(historyScroll.checkpoint());
+    }
+
+    HistoryScrollFile openScroll(openFileName);
+    QVERIFY(HistoryFile::isInUse(openFileName));
+    QVERIFY(!HistoryFile::isInUse(unusedFileName));
+
+    HistoryTypeFile::removeUnusedFiles(tempDir.name(), QStringList() << usedFileName);
+    QVERIFY(QFile::exists(usedFileName));
+    QVERIFY(QFile::exists(openFileName));
+    QVERIFY(!QFile::exists(unusedFileName));
+}
+
+void HistoryTest::testCompactHistoryEviction()
+{
+    CompactHistoryScroll historyScroll(100);
+
+    for (int i = 0; i < 350; i++) {
+        TextLine line(i % 50);
+        for (int j = 0; j < line.size(); j++)
+            line[j].character = i + j;
+        historyScroll.addCellsVector(line);
+        historyScroll.addLine(i % 2);
+    }
+    QCOMPARE(historyScroll.getLines(), 100);
+
+    // the oldest remaining line is #250
+    Character buffer[50];
+    for (int lineNumber = 0; lineNumber < 100; lineNumber++) {
+        const int i = 250 + lineNumber;
+        QCOMPARE(historyScroll.getLineLen(lineNumber), i % 50);
+        QCOMPARE(historyScroll.isWrappedLine(lineNumber), bool(i % 2));
+        historyScroll.getCells(lineNumber, 0, i % 50, buffer);
+        for (int j = 0; j < i % 50; j++)
+            QCOMPARE(buffer[j].character, quint16(i + j));
+    }
+
+    historyScroll.setMaxNbLines(10);
+    QCOMPARE(historyScroll.getLines(), 10);
+    QCOMPARE(historyScroll.getLineLen(0), 340 % 50);
+
+    historyScroll.setMaxNbLines(1000);
+    historyScroll.addCells(buffer, 5);
+    historyScroll.addLine();
+    QCOMPARE(historyScroll.getLines(), 11);
+    QCOMPARE(historyScroll.getLineLen(10), 5);
+}
+
+void HistoryTest::testCompactHistoryCompression()
+{
+    CompactHistoryScroll historyScroll(50000);
+
+    const int lineCount = 50000;
+    TextLine line(80);
+    for (int i = 0; i < lineCount; i++) {
+        for (int j = 0; j < line.size(); j++)
+            line[j].character = 'a' + (i + j) % 26;
+        historyScroll.addCellsVector(line);
+        historyScroll.addLine();
+    }
+
+    // older blocks have been compressed
+    QVERIFY(historyScroll.memoryUsage() < historyScroll.uncompressedMemoryUsage());
+
+    // and are transparently decompressed when they are read
+    Character buffer[80];
+    for (int i = 0; i < lineCount; i += 97) {
+        QCOMPARE(historyScroll.getLineLen(i), 80);
+        historyScroll.getCells(i, 0, 80, buffer);
+        for (int j = 0; j < 80; j++)
+            QCOMPARE(buffer[j].character, quint16('a' + (i + j) % 26));
+    }
+}
+
+void HistoryTest::testCompactHistoryTrueColors()
+{
+    CompactHistoryScroll historyScroll(50000);
+
+    const CharacterColor foreground(COLOR_SPACE_RGB, 0x102030);
+    const CharacterColor background(COLOR_SPACE_RGB, 0x405060);
+    TextLine line(80);
+    line[10].foregroundColor = foreground;
+    line[20].backgroundColor = background;
+    historyScroll.addCellsVector(line);
+    historyScroll.addLine();
+
+    line[10] = Character();
+    line[20] = Character();
+    for (int i = 0; i < 50000; i++) {
+        for (int j = 0; j < line.size(); j++)
+            line[j].character = 'a' + (i + j) % 26;
+        historyScroll.addCellsVector(line);
+        historyScroll.addLine();
+    }
+
+    // the block holding the colored line has been frozen, finding the
+    // colors used must not thaw it
+    const qint64 memoryUsage = historyScroll.memoryUsage();
+    QVERIFY(memoryUsage < historyScroll.uncompressedMemoryUsage());
+
+    QSet<int> indexes;
+    historyScroll.addUsedTrueColors(indexes);
+    QVERIFY(indexes.contains(foreground.trueColorIndex()));
+    QVERIFY(indexes.contains(background.trueColorIndex()));
+    QCOMPARE(historyScroll.memoryUsage(), memoryUsage);
+}
+
+void HistoryTest::testHistoryMigration()
+{
+    CompactHistoryScroll* compactScroll = new CompactHistoryScroll(10000);
+    TextLine line(20);
+    for (int i = 0; i < 10000; i++) {
+        line[0].character = i;
+        compactScroll->addCellsVector(line);
+        compactScroll->addLine();
+    }
+
+    HistoryTypeFile historyType((QString()));
+    HistoryScroll* historyScroll = historyType.scroll(compactScroll);
+    HistoryScrollMigration* migration = dynamic_cast<HistoryScrollMigration*>(historyScroll);
+    QVERIFY(migration);
+    QCOMPARE(migration->getType().isUnlimited(), true);
+
+    // lines added during the migration follow the old ones
+    int lineCount = 10000;
+    Character buffer[20];
+    while (!migration->migrate(1000)) {
+        line[0].character = lineCount++;
+        migration->addCellsVector(line);
+        migration->addLine();
+
+        QCOMPARE(migration->getLines(), lineCount);
+        migration->getCells(lineCount - 1, 0, 1, buffer);
+        QCOMPARE(buffer[0].character, quint16(lineCount - 1));
+    }
+
+    historyScroll = migration->takeTarget();
+    delete migration;
+
+    QVERIFY(dynamic_cast<HistoryScrollFile*>(historyScroll));
+    QCOMPARE(historyScroll->getLines(), lineCount);
+    for (int i = 0; i < lineCount; i += 13) {
+        historyScroll->getCells(i, 0, 20, buffer);
+        QCOMPARE(buffer[0].character, quint16(i));
+    }
+
+    delete historyScroll;
+}
+
+// Decodes a line the way CompactHistoryLine originally did, looking up the
+// format of each character by scanning the format runs from the start of
+// the line.  Kept as the reference for benchmarkCompactHistoryLine().
+class LinearCompactHistoryLine : public CompactHistoryLine
+{
+public:
+    LinearCompactHistoryLine(const TextLine& line, CompactHistoryBlockList& blockList)
+        : CompactHistoryLine(line, blockList) {}
+
+    void getCharactersLinear(Character* array, int size, int startColumn) {
+        for (int i = startColumn; i < size + startColumn; i++) {
+            int formatPos = 0;
+            while ((formatPos + 1) < _formatLength && i >= _formatArray[formatPos + 1].startPos)
+                formatPos++;
+
+            Character& r = array[i - startColumn];
+            r.character = _text[i];
+            r.rendition = _formatArray[formatPos].rendition;
+            r.foregroundColor = _formatArray[formatPos].fgColor;
+            r.backgroundColor = _formatArray[formatPos].bgColor;
+            r.isRealCharacter = _formatArray[formatPos].isRealCharacter;
+        }
+    }
+};
+
+void HistoryTest::benchmarkCompactHistoryLine_data()
+{
+    QTest::addColumn<QString>("method");
+
+    QTest::newRow("getCharacters") << "getCharacters";
+    QTest::newRow("getCharacter") << "getCharacter";
+    QTest::newRow("linear scan") << "linear";
+}
+
+void HistoryTest::benchmarkCompactHistoryLine()
+{
+    QFETCH(QString, method);
+
+    // a wide line which changes colors every few characters,
+    // similar to colored compiler or ls output
+    const int columns = 300;
+    TextLine text(columns);
+    for (int i = 0; i < columns; i++) {
+        text[i].character = 'a' + i % 26;
+        text[i].foregroundColor = CharacterColor(COLOR_SPACE_SYSTEM, (i / 4) % 8);
+    }
+
+    CompactHistoryBlockList blockList;
+    LinearCompactHistoryLine* line = new(blockList, text) LinearCompactHistoryLine(text, blockList);
+
+    Character buffer[columns];
+    if (method == "getCharacters") {
+        QBENCHMARK {
+            line->getCharacters(buffer, columns, 0);
+        }
+    } else if (method == "getCharacter") {
+        QBENCHMARK {
+            for (int i = 0; i < columns; i++)
+                line->getCharacter(i, buffer[i]);
+        }
+    } else {
+        QBENCHMARK {
+            line->getCharactersLinear(buffer, columns, 0);
+        }
+    }
+
+    for (int i = 0; i < columns; i++)
+        QCOMPARE(buffer[i], text[i]);
+
+    delete line;
+}
+
+void HistoryTest::testWrapIndex()
+{
+    CompactHistoryScroll historyScroll(10);
+    HistoryWrapIndex wrapIndex;
+    wrapIndex.setScroll(&historyScroll);
+    wrapIndex.setWidth(4);
+
+    // each logical line is "abcdef" wrapped onto "abc"
+    TextLine line;
+    for (int i = 0; i < 3000; i++) {
+        line.resize(i % 2 ? 3 : 6);
+        for (int j = 0; j < line.size(); j++)
+            line[j].character = 'a' + j;
+        historyScroll.addCellsVector(line);
+        historyScroll.addLine(i % 2 == 0);
+        wrapIndex.lineAdded();
+    }
+
+    // the 5 logical lines which are left are wrapped onto 3 lines each
+    QCOMPARE(wrapIndex.getLines(), 15);
+    QCOMPARE(wrapIndex.getLineLen(0), 4);
+    QCOMPARE(wrapIndex.getLineLen(2), 1);
+    QVERIFY(wrapIndex.isWrappedLine(1));
+    QVERIFY(!wrapIndex.isWrappedLine(2));
+
+    Character buffer[4];
+    wrapIndex.getCells(1, 0, 4, buffer);
+    QCOMPARE(buffer[0].character, quint16('e'));
+    QCOMPARE(buffer[2].character, quint16('a'));
+
+    wrapIndex.setWidth(9);
+    QCOMPARE(wrapIndex.getLines(), 5);
+    QVERIFY(!wrapIndex.isWrappedLine(0));
+    wrapIndex.setWidth(4);
+    QCOMPARE(wrapIndex.getLines(), 15);
+
+    // dropping "abcdef" splits the wrapped line "efab"
+    line.resize(6);
+    historyScroll.addCellsVector(line);
+    historyScroll.addLine(true);
+    QVERIFY(!wrapIndex.lineAdded());
+    QCOMPARE(wrapIndex.getLines(), 16);
+    QCOMPARE(wrapIndex.getLineLen(0), 2);
+    wrapIndex.getCells(0, 0, 2, buffer);
+    QCOMPARE(buffer[0].character, quint16('a'));
+    QVERIFY(wrapIndex.isWrappedLine(15));
+}
+
+// adds 'text' to 'historyScroll' as one line, in which the characters
+// outside of Latin-1 are double width
+static void addWideLine(HistoryScroll& historyScroll, const QString& text, bool wrapped)
+{
+    TextLine line;
+    for (int i = 0; i < text.length(); i++) {
+        line << Character(text[i].unicode());
+        if (text[i].unicode() > 0xff)
+            line << Character(0, CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR),
+                              CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR),
+                              DEFAULT_RENDITION, false);
+    }
+    historyScroll.addCellsVector(line);
+    historyScroll.addLine(wrapped);
+}
+
+void HistoryTest::testWrapIndexWideCharacters()
+{
+    const QChar zhong(0x4e2d);
+    const QChar wen(0x6587);
+    const QChar zi(0x5b57);
+
+    CompactHistoryScroll historyScroll(3);
+    HistoryWrapIndex wrapIndex;
+    wrapIndex.setScroll(&historyScroll);
+    wrapIndex.setWidth(4);
+
+    // each logical line is "a" zhong wen wrapped onto zi "b", which is
+    // wrapped onto "a" zhong, wen zi and "b" as a double width character
+    // must not be split
+    const QString first = QString("a") + zhong + wen;
+    const QString second = QString(zi) + 'b';
+    addWideLine(historyScroll, first, true);
+    QVERIFY(historyScroll.hasWideCharacters(0));
+    wrapIndex.lineAdded();
+    addWideLine(historyScroll, second, false);
+    wrapIndex.lineAdded();
+    addWideLine(historyScroll, first, true);
+    wrapIndex.lineAdded();
+
+    QCOMPARE(wrapIndex.getLines(), 5);
+    QCOMPARE(wrapIndex.getLineLen(0), 3);
+    QCOMPARE(wrapIndex.getLineLen(1), 4);
+    QCOMPARE(wrapIndex.getLineLen(2), 1);
+    QCOMPARE(wrapIndex.getLineLen(3), 3);
+    QCOMPARE(wrapIndex.getLineLen(4), 2);
+    QVERIFY(wrapIndex.isWrappedLine(0));
+    QVERIFY(!wrapIndex.isWrappedLine(2));
+    QVERIFY(wrapIndex.isWrappedLine(4));
+
+    Character buffer[4];
+    wrapIndex.getCells(1, 0, 4, buffer);
+    QCOMPARE(buffer[0].character, wen.unicode());
+    QVERIFY(buffer[1].isWidePlaceholder());
+    QCOMPARE(buffer[2].character, zi.unicode());
+
+    // completing the last logical line moves wen onto the next wrapped line,
+    // and dropping the first line leaves zi "b" of the first logical line
+    addWideLine(historyScroll, second, false);
+    QVERIFY(!wrapIndex.lineAdded());
+    QCOMPARE(wrapIndex.getLines(), 4);
+    QCOMPARE(wrapIndex.getLineLen(0), 3);
+    wrapIndex.getCells(0, 0, 1, buffer);
+    QCOMPARE(buffer[0].character, zi.unicode());
+    QCOMPARE(wrapIndex.getLineLen(2), 4);
+    QCOMPARE(wrapIndex.wrappedLine(0), 0);
+    QCOMPARE(wrapIndex.wrappedLine(1), 1);
+    QCOMPARE(wrapIndex.scrollLine(2), 1);
+
+    wrapIndex.setWidth(6);
+    QCOMPARE(wrapIndex.getLines(), 3);
+    QCOMPARE(wrapIndex.getLineLen(1), 5);
+    QCOMPARE(wrapIndex.getLineLen(2), 3);
+
+    wrapIndex.setWidth(4);
+    QCOMPARE(wrapIndex.getLines(), 4);
+    QCOMPARE(wrapIndex.getLineLen(1), 3);
+
+    // the lengths and flags of the lines are known without the lines
+    wrapIndex.reset();
+    QCOMPARE(wrapIndex.getLines(), 4);
+}
+
+void HistoryTest::testSearchIndex()
+{
+    HistorySearchIndex index;
+    for (int i = 0; i < 1000; i++)
+        index.addLine(QString("line %1").arg(i), false);
+    index.addLine("the Needle in", true);
+    index.addLine("the haystack", false);
+    for (int i = 0; i < 1000; i++)
+        index.addLine(QString("line %1").arg(i), false);
+    QCOMPARE(index.lineCount(), 2002);
+
+    // the lines of a block which contains the text are looked at
+    const QVector<int> keys = HistorySearchIndex::trigramKeys("needle");
+    int line = index.findLine(0, 2001, keys);
+    QVERIFY(line != -1 && line <= 1000);
+    QVERIFY(line > 1000 - 128);
+    line = index.findLine(2001, 0, keys);
+    QVERIFY(line >= 1000 && line < 1000 + 128);
+
+    QCOMPARE(index.findLine(0, 2001, HistorySearchIndex::trigramKeys("nothing")), -1);
+
+    // text which continues on the next line
+    QVERIFY(index.findLine(0, 2001, HistorySearchIndex::trigramKeys("inthe hay")) != -1);
+
+    // text which is too short to be looked up may be anywhere
+    QCOMPARE(index.findLine(5, 2001, HistorySearchIndex::trigramKeys("ne")), 5);
+
+    index.removeLines(1500);
+    QCOMPARE(index.lineCount(), 502);
+    QCOMPARE(index.findLine(0, 501, keys), -1);
+    line = index.findLine(0, 501, HistorySearchIndex::trigramKeys("line 999"));
+    QVERIFY(line != -1 && line > 501 - 128);
+}
+
 QTEST_KDEMAIN(HistoryTest , GUI)
 
 #include "HistoryTest.moc"
@@ -35,6 +35,21 @@ private slots:
     void testCompactHistory();
     void testEmulationHistory();
     void testHistoryScroll();
+    void testHistoryFileContents();
+    void testHistoryFileSegments();
+    void testHistoryFileReopen();
+    void testHistoryFileTrueColors();
+    void testHistoryFilePermissions();
+    void testRemoveUnusedHistoryFiles();
+    void testCompactHistoryEviction();
+    void testCompactHistoryCompression();
+    void testCompactHistoryTrueColors();
+    void testHistoryMigration();
+    void testWrapIndex();
+    void testWrapIndexWideCharacters();
+    void testSearchIndex();
+    void benchmarkCompactHistoryLine_data();
+    void benchmarkCompactHistoryLine();
 
 private:
 };
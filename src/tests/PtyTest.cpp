@@ -21,14 +21,39 @@
 #include "PtyTest.h"
 
 // Qt
+#include <QtCore/QMutex>
 #include <QtCore/QSize>
 #include <QtCore/QStringList>
+#include <QtCore/QThread>
 
 // KDE
 #include <qtest_kde.h>
 
+// Konsole
+#include "../PtyReader.h"
+
 using namespace Konsole;
 
+namespace
+{
+// collects the output which is passed to it, and the thread it is passed in
+class OutputCollector : public PtyOutputProcessor
+{
+public:
+    OutputCollector() : thread(0) {}
+
+    virtual void processOutput(const char* data, int length) {
+        QMutexLocker locker(&mutex);
+        output.append(data, length);
+        thread = QThread::currentThread();
+    }
+
+    QMutex mutex;
+    QByteArray output;
+    QThread* thread;
+};
+}
+
 void PtyTest::init()
 {
 }
@@ -89,6 +114,96 @@ void PtyTest::testRunProgram()
     QCOMPARE(pty.foregroundProcessGroup(), pty.pid());
 }
 
+void PtyTest::testThreadedReading()
+{
+    Pty pty;
+    pty.setThreadedReading(true);
+    QVERIFY(pty.threadedReading());
+
+    _receivedData.clear();
+    _largestReceivedBlock = 0;
+    connect(&pty, SIGNAL(receivedData(const char*,int)),
+            this, SLOT(receiveData(const char*,int)));
+
+    QStringList arguments;
+    arguments << "sh" << "-c" << "echo threaded";
+    const int result = pty.start("sh", arguments, QStringList());
+    QCOMPARE(result, 0);
+
+    for (int i = 0; i < 50 && !_receivedData.contains("threaded"); i++)
+        QTest::qWait(100);
+    QVERIFY(_receivedData.contains("threaded"));
+
+    pty.setThreadedReading(false);
+    QVERIFY(!pty.threadedReading());
+}
+
+void PtyTest::testReadInBlocks()
+{
+    Pty pty;
+
+    _receivedData.clear();
+    _largestReceivedBlock = 0;
+    connect(&pty, SIGNAL(receivedData(const char*,int)),
+            this, SLOT(receiveData(const char*,int)));
+
+    const int outputLength = 1000000;
+    QStringList arguments;
+    arguments << "sh" << "-c" << QString("head -c %1 /dev/zero | tr '\\0' x").arg(outputLength);
+    const int result = pty.start("sh", arguments, QStringList());
+    QCOMPARE(result, 0);
+
+    for (int i = 0; i < 100 && _receivedData.count('x') < outputLength; i++)
+        QTest::qWait(100);
+    QCOMPARE(_receivedData.count('x'), outputLength);
+
+    // the output is passed on in blocks of limited size
+    QVERIFY(_largestReceivedBlock <= 65536);
+    QCOMPARE(pty.bytesReceived(), qint64(_receivedData.size()));
+    QCOMPARE(pty.pendingBytes(), 0);
+}
+
+void PtyTest::testOutputProcessor()
+{
+    Pty pty;
+    OutputCollector collector;
+    pty.setThreadedReading(true);
+    pty.setOutputProcessor(&collector);
+
+    _receivedData.clear();
+    connect(&pty, SIGNAL(receivedData(const char*,int)),
+            this, SLOT(receiveData(const char*,int)));
+
+    QStringList arguments;
+    arguments << "sh" << "-c" << "echo processed";
+    const int result = pty.start("sh", arguments, QStringList());
+    QCOMPARE(result, 0);
+
+    bool processed = false;
+    for (int i = 0; i < 50 && !processed; i++) {
+        QTest::qWait(100);
+        QMutexLocker locker(&collector.mutex);
+        processed = collector.output.contains("processed");
+    }
+    QVERIFY(processed);
+
+    // the output is processed in the reading thread instead of being
+    // passed on with receivedData()
+    pty.setOutputProcessor(0);
+    QVERIFY(collector.thread != 0);
+    QVERIFY(collector.thread != QThread::currentThread());
+    QVERIFY(_receivedData.isEmpty());
+    QCOMPARE(pty.bytesReceived(), qint64(collector.output.size()));
+
+    pty.setThreadedReading(false);
+}
+
+void PtyTest::receiveData(const char* buffer, int length)
+{
+    _receivedData.append(buffer, length);
+    _largestReceivedBlock = qMax(_largestReceivedBlock, length);
+}
+
 QTEST_KDEMAIN_CORE(PtyTest)
 
 #include "PtyTest.moc"
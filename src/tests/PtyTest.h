@@ -39,6 +39,17 @@ private slots:
     void testWindowSize();
 
     void testRunProgram();
+    void testThreadedReading();
+    void testReadInBlocks();
+    void testOutputProcessor();
+
+    // collects the output received in testThreadedReading() and
+    // testReadInBlocks()
+    void receiveData(const char* buffer, int length);
+
+private:
+    QByteArray _receivedData;
+    int _largestReceivedBlock;
 };
 
 }
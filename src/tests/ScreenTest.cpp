@@ -0,0 +1,469 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "ScreenTest.h"
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Screen.h"
+#include "../History.h"
+
+using namespace Konsole;
+
+static void display(Screen* screen, const char* text)
+{
+    while (*text)
+        screen->displayCharacter(*text++);
+}
+
+static void display(Screen* screen, const QString& text)
+{
+    for (int i = 0; i < text.length(); i++)
+        screen->displayCharacter(text[i].unicode());
+}
+
+// some double width characters
+static const QString CJK_TEXT = QString(QChar(0x4e2d)) + QChar(0x6587) + QChar(0x5b57) + QChar(0x7b26);
+
+// returns the text of 'line', counting the history lines first
+static QString lineText(const Screen& screen, int line)
+{
+    const int columns = screen.getColumns();
+    QVector<Character> image(columns);
+    screen.getImage(image.data(), image.size(), line, line);
+
+    QString text;
+    for (int i = 0; i < columns; i++) {
+        if (!image[i].isWidePlaceholder())
+            text += QChar(image[i].character);
+    }
+    return text.trimmed();
+}
+
+// returns the number of cells from 'startLine' to the last line of the
+// screen which getImage() shows reversed but isSelected() does not report
+// as selected, or the other way around.  'selectedCount' is set to the
+// number of selected cells among them
+static int selectionMismatches(const Screen& screen, int startLine, int& selectedCount)
+{
+    const int columns = screen.getColumns();
+    const int endLine = screen.getHistLines() + screen.getLines() - 1;
+    QVector<Character> image((endLine - startLine + 1) * columns);
+    screen.getImage(image.data(), image.size(), startLine, endLine);
+
+    // the cells are all drawn in the default colors, unless they are reversed
+    const Character plain;
+    int mismatches = 0;
+    selectedCount = 0;
+    for (int line = startLine; line <= endLine; line++) {
+        for (int column = 0; column < columns; column++) {
+            const Character& cell = image[(line - startLine) * columns + column];
+            const bool reversed = cell.foregroundColor == plain.backgroundColor &&
+                                  cell.backgroundColor == plain.foregroundColor;
+            const bool selected = screen.isSelected(column, line);
+            if (reversed != selected)
+                mismatches++;
+            if (selected)
+                selectedCount++;
+        }
+    }
+    return mismatches;
+}
+
+void ScreenTest::testLineStampChangesWithLine()
+{
+    Screen screen(5, 20);
+    screen.setCursorYX(5, 1);
+
+    const QVector<quint64> before = screen.getLineStamps(0, 4);
+
+    screen.setCursorYX(2, 1);
+    display(&screen, "hello");
+    screen.setCursorYX(4, 3);
+    screen.clearToEndOfLine();
+    screen.setCursorYX(5, 1);
+
+    const QVector<quint64> after = screen.getLineStamps(0, 4);
+    QCOMPARE(after[0], before[0]);
+    QVERIFY(after[1] != before[1]);
+    QCOMPARE(after[2], before[2]);
+    QVERIFY(after[3] != before[3]);
+
+    // every change gives the line a new stamp
+    screen.setCursorYX(2, 1);
+    display(&screen, "x");
+    screen.setCursorYX(5, 1);
+    QVERIFY(screen.getLineStamps(0, 4)[1] != after[1]);
+}
+
+void ScreenTest::testLineStampFollowsScroll()
+{
+    Screen screen(5, 20);
+    screen.setCursorYX(5, 1);
+
+    const QVector<quint64> before = screen.getLineStamps(0, 4);
+
+    screen.scrollUp(2);
+
+    const QVector<quint64> after = screen.getLineStamps(0, 4);
+    QCOMPARE(after[0], before[2]);
+    QCOMPARE(after[1], before[3]);
+
+    // the lines cleared by the scroll are new
+    QVERIFY(!before.contains(after[3]));
+}
+
+void ScreenTest::testHistoryLineStamp()
+{
+    Screen screen(3, 20);
+    screen.setScroll(CompactHistoryType(2), false);
+    screen.setCursorYX(3, 1);
+
+    display(&screen, "one");
+    screen.newLine();
+    display(&screen, "two");
+    screen.newLine();
+    QCOMPARE(screen.getHistLines(), 2);
+
+    const QVector<quint64> stamps = screen.getLineStamps(0, 4);
+    QVERIFY(stamps[0] != stamps[1]);
+
+    // a line keeps its stamp when the oldest line is dropped from the history
+    display(&screen, "three");
+    screen.newLine();
+    QCOMPARE(screen.getHistLines(), 2);
+    QCOMPARE(screen.getLineStamps(0, 4)[0], stamps[1]);
+}
+
+void ScreenTest::testCursorLineStamp()
+{
+    Screen screen(5, 20);
+    screen.setCursorYX(3, 4);
+
+    const QVector<quint64> stamps = screen.getLineStamps(0, 4);
+    QCOMPARE(stamps[2], quint64(0));
+    QVERIFY(stamps[1] != 0);
+}
+
+void ScreenTest::testImageStamp()
+{
+    Screen screen(5, 20);
+
+    quint64 stamp = screen.imageStamp();
+    display(&screen, "hello");
+    QCOMPARE(screen.imageStamp(), stamp);
+
+    screen.setSelectionStart(0, 0, false);
+    screen.setSelectionEnd(3, 0);
+    QVERIFY(screen.imageStamp() != stamp);
+
+    stamp = screen.imageStamp();
+    screen.setMode(MODE_Screen);
+    QVERIFY(screen.imageStamp() != stamp);
+
+    stamp = screen.imageStamp();
+    screen.resizeImage(10, 40);
+    QVERIFY(screen.imageStamp() != stamp);
+}
+
+void ScreenTest::testPartialImage()
+{
+    Screen screen(4, 10);
+    display(&screen, "one");
+    screen.setCursorYX(3, 1);
+    display(&screen, "three");
+
+    QVector<Character> image(4 * 10);
+    screen.getImage(image.data(), image.size(), 0, 3);
+
+    screen.setCursorYX(1, 1);
+    display(&screen, "ONE");
+    screen.setCursorYX(3, 1);
+    display(&screen, "THREE");
+
+    // only the third line is copied again
+    QBitArray linesToCopy(4);
+    linesToCopy.setBit(2);
+    screen.getImage(image.data(), image.size(), 0, 3, linesToCopy);
+
+    QCOMPARE(image[0].character, quint16('o'));
+    QCOMPARE(image[2 * 10].character, quint16('T'));
+    QVERIFY(image[2 * 10 + 5].rendition & RE_CURSOR);
+}
+
+void ScreenTest::testReflowOnResize()
+{
+    Screen screen(4, 10);
+    screen.setReflowLines(true);
+    display(&screen, "abcdefghijklmno");
+    screen.setCursorYX(4, 1);
+    display(&screen, "xyz");
+    screen.setCursorYX(4, 3);
+
+    screen.resizeImage(4, 20);
+    QCOMPARE(lineText(screen, 0), QString("abcdefghijklmno"));
+    QCOMPARE(lineText(screen, 1), QString());
+    QCOMPARE(lineText(screen, 2), QString("xyz"));
+    QCOMPARE(screen.getCursorX(), 2);
+    QCOMPARE(screen.getCursorY(), 2);
+
+    // the first line no longer fits, and is lost as there is no history
+    screen.resizeImage(4, 5);
+    QCOMPARE(lineText(screen, 0), QString("fghij"));
+    QCOMPARE(lineText(screen, 1), QString("klmno"));
+    QCOMPARE(lineText(screen, 2), QString());
+    QCOMPARE(lineText(screen, 3), QString("xyz"));
+    QCOMPARE(screen.getLineProperties(0, 3)[0], LineProperty(LINE_WRAPPED));
+    QCOMPARE(screen.getLineProperties(0, 3)[1], LineProperty(LINE_DEFAULT));
+    QCOMPARE(screen.getCursorY(), 3);
+    QCOMPARE(screen.getCursorX(), 2);
+
+    // margins are kept if they fit
+    screen.setMargins(2, 3);
+    screen.resizeImage(5, 5);
+    QCOMPARE(screen.bottomMargin(), 2);
+    screen.resizeImage(2, 5);
+    QCOMPARE(screen.bottomMargin(), 1);
+
+    // double width characters are not split, one which does not fit at
+    // the end of a line is moved to the next one
+    Screen wide(4, 6);
+    wide.setReflowLines(true);
+    display(&wide, "ab");
+    display(&wide, CJK_TEXT);
+    QCOMPARE(lineText(wide, 0), QString("ab") + CJK_TEXT.left(2));
+    QCOMPARE(lineText(wide, 1), CJK_TEXT.mid(2));
+
+    wide.resizeImage(4, 5);
+    QCOMPARE(lineText(wide, 0), QString("ab") + CJK_TEXT.left(1));
+    QCOMPARE(lineText(wide, 1), CJK_TEXT.mid(1, 2));
+    QCOMPARE(lineText(wide, 2), CJK_TEXT.mid(3));
+    QCOMPARE(wide.getLineProperties(0, 2)[0], LineProperty(LINE_WRAPPED));
+    QCOMPARE(wide.getLineProperties(0, 2)[1], LineProperty(LINE_WRAPPED));
+    QCOMPARE(wide.getLineProperties(0, 2)[2], LineProperty(LINE_DEFAULT));
+    QCOMPARE(wide.getCursorY(), 2);
+    QCOMPARE(wide.getCursorX(), 2);
+
+    wide.resizeImage(4, 6);
+    QCOMPARE(lineText(wide, 0), QString("ab") + CJK_TEXT.left(2));
+    QCOMPARE(lineText(wide, 1), CJK_TEXT.mid(2));
+    QCOMPARE(wide.getCursorY(), 1);
+    QCOMPARE(wide.getCursorX(), 4);
+}
+
+void ScreenTest::testHistoryReflow()
+{
+    Screen screen(2, 10);
+    screen.setReflowLines(true);
+    screen.setScroll(CompactHistoryType(100));
+
+    display(&screen, "abcdefghijklmnopqrstuvwxy");
+    screen.nextLine();
+    display(&screen, "z");
+    QCOMPARE(screen.getHistLines(), 2);
+
+    // the history is wrapped again when the width changes
+    screen.resizeImage(2, 5);
+    QCOMPARE(screen.getHistLines(), 4);
+    QCOMPARE(lineText(screen, 0), QString("abcde"));
+    QCOMPARE(lineText(screen, 3), QString("pqrst"));
+    QCOMPARE(lineText(screen, 4), QString("uvwxy"));
+    QCOMPARE(lineText(screen, 5), QString("z"));
+
+    screen.resizeImage(2, 20);
+    QCOMPARE(screen.getHistLines(), 1);
+    QCOMPARE(lineText(screen, 0), QString("abcdefghijklmnopqrst"));
+    QCOMPARE(screen.getLineProperties(0, 0)[0], LineProperty(LINE_WRAPPED));
+
+    screen.resizeImage(2, 10);
+    QCOMPARE(screen.getHistLines(), 2);
+    QCOMPARE(lineText(screen, 1), QString("klmnopqrst"));
+
+    // double width characters in the history are not split either
+    Screen wide(2, 6);
+    wide.setReflowLines(true);
+    wide.setScroll(CompactHistoryType(100));
+
+    display(&wide, "ab");
+    display(&wide, CJK_TEXT);
+    wide.nextLine();
+    display(&wide, "y");
+    wide.nextLine();
+    display(&wide, "z");
+    QCOMPARE(wide.getHistLines(), 2);
+
+    wide.resizeImage(2, 5);
+    QCOMPARE(wide.getHistLines(), 3);
+    QCOMPARE(lineText(wide, 0), QString("ab") + CJK_TEXT.left(1));
+    QCOMPARE(lineText(wide, 1), CJK_TEXT.mid(1, 2));
+    QCOMPARE(lineText(wide, 2), CJK_TEXT.mid(3));
+    QCOMPARE(lineText(wide, 3), QString("y"));
+
+    wide.resizeImage(2, 6);
+    QCOMPARE(wide.getHistLines(), 2);
+    QCOMPARE(lineText(wide, 0), QString("ab") + CJK_TEXT.left(2));
+    QCOMPARE(lineText(wide, 1), CJK_TEXT.mid(2));
+
+    // lines of the screen which are moved into the history are counted
+    // as added to it
+    Screen moved(2, 10);
+    moved.setReflowLines(true);
+    moved.setScroll(CompactHistoryType(100));
+
+    display(&moved, "abcdefgh");
+    moved.nextLine();
+    display(&moved, "z");
+    QCOMPARE(moved.historyLinesAdded(), qint64(0));
+
+    moved.resizeImage(2, 4);
+    QCOMPARE(moved.getHistLines(), 1);
+    QCOMPARE(lineText(moved, 0), QString("abcd"));
+    QCOMPARE(moved.historyLinesAdded(), qint64(1));
+}
+
+void ScreenTest::testFindSearchLine()
+{
+    Screen screen(2, 10);
+    screen.setReflowLines(true);
+    screen.setScroll(CompactHistoryType(1000));
+
+    for (int i = 0; i < 500; i++) {
+        display(&screen, i == 300 ? "a needle" : "hay");
+        screen.nextLine();
+    }
+    const int histLines = screen.getHistLines();
+    QCOMPARE(histLines, 499);
+
+    int line = screen.findSearchLine("Needle", 0, histLines + 1);
+    QVERIFY(line != -1 && line <= 300);
+    line = screen.findSearchLine("needle", histLines + 1, 0);
+    QCOMPARE(line, histLines + 1);
+    line = screen.findSearchLine("needle", histLines - 1, 0);
+    QVERIFY(line >= 300 && line < histLines);
+
+    // lines far from the text are skipped, but the lines on the screen
+    // may always contain it
+    QCOMPARE(screen.findSearchLine("needle", 400, histLines + 1), histLines);
+    QCOMPARE(screen.findSearchLine("needle", histLines - 1, 400), -1);
+
+    // the index follows the lines of the history when they are wrapped again
+    screen.resizeImage(2, 4);
+    line = screen.findSearchLine("needle", 0, screen.getHistLines() - 1);
+    QVERIFY(line != -1 && line <= 300);
+    QCOMPARE(lineText(screen, 301), QString("edle"));
+    QCOMPARE(screen.findSearchLine("needle", 400, screen.getHistLines() - 1), -1);
+
+    // a large history is indexed over several searches, no lines are
+    // skipped until all of them are indexed
+    Screen large(2, 10);
+    large.setScroll(CompactHistoryType(30000));
+    for (int i = 0; i < 25000; i++) {
+        display(&large, "hay");
+        large.nextLine();
+    }
+    const int largeHistLines = large.getHistLines();
+    QCOMPARE(largeHistLines, 24999);
+    QCOMPARE(large.findSearchLine("needle", 0, largeHistLines + 1), 0);
+    QCOMPARE(large.findSearchLine("needle", 0, largeHistLines + 1), 0);
+    QCOMPARE(large.findSearchLine("needle", 0, largeHistLines + 1), largeHistLines);
+
+    // from then on new lines are indexed as they are added
+    display(&large, "a needle");
+    large.nextLine();
+    large.nextLine();
+    QCOMPARE(large.findSearchLine("needle", 0, large.getHistLines() + 1), 25000);
+}
+
+QTEST_KDEMAIN_CORE(ScreenTest)
+
+void ScreenTest::testSelectionImage()
+{
+    Screen screen(5, 10);
+    for (int i = 0; i < 5; i++) {
+        display(&screen, "0123456789");
+        if (i < 4)
+            screen.nextLine();
+    }
+
+    int selectedCount;
+    screen.setSelectionStart(3, 1, false);
+    screen.setSelectionEnd(4, 3);
+    QCOMPARE(selectionMismatches(screen, 0, selectedCount), 0);
+    QCOMPARE(selectedCount, 7 + 10 + 5);
+
+    // a selection within a single line
+    screen.setSelectionStart(6, 2, false);
+    screen.setSelectionEnd(2, 2);
+    QCOMPARE(selectionMismatches(screen, 0, selectedCount), 0);
+    QCOMPARE(selectedCount, 5);
+
+    screen.clearSelection();
+    QCOMPARE(selectionMismatches(screen, 0, selectedCount), 0);
+    QCOMPARE(selectedCount, 0);
+}
+
+void ScreenTest::testBlockSelectionImage()
+{
+    Screen screen(5, 10);
+    display(&screen, "0123456789");
+
+    // the corners may be given in any order
+    int selectedCount;
+    screen.setSelectionStart(7, 1, true);
+    screen.setSelectionEnd(2, 3);
+    QCOMPARE(selectionMismatches(screen, 0, selectedCount), 0);
+    QCOMPARE(selectedCount, 3 * 6);
+
+    screen.setSelectionStart(4, 0, true);
+    screen.setSelectionEnd(4, 4);
+    QCOMPARE(selectionMismatches(screen, 0, selectedCount), 0);
+    QCOMPARE(selectedCount, 5);
+}
+
+void ScreenTest::testHistorySelectionImage()
+{
+    Screen screen(3, 10);
+    screen.setScroll(CompactHistoryType(100));
+    for (int i = 0; i < 8; i++) {
+        display(&screen, "0123456789");
+        screen.nextLine();
+    }
+    const int historyLines = screen.getHistLines();
+    QVERIFY(historyLines > 2);
+
+    // from the second history line to the second line of the screen
+    int selectedCount;
+    screen.setSelectionStart(2, 1, false);
+    screen.setSelectionEnd(3, historyLines + 1);
+    const int expectedCount = historyLines * 10 + 2;
+    QCOMPARE(selectionMismatches(screen, 0, selectedCount), 0);
+    QCOMPARE(selectedCount, expectedCount);
+
+    // an image which starts after the first selected line
+    QCOMPARE(selectionMismatches(screen, 2, selectedCount), 0);
+    QCOMPARE(selectedCount, expectedCount - 8);
+
+    screen.setSelectionStart(1, 0, true);
+    screen.setSelectionEnd(4, historyLines + 2);
+    QCOMPARE(selectionMismatches(screen, 0, selectedCount), 0);
+    QCOMPARE(selectedCount, (historyLines + 3) * 4);
+}
+
+#include "ScreenTest.moc"
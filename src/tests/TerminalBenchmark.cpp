@@ -0,0 +1,342 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+/*
+   konsole-bench feeds terminal output through Vt102Emulation, Screen and the
+   history without a terminal process, and reports how fast it is processed.
+
+   Besides a set of generated kinds of output, recorded output (for example
+   from script(1)) can be given as files on the command line.  Each kind of
+   output is repeated up to --size MiB.  With --paint, the output is also
+   shown in an offscreen TerminalDisplay which is painted after every block.
+
+   One line is printed per result, as "name value" pairs, so that the
+   results are easy to compare between builds:
+
+   receive plain-text bytes 16777216 seconds 0.52 MBps 30.8 nsPerByte 31.0 allocations 1203 allocatedBytes 1645760
+   paint plain-text frames 256 msPerFrame 1.92
+*/
+
+// Standard
+#include <stdlib.h>
+
+// Qt
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QTextCodec>
+#include <QtCore/QTextStream>
+#include <QtGui/QImage>
+
+// KDE
+#include <KAboutData>
+#include <KApplication>
+#include <KCmdLineArgs>
+
+// Konsole
+#include "../History.h"
+#include "../ScreenWindow.h"
+#include "../TerminalDisplay.h"
+#include "../Vt102Emulation.h"
+
+using namespace Konsole;
+
+// size of the emulation's screen
+static const int LINES = 24;
+static const int COLUMNS = 80;
+
+// number of lines of history, as in the default profile
+static const int HISTORY_LINES = 1000;
+
+// the output is passed to the emulation in blocks of the size which Pty
+// passes on at once
+static const int BLOCK_SIZE = 65536;
+
+// Allocations are counted by replacing malloc() and friends, which the
+// allocations of both Qt's containers and operator new end up in.  This
+// relies on glibc, elsewhere the allocations are not reported.  The
+// counters are only accurate while the benchmark is the only thread which
+// allocates.
+static qint64 allocationCount = 0;
+static qint64 allocatedBytes = 0;
+
+#ifdef __GLIBC__
+#define COUNT_ALLOCATIONS 1
+
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+
+    void* malloc(size_t size)
+    {
+        allocationCount++;
+        allocatedBytes += size;
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        allocationCount++;
+        allocatedBytes += count * size;
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size)
+    {
+        allocationCount++;
+        allocatedBytes += size;
+        return __libc_realloc(pointer, size);
+    }
+}
+#endif
+
+// lines of a log file, as shown by cat
+static QByteArray plainText()
+{
+    QByteArray data;
+    for (int i = 0; i < 100; i++) {
+        data += "2013-06-01 12:00:" + QByteArray::number(10 + i % 50);
+        data += " INFO  server: accepted connection from 10.0.0." + QByteArray::number(i);
+        data += ":4242, request " + QByteArray::number(i * 7919);
+        data += " took " + QByteArray::number(i % 13) + " ms\r\n";
+    }
+    return data;
+}
+
+// output in which almost every word changes the rendition, as printed by
+// compilers, test runners and ls
+static QByteArray sgrHeavy()
+{
+    QByteArray data;
+    for (int i = 0; i < 100; i++) {
+        data += "\033[1;3" + QByteArray::number(i % 8) + "m[ RUN ]\033[0m ";
+        data += "\033[38;5;" + QByteArray::number(i * 3 % 256) + "mParserTest\033[39m.";
+        data += "\033[48;2;" + QByteArray::number(i) + ";40;80mtestCsi\033[49m ";
+        data += "\033[4munderlined\033[24m \033[7mreversed\033[27m ";
+        data += "\033[2;36m(" + QByteArray::number(i % 17) + " ms)\033[0m\r\n";
+    }
+    return data;
+}
+
+// lines of Chinese, Japanese and Korean text, in which every character is
+// double width and takes three bytes in UTF-8
+static QByteArray cjkText()
+{
+    QByteArray data;
+    for (int line = 0; line < 100; line++) {
+        QString text;
+        for (int i = 0; i < COLUMNS / 2 - 1; i++) {
+            const ushort first = (i % 3 == 0) ? 0x4e00 : ((i % 3 == 1) ? 0x3041 : 0xac00);
+            text += QChar(first + (line * COLUMNS + i) % 80);
+        }
+        data += text.toUtf8() + "\r\n";
+    }
+    return data;
+}
+
+// a full screen program such as top repainting all of its rows at
+// addressed cursor positions
+static QByteArray fullScreen()
+{
+    QByteArray data;
+    for (int frame = 0; frame < 20; frame++) {
+        data += "\033[?25l\033[H\033[30;42m  PID USER      PRI  NI  VIRT   RES  %CPU COMMAND\033[K\033[m";
+        for (int row = 2; row <= LINES; row++) {
+            data += "\033[" + QByteArray::number(row) + ";1H";
+            data += (row == 2 + frame % (LINES - 1)) ? "\033[7m" : "";
+            data += QByteArray::number(1000 + row * 37 + frame).rightJustified(5);
+            data += (row % 3 == 0) ? " \033[1mroot\033[22m    " : " user    ";
+            data += "  20   0 \033[36m" + QByteArray::number(row * frame % 999) + "M\033[39m";
+            data += "  " + QByteArray::number((row * 7 + frame) % 100) + ".0 process-" + QByteArray::number(row);
+            data += "\033[m\033[K";
+        }
+        data += "\033[?25h";
+    }
+    return data;
+}
+
+// a program which scrolls part of the screen, as pagers, editors and
+// chat clients do, with inserted and deleted lines and reverse index
+static QByteArray scrollRegion()
+{
+    QByteArray data = "\033[2;" + QByteArray::number(LINES - 1) + "r";
+    for (int i = 0; i < 100; i++) {
+        data += "\033[" + QByteArray::number(LINES - 1) + ";1H\n";
+        data += "message " + QByteArray::number(i) + " in the scrolled part of the screen";
+
+        if (i % 10 == 0)
+            data += "\033[5;1H\033[3L\033[10;1H\033[2M";
+        if (i % 25 == 0)
+            data += "\033[2;1H\033M\033M\033M";
+
+        data += "\033[1;1H\033[7mstatus line " + QByteArray::number(i) + "\033[K\033[m";
+    }
+    data += "\033[r";
+    return data;
+}
+
+// repeats 'output' until it is 'size' bytes long
+static QByteArray repeated(const QByteArray& output, int size)
+{
+    QByteArray data;
+    if (output.isEmpty())
+        return data;
+
+    data.reserve(size);
+    while (data.size() < size)
+        data += output.left(size - data.size());
+    return data;
+}
+
+static void setupEmulation(Emulation* emulation)
+{
+    emulation->setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation->setHistory(CompactHistoryType(HISTORY_LINES));
+    emulation->setImageSize(LINES, COLUMNS);
+}
+
+static void benchmarkReceive(QTextStream& out, const QString& name, const QByteArray& data)
+{
+    Vt102Emulation emulation;
+    setupEmulation(&emulation);
+
+    const qint64 allocationsBefore = allocationCount;
+    const qint64 allocatedBytesBefore = allocatedBytes;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < data.size(); i += BLOCK_SIZE)
+        emulation.receiveData(data.constData() + i, qMin(BLOCK_SIZE, data.size() - i));
+
+    const qint64 nanoseconds = qMax(timer.nsecsElapsed(), qint64(1));
+    const double seconds = nanoseconds / 1e9;
+
+    out << "receive " << name
+        << " bytes " << data.size()
+        << " seconds " << seconds
+        << " MBps " << data.size() / seconds / (1024 * 1024)
+        << " nsPerByte " << double(nanoseconds) / qMax(data.size(), 1);
+#ifdef COUNT_ALLOCATIONS
+    out << " allocations " << allocationCount - allocationsBefore
+        << " allocatedBytes " << allocatedBytes - allocatedBytesBefore;
+#else
+    Q_UNUSED(allocationsBefore);
+    Q_UNUSED(allocatedBytesBefore);
+#endif
+    out << endl;
+}
+
+static void benchmarkPaint(QTextStream& out, const QString& name, const QByteArray& data)
+{
+    Vt102Emulation emulation;
+    setupEmulation(&emulation);
+
+    ScreenWindow* window = emulation.createWindow();
+
+    TerminalDisplay* display = new TerminalDisplay(0);
+    display->setAttribute(Qt::WA_DontShowOnScreen);
+    display->setScreenWindow(window);
+    display->setFixedSize(COLUMNS, LINES);
+    // hidden displays are not updated
+    display->show();
+
+    QImage frame(display->size(), QImage::Format_ARGB32_Premultiplied);
+
+    // only the time taken to update and paint the display is measured,
+    // not the time taken to process the output
+    QElapsedTimer timer;
+    qint64 nanoseconds = 0;
+    int frames = 0;
+
+    for (int i = 0; i < data.size(); i += BLOCK_SIZE) {
+        emulation.receiveData(data.constData() + i, qMin(BLOCK_SIZE, data.size() - i));
+
+        // the views are updated as at a frame of the UpdateScheduler,
+        // which also resets the scrolled and dropped line counts
+        timer.start();
+        emulation.flushUpdate();
+        display->render(&frame);
+        nanoseconds += timer.nsecsElapsed();
+        frames++;
+    }
+
+    out << "paint " << name
+        << " frames " << frames
+        << " msPerFrame " << nanoseconds / 1e6 / qMax(frames, 1)
+        << endl;
+
+    delete display;
+}
+
+int main(int argc, char** argv)
+{
+    KAboutData about("konsole-bench",
+                     0,
+                     ki18n("konsole-bench"),
+                     "1.0",
+                     ki18n("Measures how fast terminal output is processed"),
+                     KAboutData::License_GPL_V2);
+
+    KCmdLineArgs::init(argc, argv, &about);
+
+    KCmdLineOptions options;
+    options.add("size <MiB>", ki18n("Amount of each kind of output to process"), "16");
+    options.add("paint", ki18n("Also measure painting the output in an offscreen display"));
+    options.add("+[file]", ki18n("Recorded terminal output to process, instead of the generated kinds"));
+    KCmdLineArgs::addCmdLineOptions(options);
+
+    KCmdLineArgs* args = KCmdLineArgs::parsedArgs();
+    const bool paint = args->isSet("paint");
+    const int size = qMax(1, args->getOption("size").toInt()) * 1024 * 1024;
+
+    // painting needs a connection to the window system
+    KApplication app(paint);
+
+    QList<QString> names;
+    QList<QByteArray> outputs;
+
+    if (args->count() == 0) {
+        names << "plain-text" << "sgr-heavy" << "cjk" << "full-screen" << "scroll-region";
+        outputs << plainText() << sgrHeavy() << cjkText() << fullScreen() << scrollRegion();
+    }
+
+    for (int i = 0; i < args->count(); i++) {
+        QFile file(args->arg(i));
+        if (!file.open(QIODevice::ReadOnly)) {
+            QTextStream(stderr) << "Unable to read " << args->arg(i) << endl;
+            return 1;
+        }
+
+        names << QFileInfo(file).fileName();
+        outputs << file.readAll();
+    }
+    args->clear();
+
+    QTextStream out(stdout);
+
+    for (int i = 0; i < outputs.count(); i++) {
+        const QByteArray data = repeated(outputs[i], size);
+
+        benchmarkReceive(out, names[i], data);
+        if (paint)
+            benchmarkPaint(out, names[i], data);
+    }
+
+    return 0;
+}
@@ -22,10 +22,16 @@
 
 #include "qtest_kde.h"
 
+// Qt
+#include <QtGui/QFontInfo>
+#include <QtGui/QImage>
+
 // Konsole
 #include "../TerminalDisplay.h"
 #include "../CharacterColor.h"
 #include "../ColorScheme.h"
+#include "../ScreenWindow.h"
+#include "../Vt102Emulation.h"
 
 using namespace Konsole;
 
@@ -107,6 +113,140 @@ void TerminalTest::testSize()
     delete display;
 }
 
+// renders 'data' in a display of 'lines' x 'columns', drawing the text with
+// or without the glyph atlas
+static QImage renderDisplay(const QByteArray& data, int lines, int columns, bool glyphAtlas)
+{
+    Vt102Emulation emulation;
+    emulation.setImageSize(lines, columns);
+    emulation.receiveData(data.constData(), data.size());
+
+    // without anti-aliasing, both ways of drawing set the same pixels
+    QFont font(QLatin1String("Monospace"));
+    font.setStyleHint(QFont::TypeWriter);
+
+    TerminalDisplay* display = new TerminalDisplay(0);
+    display->setAntialias(false);
+    display->setFixedSize(columns, lines);
+    display->setVTFont(font);
+    display->setFixedSize(columns, lines);
+    display->setGlyphAtlasEnabled(glyphAtlas);
+    display->setScreenWindow(emulation.createWindow());
+    // hidden displays are not updated
+    display->show();
+    display->updateImage();
+
+    QImage frame(display->size(), QImage::Format_ARGB32_Premultiplied);
+    display->render(&frame);
+
+    delete display;
+    return frame;
+}
+
+void TerminalTest::testGlyphAtlasRendering_data()
+{
+    QTest::addColumn<QByteArray>("rendition");
+
+    QTest::newRow("plain") << QByteArray();
+    QTest::newRow("colored") << QByteArray("\033[31;42m");
+    QTest::newRow("bold") << QByteArray("\033[1m");
+    QTest::newRow("underline") << QByteArray("\033[4m");
+}
+
+void TerminalTest::testGlyphAtlasRendering()
+{
+    QFETCH(QByteArray, rendition);
+
+    if (!QFontInfo(QFont(QLatin1String("Monospace"))).fixedPitch())
+        QSKIP("The glyph atlas is only used with a fixed pitch font", SkipSingle);
+
+    const int lines = 3;
+    const int columns = 40;
+
+    // the cursor is hidden, so that only the text is compared
+    QByteArray data("\033[?25l");
+    data += rendition;
+    data += "The quick brown fox jumps over the lazy\r\n";
+    data += "dog. ~!@#$%^&*()_+-=[]{};:'\",.<>/?\\|";
+    data += "\033[m\r\nlast line";
+
+    const QImage expected = renderDisplay(data, lines, columns, false);
+    const QImage actual = renderDisplay(data, lines, columns, true);
+    QCOMPARE(actual.size(), expected.size());
+
+    // pixels which differ from the display's background in the image drawn
+    // without the atlas, and pixels which differ between the images.  Glyphs
+    // which overhang their cell are clipped in the atlas, so a few pixels at
+    // the edges of the cells may differ
+    const QRgb background = expected.pixel(0, 0);
+    int inkPixels = 0;
+    int differentPixels = 0;
+    for (int y = 0; y < expected.height(); y++) {
+        for (int x = 0; x < expected.width(); x++) {
+            if (expected.pixel(x, y) != background)
+                inkPixels++;
+            if (expected.pixel(x, y) != actual.pixel(x, y))
+                differentPixels++;
+        }
+    }
+
+    QVERIFY(inkPixels > 0);
+    QVERIFY2(differentPixels * 50 <= inkPixels,
+             qPrintable(QString("%1 of %2 pixels differ").arg(differentPixels).arg(inkPixels)));
+}
+
+void TerminalTest::benchmarkRedraw_data()
+{
+    QTest::addColumn<bool>("glyphAtlas");
+
+    QTest::newRow("text layout") << false;
+    QTest::newRow("glyph atlas") << true;
+}
+
+void TerminalTest::benchmarkRedraw()
+{
+    QFETCH(bool, glyphAtlas);
+
+    const int columns = 80;
+    const int lines = 25;
+
+    // a full screen of text in various colors, as drawn by
+    // full screen applications
+    Vt102Emulation emulation;
+    emulation.setImageSize(lines, columns);
+
+    QByteArray data;
+    for (int line = 0; line < lines; line++) {
+        data += "\033[";
+        data += QByteArray::number(line + 1);
+        data += ";1H";
+        for (int column = 0; column < columns; column += 10) {
+            data += "\033[3";
+            data += QByteArray::number((line + column / 10) % 8);
+            data += "m";
+            data += "abcdefghij";
+        }
+    }
+    emulation.receiveData(data.constData(), data.size());
+
+    TerminalDisplay* display = new TerminalDisplay(0);
+    display->setFixedSize(columns, lines);
+    display->setGlyphAtlasEnabled(glyphAtlas);
+    display->setScreenWindow(emulation.createWindow());
+    // hidden displays are not updated
+    display->show();
+    display->updateImage();
+
+    // each iteration draws a frame, the frame rate is 1000 divided by
+    // the time taken for an iteration in milliseconds
+    QImage frame(display->size(), QImage::Format_ARGB32_Premultiplied);
+    QBENCHMARK {
+        display->render(&frame);
+    }
+
+    delete display;
+}
+
 QTEST_KDEMAIN(TerminalTest , GUI)
 
 #include "TerminalTest.moc"
@@ -33,6 +33,10 @@ private slots:
     void testScrollBarPositions();
     void testColorTable();
     void testSize();
+    void testGlyphAtlasRendering_data();
+    void testGlyphAtlasRendering();
+    void benchmarkRedraw_data();
+    void benchmarkRedraw();
 
 private:
 };
@@ -0,0 +1,268 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "Vt102EmulationTest.h"
+
+// Qt
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTextStream>
+#include <QtTest/QSignalSpy>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../ScreenWindow.h"
+#include "../Vt102Emulation.h"
+#include "../TerminalCharacterDecoder.h"
+#include "../UpdateScheduler.h"
+
+using namespace Konsole;
+
+// Size of the output which is fed to the emulation in each benchmark iteration,
+// so that the timings of the different kinds of output are comparable
+static const int BENCHMARK_DATA_SIZE = 1024 * 1024;
+
+static QString lineText(Emulation* emulation, int line)
+{
+    QString text;
+    QTextStream stream(&text);
+    PlainTextDecoder decoder;
+
+    decoder.begin(&stream);
+    emulation->writeToStream(&decoder, line, line);
+    decoder.end();
+
+    while (text.endsWith('\n'))
+        text.chop(1);
+
+    return text;
+}
+
+static void receive(Emulation* emulation, const QByteArray& data)
+{
+    emulation->receiveData(data.constData(), data.size());
+}
+
+void Vt102EmulationTest::testPrintableText()
+{
+    Vt102Emulation emulation;
+
+    receive(&emulation, "hello \033[1;31mred\033[0m \033[38;5;208morange\033[m world");
+    QCOMPARE(lineText(&emulation, 0), QString("hello red orange world"));
+}
+
+void Vt102EmulationTest::testCursorPosition()
+{
+    Vt102Emulation emulation;
+
+    receive(&emulation, "\033[3;5HX\033[2DY\033[1AZ");
+    QCOMPARE(lineText(&emulation, 1), QString("    Z"));
+    QCOMPARE(lineText(&emulation, 2), QString("   YX"));
+
+    receive(&emulation, "\033[3;1H\033[K");
+    QCOMPARE(lineText(&emulation, 2), QString());
+}
+
+void Vt102EmulationTest::testSequenceSplitAcrossReads()
+{
+    Vt102Emulation emulation;
+
+    // the parser state and parameters must survive the end of a read
+    receive(&emulation, "ab\033");
+    receive(&emulation, "[1");
+    receive(&emulation, "0");
+    receive(&emulation, "Gc");
+    QCOMPARE(lineText(&emulation, 0), QString("ab       c"));
+}
+
+void Vt102EmulationTest::testControlWithinSequence()
+{
+    Vt102Emulation emulation;
+
+    // control characters are processed without ending the sequence ...
+    receive(&emulation, "abc\033[\b2Dx");
+    QCOMPARE(lineText(&emulation, 0), QString("xbc"));
+
+    // ... unless they cancel it, CAN then shows a checkerboard
+    receive(&emulation, "\r\033[2\030D");
+    QCOMPARE(lineText(&emulation, 0), QString::fromUtf8("\xe2\x96\x92" "Dc"));
+}
+
+void Vt102EmulationTest::testCharsetSelection()
+{
+    Vt102Emulation emulation;
+
+    receive(&emulation, "\033(0lqk\033(Blqk");
+    QCOMPARE(lineText(&emulation, 0), QString::fromUtf8("\xe2\x94\x8c\xe2\x94\x80\xe2\x94\x90lqk"));
+}
+
+void Vt102EmulationTest::testWindowTitle()
+{
+    Vt102Emulation emulation;
+    QSignalSpy spy(&emulation, SIGNAL(titleChanged(int,QString)));
+
+    receive(&emulation, "\033]2;my title\007text");
+    QCOMPARE(lineText(&emulation, 0), QString("text"));
+
+    QTest::qWait(100);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).toInt(), 2);
+    QCOMPARE(spy.at(0).at(1).toString(), QString("my title"));
+}
+
+void Vt102EmulationTest::testUpdatesCoalesced()
+{
+    Vt102Emulation emulation;
+    QSignalSpy spy(&emulation, SIGNAL(outputChanged()));
+
+    // output which arrives before the next frame is shown in a single update
+    receive(&emulation, "one ");
+    receive(&emulation, "two ");
+    receive(&emulation, "three");
+    QCOMPARE(spy.count(), 0);
+
+    QTest::qWait(200);
+    QCOMPARE(spy.count(), 1);
+}
+
+void Vt102EmulationTest::testThrottledUpdates()
+{
+    UpdateScheduler* scheduler = UpdateScheduler::instance();
+    const int backgroundFrameRate = scheduler->backgroundFrameRate();
+    scheduler->setBackgroundFrameRate(1);
+
+    Vt102Emulation emulation;
+    emulation.setUpdatesThrottled(true);
+    QSignalSpy spy(&emulation, SIGNAL(outputChanged()));
+
+    receive(&emulation, "one");
+    QTest::qWait(200);
+    QCOMPARE(spy.count(), 1);
+
+    // further output waits for the next background frame ...
+    receive(&emulation, "two");
+    QTest::qWait(200);
+    QCOMPARE(spy.count(), 1);
+
+    // ... unless the updates are no longer throttled
+    emulation.setUpdatesThrottled(false);
+    QTest::qWait(200);
+    QCOMPARE(spy.count(), 2);
+
+    scheduler->setBackgroundFrameRate(backgroundFrameRate);
+}
+
+void Vt102EmulationTest::testFlushUpdate()
+{
+    Vt102Emulation emulation;
+    QSignalSpy spy(&emulation, SIGNAL(outputChanged()));
+
+    // the views are updated at once, and not again at the next frame
+    receive(&emulation, "one");
+    emulation.flushUpdate();
+    QCOMPARE(spy.count(), 1);
+
+    QTest::qWait(200);
+    QCOMPARE(spy.count(), 1);
+}
+
+void Vt102EmulationTest::testManyTrueColors()
+{
+    Vt102Emulation emulation;
+
+    // far more RGB colors than fit into the table are used below the
+    // first line, the positions of those which are no longer shown are
+    // reclaimed in between
+    receive(&emulation, "\033[38;2;1;2;3mA\033[m");
+
+    const int colorCount = CharacterColor::trueColorIndexLimit() * 3 / 2;
+    const int reclaimCount = CharacterColor::trueColorReclaimCount();
+    for (int i = 0; i < colorCount; i += 1000) {
+        QByteArray data;
+        for (int color = i; color < qMin(i + 1000, colorCount); color++) {
+            data += "\033[2;1H\033[48;2;" + QByteArray::number(color >> 16) + ';' +
+                    QByteArray::number((color >> 8) & 0xFF) + ';' +
+                    QByteArray::number(color & 0xFF) + "mB";
+        }
+        receive(&emulation, data);
+        QCoreApplication::processEvents();
+    }
+    QVERIFY(CharacterColor::trueColorReclaimCount() > reclaimCount);
+
+    // no color has been lost or approximated
+    ScreenWindow* window = emulation.createWindow();
+    const Character* image = window->getImage();
+    const int lastColor = colorCount - 1;
+    QCOMPARE(image[0].foregroundColor.color(0), QColor(1, 2, 3));
+    QCOMPARE(image[window->windowColumns()].backgroundColor.color(0),
+             QColor(lastColor >> 16, (lastColor >> 8) & 0xFF, lastColor & 0xFF));
+}
+
+void Vt102EmulationTest::benchmarkReceiveData_data()
+{
+    QTest::addColumn<QByteArray>("output");
+
+    // Each row repeats a typical piece of program output up to BENCHMARK_DATA_SIZE
+
+    // cat of a log file
+    QTest::newRow("plain text")
+            << QByteArray("2013-06-01 12:00:00 INFO  server: accepted connection from 10.0.0.1:4242\r\n");
+
+    // a test runner or compiler with colored results
+    QTest::newRow("colored test runner")
+            << QByteArray("\033[1;32m[       OK ]\033[0m \033[1mParserTest\033[0m.\033[36mtestCsi\033[0m"
+                          " \033[38;5;244m(3 ms)\033[0m\r\n");
+
+    // a progress bar redrawing the same line
+    QTest::newRow("progress bar")
+            << QByteArray("\r\033[K 42% [\033[32m==========>\033[0m          ] 1.2MB/s eta 0:03");
+
+    // a full screen program like htop repainting its rows
+    QTest::newRow("full screen redraw")
+            << QByteArray("\033[?25l\033[H\033[30;42m  PID USER      PRI  NI  VIRT   RES\033[K\033[m"
+                          "\033[2;1H\033[38;5;33m 1234\033[39m \033[1mroot\033[22m      20   0 \033[36m612M\033[39m 48M"
+                          "\033[3;1H\033[7m 5678\033[27m user      20   0 \033[36m1.2G\033[39m 96M\033[K\033[?25h");
+
+    // ncurses box drawing with the VT100 graphics charset
+    QTest::newRow("line drawing")
+            << QByteArray("\033[5;10H\033(0lqqqqqqqqqqqqqqqqqqqqk\033(B\033[6;10H\033(0x\033(B menu item      \033(0x\033(B"
+                          "\033[7;10H\033(0mqqqqqqqqqqqqqqqqqqqqj\033(B");
+}
+
+void Vt102EmulationTest::benchmarkReceiveData()
+{
+    QFETCH(QByteArray, output);
+
+    QByteArray data;
+    data.reserve(BENCHMARK_DATA_SIZE);
+    while (data.size() + output.size() <= BENCHMARK_DATA_SIZE)
+        data.append(output);
+
+    Vt102Emulation emulation;
+    emulation.setImageSize(40, 80);
+
+    QBENCHMARK {
+        receive(&emulation, data);
+    }
+}
+
+QTEST_KDEMAIN(Vt102EmulationTest , GUI)
+
+#include "Vt102EmulationTest.moc"
+